@@ -24,6 +24,8 @@
 #include <memory>
 #include <chrono>
 
+#include "AVServer_34_LockProfiler.h"
+
 /**
  * @class SafeQueue
  * @brief 线程安全的队列，基于std::queue和互斥锁实现
@@ -56,7 +58,18 @@ public:
      * @brief 默认构造函数
      * 初始化互斥锁和条件变量
      */
-    SafeQueue() = default;
+    SafeQueue()
+        : mutex_("SafeQueue") {
+    }
+
+    /**
+     * @brief 构造函数
+     *
+     * @param lock_site 锁竞争分析中使用的锁位置名称
+     */
+    explicit SafeQueue(const char* lock_site)
+        : mutex_(lock_site) {
+    }
 
     /**
      * @brief 析构函数
@@ -101,7 +114,7 @@ public:
         {
             // 使用std::lock_guard自动管理锁的生命周期
             // 构造时自动加锁，析构时自动解锁
-            std::lock_guard<std::mutex> lock(mutex_);
+            std::lock_guard<ProfiledMutex> lock(mutex_);
             queue_.push(value);
         }
         // 通知一个等待的消费者线程
@@ -119,7 +132,7 @@ public:
      */
     void push(T&& value) {
         {
-            std::lock_guard<std::mutex> lock(mutex_);
+            std::lock_guard<ProfiledMutex> lock(mutex_);
             // std::move将左值转换为右值，避免不必要的拷贝
             queue_.push(std::move(value));
         }
@@ -138,7 +151,7 @@ public:
     bool pop(T& value) {
         // std::unique_lock提供了更灵活的锁管理
         // 支持lock(), unlock(), try_lock()等操作
-        std::unique_lock<std::mutex> lock(mutex_);
+        ProfiledUniqueLock lock(mutex_);
 
         // 等待直到队列不为空或shutdown_标志被设置
         // 这避免了虚假唤醒（spurious wakeup）
@@ -171,7 +184,7 @@ public:
      * @note 支持毫秒级的超时控制
      */
     bool pop_for(T& value, int timeout_ms) {
-        std::unique_lock<std::mutex> lock(mutex_);
+        ProfiledUniqueLock lock(mutex_);
 
         // wait_for会在指定时间后返回，即使条件未满足
         // 返回值表示条件是否满足
@@ -207,7 +220,7 @@ public:
      * @note 时间复杂度：O(1)
      */
     bool try_pop(T& value) {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
 
         if (queue_.empty()) {
             return false;
@@ -227,7 +240,7 @@ public:
      * @note 主要用于监控和调试，不要依赖其进行逻辑判断
      */
     size_t size() const {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
         return queue_.size();
     }
 
@@ -239,7 +252,7 @@ public:
      * @note 同样受多线程影响，返回值可能立即失效
      */
     bool empty() const {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
         return queue_.empty();
     }
 
@@ -250,7 +263,7 @@ public:
      * @note 时间复杂度：O(n)，n为队列中的元素个数
      */
     void clear() {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
 
         // 弹出所有元素
         while (!queue_.empty()) {
@@ -271,7 +284,7 @@ public:
      */
     void shutdown() {
         {
-            std::lock_guard<std::mutex> lock(mutex_);
+            std::lock_guard<ProfiledMutex> lock(mutex_);
             shutdown_ = true;
         }
         // 唤醒所有等待的线程
@@ -284,14 +297,14 @@ public:
      * @return true 如果队列已被shutdown()关闭
      */
     bool is_shutdown() const {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
         return shutdown_;
     }
 
 private:
     std::queue<T> queue_;                          // 底层std::queue容器
-    mutable std::mutex mutex_;                     // 保护queue_的互斥锁
-    std::condition_variable condition_;            // 条件变量，用于线程间的信号传递
+    mutable ProfiledMutex mutex_;                  // 保护queue_的互斥锁（锁竞争分析见LockProfiler.h）
+    ProfiledConditionVariable condition_;          // 条件变量，用于线程间的信号传递
     bool shutdown_ = false;                        // 队列关闭标志
 };
 
@@ -51,6 +51,7 @@ public:
      *
      * @note capacity应该是2的幂次方以便于位运算优化
      * @note 会在堆上分配capacity大小的内存
+     * @note 为区分满和空保留一个字节，最多可存capacity-1字节
      */
     explicit CircularBuffer(size_t capacity)
         : capacity_(capacity),
@@ -95,8 +96,8 @@ public:
 
         std::lock_guard<std::mutex> lock(mutex_);
 
-        // 计算可用的写入空间
-        size_t available = capacity_ - available_data();
+        // 计算可用的写入空间（保留一个字节区分满和空）
+        size_t available = capacity_ - 1 - available_data_unlocked();
 
         // 如果请求写入超过可用空间，只写入可用部分
         size_t bytes_to_write = std::min(size, available);
@@ -146,7 +147,7 @@ public:
         std::lock_guard<std::mutex> lock(mutex_);
 
         // 计算可读的数据大小
-        size_t bytes_available = available_data();
+        size_t bytes_available = available_data_unlocked();
         size_t bytes_to_read = std::min(size, bytes_available);
 
         if (bytes_to_read == 0) {
@@ -193,7 +194,7 @@ public:
 
         std::lock_guard<std::mutex> lock(mutex_);
 
-        size_t bytes_available = available_data();
+        size_t bytes_available = available_data_unlocked();
         size_t bytes_to_peek = std::min(size, bytes_available);
 
         if (bytes_to_peek == 0) {
@@ -243,7 +244,7 @@ public:
      */
     size_t available_space() const {
         std::lock_guard<std::mutex> lock(mutex_);
-        return capacity_ - available_data_unlocked();
+        return capacity_ - 1 - available_data_unlocked();
     }
 
     /**
@@ -286,7 +287,7 @@ public:
      */
     bool full() const {
         std::lock_guard<std::mutex> lock(mutex_);
-        return available_data_unlocked() == capacity_;
+        return available_data_unlocked() == capacity_ - 1;
     }
 
 private:
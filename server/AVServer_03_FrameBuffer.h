@@ -22,6 +22,10 @@
 #include <mutex>
 #include <vector>
 
+#include "AVServer_30_LatencyTrace.h"
+#include "AVServer_34_LockProfiler.h"
+#include "AVServer_36_FlightRecorder.h"
+
 /**
  * @enum FrameType
  * @brief 音视频帧的类型定义
@@ -64,6 +68,7 @@ struct AVFrame {
     // ===== 时间戳 =====
     uint64_t timestamp;                        // 帧的时间戳（毫秒）
     uint64_t pts;                              // 显示时间戳（Presentation Time Stamp）
+    FrameTimestamps stamps;                    // 各处理阶段的单调时间戳（见LatencyTrace.h）
 
     // ===== 数据 =====
     std::vector<uint8_t> data;                 // 帧数据缓冲
@@ -73,6 +78,9 @@ struct AVFrame {
     uint32_t bitrate;                          // 比特率（bps）
     uint8_t quality;                           // 质量级别（0-100）
 
+    // ===== 内存位置 =====
+    int numa_node;                             // data缓冲所在的NUMA节点（-1表示未知，见Numa.h）
+
     /**
      * @brief 构造函数 - 初始化帧结构
      * @param type 帧类型
@@ -92,13 +100,16 @@ struct AVFrame {
           pts(0),
           size(0),
           bitrate(0),
-          quality(80) {
+          quality(80),
+          numa_node(-1) {
         // 预分配缓冲以避免频繁内存分配
         data.reserve(capacity);
     }
 
     /**
      * @brief 复制构造函数
+     *
+     * @note numa_node描述的是缓冲内存而不是内容：副本的缓冲由当前线程新分配，节点未知
      */
     AVFrame(const AVFrame& other)
         : frame_type(other.frame_type),
@@ -109,14 +120,18 @@ struct AVFrame {
           channels(other.channels),
           timestamp(other.timestamp),
           pts(other.pts),
+          stamps(other.stamps),
           data(other.data),
           size(other.size),
           bitrate(other.bitrate),
-          quality(other.quality) {
+          quality(other.quality),
+          numa_node(-1) {
     }
 
     /**
      * @brief 赋值操作符
+     *
+     * @note 不复制numa_node：容量足够时目标沿用自己的缓冲
      */
     AVFrame& operator=(const AVFrame& other) {
         if (this != &other) {
@@ -128,6 +143,7 @@ struct AVFrame {
             channels = other.channels;
             timestamp = other.timestamp;
             pts = other.pts;
+            stamps = other.stamps;
             data = other.data;
             size = other.size;
             bitrate = other.bitrate;
@@ -145,6 +161,7 @@ struct AVFrame {
         size = 0;
         timestamp = 0;
         pts = 0;
+        stamps.reset();
     }
 
     /**
@@ -211,23 +228,33 @@ public:
      * @param pool_size 池中预创建的帧数量
      * @param frame_capacity 每个帧的数据缓冲初始大小
      *
+     * @param numa_node 帧所在的NUMA节点（-1表示不关心，见make_node_local_frame_pool）
+     *
      * @note pool_size应该根据实时性要求调整
      * @note 典型值：30fps视频需要pool_size >= 3-5
+     * @note 指定numa_node时预先触碰每帧的缓冲，使物理页在构造线程所在节点上分配
      */
-    FrameBufferPool(size_t pool_size = 10, uint32_t frame_capacity = 1024 * 1024)
+    FrameBufferPool(size_t pool_size = 10, uint32_t frame_capacity = 1024 * 1024,
+                    int numa_node = -1)
         : pool_size_(pool_size),
           frame_capacity_(frame_capacity),
+          numa_node_(numa_node),
+          mutex_("FrameBufferPool"),
           stats_total_get_(0),
           stats_total_return_(0) {
         // 预创建pool_size个AVFrame对象
         for (size_t i = 0; i < pool_size; ++i) {
-            available_frames_.push(
-                std::make_shared<AVFrame>(
-                    FrameType::VIDEO_I_FRAME,
-                    CodecType::H264,
-                    frame_capacity
-                )
+            auto frame = std::make_shared<AVFrame>(
+                FrameType::VIDEO_I_FRAME,
+                CodecType::H264,
+                frame_capacity
             );
+            if (numa_node_ >= 0) {
+                frame->data.resize(frame_capacity);
+                frame->data.clear();
+                frame->numa_node = numa_node_;
+            }
+            available_frames_.push(frame);
         }
     }
 
@@ -247,7 +274,7 @@ public:
      * @note 获取的帧应该在使用完后调用return_frame归还
      */
     std::shared_ptr<AVFrame> get() {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
 
         std::shared_ptr<AVFrame> frame;
 
@@ -262,6 +289,8 @@ public:
                 CodecType::H264,
                 frame_capacity_
             );
+            frame->numa_node = numa_node_;
+            flight_record(FlightEvent::POOL_EXHAUSTED, 0, frame_capacity_);
         }
 
         // 清空数据但保留缓冲
@@ -286,7 +315,7 @@ public:
             return;
         }
 
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
 
         // 清空数据
         frame->clear();
@@ -294,8 +323,10 @@ public:
         // 如果池还没满，归还给池
         if (available_frames_.size() < pool_size_) {
             available_frames_.push(frame);
+        } else {
+            // 否则让智能指针自动销毁
+            flight_record(FlightEvent::POOL_DISCARDED, 0, static_cast<uint32_t>(pool_size_));
         }
-        // 否则让智能指针自动销毁
 
         // 统计信息
         stats_total_return_++;
@@ -307,7 +338,7 @@ public:
      * @return 可用帧的数量
      */
     size_t available_count() const {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
         return available_frames_.size();
     }
 
@@ -315,27 +346,35 @@ public:
      * @brief 清空池中的所有帧
      */
     void clear() {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
         while (!available_frames_.empty()) {
             available_frames_.pop();
         }
     }
 
+    /**
+     * @brief 池中帧所在的NUMA节点（-1表示不关心）
+     */
+    int numa_node() const {
+        return numa_node_;
+    }
+
     /**
      * @brief 获取池的统计信息
      *
      * @return 一对数值（总get次数，总return次数）
      */
     std::pair<uint64_t, uint64_t> get_statistics() const {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<ProfiledMutex> lock(mutex_);
         return {stats_total_get_, stats_total_return_};
     }
 
 private:
     size_t pool_size_;                          // 池的目标大小
     uint32_t frame_capacity_;                   // 每个帧的缓冲初始大小
+    int numa_node_;                             // 帧所在的NUMA节点
     std::queue<std::shared_ptr<AVFrame>> available_frames_;  // 可用帧队列
-    mutable std::mutex mutex_;                  // 保护队列的互斥锁
+    mutable ProfiledMutex mutex_;               // 保护队列的互斥锁
 
     // ===== 统计信息 =====
     uint64_t stats_total_get_;                  // 总获取次数
@@ -6,6 +6,11 @@
  * - 分发任务到可用线程
  * - 自动负载均衡
  * - 优雅关闭
+ * - 可作为Executor执行TaskFuture的延续（见TaskFuture.h）
+ * - parallel_for：把一帧按行或分块拆分到多个核心上执行
+ * - 截止时间：任务可带截止时间，过期的任务在执行前被丢弃；同一优先级内按最早截止时间优先（EDF），
+ *   没有截止时间的任务按入队时间加排序预算参与排序，不会被截止任务饿死
+ * - 运行时增减工作线程（自动扩缩容见PoolAutoscaler.h）
  *
  * 设计模式：
  * 使用线程池可以：
@@ -25,10 +30,369 @@
 
 #include <thread>
 #include <vector>
+#include <map>
 #include <functional>
 #include <memory>
 #include <atomic>
-#include "SafeQueue.h"
+#include <mutex>
+#include <future>
+#include <exception>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <stdexcept>
+#include <string>
+#include <cstdio>
+#include "AVServer_01_SafeQueue.h"
+#include "AVServer_23_TaskFuture.h"
+
+// ============================================================================
+// ======================== 数据并行 ==========================================
+// ============================================================================
+
+/**
+ * @enum ChunkPolicy
+ * @brief parallel_for的分块方式
+ */
+enum class ChunkPolicy {
+    STATIC,                 // 按参与线程数等分，调度开销最小，适合每个元素耗时均匀的情况
+    DYNAMIC,                // 按grain大小切块、谁空闲谁领取，适合耗时不均匀的情况
+};
+
+/**
+ * @struct ParallelForState
+ * @brief 一次parallel_for调用的共享状态
+ *
+ * @note 由调用者和辅助任务共享（shared_ptr），辅助任务可能在调用返回后才被执行，
+ *       此时所有块都已被领取，它不会再访问fn
+ */
+struct ParallelForState {
+    size_t begin;                                   // 范围起点
+    size_t end;                                     // 范围终点（不含）
+    size_t chunk_size;                              // 每块大小
+    size_t chunk_count;                             // 块数
+    std::atomic<size_t> next_chunk;                 // 下一个待领取的块
+    std::atomic<size_t> done_chunks;                // 已完成的块数
+    const void* fn;                                 // 类型擦除的块函数
+    void (*invoke)(const void*, size_t, size_t);    // 调用fn(chunk_begin, chunk_end)
+    std::atomic<bool> failed;                       // 是否有块抛出异常
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    ParallelForState()
+        : begin(0), end(0), chunk_size(1), chunk_count(0),
+          next_chunk(0), done_chunks(0),
+          fn(nullptr), invoke(nullptr),
+          failed(false) {
+    }
+
+    /**
+     * @brief 领取并执行块，直到没有剩余的块
+     */
+    void run_chunks() {
+        while (true) {
+            size_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= chunk_count) {
+                return;
+            }
+
+            if (!failed.load(std::memory_order_relaxed)) {
+                size_t chunk_begin = begin + chunk * chunk_size;
+                size_t chunk_end = std::min(end, chunk_begin + chunk_size);
+                try {
+                    invoke(fn, chunk_begin, chunk_end);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+
+            done_chunks.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief 等待所有块完成（先自旋，再让出CPU）
+     */
+    void wait_all() const {
+        int spins = 0;
+        while (done_chunks.load(std::memory_order_acquire) < chunk_count) {
+            // 块通常只有几微秒，先忙等避免线程切换
+            if (++spins >= 1024) {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+// ============================================================================
+// ======================== 截止时间调度 ======================================
+// ============================================================================
+
+/**
+ * @enum TaskPriority
+ * @brief 任务优先级类别
+ *
+ * @note 类别之间严格按优先级出队，高优先级持续过载时低优先级会饥饿
+ */
+enum class TaskPriority {
+    HIGH = 0,               // 实时路径（如parallel_for的辅助块）
+    NORMAL = 1,             // 默认
+    LOW = 2,                // 后台任务（统计、清理）
+};
+
+constexpr size_t TASK_PRIORITY_COUNT = 3;
+
+inline const char* task_priority_to_string(TaskPriority priority) {
+    switch (priority) {
+        case TaskPriority::HIGH:   return "high";
+        case TaskPriority::NORMAL: return "normal";
+        case TaskPriority::LOW:    return "low";
+        default:                   return "unknown";
+    }
+}
+
+/**
+ * @struct TaskOptions
+ * @brief 任务的调度参数
+ *
+ * 使用示例：
+ * @code
+ *   // 编码一帧，33ms后还没开始就没有意义了
+ *   TaskOptions options = TaskOptions::within(33);
+ *   options.on_expired = [frame]() { frame_pool->return_frame(frame); };
+ *   pool.schedule([frame]() { encode(frame); }, options);
+ * @endcode
+ */
+struct TaskOptions {
+    using Clock = std::chrono::steady_clock;
+
+    TaskPriority priority;                  // 优先级类别
+    Clock::time_point deadline;             // 截止时间（time_point::max()表示没有截止时间）
+    std::function<void()> on_expired;       // 过期时代替任务在工作线程上调用（可为空）
+
+    TaskOptions()
+        : priority(TaskPriority::NORMAL),
+          deadline(Clock::time_point::max()) {
+    }
+
+    /**
+     * @brief 从现在起budget_ms毫秒内必须开始执行
+     */
+    static TaskOptions within(int budget_ms, TaskPriority priority = TaskPriority::NORMAL) {
+        TaskOptions options;
+        options.priority = priority;
+        options.deadline = Clock::now() + std::chrono::milliseconds(budget_ms);
+        return options;
+    }
+
+    bool has_deadline() const {
+        return deadline != Clock::time_point::max();
+    }
+};
+
+/**
+ * @class TaskExpiredError
+ * @brief submit_before()的任务过期时，TaskFuture以此异常完成
+ */
+class TaskExpiredError : public std::runtime_error {
+public:
+    TaskExpiredError()
+        : std::runtime_error("task deadline expired") {
+    }
+};
+
+/**
+ * @struct ThreadPoolStatistics
+ * @brief 线程池运行统计
+ */
+struct ThreadPoolStatistics {
+    uint64_t tasks_executed;                            // 已执行的任务数
+    uint64_t tasks_expired;                             // 因过期被丢弃的任务数
+    uint64_t expired_by_priority[TASK_PRIORITY_COUNT];  // 各优先级的过期数
+    size_t queue_size;                                  // 当前排队任务数
+    size_t active_tasks;                                // 正在执行的任务数
+    size_t threads;                                     // 当前工作线程数
+    uint64_t tasks_dequeued;                            // 已出队任务数（执行 + 过期）
+    uint64_t queue_wait_ns;                             // 出队任务的累计排队时间
+    uint64_t busy_ns;                                   // 工作线程累计执行任务的时间
+
+    ThreadPoolStatistics()
+        : tasks_executed(0), tasks_expired(0),
+          expired_by_priority{0, 0, 0},
+          queue_size(0), active_tasks(0), threads(0),
+          tasks_dequeued(0), queue_wait_ns(0), busy_ns(0) {
+    }
+
+    /**
+     * @brief 平均排队时间（毫秒）
+     */
+    double average_wait_ms() const {
+        return tasks_dequeued > 0 ? queue_wait_ns / 1e6 / tasks_dequeued : 0.0;
+    }
+
+    std::string to_string() const {
+        char buffer[320];
+        snprintf(buffer, sizeof(buffer),
+                 "ThreadPool Stats: threads=%zu executed=%llu expired=%llu "
+                 "(high=%llu normal=%llu low=%llu) queued=%zu active=%zu avg_wait=%.2fms",
+                 threads,
+                 static_cast<unsigned long long>(tasks_executed),
+                 static_cast<unsigned long long>(tasks_expired),
+                 static_cast<unsigned long long>(expired_by_priority[0]),
+                 static_cast<unsigned long long>(expired_by_priority[1]),
+                 static_cast<unsigned long long>(expired_by_priority[2]),
+                 queue_size, active_tasks, average_wait_ms());
+        return std::string(buffer);
+    }
+};
+
+/**
+ * @class DeadlineTaskQueue
+ * @brief 线程池的任务队列：按优先级类别分组，类别内按截止时间排序（EDF）
+ *
+ * 出队规则：
+ * 1. 先取最高的非空优先级类别
+ * 2. 类别内取排序时间最早的任务：带截止时间的任务用截止时间，
+ *    没有截止时间的任务用入队时间加上类别的排序预算（no_deadline_budget_ms）
+ * 3. 排序时间相同时按入队顺序；类别内都没有截止时间时退化为原来的FIFO
+ *
+ * @note 没有截止时间的任务排队超过排序预算后排到新提交的截止任务之前，
+ *       持续的submit_before()负载不会让add_task()的任务无限期等待
+ * @note 过期判断由工作线程在执行前完成，队列本身不丢弃任务
+ */
+class DeadlineTaskQueue {
+public:
+    using Clock = TaskOptions::Clock;
+
+    struct Entry {
+        std::function<void()> task;
+        std::function<void()> on_expired;
+        Clock::time_point deadline;
+        Clock::time_point order;                // 排序时间（截止时间，或入队时间加排序预算）
+        Clock::time_point enqueued;             // 入队时间，用于统计排队时间
+        TaskPriority priority;
+        uint64_t sequence;                      // 入队序号，保证同排序时间时FIFO
+        bool retire;                            // 退出标记：取到它的工作线程退出
+    };
+
+    DeadlineTaskQueue()
+        : next_sequence_(0),
+          size_(0),
+          shutdown_(false) {
+    }
+
+    /**
+     * @return false 队列已关闭，任务未入队
+     */
+    bool push(std::function<void()> task, TaskOptions options) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (shutdown_) {
+                return false;
+            }
+
+            auto& heap = heaps_[static_cast<size_t>(options.priority)];
+            auto now = Clock::now();
+            auto order = options.has_deadline()
+                ? options.deadline
+                : now + std::chrono::milliseconds(no_deadline_budget_ms(options.priority));
+            heap.push_back(Entry{std::move(task), std::move(options.on_expired),
+                                 options.deadline, order, now, options.priority,
+                                 next_sequence_++, false});
+            std::push_heap(heap.begin(), heap.end(), later_first);
+            size_++;
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 放入一个退出标记，取到它的工作线程结束运行
+     *
+     * @note 标记在HIGH类别中且截止时间最早，空闲线程会立即取到；
+     *       所有线程都忙时，第一个完成当前任务的线程退出
+     */
+    void push_retire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& heap = heaps_[static_cast<size_t>(TaskPriority::HIGH)];
+            heap.push_back(Entry{nullptr, nullptr, Clock::time_point::min(), Clock::time_point::min(),
+                                 Clock::now(), TaskPriority::HIGH, next_sequence_++, true});
+            std::push_heap(heap.begin(), heap.end(), later_first);
+            size_++;
+        }
+        cond_.notify_one();
+    }
+
+    /**
+     * @brief 阻塞取出下一个任务
+     *
+     * @return false 队列已关闭且为空
+     */
+    bool pop(Entry& entry) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return size_ > 0 || shutdown_; });
+
+        for (auto& heap : heaps_) {
+            if (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), later_first);
+                entry = std::move(heap.back());
+                heap.pop_back();
+                size_--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return size_;
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shutdown_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    /**
+     * @brief 没有截止时间的任务的排序预算（毫秒）
+     *
+     * @note 只影响排序，不会让这类任务过期
+     */
+    static int no_deadline_budget_ms(TaskPriority priority) {
+        switch (priority) {
+            case TaskPriority::HIGH:   return 5;
+            case TaskPriority::NORMAL: return 50;
+            default:                   return 500;
+        }
+    }
+
+private:
+    /**
+     * @brief 堆比较函数：a比b晚（std::push_heap默认是最大堆，这里取反得到最早截止时间在顶）
+     */
+    static bool later_first(const Entry& a, const Entry& b) {
+        if (a.order != b.order) {
+            return a.order > b.order;
+        }
+        return a.sequence > b.sequence;
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<Entry> heaps_[TASK_PRIORITY_COUNT];     // 每个优先级类别一个最小堆
+    uint64_t next_sequence_;
+    size_t size_;
+    bool shutdown_;
+};
 
 /**
  * @class ThreadPool
@@ -56,8 +420,22 @@
  *
  *   // 析构时自动等待所有任务完成并关闭线程
  * @endcode
+ *
+ * 需要串联后续步骤时使用submit()，返回可以挂延续的TaskFuture：
+ * @code
+ *   pool.submit([]() { return 21; })
+ *       .then(pool, [](int x) { return x * 2; })
+ *       .then([](int x) { std::cout << x << std::endl; });
+ * @endcode
+ *
+ * 有时效的任务带上截止时间，过载时过期任务不再占用CPU：
+ * @code
+ *   pool.submit_before(TaskOptions::Clock::now() + std::chrono::milliseconds(33),
+ *                      [frame]() { return encode(frame); })
+ *       .on_complete([](TaskFuture<Packet>& f) { ... });  // 过期时get()抛出TaskExpiredError
+ * @endcode
  */
-class ThreadPool {
+class ThreadPool : public Executor {
 public:
     /**
      * @brief 任务类型定义
@@ -71,21 +449,25 @@ public:
      *
      * @param num_threads 线程数量
      *        - 通常设为CPU核心数或稍多一些
-     *        - 推荐：std::thread::hardware_concurrency()
+     *        - 推荐：effective_cpu_count()（考虑了容器的CPU配额，见PoolAutoscaler.h）
      *        - 本项目中推荐值：4-16，根据服务器配置调整
      *
      * @note 构造后线程立即启动并等待任务
+     * @note 线程数可在运行时通过add_workers/retire_workers/resize调整
      */
     explicit ThreadPool(size_t num_threads = 4)
         : stop_(false),
-          active_tasks_(0) {
+          active_tasks_(0),
+          worker_count_(0),
+          next_worker_id_(0),
+          tasks_executed_(0),
+          tasks_expired_(0),
+          expired_by_priority_{},
+          tasks_dequeued_(0),
+          queue_wait_ns_(0),
+          busy_ns_(0) {
         // 创建num_threads个工作线程
-        for (size_t i = 0; i < num_threads; ++i) {
-            // std::thread会立即启动线程
-            // &ThreadPool::worker是成员函数指针
-            // this是传给成员函数的隐式参数
-            threads_.emplace_back(&ThreadPool::worker, this);
-        }
+        add_workers(num_threads);
     }
 
     /**
@@ -131,7 +513,7 @@ public:
      *   pool.add_task(&MyClass::method, &obj);
      * @endcode
      *
-     * @note 如果线程池已关闭，任务不会被添加
+     * @note 如果线程池已关闭，任务不会被添加，返回的future以broken_promise异常完成（与submit()一致）
      */
     template <typename F, typename... Args>
     auto add_task(F&& f, Args&&... args) {
@@ -150,7 +532,13 @@ public:
 
         // 添加任务到队列
         // Lambda将std::packaged_task转换为std::function<void()>
-        queue_.push([task]() { (*task)(); });
+        if (stop_.load() || !queue_.push([task]() { (*task)(); }, TaskOptions())) {
+            // 任务不会执行：让等待future的调用者立即得到异常，而不是永远阻塞
+            std::promise<return_type> rejected;
+            rejected.set_exception(std::make_exception_ptr(
+                std::future_error(std::future_errc::broken_promise)));
+            return rejected.get_future();
+        }
 
         return future;
     }
@@ -168,10 +556,204 @@ public:
     template <typename F, typename... Args>
     void add_work(F&& f, Args&&... args) {
         queue_.push(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...),
+            TaskOptions()
         );
     }
 
+    /**
+     * @brief 按调度参数添加任务
+     *
+     * @param task 任务
+     * @param options 优先级、截止时间和过期回调
+     * @return false 线程池已关闭，任务未入队
+     *
+     * @note 工作线程取出任务时若已过截止时间，不执行task，改为调用options.on_expired
+     * @note 截止时间指"最晚开始时间"，已开始的任务不会被中断
+     */
+    bool schedule(Task task, TaskOptions options) {
+        if (stop_.load()) {
+            return false;
+        }
+        return queue_.push(std::move(task), std::move(options));
+    }
+
+    /**
+     * @brief 提交任务，返回支持延续的TaskFuture
+     *
+     * @tparam F 任务函数的类型
+     * @tparam Args 参数类型
+     * @param f 任务函数
+     * @param args 参数
+     *
+     * @return TaskFuture，可以get()阻塞等待，也可以then()挂接下一步
+     *
+     * @note 与add_task的区别：结果就绪时直接调度延续，不需要线程阻塞在get()上
+     * @note 线程池已关闭时，返回的future以broken_promise异常完成
+     */
+    template <typename F, typename... Args>
+    auto submit(F&& f, Args&&... args) {
+        return async_on(*this, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    }
+
+    /**
+     * @brief 提交带截止时间的任务，返回TaskFuture
+     *
+     * @param deadline 最晚开始时间
+     * @param f 任务函数
+     * @param args 参数
+     *
+     * @return TaskFuture；任务过期时以TaskExpiredError完成
+     *
+     * @note 优先级为NORMAL，需要其他优先级时使用submit_with()
+     */
+    template <typename F, typename... Args>
+    auto submit_before(TaskOptions::Clock::time_point deadline, F&& f, Args&&... args) {
+        TaskOptions options;
+        options.deadline = deadline;
+        return submit_with(std::move(options), std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief 按调度参数提交任务，返回TaskFuture
+     *
+     * @note options.on_expired会在future以TaskExpiredError完成之后调用
+     * @note 线程池已关闭时，返回的future以broken_promise异常完成
+     */
+    template <typename F, typename... Args>
+    auto submit_with(TaskOptions options, F&& f, Args&&... args) {
+        auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+        using R = std::invoke_result_t<decltype(bound)&>;
+
+        auto promise = std::make_shared<TaskPromise<R>>();
+        TaskFuture<R> result = promise->get_future();
+        auto task = std::make_shared<decltype(bound)>(std::move(bound));
+
+        std::function<void()> user_on_expired = std::move(options.on_expired);
+        options.on_expired = [promise, user_on_expired]() {
+            promise->set_exception(std::make_exception_ptr(TaskExpiredError()));
+            if (user_on_expired) {
+                user_on_expired();
+            }
+        };
+
+        schedule([promise, task]() { fulfill_promise(*promise, *task); }, std::move(options));
+        return result;
+    }
+
+    /**
+     * @brief Executor接口：把任务放入队列
+     *
+     * @note 线程池已关闭时任务被直接丢弃（析构）
+     */
+    void execute(std::function<void()> task) override {
+        if (stop_.load()) {
+            return;
+        }
+        queue_.push(std::move(task), TaskOptions());
+    }
+
+    /**
+     * @brief 数据并行循环：对[begin, end)分块，fn(chunk_begin, chunk_end)在多个线程上执行
+     *
+     * @param begin 范围起点
+     * @param end 范围终点（不含）
+     * @param grain 每块最少元素数（DYNAMIC时即块大小）
+     * @param fn 块函数，签名 void(size_t chunk_begin, size_t chunk_end)
+     * @param policy 分块方式
+     *
+     * @note 调用线程也参与执行，返回时所有块都已完成
+     * @note 辅助线程还没开始时，调用线程会把剩下的块全部做完，
+     *       所以线程池繁忙或在工作线程中嵌套调用也不会死锁
+     * @note 某块抛出异常时，尚未开始的块被跳过，异常在调用线程重新抛出
+     *
+     * 使用示例：
+     * @code
+     *   // 按行并行处理一帧，每块至少16行
+     *   pool.parallel_for(0, height, 16, [&](size_t y0, size_t y1) {
+     *       for (size_t y = y0; y < y1; ++y) {
+     *           convert_row(frame, y);
+     *       }
+     *   });
+     * @endcode
+     */
+    template <typename Fn>
+    void parallel_for(size_t begin, size_t end, size_t grain, const Fn& fn,
+                      ChunkPolicy policy = ChunkPolicy::DYNAMIC) {
+        if (end <= begin) {
+            return;
+        }
+
+        size_t total = end - begin;
+        grain = std::max<size_t>(grain, 1);
+        size_t workers = worker_count_.load();
+        size_t participants = workers + 1;
+
+        size_t chunk_size;
+        if (policy == ChunkPolicy::STATIC) {
+            chunk_size = std::max(grain, (total + participants - 1) / participants);
+        } else {
+            chunk_size = grain;
+        }
+        size_t chunk_count = (total + chunk_size - 1) / chunk_size;
+
+        // 只有一块或线程池已关闭时直接在调用线程执行
+        if (chunk_count <= 1 || workers == 0 || stop_.load()) {
+            fn(begin, end);
+            return;
+        }
+
+        auto state = std::make_shared<ParallelForState>();
+        state->begin = begin;
+        state->end = end;
+        state->chunk_size = chunk_size;
+        state->chunk_count = chunk_count;
+        state->fn = &fn;
+        state->invoke = [](const void* f, size_t b, size_t e) {
+            (*static_cast<const Fn*>(f))(b, e);
+        };
+
+        // 调用线程正在等待这些块，辅助任务排在普通任务之前
+        TaskOptions helper_options;
+        helper_options.priority = TaskPriority::HIGH;
+
+        size_t helpers = std::min(workers, chunk_count - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            queue_.push([state]() { state->run_chunks(); }, helper_options);
+        }
+
+        state->run_chunks();
+        state->wait_all();
+
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+    /**
+     * @brief 二维分块并行：把width x height的区域切成tile_w x tile_h的块
+     *
+     * @param fn 块函数，签名 void(size_t x0, size_t y0, size_t x1, size_t y1)
+     *
+     * @note 块按行优先编号，使用DYNAMIC分块，每次领取一个块
+     */
+    template <typename Fn>
+    void parallel_for_tiles(size_t width, size_t height, size_t tile_w, size_t tile_h,
+                            const Fn& fn) {
+        tile_w = std::max<size_t>(tile_w, 1);
+        tile_h = std::max<size_t>(tile_h, 1);
+        size_t tiles_x = (width + tile_w - 1) / tile_w;
+        size_t tiles_y = (height + tile_h - 1) / tile_h;
+
+        parallel_for(0, tiles_x * tiles_y, 1, [&](size_t t0, size_t t1) {
+            for (size_t t = t0; t < t1; ++t) {
+                size_t x0 = (t % tiles_x) * tile_w;
+                size_t y0 = (t / tiles_x) * tile_h;
+                fn(x0, y0, std::min(width, x0 + tile_w), std::min(height, y0 + tile_h));
+            }
+        });
+    }
+
     /**
      * @brief 获取当前队列中待处理的任务数
      *
@@ -199,9 +781,98 @@ public:
      * @brief 获取线程池中的线程数
      *
      * @return 工作线程的数量
+     *
+     * @note retire_workers()之后立即减少，不等待线程真正退出
      */
     size_t thread_count() const {
-        return threads_.size();
+        return worker_count_.load();
+    }
+
+    /**
+     * @brief 增加工作线程
+     *
+     * @param count 增加的线程数
+     * @return 调整后的线程数
+     *
+     * @note 线程池已关闭时不做任何事
+     */
+    size_t add_workers(size_t count) {
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        if (stop_.load()) {
+            return worker_count_.load();
+        }
+        reap_retired_locked();
+
+        for (size_t i = 0; i < count; ++i) {
+            // std::thread会立即启动线程
+            // &ThreadPool::worker是成员函数指针
+            // this是传给成员函数的隐式参数
+            size_t id = next_worker_id_++;
+            workers_.emplace(id, std::thread(&ThreadPool::worker, this, id));
+            worker_count_++;
+        }
+        return worker_count_.load();
+    }
+
+    /**
+     * @brief 退出部分工作线程
+     *
+     * @param count 退出的线程数
+     * @return 调整后的线程数
+     *
+     * @note 至少保留1个线程，否则队列中的任务永远不会执行
+     * @note 正在执行的任务不会被打断：线程完成当前任务后取到退出标记才结束
+     */
+    size_t retire_workers(size_t count) {
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        if (stop_.load()) {
+            return worker_count_.load();
+        }
+        reap_retired_locked();
+
+        size_t current = worker_count_.load();
+        count = std::min(count, current > 1 ? current - 1 : 0);
+        for (size_t i = 0; i < count; ++i) {
+            queue_.push_retire();
+            worker_count_--;
+        }
+        return worker_count_.load();
+    }
+
+    /**
+     * @brief 把线程数调整为num_threads（至少为1）
+     *
+     * @return 调整后的线程数
+     */
+    size_t resize(size_t num_threads) {
+        num_threads = std::max<size_t>(num_threads, 1);
+        size_t current = worker_count_.load();
+        if (num_threads > current) {
+            return add_workers(num_threads - current);
+        }
+        if (num_threads < current) {
+            return retire_workers(current - num_threads);
+        }
+        return current;
+    }
+
+    /**
+     * @brief 获取执行与过期统计
+     */
+    ThreadPoolStatistics get_statistics() const {
+        ThreadPoolStatistics stats;
+        stats.tasks_executed = tasks_executed_.load();
+        stats.tasks_expired = tasks_expired_.load();
+        for (size_t i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+            stats.expired_by_priority[i] = expired_by_priority_[i].load();
+        }
+        stats.queue_size = queue_.size();
+        stats.active_tasks = active_tasks_.load();
+        stats.threads = worker_count_.load();
+        stats.tasks_dequeued = tasks_dequeued_.load();
+        stats.queue_wait_ns = queue_wait_ns_.load();
+        stats.busy_ns = busy_ns_.load();
+        return stats;
     }
 
     /**
@@ -224,8 +895,17 @@ public:
             // 关闭队列，让所有等待的pop立即返回
             queue_.shutdown();
 
+            // 取出所有线程后在锁外join（退出的线程需要获取workers_mutex_登记自己）
+            std::map<size_t, std::thread> workers;
+            {
+                std::lock_guard<std::mutex> lock(workers_mutex_);
+                workers.swap(workers_);
+                retired_ids_.clear();
+                worker_count_ = 0;
+            }
+
             // 等待所有线程退出
-            for (auto& thread : threads_) {
+            for (auto& [id, thread] : workers) {
                 if (thread.joinable()) {
                     thread.join();
                 }
@@ -248,29 +928,61 @@ private:
      *
      * 工作流程：
      * 1. 等待从队列中获取任务
-     * 2. 如果获取成功，执行任务
-     * 3. 重复直到线程池关闭
+     * 2. 取到退出标记则结束（retire_workers）
+     * 3. 已过截止时间则丢弃（调用on_expired），否则执行任务
+     * 4. 重复直到线程池关闭
+     *
+     * @param id 工作线程编号（workers_的键）
      *
      * @note 这是每个工作线程运行的函数
-     * @note 在析构函数中通过join()等待其返回
+     * @note 在shutdown()中通过join()等待其返回；被退出的线程由后续的增减操作回收
      */
-    void worker() {
+    void worker(size_t id) {
+        using Clock = DeadlineTaskQueue::Clock;
+
         // 循环运行直到stop_标志被设置
         while (!stop_.load()) {
-            Task task;
+            DeadlineTaskQueue::Entry entry;
 
             // 从队列阻塞式获取任务
             // 如果线程池关闭，pop会返回false
-            if (queue_.pop(task)) {
+            if (queue_.pop(entry)) {
+                if (entry.retire) {
+                    std::lock_guard<std::mutex> lock(workers_mutex_);
+                    retired_ids_.push_back(id);
+                    return;
+                }
+
+                auto dequeued = Clock::now();
+                tasks_dequeued_++;
+                queue_wait_ns_ += static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(dequeued - entry.enqueued).count());
+
+                // 过期任务不执行，只通知提交者
+                if (entry.deadline < dequeued) {
+                    tasks_expired_++;
+                    expired_by_priority_[static_cast<size_t>(entry.priority)]++;
+                    if (entry.on_expired) {
+                        try {
+                            entry.on_expired();
+                        } catch (...) {
+                        }
+                    }
+                    continue;
+                }
+
                 try {
                     // 增加活跃任务计数
                     active_tasks_++;
 
                     // 执行任务
-                    task();
+                    entry.task();
 
                     // 减少活跃任务计数
                     active_tasks_--;
+                    tasks_executed_++;
+                    busy_ns_ += static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - dequeued).count());
                 } catch (const std::exception& e) {
                     // 捕获任务执行时的异常
                     // 防止异常导致线程退出
@@ -282,11 +994,39 @@ private:
         }
     }
 
+    /**
+     * @brief join已经退出的线程并从workers_中移除
+     *
+     * @note 调用者必须持有workers_mutex_；线程登记退出后不再获取锁，join不会死锁
+     */
+    void reap_retired_locked() {
+        for (size_t id : retired_ids_) {
+            auto it = workers_.find(id);
+            if (it != workers_.end()) {
+                if (it->second.joinable()) {
+                    it->second.join();
+                }
+                workers_.erase(it);
+            }
+        }
+        retired_ids_.clear();
+    }
+
 private:
-    std::vector<std::thread> threads_;          // 工作线程集合
-    SafeQueue<Task> queue_;                     // 任务队列
+    std::mutex workers_mutex_;                  // 保护workers_和retired_ids_
+    std::map<size_t, std::thread> workers_;     // 工作线程集合（编号 -> 线程）
+    std::vector<size_t> retired_ids_;           // 已退出、待join的线程编号
+    DeadlineTaskQueue queue_;                   // 任务队列（优先级 + 截止时间）
     std::atomic<bool> stop_;                    // 关闭标志（原子操作）
     std::atomic<size_t> active_tasks_;          // 活跃任务计数（原子操作）
+    std::atomic<size_t> worker_count_;          // 工作线程数（不含已请求退出的线程）
+    size_t next_worker_id_;                     // 下一个工作线程编号（受workers_mutex_保护）
+    std::atomic<uint64_t> tasks_executed_;      // 已执行任务数
+    std::atomic<uint64_t> tasks_expired_;       // 过期丢弃任务数
+    std::atomic<uint64_t> expired_by_priority_[TASK_PRIORITY_COUNT];  // 各优先级过期数
+    std::atomic<uint64_t> tasks_dequeued_;      // 已出队任务数
+    std::atomic<uint64_t> queue_wait_ns_;       // 累计排队时间
+    std::atomic<uint64_t> busy_ns_;             // 累计执行时间
 };
 
 #endif // THREAD_POOL_H
@@ -33,6 +33,12 @@
 #include <vector>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <chrono>
+#include <cstdio>
+
+#include "AVServer_03_FrameBuffer.h"
+#include "AVServer_29_TimeService.h"
 
 // ============================================================================
 // ======================== 消息类型定义 =======================================
@@ -180,8 +186,9 @@ struct MessageHeader {
         // 在实际项目中，应该使用标准CRC库或更复杂的校验算法
         uint16_t crc = 0xFFFF;
 
-        // 对前18字节计算CRC
-        const uint8_t* data = reinterpret_cast<const uint8_t*>(this);
+        // 对序列化后的前18字节计算CRC（结构体内存布局含填充字节，不能直接使用）
+        uint8_t data[18];
+        encode_fields(data);
         for (int i = 0; i < 18; ++i) {
             crc ^= data[i];
             for (int j = 0; j < 8; ++j) {
@@ -210,9 +217,10 @@ struct MessageHeader {
             return 0;
         }
 
-        // 使用memcpy进行序列化，对齐性能更好
-        // 注意：在实际网络传输中应转换为网络字节序（大端）
-        std::memcpy(buffer, this, HEADER_SIZE);
+        // 按布局逐字段写入网络字节序（结构体有填充，不能整体memcpy）
+        encode_fields(buffer);
+        buffer[18] = static_cast<uint8_t>(header_crc >> 8);
+        buffer[19] = static_cast<uint8_t>(header_crc);
         return HEADER_SIZE;
     }
 
@@ -229,9 +237,65 @@ struct MessageHeader {
             return 0;
         }
 
-        std::memcpy(this, buffer, HEADER_SIZE);
+        magic = static_cast<uint32_t>(read_be(buffer, 4));
+        type = static_cast<uint16_t>(read_be(buffer + 4, 2));
+        payload_size = static_cast<uint32_t>(read_be(buffer + 6, 4));
+        timestamp = read_be(buffer + 10, 8);
+        header_crc = static_cast<uint16_t>(read_be(buffer + 18, 2));
         return HEADER_SIZE;
     }
+
+private:
+    /**
+     * @brief 按网络字节序写入前18字节（除header_crc外的所有字段）
+     */
+    void encode_fields(uint8_t* buffer) const {
+        write_be(buffer, magic, 4);
+        write_be(buffer + 4, type, 2);
+        write_be(buffer + 6, payload_size, 4);
+        write_be(buffer + 10, timestamp, 8);
+    }
+
+    static void write_be(uint8_t* buffer, uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) {
+            buffer[i] = static_cast<uint8_t>(value);
+            value >>= 8;
+        }
+    }
+
+    static uint64_t read_be(const uint8_t* buffer, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value = (value << 8) | buffer[i];
+        }
+        return value;
+    }
+};
+
+// ============================================================================
+// ======================== 消息本地元数据 ====================================
+// ============================================================================
+
+/**
+ * @struct MessageMeta
+ * @brief 消息在服务器内部携带的元数据
+ *
+ * 只在进程内使用，不参与序列化，不会出现在网络上。
+ * 发送队列根据这些信息决定优先级和丢弃策略。
+ */
+struct MessageMeta {
+    bool has_frame_type;         // frame_type是否有效
+    FrameType frame_type;        // 媒体帧类型（I/P/B/音频）
+    bool has_pts;                // pts_ms是否有效
+    uint64_t pts_ms;             // 显示时间戳（毫秒，与ProtocolHelper::get_timestamp_ms同一时钟）
+    FrameTimestamps stamps;      // 所承载媒体帧的阶段时间戳（发送完成时记入LatencyTracer）
+
+    MessageMeta()
+        : has_frame_type(false),
+          frame_type(FrameType::VIDEO_P_FRAME),
+          has_pts(false),
+          pts_ms(0) {
+    }
 };
 
 // ============================================================================
@@ -302,7 +366,8 @@ public:
     Message(const Message& other)
         : header_(other.header_),
           payload_(other.payload_),
-          valid_(other.valid_) {
+          valid_(other.valid_),
+          meta_(other.meta_) {
     }
 
     /**
@@ -313,6 +378,7 @@ public:
             header_ = other.header_;
             payload_ = other.payload_;
             valid_ = other.valid_;
+            meta_ = other.meta_;
         }
         return *this;
     }
@@ -373,6 +439,57 @@ public:
         return header_;
     }
 
+    // ===== 本地元数据 =====
+
+    /**
+     * @brief 获取消息的本地元数据
+     *
+     * @return 常量元数据引用
+     */
+    const MessageMeta& get_meta() const {
+        return meta_;
+    }
+
+    /**
+     * @brief 标记消息承载的媒体帧类型
+     *
+     * @param type 帧类型
+     *
+     * @note 只影响服务器内部的发送调度，不改变线上格式
+     */
+    void set_frame_type(FrameType type) {
+        meta_.has_frame_type = true;
+        meta_.frame_type = type;
+    }
+
+    /**
+     * @brief 设置消息承载的媒体帧的显示时间戳
+     *
+     * @param pts_ms 显示时间戳（毫秒）
+     *
+     * @note 发送队列用它和会话延迟目标计算帧的截止时间
+     */
+    void set_pts_ms(uint64_t pts_ms) {
+        meta_.has_pts = true;
+        meta_.pts_ms = pts_ms;
+    }
+
+    /**
+     * @brief 设置消息承载的媒体帧的阶段时间戳
+     *
+     * @param stamps 帧在采集、编码等阶段的时间戳
+     */
+    void set_stamps(const FrameTimestamps& stamps) {
+        meta_.stamps = stamps;
+    }
+
+    /**
+     * @brief 在指定阶段打上当前时间（消息未参与追踪时无效果）
+     */
+    void stamp(FrameStage stage) {
+        meta_.stamps.stamp(stage);
+    }
+
     // ===== 消息体操作 =====
 
     /**
@@ -593,6 +710,7 @@ private:
     MessageHeader header_;           // 消息头
     std::vector<uint8_t> payload_;   // 消息体
     bool valid_;                     // 消息有效性标志
+    MessageMeta meta_;               // 本地元数据（不序列化）
 };
 
 // ============================================================================
@@ -657,16 +775,14 @@ public:
     /**
      * @brief 获取当前系统时间戳（毫秒）
      *
-     * @return 当前时间的毫秒时间戳
+     * @return 当前时间的毫秒时间戳（Unix时间）
      *
      * @note 用于设置Message的timestamp字段
-     * @note 基于system_clock（相对于系统启动或1970年）
+     * @note 由单调时钟映射到墙钟（见TimeService.h），不随NTP调整跳变；
+     *       时钟线程运行时只读取缓存值
      */
     static uint64_t get_timestamp_ms() {
-        using namespace std::chrono;
-        auto now = system_clock::now();
-        auto duration = now.time_since_epoch();
-        return duration_cast<milliseconds>(duration).count();
+        return static_cast<uint64_t>(TimeService::instance().wall_now_ms());
     }
 };
 
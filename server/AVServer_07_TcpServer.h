@@ -9,7 +9,8 @@
  *
  * 设计模式：
  * - Reactor模式：事件驱动的网络编程
- * - 线程池管理：使用ThreadPool处理客户端请求
+ * - 协程会话：C++20编译时每个连接是事件循环上的一个协程（见Coroutine.h）
+ * - 线程池管理：C++17编译时使用ThreadPool处理客户端请求
  * - 连接生命周期管理：自动清理断开的连接
  *
  * 应用场景：
@@ -54,6 +55,11 @@
 
 #include "AVServer_01_SafeQueue.h"
 #include "AVServer_04_ThreadPool.h"
+#include "AVServer_26_PoolAutoscaler.h"
+#include "AVServer_27_Numa.h"
+#include "AVServer_18_PrioritySendQueue.h"
+#include "AVServer_34_LockProfiler.h"
+#include "AVServer_35_TcpInfo.h"
 
 // ============================================================================
 // ======================== TCP服务器配置 ======================================
@@ -69,6 +75,11 @@
  * - 接收/发送缓冲区大小
  * - 超时设置
  * - 线程数量
+ * - 连接发送队列
+ * - 媒体管道拓扑
+ * - 事件循环线程数
+ * - 低延迟忙轮询
+ * - 指标导出
  */
 struct ServerConfig {
     uint16_t port;                  // 监听端口（默认8888）
@@ -85,7 +96,33 @@ struct ServerConfig {
     int heartbeat_interval_ms;      // 心跳包间隔（毫秒）
     int heartbeat_timeout_ms;       // 心跳超时阈值（毫秒）
 
-    size_t thread_pool_size;        // 处理客户端请求的线程数
+    size_t thread_pool_size;        // 处理客户端请求的线程数（自动扩缩容时为下限）
+    size_t thread_pool_max_size;    // 自动扩缩容的上限（不大于thread_pool_size时不启用）
+
+    SendQueueConfig send_queue;     // 每个连接的优先级发送队列配置
+
+    std::string pipeline_spec;      // 媒体管道的阶段图描述（空表示使用MediaProcessor，格式见StageGraph.h）
+
+    size_t event_loop_threads;      // 运行会话的事件循环线程数（C++20为协程，否则为回调；0表示使用线程池模型，
+                                    // 每个会话独占一个线程池线程，并发会话数受线程池大小限制）
+
+    int numa_node;                  // 媒体流（捕获、编码、发送线程）所在的NUMA节点（-1表示不绑定）
+
+    int busy_poll_us;               // 事件循环阻塞前的忙轮询时间，同时设置连接的SO_BUSY_POLL（微秒，0表示关闭）
+    bool prefer_busy_poll;          // 忙轮询时设置SO_PREFER_BUSY_POLL
+
+    uint16_t metrics_port;          // Prometheus指标HTTP端口（0表示不启用，见MetricsExporter.h）
+    std::string metrics_addr;       // 指标HTTP监听地址（默认只监听本机）
+    size_t metrics_label_limit;     // 按客户端或按流展开的指标最多输出的标签组数，其余合并为"other"
+
+    int tcp_info_interval_ms;       // 每个事件循环批量采样TCP_INFO的周期（毫秒，0表示不采样，见TcpInfo.h）
+
+    bool flight_recorder;               // 是否记录流水线事件（见FlightRecorder.h）
+    size_t flight_recorder_events;      // 每个线程的事件环容量（向上取整为2的幂）
+    int flight_recorder_window_ms;      // 导出最近多少毫秒的事件（0表示事件环中的全部）
+    std::string flight_recorder_path;   // trace命令和SIGUSR1导出的默认文件
+
+    std::string ingest_capture_path;    // 录制入站字节流的文件（空表示不录制，回放见IngestCapture.h）
 
     /**
      * @brief 构造函数 - 初始化为默认值
@@ -101,10 +138,28 @@ struct ServerConfig {
           send_timeout_ms(0),                // 无限制
           heartbeat_interval_ms(5000),       // 5秒
           heartbeat_timeout_ms(15000),       // 15秒
-          thread_pool_size(4) {              // 4个工作线程
+          thread_pool_size(default_thread_pool_size()),  // 可用CPU数（考虑容器配额）
+          thread_pool_max_size(0),           // 不自动扩缩容
+          event_loop_threads(1),             // 1个事件循环线程
+          numa_node(-1),                     // 不绑定NUMA节点
+          busy_poll_us(0),                   // 不忙轮询
+          prefer_busy_poll(true),
+          metrics_port(0),                   // 不导出指标
+          metrics_addr("127.0.0.1"),
+          metrics_label_limit(64),
+          tcp_info_interval_ms(1000),        // 每秒采样一次
+          flight_recorder(true),
+          flight_recorder_events(16384),     // 每线程384KB
+          flight_recorder_window_ms(10000),  // 10秒
+          flight_recorder_path("avserver-trace.json"),
+          ingest_capture_path() {
     }
 };
 
+// Connection依赖完整的ServerConfig定义
+#include "AVServer_08_Connection.h"
+#include "AVServer_24_EventLoop.h"
+
 // ============================================================================
 // ======================== TCP服务器类 =======================================
 // ============================================================================
@@ -117,7 +172,7 @@ struct ServerConfig {
  * 1. 创建并绑定监听套接字到指定端口
  * 2. 启动接收线程，等待客户端连接
  * 3. 接受新连接，创建Connection对象管理
- * 4. 分配给线程池处理客户端请求
+ * 4. 在事件循环上启动会话（C++20为协程，否则为回调）；event_loop_threads为0时分配给线程池
  * 5. 监测连接状态，断开时进行清理
  *
  * 使用示例：
@@ -155,6 +210,8 @@ struct ServerConfig {
  */
 class TcpServer {
 public:
+    static constexpr int SESSION_POLL_MS = 200;     // 线程池模型中会话阻塞读取的超时（用于及时响应停止和心跳超时）
+
     /**
      * @brief 客户端连接事件回调
      * 参数：指向Connection对象的智能指针
@@ -184,6 +241,23 @@ public:
      */
     using OnClientDisconnectedCallback = std::function<void(const std::shared_ptr<class Connection>&)>;
 
+    /**
+     * @brief 传输层状态采样回调
+     * 参数：一个事件循环上所有会话的（连接ID，TCP_INFO采样）
+     *
+     * @note 在事件循环线程中执行，每个循环每个采样周期调用一次
+     */
+    using TransportSample = std::pair<uint32_t, TcpTransportInfo>;
+    using OnTransportSampledCallback = std::function<void(const std::vector<TransportSample>&)>;
+
+    /**
+     * @brief 消息发送完成回调
+     * 参数：消息类型，写入套接字的字节数（含消息头）
+     *
+     * @note 在写套接字的线程中、持有该连接的发送锁时执行，只应更新计数
+     */
+    using OnMessageSentCallback = std::function<void(MessageType, size_t)>;
+
     /**
      * @brief 构造函数
      *
@@ -197,7 +271,8 @@ public:
           running_(false),
           accept_thread_(),
           thread_pool_(config.thread_pool_size),
-          next_connection_id_(1) {
+          next_connection_id_(1),
+          next_loop_(0) {
     }
 
     /**
@@ -291,6 +366,46 @@ public:
 
         // 设置标志并启动接收线程
         running_ = true;
+
+        // 收发路径上的活动时间和消息时间戳读取缓存的粗粒度时钟
+        TimeService::instance().start_ticker();
+
+        if (config_.thread_pool_max_size > config_.thread_pool_size) {
+            AutoscaleConfig autoscale;
+            autoscale.min_threads = config_.thread_pool_size;
+            autoscale.max_threads = config_.thread_pool_max_size;
+            autoscaler_ = std::make_unique<ThreadPoolAutoscaler>(thread_pool_, autoscale);
+            autoscaler_->start();
+        }
+
+        if (config_.event_loop_threads > 0) {
+            // 事件循环模式：接收和所有会话都在事件循环上（C++20为协程，否则为回调）
+            set_nonblocking(listen_socket_);
+            loop_sessions_.resize(config_.event_loop_threads);
+            for (size_t i = 0; i < config_.event_loop_threads; ++i) {
+                loops_.push_back(std::make_unique<EventLoop>());
+                loops_.back()->set_busy_poll(config_.busy_poll_us);
+                loops_.back()->start();
+
+                // 发送线程与媒体流在同一节点，读取帧数据不跨节点
+                if (config_.numa_node >= 0) {
+                    int node = config_.numa_node;
+                    loops_.back()->post([node] { pin_current_thread_to_node(node); });
+                }
+
+                if (config_.tcp_info_interval_ms > 0) {
+                    EventLoop* loop = loops_.back().get();
+                    loop->post([this, loop, i] { schedule_transport_sampling(*loop, i); });
+                }
+            }
+            EventLoop* accept_loop = loops_.front().get();
+            accept_loop->post([this, accept_loop] { accept_sessions(*accept_loop); });
+
+            std::cout << "Server started on " << config_.listen_addr << ":"
+                      << config_.port << " (" << loops_.size() << " event loops)" << std::endl;
+            return true;
+        }
+
         accept_thread_ = std::thread(&TcpServer::accept_loop, this);
 
         std::cout << "Server started on " << config_.listen_addr << ":"
@@ -303,10 +418,10 @@ public:
      *
      * 步骤：
      * 1. 设置running_标志为false
-     * 2. 关闭监听套接字（使accept()返回）
-     * 3. 等待接收线程退出
-     * 4. 关闭所有客户端连接
-     * 5. 关闭线程池
+     * 2. 停止事件循环（所有会话协程以CLOSED结束并完成清理）
+     * 3. 关闭监听套接字（使accept()返回），等待接收线程退出
+     * 4. 关闭线程池（线程池模型的会话先自行结束）
+     * 5. 关闭剩余的客户端连接
      *
      * @note 函数会阻塞直到所有连接都关闭
      * @note 可以安全地多次调用
@@ -319,8 +434,16 @@ public:
             return;
         }
 
-        // 关闭监听套接字，导致accept()返回
+        // 停止事件循环，等待中的会话被唤醒并退出
+        for (auto& loop : loops_) {
+            loop->stop();
+        }
+        loops_.clear();
+        loop_sessions_.clear();
+
+        // 关闭监听套接字，导致accept()返回（Linux上只有shutdown能唤醒阻塞的accept()）
         if (listen_socket_ != INVALID_SOCKET) {
+            ::shutdown(listen_socket_, SHUT_RDWR);
             ::closesocket(listen_socket_);
             listen_socket_ = INVALID_SOCKET;
         }
@@ -330,9 +453,17 @@ public:
             accept_thread_.join();
         }
 
-        // 关闭所有客户端连接
+        // 先停止扩缩容，再关闭线程池
+        // 线程池模型的会话在SESSION_POLL_MS内发现停止，自行关闭连接后线程才退出
+        if (autoscaler_) {
+            autoscaler_->stop();
+            autoscaler_.reset();
+        }
+        thread_pool_.shutdown();
+
+        // 关闭剩余的客户端连接（尚未开始处理的会话）
         {
-            std::lock_guard<std::mutex> lock(connections_mutex_);
+            std::lock_guard<ProfiledMutex> lock(connections_mutex_);
             for (auto& [id, conn] : connections_) {
                 if (conn) {
                     conn->close();
@@ -340,9 +471,7 @@ public:
             }
             connections_.clear();
         }
-
-        // 关闭线程池
-        thread_pool_.shutdown();
+        TimeService::instance().stop_ticker();
 
         std::cout << "Server stopped" << std::endl;
     }
@@ -362,7 +491,7 @@ public:
      * @return 活跃连接的数量
      */
     size_t get_connection_count() const {
-        std::lock_guard<std::mutex> lock(connections_mutex_);
+        std::lock_guard<ProfiledMutex> lock(connections_mutex_);
         return connections_.size();
     }
 
@@ -373,7 +502,7 @@ public:
      * @return 指向Connection的智能指针，如果不存在返回nullptr
      */
     std::shared_ptr<class Connection> get_connection(uint32_t connection_id) const {
-        std::lock_guard<std::mutex> lock(connections_mutex_);
+        std::lock_guard<ProfiledMutex> lock(connections_mutex_);
         auto it = connections_.find(connection_id);
         if (it != connections_.end()) {
             return it->second;
@@ -390,7 +519,7 @@ public:
      * @note 如果某个连接发送失败，继续发送给其他连接
      */
     void broadcast(const Message& message) {
-        std::lock_guard<std::mutex> lock(connections_mutex_);
+        std::lock_guard<ProfiledMutex> lock(connections_mutex_);
         for (auto& [id, conn] : connections_) {
             if (conn && conn->is_connected()) {
                 conn->send(message);
@@ -431,6 +560,28 @@ public:
         on_client_disconnected_ = callback;
     }
 
+    /**
+     * @brief 设置传输层状态采样回调
+     *
+     * @param callback 回调函数
+     *
+     * @note 需要在start()之前设置；只有事件循环模式下才会采样
+     */
+    void set_on_transport_sampled(OnTransportSampledCallback callback) {
+        on_transport_sampled_ = callback;
+    }
+
+    /**
+     * @brief 设置消息发送完成回调
+     *
+     * @param callback 回调函数
+     *
+     * @note 需要在start()之前设置；每条消息完整写入套接字后调用一次
+     */
+    void set_on_message_sent(OnMessageSentCallback callback) {
+        on_message_sent_ = callback;
+    }
+
     /**
      * @brief 获取服务器配置
      *
@@ -440,6 +591,17 @@ public:
         return config_;
     }
 
+    /**
+     * @brief 所有事件循环的忙轮询统计（合计）
+     */
+    SpinStatistics get_reactor_spin_statistics() const {
+        SpinStatistics total;
+        for (const auto& loop : loops_) {
+            total += loop->get_spin_statistics();
+        }
+        return total;
+    }
+
 private:
     /**
      * @brief 接收线程的主循环
@@ -470,34 +632,13 @@ private:
                     break;
                 }
                 // 其他错误情况
-                std::cerr << "accept() failed" << std::endl;
+                AV_LOG_WARN("TcpServer", "accept() failed: errno={}", errno);
                 continue;
             }
 
-            // 创建Connection对象
-            uint32_t connection_id = next_connection_id_++;
-            auto connection = std::make_shared<class Connection>(
-                connection_id,
-                client_socket,
-                client_addr,
-                config_);
-
-            // 保存到连接映射表
-            {
-                std::lock_guard<std::mutex> lock(connections_mutex_);
-                if (connections_.size() < static_cast<size_t>(config_.max_connections)) {
-                    connections_[connection_id] = connection;
-                } else {
-                    // 达到最大连接数，拒绝新连接
-                    std::cerr << "Max connections reached, rejecting new connection" << std::endl;
-                    connection->close();
-                    continue;
-                }
-            }
-
-            // 调用连接回调
-            if (on_client_connected_) {
-                on_client_connected_(connection);
+            auto connection = register_connection(client_socket, client_addr, false);
+            if (!connection) {
+                continue;
             }
 
             // 分配给线程池处理
@@ -514,27 +655,444 @@ private:
     }
 
     /**
-     * @brief 处理单个客户端的消息接收和处理
+     * @brief 为新接受的套接字创建Connection并登记
      *
-     * @param connection 指向客户端Connection对象的智能指针
+     * @param event_driven 是否由事件循环中的协程会话管理
+     * @return 新连接；达到最大连接数时返回nullptr（套接字已关闭）
      *
-     * @note 该函数在线程池线程中执行
-     * @note 持续接收消息直到连接断开
+     * @note 登记后调用on_client_connected_回调
      */
-    void handle_client(const std::shared_ptr<class Connection>& connection) {
-        // TODO: 这是一个占位符，具体实现在Connection类中
-        // 实际实现应该在Connection类中处理消息接收
+    std::shared_ptr<Connection> register_connection(SOCKET client_socket,
+                                                    const struct sockaddr_in& client_addr,
+                                                    bool event_driven) {
+        // 创建Connection对象
+        uint32_t connection_id = next_connection_id_++;
+        auto connection = std::make_shared<Connection>(
+            connection_id,
+            client_socket,
+            client_addr,
+            config_);
+
+        if (event_driven) {
+            connection->set_event_driven();
+        }
+        if (on_message_sent_) {
+            connection->set_message_sent_handler(on_message_sent_);
+        }
+
+        if (config_.busy_poll_us > 0) {
+            enable_socket_busy_poll(static_cast<int>(client_socket), config_.busy_poll_us,
+                                    config_.prefer_busy_poll);
+        }
+
+        // 保存到连接映射表
+        {
+            std::lock_guard<ProfiledMutex> lock(connections_mutex_);
+            if (connections_.size() < static_cast<size_t>(config_.max_connections)) {
+                connections_[connection_id] = connection;
+            } else {
+                // 达到最大连接数，拒绝新连接
+                AV_LOG_WARN("TcpServer", "Max connections reached, rejecting new connection");
+                connection->close();
+                connection->release_socket();
+                return nullptr;
+            }
+        }
+
+        // 调用连接回调
+        if (on_client_connected_) {
+            on_client_connected_(connection);
+        }
+        return connection;
+    }
+
+    /**
+     * @brief 会话结束：通知断开并从连接映射表中移除
+     */
+    void finish_session(const std::shared_ptr<Connection>& connection) {
         if (on_client_disconnected_) {
             on_client_disconnected_(connection);
         }
 
-        // 从连接映射表中移除
-        {
-            std::lock_guard<std::mutex> lock(connections_mutex_);
-            connections_.erase(connection->get_id());
+        std::lock_guard<ProfiledMutex> lock(connections_mutex_);
+        connections_.erase(connection->get_id());
+    }
+
+    /**
+     * @brief 接受所有待处理连接，按轮询分配到各个事件循环并启动会话
+     *
+     * @note 在第一个事件循环上执行（监听套接字是非阻塞的）
+     */
+    void accept_pending() {
+        while (running_.load()) {
+            struct sockaddr_in client_addr;
+            socklen_t addr_len = sizeof(client_addr);
+            SOCKET client_socket = ::accept(listen_socket_,
+                                            reinterpret_cast<struct sockaddr*>(&client_addr),
+                                            &addr_len);
+            if (client_socket == INVALID_SOCKET) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    AV_LOG_WARN("TcpServer", "accept() failed: errno={}", errno);
+                }
+                break;
+            }
+
+            // 在所属事件循环的线程上创建连接：接收缓冲区等每连接状态
+            // 按first-touch分配在该循环所在的NUMA节点上
+            // 回调没有执行就被丢弃（目标循环已停止）时，PendingSocket析构关闭套接字
+            size_t index = next_loop_++ % loops_.size();
+            EventLoop* target = loops_[index].get();
+            auto pending = std::make_shared<PendingSocket>(client_socket);
+            target->post([this, target, index, pending, client_addr] {
+                if (!running_.load()) {
+                    return;
+                }
+                auto connection = register_connection(pending->release(), client_addr, true);
+                if (!connection) {
+                    return;
+                }
+                connection->set_send_blocked_handler(make_send_blocked_handler(*target, connection));
+                run_session(*target, index, connection);
+            });
+        }
+    }
+
+    /**
+     * @brief 会话结束：注销等待、关闭套接字并通知断开
+     *
+     * @note 在会话所在的循环线程中调用
+     */
+    void end_session(EventLoop& loop, size_t loop_index, const std::shared_ptr<Connection>& connection) {
+        loop_sessions_[loop_index].erase(connection->get_id());
+        connection->close();
+        loop.remove_fd(connection->get_socket());
+        connection->release_socket();
+        finish_session(connection);
+    }
+
+#if AVSERVER_HAS_COROUTINES
+    /**
+     * @brief 接收协程：监听套接字可读时接受所有待处理连接
+     *
+     * @note 运行在第一个事件循环上，新会话按轮询分配到各个事件循环
+     */
+    DetachedTask accept_sessions(EventLoop& loop) {
+        while (running_.load()) {
+            IoResult result = co_await wait_readable(loop, listen_socket_);
+            if (result != IoResult::READY) {
+                break;
+            }
+            accept_pending();
+        }
+    }
+
+    /**
+     * @brief 会话协程：顺序处理一个连接的全部消息
+     *
+     * 流程：
+     * 1. 等待下一条消息，超过心跳超时没有任何消息则断开
+     * 2. 交给on_message_received回调（握手、START_STREAM、心跳等在其中处理）
+     * 3. 连接断开或服务器停止时注销等待、关闭套接字并通知断开
+     *
+     * @param loop_index 所在事件循环的下标（会话登记在loop_sessions_中，供传输层采样）
+     */
+    DetachedTask run_session(EventLoop& loop, size_t loop_index, std::shared_ptr<Connection> connection) {
+        AsyncConnection io(loop, connection);
+        loop_sessions_[loop_index][connection->get_id()] = connection;
+        int idle_timeout_ms = config_.heartbeat_timeout_ms > 0 ? config_.heartbeat_timeout_ms : -1;
+
+        while (running_.load()) {
+            auto message = co_await io.read_message(idle_timeout_ms);
+            if (!message) {
+                if (io.last_result() == IoResult::TIMEOUT) {
+                    AV_LOG_INFO("TcpServer", "Connection #{} heartbeat timeout", connection->get_id());
+                }
+                break;
+            }
+            on_message_received(connection, *message);
+        }
+
+        end_session(loop, loop_index, connection);
+    }
+
+    /**
+     * @brief 发送协程：套接字写满后等待可写，把剩余的发送队列写完
+     *
+     * @param scheduled 防止同一连接同时存在多个发送协程
+     */
+    DetachedTask pump_send_queue(EventLoop& loop, std::shared_ptr<Connection> connection,
+                                 std::shared_ptr<std::atomic<bool>> scheduled) {
+        AsyncConnection io(loop, connection);
+        while (true) {
+            co_await io.flush();
+            scheduled->store(false);
+
+            // 清除标志后再检查一次，避免错过并发入队的消息
+            if (!connection->is_connected() ||
+                connection->flush_send_queue() != Connection::SendStatus::WOULD_BLOCK ||
+                scheduled->exchange(true)) {
+                break;
+            }
+        }
+    }
+
+#else
+    /**
+     * @brief 接收回调：监听套接字可读时接受所有待处理连接，然后重新等待（没有协程时使用）
+     *
+     * @note 运行在第一个事件循环上，新会话按轮询分配到各个事件循环
+     */
+    void accept_sessions(EventLoop& loop) {
+        if (!running_.load()) {
+            return;
+        }
+        loop.await_io(listen_socket_, IoEvent::READABLE, -1, [this, &loop](IoResult result) {
+            if (result != IoResult::READY) {
+                return;
+            }
+            accept_pending();
+            accept_sessions(loop);
+        });
+    }
+
+    /**
+     * @brief 会话：在事件循环上以回调方式处理一个连接的全部消息（没有协程时使用）
+     *
+     * 流程与协程版本相同：读出所有已到达的消息交给on_message_received回调，
+     * 没有数据时等待可读，超过心跳超时没有任何消息则断开
+     *
+     * @param loop_index 所在事件循环的下标（会话登记在loop_sessions_中，供传输层采样）
+     */
+    void run_session(EventLoop& loop, size_t loop_index, std::shared_ptr<Connection> connection) {
+        loop_sessions_[loop_index][connection->get_id()] = connection;
+        continue_session(loop, loop_index, std::move(connection), std::chrono::steady_clock::now());
+    }
+
+    /**
+     * @brief 会话的一轮：处理已到达的消息，然后登记下一次等待
+     *
+     * @param last_message 上一条消息的到达时间（心跳超时从这里算起）
+     */
+    void continue_session(EventLoop& loop, size_t loop_index, std::shared_ptr<Connection> connection,
+                          std::chrono::steady_clock::time_point last_message) {
+        while (running_.load()) {
+            Message message;
+            Connection::ReceiveStatus status = connection->poll_message(message);
+            if (status == Connection::ReceiveStatus::MESSAGE) {
+                last_message = std::chrono::steady_clock::now();
+                on_message_received(connection, message);
+                continue;
+            }
+            if (status == Connection::ReceiveStatus::CLOSED) {
+                break;
+            }
+
+            int wait_ms = -1;
+            if (config_.heartbeat_timeout_ms > 0) {
+                auto remaining = config_.heartbeat_timeout_ms -
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - last_message).count();
+                wait_ms = remaining > 0 ? static_cast<int>(remaining) : 0;
+            }
+
+            SOCKET socket = connection->get_socket();
+            bool waiting = loop.await_io(socket, IoEvent::READABLE, wait_ms,
+                [this, &loop, loop_index, connection, last_message](IoResult result) {
+                    if (result == IoResult::READY) {
+                        continue_session(loop, loop_index, connection, last_message);
+                        return;
+                    }
+                    if (result == IoResult::TIMEOUT) {
+                        AV_LOG_INFO("TcpServer", "Connection #{} heartbeat timeout", connection->get_id());
+                    }
+                    end_session(loop, loop_index, connection);
+                });
+            if (waiting) {
+                return;
+            }
+            break;
+        }
+
+        end_session(loop, loop_index, connection);
+    }
+
+    /**
+     * @brief 发送回调：套接字写满后等待可写，把剩余的发送队列写完（没有协程时使用）
+     *
+     * @param scheduled 防止同一连接同时存在多个发送等待
+     */
+    void pump_send_queue(EventLoop& loop, std::shared_ptr<Connection> connection,
+                         std::shared_ptr<std::atomic<bool>> scheduled) {
+        SOCKET socket = connection->get_socket();
+        bool waiting = loop.await_io(socket, IoEvent::WRITABLE, -1,
+            [this, &loop, connection, scheduled](IoResult result) {
+                if (result == IoResult::READY &&
+                    connection->flush_send_queue() == Connection::SendStatus::WOULD_BLOCK) {
+                    pump_send_queue(loop, connection, scheduled);
+                    return;
+                }
+                scheduled->store(false);
+
+                // 清除标志后再检查一次，避免错过并发入队的消息
+                if (result == IoResult::READY && connection->is_connected() &&
+                    connection->flush_send_queue() == Connection::SendStatus::WOULD_BLOCK &&
+                    !scheduled->exchange(true)) {
+                    pump_send_queue(loop, connection, scheduled);
+                }
+            });
+        if (!waiting) {
+            scheduled->store(false);
+        }
+    }
+#endif // AVSERVER_HAS_COROUTINES
+
+    /**
+     * @brief 在事件循环上登记下一次传输层采样
+     *
+     * @note 在循环线程中调用；服务器停止后不再登记
+     */
+    void schedule_transport_sampling(EventLoop& loop, size_t loop_index) {
+        if (!running_.load()) {
+            return;
+        }
+        loop.run_after(config_.tcp_info_interval_ms, [this, &loop, loop_index] {
+            sample_transport_info(loop_index);
+            schedule_transport_sampling(loop, loop_index);
+        });
+    }
+
+    /**
+     * @brief 批量采样一个事件循环上所有会话的TCP_INFO，结果一次交给回调
+     *
+     * @note 在循环线程中执行：会话只在这个线程上关闭套接字，采样时套接字一定有效
+     */
+    void sample_transport_info(size_t loop_index) {
+        auto& sessions = loop_sessions_[loop_index];
+        if (sessions.empty() || !on_transport_sampled_) {
+            return;
         }
+
+        std::vector<TransportSample> batch;
+        batch.reserve(sessions.size());
+        for (const auto& [id, connection] : sessions) {
+            TcpTransportInfo info;
+            if (read_tcp_transport_info(connection->get_socket(), info)) {
+                batch.emplace_back(id, info);
+            }
+        }
+        if (!batch.empty()) {
+            on_transport_sampled_(batch);
+        }
+    }
+
+    /**
+     * @brief 创建Connection的发送阻塞通知：把发送协程（没有协程时为发送回调）投递到连接所在的事件循环
+     */
+    std::function<void()> make_send_blocked_handler(EventLoop& loop,
+                                                    const std::shared_ptr<Connection>& connection) {
+        auto scheduled = std::make_shared<std::atomic<bool>>(false);
+        std::weak_ptr<Connection> weak_conn = connection;
+        EventLoop* target = &loop;
+
+        return [this, target, weak_conn, scheduled]() {
+            if (scheduled->exchange(true)) {
+                return;
+            }
+            target->post([this, target, weak_conn, scheduled] {
+                auto conn = weak_conn.lock();
+                if (conn && conn->is_connected()) {
+                    pump_send_queue(*target, conn, scheduled);
+                } else {
+                    scheduled->store(false);
+                }
+            });
+        };
     }
 
+    /**
+     * @brief 处理单个客户端的消息接收和处理（线程池模型，event_loop_threads为0时使用）
+     *
+     * 流程与run_session相同：
+     * 1. 阻塞读取下一条消息，每SESSION_POLL_MS醒来检查停止和心跳超时
+     * 2. 交给on_message_received回调
+     * 3. 连接断开、心跳超时或服务器停止时关闭套接字并通知断开
+     *
+     * @param connection 指向客户端Connection对象的智能指针
+     *
+     * @note 该函数在线程池线程中执行，会话期间独占该线程
+     */
+    void handle_client(const std::shared_ptr<class Connection>& connection) {
+        set_receive_timeout(connection->get_socket(), SESSION_POLL_MS);
+        auto last_message = std::chrono::steady_clock::now();
+
+        while (running_.load()) {
+            Message message;
+            Connection::ReceiveStatus status = connection->poll_message(message);
+            if (status == Connection::ReceiveStatus::MESSAGE) {
+                last_message = std::chrono::steady_clock::now();
+                on_message_received(connection, message);
+                continue;
+            }
+            if (status == Connection::ReceiveStatus::CLOSED) {
+                break;
+            }
+
+            // 读取超时：检查心跳
+            if (config_.heartbeat_timeout_ms > 0 &&
+                std::chrono::steady_clock::now() - last_message >
+                    std::chrono::milliseconds(config_.heartbeat_timeout_ms)) {
+                AV_LOG_INFO("TcpServer", "Connection #{} heartbeat timeout", connection->get_id());
+                break;
+            }
+        }
+
+        connection->close();
+        connection->release_socket();
+        finish_session(connection);
+    }
+
+    /**
+     * @brief 设置阻塞套接字的接收超时
+     */
+    static void set_receive_timeout(SOCKET socket, int timeout_ms) {
+#ifdef _WIN32
+        DWORD timeout = static_cast<DWORD>(timeout_ms);
+        ::setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+#else
+        struct timeval timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        ::setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+    }
+
+    /**
+     * @struct PendingSocket
+     * @brief 已接受、尚未交给Connection的套接字；没有被取走就在析构时关闭
+     */
+    struct PendingSocket {
+        SOCKET socket;
+
+        explicit PendingSocket(SOCKET s)
+            : socket(s) {
+        }
+
+        ~PendingSocket() {
+            if (socket != INVALID_SOCKET) {
+                ::closesocket(socket);
+            }
+        }
+
+        PendingSocket(const PendingSocket&) = delete;
+        PendingSocket& operator=(const PendingSocket&) = delete;
+
+        SOCKET release() {
+            SOCKET s = socket;
+            socket = INVALID_SOCKET;
+            return s;
+        }
+    };
+
     /**
      * @brief 被Connection调用，用于处理接收到的消息
      *
@@ -562,15 +1120,23 @@ private:
 
     std::thread accept_thread_;                     // 接收连接的线程
     ThreadPool thread_pool_;                        // 处理客户端请求的线程池
+    std::unique_ptr<ThreadPoolAutoscaler> autoscaler_;  // 线程池自动扩缩容（可为空）
 
-    mutable std::mutex connections_mutex_;          // 保护connections_的互斥锁
+    mutable ProfiledMutex connections_mutex_{"TcpServer.connections"};  // 保护connections_的互斥锁
     std::map<uint32_t, std::shared_ptr<class Connection>> connections_;  // 活跃连接映射表
     std::atomic<uint32_t> next_connection_id_;      // 下一个连接ID
 
+    std::vector<std::unique_ptr<EventLoop>> loops_; // 事件循环（运行接收和会话协程）
+    // 每个事件循环上的会话（与loops_下标对应，只在对应的循环线程中访问）
+    std::vector<std::map<uint32_t, std::shared_ptr<class Connection>>> loop_sessions_;
+    std::atomic<size_t> next_loop_;                 // 下一个会话分配到的事件循环
+
     // 事件回调函数
     OnClientConnectedCallback on_client_connected_;
     OnMessageReceivedCallback on_message_received_;
     OnClientDisconnectedCallback on_client_disconnected_;
+    OnTransportSampledCallback on_transport_sampled_;
+    OnMessageSentCallback on_message_sent_;
 };
 
 #endif // TCP_SERVER_H
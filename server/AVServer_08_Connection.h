@@ -10,7 +10,7 @@
  *
  * 设计特点：
  * - 非阻塞消息接收（使用循环缓冲区）
- * - 消息队列（发送）
+ * - 优先级发送队列（控制 > 音频 > 关键帧 > 非关键帧）
  * - 自动心跳和超时检测
  * - 线程安全的状态管理
  *
@@ -31,6 +31,10 @@
 #include <iostream>
 #include <queue>
 #include <mutex>
+#include <vector>
+#include <cerrno>
+#include <functional>
+#include <algorithm>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -49,6 +53,11 @@
 
 #include "AVServer_02_CircularBuffer.h"
 #include "AVServer_06_MessageProtocol.h"
+#include "AVServer_18_PrioritySendQueue.h"
+#include "AVServer_25_Coroutine.h"
+#include "AVServer_33_AsyncLogger.h"
+#include "AVServer_36_FlightRecorder.h"
+#include "AVServer_37_IngestCapture.h"
 
 // ============================================================================
 // ======================== 连接类 ===========================================
@@ -70,7 +79,8 @@
  *
  * 线程安全性：
  * - 接收操作：在单个工作线程中执行（不需要额外同步）
- * - 发送操作：可从多个线程调用，使用发送队列
+ * - 发送操作：可从多个线程调用，消息进入优先级发送队列，
+ *   同一时刻只有一个线程负责把队列写入套接字
  * - 状态检查：使用原子操作
  *
  * 使用示例：
@@ -118,7 +128,10 @@ public:
           config_(config),
           connected_(true),
           recv_buffer_(config.recv_buffer_size),
-          last_activity_time_(std::chrono::steady_clock::now()) {
+          last_activity_time_(TimeService::instance().coarse_now()),
+          send_queue_(config.send_queue),
+          pending_offset_(0),
+          event_driven_(false) {
 
         // 构建客户端地址字符串
         char addr_str[INET_ADDRSTRLEN];
@@ -126,7 +139,9 @@ public:
         client_addr_str_ = std::string(addr_str) + ":" +
                           std::to_string(ntohs(client_addr_.sin_port));
 
-        std::cout << "New connection #" << id_ << " from " << client_addr_str_ << std::endl;
+        AV_LOG_INFO("Connection", "New connection #{} from {}", id_, client_addr_str_);
+        flight_record(FlightEvent::CONNECTION_OPENED, id_);
+        IngestRecorder::instance().record(IngestRecordKind::OPEN, id_);
     }
 
     /**
@@ -135,6 +150,7 @@ public:
      */
     ~Connection() {
         close();
+        release_socket();
     }
 
     /**
@@ -198,6 +214,8 @@ public:
      *
      * @note 可以多次调用，后续调用无效果
      * @note 关闭后无法再收发消息
+     * @note 事件驱动模式下只shutdown套接字：事件循环中等待它的会话会被唤醒，
+     *       由会话在注销等待后调用release_socket()真正关闭，避免fd被复用后误唤醒
      */
     void close() {
         bool expected = true;
@@ -206,17 +224,82 @@ public:
             return;
         }
 
-        // 关闭套接字
+        if (event_driven_) {
+            if (socket_ != INVALID_SOCKET) {
+                ::shutdown(socket_, SHUT_RDWR);
+            }
+            AV_LOG_INFO("Connection", "Connection #{} from {} closed", id_, client_addr_str_);
+            return;
+        }
+
+        // 关闭套接字：先shutdown唤醒阻塞在send()上的发送线程，再持发送锁关闭，
+        // 保证不会有线程在fd被复用后继续往上面写
         if (socket_ != INVALID_SOCKET) {
+            ::shutdown(socket_, SHUT_RDWR);
+            std::lock_guard<std::mutex> lock(send_mutex_);
             ::closesocket(socket_);
             socket_ = INVALID_SOCKET;
+            note_socket_closed();
         }
 
         // 清空缓冲区
         recv_buffer_.clear();
 
-        std::cout << "Connection #" << id_ << " from " << client_addr_str_
-                  << " closed" << std::endl;
+        AV_LOG_INFO("Connection", "Connection #{} from {} closed", id_, client_addr_str_);
+    }
+
+    /**
+     * @brief 切换到事件驱动模式（套接字设为非阻塞，由事件循环中的会话管理）
+     *
+     * @note 必须在开始收发之前调用
+     */
+    void set_event_driven() {
+        event_driven_ = true;
+        if (socket_ != INVALID_SOCKET) {
+            int flags = ::fcntl(socket_, F_GETFL, 0);
+            ::fcntl(socket_, F_SETFL, flags | O_NONBLOCK);
+        }
+    }
+
+    bool is_event_driven() const {
+        return event_driven_;
+    }
+
+    /**
+     * @brief 关闭close()后保留的套接字（事件驱动模式由会话调用）
+     *
+     * @note 持发送锁关闭：扇出线程可能正在drain_locked()中写这个套接字
+     */
+    void release_socket() {
+        if (socket_ != INVALID_SOCKET && !connected_.load()) {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            ::closesocket(socket_);
+            socket_ = INVALID_SOCKET;
+            note_socket_closed();
+        }
+    }
+
+    /**
+     * @brief 设置发送被阻塞时的通知
+     *
+     * @param handler 非阻塞套接字写满（WOULD_BLOCK）时调用，
+     *                通常用于让事件循环等待可写后继续flush_send_queue()
+     *
+     * @note 可能在任意发送线程中调用，处理函数应当只投递任务
+     */
+    void set_send_blocked_handler(std::function<void()> handler) {
+        send_blocked_handler_ = std::move(handler);
+    }
+
+    /**
+     * @brief 设置消息完整写入套接字后的通知（发送统计按实际写出计数，而不是按入队计数）
+     *
+     * @param handler 参数为消息类型和线上字节数；在持有发送锁的发送线程中调用，只应更新计数
+     *
+     * @note 必须在连接开始发送之前设置（TcpServer在登记连接之前设置）
+     */
+    void set_message_sent_handler(std::function<void(MessageType, size_t)> handler) {
+        message_sent_handler_ = std::move(handler);
     }
 
     // ===== 消息接收 =====
@@ -254,12 +337,13 @@ public:
         }
 
         // 更新最后活动时间
-        last_activity_time_ = std::chrono::steady_clock::now();
+        last_activity_time_ = TimeService::instance().coarse_now();
+        IngestRecorder::instance().record(IngestRecordKind::DATA, id_, recv_buf, bytes_received);
 
         // 写入循环缓冲区
         size_t written = recv_buffer_.write(recv_buf, bytes_received);
         if (written != static_cast<size_t>(bytes_received)) {
-            std::cerr << "Warning: recv_buffer full, dropping data" << std::endl;
+            AV_LOG_WARN("Connection", "recv_buffer full on connection #{}, dropping data", id_);
         }
 
         // 尝试从缓冲区提取完整消息
@@ -270,6 +354,63 @@ public:
         return false;
     }
 
+    /**
+     * @enum ReceiveStatus
+     * @brief 非阻塞接收的结果
+     */
+    enum class ReceiveStatus {
+        MESSAGE,                // 取到一条完整消息
+        WOULD_BLOCK,            // 套接字暂无数据，需要等待可读
+        CLOSED,                 // 连接已断开
+    };
+
+    /**
+     * @brief 非阻塞接收：先从缓冲区取消息，不够时读套接字直到取到消息或没有数据
+     *
+     * @param[out] message 存储接收到的消息
+     * @return 接收结果
+     *
+     * @note 供事件驱动模式使用（套接字是非阻塞的）；线程池模型在设置了SO_RCVTIMEO的阻塞套接字上
+     *       使用，此时WOULD_BLOCK表示读取超时
+     */
+    ReceiveStatus poll_message(Message& message) {
+        while (true) {
+            if (try_extract_message(message)) {
+                return ReceiveStatus::MESSAGE;
+            }
+            if (!connected_.load()) {
+                return ReceiveStatus::CLOSED;
+            }
+
+            size_t space = recv_buffer_.available_space();
+            if (space == 0) {
+                // 缓冲区满却取不出消息：消息超过缓冲区大小，无法恢复
+                AV_LOG_WARN("Connection", "Receive buffer overflow on connection #{}", id_);
+                connected_ = false;
+                return ReceiveStatus::CLOSED;
+            }
+
+            uint8_t recv_buf[4096];
+            int bytes_received = ::recv(socket_, reinterpret_cast<char*>(recv_buf),
+                                       std::min(sizeof(recv_buf), space), 0);
+
+            if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return ReceiveStatus::WOULD_BLOCK;
+            }
+            if (bytes_received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes_received <= 0) {
+                connected_ = false;
+                return ReceiveStatus::CLOSED;
+            }
+
+            last_activity_time_ = TimeService::instance().coarse_now();
+            IngestRecorder::instance().record(IngestRecordKind::DATA, id_, recv_buf, bytes_received);
+            recv_buffer_.write(recv_buf, bytes_received);
+        }
+    }
+
     /**
      * @brief 接收消息（阻塞版本，带超时）
      *
@@ -303,48 +444,99 @@ public:
 
     // ===== 消息发送 =====
 
+    /**
+     * @enum SendStatus
+     * @brief 发送队列刷新的结果
+     */
+    enum class SendStatus {
+        DRAINED,                // 队列已全部写入套接字
+        BUSY,                   // 另一个线程正在刷新队列，消息会由它发送
+        WOULD_BLOCK,            // 非阻塞套接字暂时不可写，剩余数据保留在队列中
+        CLOSED,                 // 连接已断开
+    };
+
     /**
      * @brief 发送消息
      *
      * @param[in] message 要发送的消息
-     * @return true 如果消息成功发送
+     * @return true 如果消息已进入发送队列且连接仍然有效
      *
-     * @note 消息会被序列化并立即发送
+     * @note 消息按优先级排队：控制 > 音频 > 关键帧 > 非关键帧
+     * @note 如果没有其他线程正在发送，当前线程会负责刷新队列
      * @note 如果连接已断开，返回false
-     * @note 该函数是同步的，可能阻塞在发送操作上
      */
     bool send(const Message& message) {
-        if (!connected_.load()) {
+        return send_shared(std::make_shared<const Message>(message));
+    }
+
+    /**
+     * @brief 发送共享消息（扇出路径使用，避免为每个连接复制消息体）
+     *
+     * @param message 共享的只读消息
+     * @return true 如果消息已进入发送队列且连接仍然有效
+     */
+    bool send_shared(std::shared_ptr<const Message> message) {
+        if (!connected_.load() || !message) {
             return false;
         }
 
-        // 序列化消息为字节流
-        std::vector<uint8_t> bytes = message.to_bytes();
+        send_queue_.push(std::move(message));
+        SendStatus status = flush_send_queue();
+        if (status == SendStatus::WOULD_BLOCK && send_blocked_handler_) {
+            send_blocked_handler_();
+        }
+        return status != SendStatus::CLOSED;
+    }
 
-        // 发送数据
-        int total_sent = 0;
-        int remaining = bytes.size();
-        const uint8_t* data = bytes.data();
+    /**
+     * @brief 把发送队列写入套接字
+     *
+     * @return 刷新结果
+     *
+     * 工作方式：
+     * - 同一时刻只有一个线程持有发送锁并写套接字
+     * - 其他线程只入队后返回，拥塞时新到的高优先级消息会插到低优先级之前
+     * - 释放发送锁后再检查一次队列，避免消息滞留
+     */
+    SendStatus flush_send_queue() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(send_mutex_, std::try_to_lock);
+            if (!lock.owns_lock()) {
+                return SendStatus::BUSY;
+            }
 
-        while (remaining > 0) {
-            int sent = ::send(socket_, reinterpret_cast<const char*>(data + total_sent),
-                            remaining, 0);
+            SendStatus status = drain_locked();
+            lock.unlock();
 
-            if (sent <= 0) {
-                // 发送失败，连接可能断开
-                connected_ = false;
-                std::cerr << "Failed to send message on connection #" << id_ << std::endl;
-                return false;
+            if (status != SendStatus::DRAINED || send_queue_.empty()) {
+                return status;
             }
-
-            total_sent += sent;
-            remaining -= sent;
         }
+    }
 
-        // 更新最后活动时间
-        last_activity_time_ = std::chrono::steady_clock::now();
+    /**
+     * @brief 获取发送队列统计信息
+     *
+     * @return 发送队列统计
+     */
+    SendQueueStatistics get_send_queue_statistics() const {
+        return send_queue_.get_statistics();
+    }
 
-        return true;
+    /**
+     * @brief 设置该连接的延迟目标
+     *
+     * @param latency_target_ms 延迟目标（毫秒），视频帧截止时间 = PTS + 该值
+     */
+    void set_latency_target_ms(int latency_target_ms) {
+        send_queue_.set_latency_target_ms(latency_target_ms);
+    }
+
+    /**
+     * @brief 获取该连接的延迟目标（毫秒）
+     */
+    int get_latency_target_ms() const {
+        return send_queue_.get_latency_target_ms();
     }
 
     /**
@@ -391,7 +583,7 @@ public:
      * @return true 如果距离最后活动超过timeout_ms
      */
     bool is_timeout(int timeout_ms) const {
-        auto now = std::chrono::steady_clock::now();
+        auto now = TimeService::instance().coarse_now();
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
             now - last_activity_time_).count();
         return elapsed > timeout_ms;
@@ -407,6 +599,95 @@ public:
     }
 
 private:
+    /**
+     * @brief 持有发送锁时把队列中的消息依次写入套接字
+     *
+     * @return 刷新结果
+     *
+     * @note 未写完的消息保存在pending_bytes_中，下次刷新时继续
+     * @note 调用者必须持有send_mutex_
+     */
+    SendStatus drain_locked() {
+        while (connected_.load()) {
+            if (pending_offset_ >= pending_bytes_.size()) {
+                std::shared_ptr<const Message> next;
+                if (!send_queue_.pop(next)) {
+                    return SendStatus::DRAINED;
+                }
+                serialize_pending(*next);
+            }
+
+            while (pending_offset_ < pending_bytes_.size()) {
+                if (!connected_.load() || socket_ == INVALID_SOCKET) {
+                    return SendStatus::CLOSED;  // 写到一半时连接被关闭
+                }
+                bool first_write = pending_offset_ == 0;
+                int sent = ::send(socket_,
+                                  reinterpret_cast<const char*>(pending_bytes_.data() + pending_offset_),
+                                  pending_bytes_.size() - pending_offset_, 0);
+
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return SendStatus::WOULD_BLOCK;
+                }
+
+                if (sent <= 0) {
+                    // 发送失败，连接可能断开
+                    connected_ = false;
+                    AV_LOG_WARN("Connection", "Failed to send message on connection #{}", id_);
+                    return SendStatus::CLOSED;
+                }
+
+                if (first_write) {
+                    pending_stamps_.stamp(FrameStage::FIRST_BYTE_SENT);
+                }
+                pending_offset_ += sent;
+            }
+            flight_record(FlightEvent::FRAME_SENT, id_, static_cast<uint32_t>(pending_bytes_.size()));
+            if (message_sent_handler_) {
+                message_sent_handler_(pending_type_, pending_bytes_.size());
+            }
+
+            if (pending_stamps_.traced()) {
+                pending_stamps_.stamp(FrameStage::LAST_BYTE_SENT);
+                LatencyTracer::instance().record(pending_stamps_);
+                pending_stamps_.reset();
+            }
+
+            // 更新最后活动时间
+            last_activity_time_ = TimeService::instance().coarse_now();
+        }
+
+        return SendStatus::CLOSED;
+    }
+
+    /**
+     * @brief 套接字真正关闭时记录连接关闭（对端断开时close()不会执行到关闭套接字）
+     */
+    void note_socket_closed() {
+        flight_record(FlightEvent::CONNECTION_CLOSED, id_);
+        IngestRecorder::instance().record(IngestRecordKind::CLOSE, id_);
+    }
+
+    /**
+     * @brief 把消息序列化到复用的pending_bytes_缓冲区
+     *
+     * @param message 要序列化的消息
+     *
+     * @note 同时复制消息的阶段时间戳：共享消息扇出给多个连接，发送时间是每个连接各自的
+     */
+    void serialize_pending(const Message& message) {
+        size_t payload_size = message.get_payload_size();
+        pending_bytes_.resize(MessageHeader::HEADER_SIZE + payload_size);
+        message.get_header().serialize(pending_bytes_.data());
+        if (payload_size > 0 && message.get_payload()) {
+            std::memcpy(pending_bytes_.data() + MessageHeader::HEADER_SIZE,
+                        message.get_payload(), payload_size);
+        }
+        pending_offset_ = 0;
+        pending_type_ = message.get_type();
+        pending_stamps_ = message.get_meta().stamps;
+    }
+
     /**
      * @brief 尝试从接收缓冲区提取完整消息
      *
@@ -442,7 +723,7 @@ private:
 
         // 验证消息头
         if (!header.is_valid()) {
-            std::cerr << "Invalid message header on connection #" << id_ << std::endl;
+            AV_LOG_WARN("Connection", "Invalid message header on connection #{}", id_);
             // 清空缓冲区以恢复同步
             recv_buffer_.clear();
             return false;
@@ -459,15 +740,13 @@ private:
         std::vector<uint8_t> msg_data(total_needed);
         size_t read_size = recv_buffer_.read(msg_data.data(), total_needed);
         if (read_size != total_needed) {
-            std::cerr << "Failed to read complete message on connection #" << id_
-                     << std::endl;
+            AV_LOG_WARN("Connection", "Failed to read complete message on connection #{}", id_);
             return false;
         }
 
         // 反序列化消息
         if (!message.from_bytes(msg_data)) {
-            std::cerr << "Failed to deserialize message on connection #" << id_
-                     << std::endl;
+            AV_LOG_WARN("Connection", "Failed to deserialize message on connection #{}", id_);
             return false;
         }
 
@@ -490,6 +769,159 @@ private:
 
     // 时间管理
     std::chrono::steady_clock::time_point last_activity_time_;  // 最后活动时间
+
+    // 发送队列
+    PrioritySendQueue send_queue_;                  // 优先级发送队列
+    std::mutex send_mutex_;                         // 发送锁（同一时刻只有一个线程写套接字）
+    std::vector<uint8_t> pending_bytes_;            // 正在发送的消息字节（复用缓冲）
+    size_t pending_offset_;                         // pending_bytes_中已发送的字节数
+    FrameTimestamps pending_stamps_;                // 正在发送的消息的阶段时间戳（逐连接打发送时间）
+    MessageType pending_type_{MessageType::FRAME_DATA};  // 正在发送的消息的类型
+    std::function<void(MessageType, size_t)> message_sent_handler_;  // 消息写完后的通知（可为空）
+
+    // 事件驱动模式
+    bool event_driven_;                             // 是否由事件循环中的会话管理
+    std::function<void()> send_blocked_handler_;    // 发送被阻塞时的通知
+};
+
+#if AVSERVER_HAS_COROUTINES
+
+// ============================================================================
+// ======================== 协程化的连接接口 ==================================
+// ============================================================================
+
+/**
+ * @class AsyncConnection
+ * @brief 在事件循环上以协程方式收发消息
+ *
+ * 使用示例：
+ * @code
+ *   DetachedTask session(EventLoop& loop, std::shared_ptr<Connection> conn) {
+ *       AsyncConnection io(loop, conn);
+ *       while (auto msg = co_await io.read_message(15000)) {
+ *           if (msg->get_type() == MessageType::HEARTBEAT) {
+ *               co_await io.send(std::make_shared<const Message>(
+ *                   MessageType::HEARTBEAT_ACK, 0, ProtocolHelper::get_timestamp_ms()));
+ *           }
+ *       }
+ *       // io.last_result()区分超时（TIMEOUT）和断开（CLOSED）
+ *   }
+ * @endcode
+ *
+ * @note 连接必须已调用set_event_driven()
+ * @note 协程在事件循环线程中恢复执行
+ */
+class AsyncConnection {
+public:
+    AsyncConnection(EventLoop& loop, std::shared_ptr<Connection> connection)
+        : loop_(loop),
+          connection_(std::move(connection)),
+          last_result_(IoResult::READY) {
+    }
+
+    Connection& connection() {
+        return *connection_;
+    }
+
+    EventLoop& loop() {
+        return loop_;
+    }
+
+    /**
+     * @brief 上一次read_message/flush的结果（READY、TIMEOUT、CLOSED或ERROR）
+     */
+    IoResult last_result() const {
+        return last_result_;
+    }
+
+    /**
+     * @brief 读取一条完整消息
+     *
+     * @param timeout_ms 超时（毫秒，<0表示不超时）
+     * @return 消息；超时或断开时为空，原因见last_result()
+     */
+    CoTask<std::optional<Message>> read_message(int timeout_ms = -1) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        Message message;
+
+        while (true) {
+            auto status = connection_->poll_message(message);
+            if (status == Connection::ReceiveStatus::MESSAGE) {
+                last_result_ = IoResult::READY;
+                co_return message;
+            }
+            if (status == Connection::ReceiveStatus::CLOSED) {
+                last_result_ = IoResult::CLOSED;
+                co_return std::nullopt;
+            }
+
+            int wait_ms = -1;
+            if (timeout_ms >= 0) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                wait_ms = remaining > 0 ? static_cast<int>(remaining) : 0;
+            }
+
+            IoResult result = co_await wait_readable(loop_, connection_->get_socket(), wait_ms);
+            if (result != IoResult::READY) {
+                last_result_ = result;
+                co_return std::nullopt;
+            }
+        }
+    }
+
+    /**
+     * @brief 等待套接字可写
+     */
+    IoAwaitable writable(int timeout_ms = -1) {
+        return wait_writable(loop_, connection_->get_socket(), timeout_ms);
+    }
+
+    /**
+     * @brief 把发送队列全部写入套接字，写满时等待可写（发送背压）
+     *
+     * @return false 如果连接已断开
+     *
+     * @note 已有其他协程在等待可写时直接返回true，由它继续发送
+     */
+    CoTask<bool> flush() {
+        while (true) {
+            auto status = connection_->flush_send_queue();
+            if (status == Connection::SendStatus::CLOSED) {
+                last_result_ = IoResult::CLOSED;
+                co_return false;
+            }
+            if (status != Connection::SendStatus::WOULD_BLOCK) {
+                co_return true;
+            }
+
+            IoResult result = co_await writable();
+            if (result == IoResult::ERROR) {
+                co_return true;
+            }
+            if (result != IoResult::READY) {
+                last_result_ = result;
+                co_return false;
+            }
+        }
+    }
+
+    /**
+     * @brief 发送消息并等待它进入套接字
+     */
+    CoTask<bool> send(std::shared_ptr<const Message> message) {
+        if (!connection_->send_shared(std::move(message))) {
+            co_return false;
+        }
+        co_return co_await flush();
+    }
+
+private:
+    EventLoop& loop_;
+    std::shared_ptr<Connection> connection_;
+    IoResult last_result_;
 };
 
+#endif // AVSERVER_HAS_COROUTINES
+
 #endif // CONNECTION_H
@@ -43,6 +43,12 @@
 #include "AVServer_14_CompressionEngine.h"
 #include "AVServer_15_MediaProcessor.h"
 #include "AVServer_16_StreamingService.h"
+#include "AVServer_21_StageGraph.h"
+#include "AVServer_31_MetricsExporter.h"
+#include "AVServer_32_ShardedCounter.h"
+#include "AVServer_34_LockProfiler.h"
+#include "AVServer_36_FlightRecorder.h"
+#include "AVServer_37_IngestCapture.h"
 
 // ============================================================================
 // ======================== 服务器状态统计 =====================================
@@ -73,6 +79,7 @@ struct ServerStatistics {
     uint64_t video_frames_received;         // 接收的视频帧数
     uint64_t audio_frames_received;         // 接收的音频帧数
     uint64_t video_frames_sent;             // 发送的视频帧数
+    uint64_t video_frames_unrouted;         // 无法转发的视频帧数（没有simulcast帧头）
     uint64_t audio_frames_sent;             // 发送的音频帧数
 
     // 时间信息
@@ -91,6 +98,7 @@ struct ServerStatistics {
           video_frames_received(0),
           audio_frames_received(0),
           video_frames_sent(0),
+          video_frames_unrouted(0),
           audio_frames_sent(0),
           start_time(std::chrono::steady_clock::now()) {
     }
@@ -136,6 +144,7 @@ struct ServerStatistics {
         oss << "  Audio Received: " << audio_frames_received << std::endl;
         oss << "  Video Sent: " << video_frames_sent << std::endl;
         oss << "  Audio Sent: " << audio_frames_sent << std::endl;
+        oss << "  Video Unrouted: " << video_frames_unrouted << std::endl;
 
         // 计算吞吐量
         if (uptime > 0) {
@@ -202,15 +211,15 @@ public:
         : tcp_server_(config),
           frame_buffer_pool_(10, 1024 * 1024),  // 10个缓冲区，每个1MB
           running_(false),
-          stats_(),
-          video_capture_(nullptr),
-          audio_capture_(nullptr),
           capture_manager_(nullptr),
           compression_engine_(nullptr),
           media_processor_(nullptr),
+          stage_graph_(nullptr),
           streaming_service_(nullptr),
           distribution_thread_(),
-          stats_update_thread_() {
+          stats_update_thread_(),
+          metrics_server_(nullptr),
+          start_time_(std::chrono::steady_clock::now()) {
 
         // 注册TCP服务器的回调
         tcp_server_.set_on_client_connected(
@@ -227,6 +236,18 @@ public:
             [this](const std::shared_ptr<Connection>& conn) {
                 on_client_disconnected(conn);
             });
+
+        tcp_server_.set_on_message_sent(
+            [this](MessageType type, size_t bytes) {
+                on_message_sent(type, bytes);
+            });
+
+        tcp_server_.set_on_transport_sampled(
+            [this](const std::vector<TcpServer::TransportSample>& samples) {
+                if (streaming_service_) {
+                    streaming_service_->update_clients_transport(samples);
+                }
+            });
     }
 
     /**
@@ -246,36 +267,50 @@ public:
      * @note 启动流程：
      *       1. 初始化音视频捕获模块
      *       2. 初始化压缩引擎
-     *       3. 初始化媒体处理器
+     *       3. 初始化媒体处理器（或按pipeline_spec构建阶段图）
      *       4. 初始化流媒体服务
      *       5. 启动TCP服务器
-     *       6. 启动消息分发线程
-     *       7. 启动统计更新线程
+     *       6. 启动消息分发线程（或启动阶段图）
+     *       7. 启动统计更新线程（配置了metrics_port时同时启动指标导出）
      */
     bool start() {
         if (running_.load()) {
             return true;
         }
+        const ServerConfig& server_config = tcp_server_.get_config();
+
+        // 事件环容量在线程第一次记录时确定，必须在任何组件线程启动前配置
+        FlightRecorder& recorder = FlightRecorder::instance();
+        recorder.set_enabled(server_config.flight_recorder);
+        recorder.set_events_per_thread(server_config.flight_recorder_events);
+        recorder.set_dump_target(server_config.flight_recorder_path, server_config.flight_recorder_window_ms);
+        LatencyTracer::instance().set_stream_limit(server_config.metrics_label_limit);
 
         // ===== 1. 初始化音视频捕获 =====
         std::cout << "[AVServer] Initializing capture modules..." << std::endl;
 
-        video_capture_ = std::make_unique<VideoCapture>(
-            1920, 1080,         // 分辨率
-            30,                 // 帧率
-            15000000            // 比特率 (15Mbps)
-        );
-
-        audio_capture_ = std::make_unique<AudioCapture>(
-            48000,              // 采样率
-            2,                  // 通道数
-            128000              // 比特率 (128kbps)
-        );
-
-        capture_manager_ = std::make_unique<CaptureManager>(
-            video_capture_.get(),
-            audio_capture_.get()
-        );
+        // 捕获对象由CaptureManager在start()时按配置创建
+        VideoCaptureConfig video_config;
+        video_config.width = 1920;              // 分辨率
+        video_config.height = 1080;
+        video_config.framerate = 30;            // 帧率
+        video_config.bitrate = 15000000;        // 比特率 (15Mbps)
+
+        AudioCaptureConfig audio_config;
+        audio_config.sample_rate = 48000;       // 采样率
+        audio_config.channels = 2;              // 通道数
+        audio_config.bitrate = 128000;          // 比特率 (128kbps)
+
+        capture_manager_ = std::make_unique<CaptureManager>();
+        capture_manager_->set_video_config(video_config);
+        capture_manager_->set_audio_config(audio_config);
+
+        // 捕获、编码、发送线程和帧缓冲池放在同一NUMA节点上
+        const int numa_node = tcp_server_.get_config().numa_node;
+        if (numa_node >= 0) {
+            std::cout << "[AVServer] " << NumaTopology::instance().to_string() << std::endl;
+            capture_manager_->set_numa_node(numa_node);
+        }
 
         // 启动捕获
         if (!capture_manager_->start()) {
@@ -302,16 +337,40 @@ public:
         }
 
         // ===== 3. 初始化媒体处理器 =====
-        std::cout << "[AVServer] Initializing media processor..." << std::endl;
+        const std::string& pipeline_spec = tcp_server_.get_config().pipeline_spec;
 
-        media_processor_ = std::make_unique<MediaProcessor>(
-            capture_manager_.get(),
-            compression_engine_.get()
-        );
+        if (pipeline_spec.empty()) {
+            std::cout << "[AVServer] Initializing media processor..." << std::endl;
 
-        if (!media_processor_->start()) {
-            std::cerr << "[AVServer] Failed to start media processor" << std::endl;
-            return false;
+            MediaProcessorConfig processor_config;
+            processor_config.numa_node = numa_node;
+
+            media_processor_ = std::make_unique<MediaProcessor>(
+                capture_manager_.get(),
+                compression_engine_.get(),
+                processor_config
+            );
+
+            if (!media_processor_->start()) {
+                std::cerr << "[AVServer] Failed to start media processor" << std::endl;
+                return false;
+            }
+        } else {
+            std::cout << "[AVServer] Building media pipeline stage graph..." << std::endl;
+
+            PipelineResources resources;
+            resources.capture = capture_manager_.get();
+            resources.engine = compression_engine_.get();
+            resources.numa_node = numa_node;
+            resources.fanout = [this](const MediaMessagePtr& frame) {
+                broadcast_frame(frame);
+            };
+
+            stage_graph_ = std::make_unique<StageGraph>(resources);
+            if (!stage_graph_->build(pipeline_spec)) {
+                std::cerr << "[AVServer] Failed to build media pipeline" << std::endl;
+                return false;
+            }
         }
 
         // ===== 4. 初始化流媒体服务 =====
@@ -328,17 +387,35 @@ public:
 
         // ===== 5. 启动TCP服务器 =====
         std::cout << "[AVServer] Starting TCP server..." << std::endl;
+        // 录制在接受连接之前开始，每个连接都有OPEN记录
+        if (!server_config.ingest_capture_path.empty()) {
+            IngestRecorder::instance().start(server_config.ingest_capture_path);
+        }
         if (!tcp_server_.start()) {
             std::cerr << "[AVServer] Failed to start TCP server" << std::endl;
             return false;
         }
 
         // ===== 6. 启动消息分发线程 =====
-        std::cout << "[AVServer] Starting message distribution thread..." << std::endl;
-        distribution_thread_ = std::thread(&AVServer::distribution_loop, this);
+        if (stage_graph_) {
+            // 阶段图的fanout阶段直接分发，不需要分发线程
+            std::cout << "[AVServer] Starting media pipeline..." << std::endl;
+            stage_graph_->start();
+        } else {
+            std::cout << "[AVServer] Starting message distribution thread..." << std::endl;
+            distribution_thread_ = std::thread(&AVServer::distribution_loop, this);
+        }
 
-        // ===== 7. 启动统计更新线程 =====
+        // ===== 7. 启动统计更新线程和指标导出 =====
         std::cout << "[AVServer] Starting statistics update thread..." << std::endl;
+        if (server_config.metrics_port != 0) {
+            metrics_server_ = std::make_unique<MetricsHttpServer>(
+                server_config.metrics_addr, server_config.metrics_port);
+            if (!metrics_server_->start()) {
+                std::cerr << "[AVServer] Metrics endpoint disabled" << std::endl;
+                metrics_server_.reset();
+            }
+        }
         stats_update_thread_ = std::thread(&AVServer::stats_update_loop, this);
 
         running_ = true;
@@ -350,7 +427,7 @@ public:
      * @brief 停止服务器
      *
      * 停止步骤：
-     * 1. 停止消息分发线程
+     * 1. 停止消息分发线程和阶段图
      * 2. 停止统计更新线程
      * 3. 停止流媒体服务
      * 4. 停止媒体处理器
@@ -377,12 +454,19 @@ public:
         if (distribution_thread_.joinable()) {
             distribution_thread_.join();
         }
+        if (stage_graph_) {
+            stage_graph_->stop();
+        }
 
         // ===== 2. 停止统计线程 =====
         std::cout << "[AVServer] Stopping statistics thread..." << std::endl;
         if (stats_update_thread_.joinable()) {
             stats_update_thread_.join();
         }
+        if (metrics_server_) {
+            metrics_server_->stop();
+            metrics_server_.reset();
+        }
 
         // ===== 3. 停止流媒体服务 =====
         std::cout << "[AVServer] Stopping streaming service..." << std::endl;
@@ -416,9 +500,15 @@ public:
         std::cout << "[AVServer] Stopping TCP server..." << std::endl;
         tcp_server_.stop();
 
+        // 连接都已关闭，写入录制文件的索引（没有录制时无效果）
+        IngestRecorder::instance().stop();
+
         // ===== 8. 清空帧缓冲池 =====
         frame_buffer_pool_.clear();
 
+        // 等待异步日志写完，避免与下面的统计输出交错
+        AsyncLogger::instance().flush();
+
         // ===== 9. 输出最终统计信息 =====
         std::cout << "\n[AVServer] Final Statistics:" << std::endl;
         print_comprehensive_statistics();
@@ -441,12 +531,35 @@ public:
      * @return 服务器统计信息
      */
     ServerStatistics get_statistics() const {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        ServerStatistics stats = stats_;
+        std::array<uint64_t, SERVER_COUNTER_COUNT> totals = counters_.sum_all();
+
+        ServerStatistics stats;
+        stats.start_time = start_time_;
+        stats.total_connections = totals[COUNTER_CONNECTIONS];
         stats.current_connections = tcp_server_.get_connection_count();
+        stats.total_messages_received = totals[COUNTER_MESSAGES_RECEIVED];
+        stats.total_messages_sent = totals[COUNTER_MESSAGES_SENT];
+        stats.total_bytes_received = totals[COUNTER_BYTES_RECEIVED];
+        stats.total_bytes_sent = totals[COUNTER_BYTES_SENT];
+        stats.video_frames_received = totals[COUNTER_VIDEO_RECEIVED];
+        stats.audio_frames_received = totals[COUNTER_AUDIO_RECEIVED];
+        stats.video_frames_sent = totals[COUNTER_VIDEO_SENT];
+        stats.audio_frames_sent = totals[COUNTER_AUDIO_SENT];
+        stats.video_frames_unrouted = totals[COUNTER_VIDEO_UNROUTED];
         return stats;
     }
 
+    /**
+     * @brief 获取统计线程最近一次发布的统计快照
+     *
+     * @return 一致的统计快照（最多滞后一个统计周期）
+     *
+     * @note 不遍历计数分片，适合高频读取（监控、指标导出）
+     */
+    ServerStatistics get_published_statistics() const {
+        return published_stats_.load();
+    }
+
     /**
      * @brief 输出统计信息
      *
@@ -465,6 +578,8 @@ public:
      * - 压缩引擎统计信息
      * - 媒体处理器统计信息
      * - 流媒体服务统计信息
+     * - 各流的帧延迟分段（见LatencyTrace.h）
+     * - 竞争最严重的锁（AVSERVER_LOCK_PROFILING编译时，见LockProfiler.h）
      *
      * @note 输出到标准输出
      */
@@ -489,11 +604,294 @@ public:
             media_processor_->print_statistics();
         }
 
+        if (stage_graph_) {
+            std::cout << "\n[AVServer] ===== 管道阶段统计 =====" << std::endl;
+            stage_graph_->print_metrics();
+        }
+
         if (streaming_service_) {
             std::cout << "\n[AVServer] ===== 流媒体统计 =====" << std::endl;
             streaming_service_->print_statistics();
             streaming_service_->print_clients_info();
         }
+
+        if (tcp_server_.get_config().busy_poll_us > 0) {
+            std::cout << "\n[AVServer] ===== 事件循环忙轮询 =====" << std::endl;
+            std::cout << tcp_server_.get_reactor_spin_statistics().to_string() << std::endl;
+        }
+
+        std::cout << "\n[AVServer] ===== 帧延迟分段 =====" << std::endl;
+        std::cout << LatencyTracer::instance().get_statistics().to_string() << std::endl;
+
+#if AVSERVER_LOCK_PROFILING
+        std::cout << "\n[AVServer] ===== 锁竞争 =====" << std::endl;
+        std::cout << LockProfiler::instance().get_statistics(LockProfiler::REPORT_SITES).to_string()
+                  << std::endl;
+#endif
+
+        if (NumaTopology::instance().is_numa()) {
+            std::cout << "\n[AVServer] ===== NUMA统计 =====" << std::endl;
+            std::cout << NumaAccessCounter::instance().get_statistics().to_string() << std::endl;
+        }
+    }
+
+    /**
+     * @brief 把所有模块的统计渲染为Prometheus文本格式
+     *
+     * @return 指标页面
+     *
+     * @note 由统计线程周期调用并发布给MetricsHttpServer，抓取请求不会调用它
+     * @note 按客户端和按流展开的指标最多输出metrics_label_limit组，其余合并为"other"
+     */
+    std::string render_metrics() const {
+        PrometheusWriter w;
+        const size_t label_limit = tcp_server_.get_config().metrics_label_limit;
+
+        // ===== 服务器 =====
+        ServerStatistics server = get_published_statistics();
+        w.family("avserver_uptime_seconds", "gauge", "Seconds since the server started");
+        w.sample("avserver_uptime_seconds", server.get_uptime_seconds());
+        w.family("avserver_connections", "gauge", "Currently open client connections");
+        w.sample("avserver_connections", server.current_connections);
+        w.family("avserver_connections_total", "counter", "Client connections accepted");
+        w.sample("avserver_connections_total", server.total_connections);
+        w.family("avserver_messages_received_total", "counter", "Messages received from clients");
+        w.sample("avserver_messages_received_total", server.total_messages_received);
+        w.family("avserver_messages_sent_total", "counter", "Messages sent to clients");
+        w.sample("avserver_messages_sent_total", server.total_messages_sent);
+        w.family("avserver_bytes_received_total", "counter", "Bytes received from clients");
+        w.sample("avserver_bytes_received_total", server.total_bytes_received);
+        w.family("avserver_bytes_sent_total", "counter", "Bytes sent to clients");
+        w.sample("avserver_bytes_sent_total", server.total_bytes_sent);
+        w.family("avserver_frames_received_total", "counter", "Media frames received from publishers");
+        w.sample("avserver_frames_received_total", server.video_frames_received, "kind=\"video\"");
+        w.sample("avserver_frames_received_total", server.audio_frames_received, "kind=\"audio\"");
+        w.family("avserver_frames_sent_total", "counter", "Media frames sent to subscribers");
+        w.sample("avserver_frames_sent_total", server.video_frames_sent, "kind=\"video\"");
+        w.sample("avserver_frames_sent_total", server.audio_frames_sent, "kind=\"audio\"");
+        w.family("avserver_frames_unrouted_total", "counter", "Publisher frames dropped without a simulcast header");
+        w.sample("avserver_frames_unrouted_total", server.video_frames_unrouted, "kind=\"video\"");
+
+        // ===== 采集 =====
+        if (capture_manager_) {
+            CaptureStatistics capture = capture_manager_->get_statistics();
+            w.family("avserver_capture_frames_total", "counter", "Frames captured from local devices");
+            w.sample("avserver_capture_frames_total", capture.video_frames_captured, "kind=\"video\"");
+            w.sample("avserver_capture_frames_total", capture.audio_frames_captured, "kind=\"audio\"");
+            w.family("avserver_capture_dropped_total", "counter", "Captured frames dropped before encoding");
+            w.sample("avserver_capture_dropped_total", capture.video_frames_dropped, "kind=\"video\"");
+            w.sample("avserver_capture_dropped_total", capture.audio_frames_dropped, "kind=\"audio\"");
+        }
+
+        // ===== 编码 =====
+        if (compression_engine_) {
+            EncodingStatistics encoding = compression_engine_->get_statistics();
+            w.family("avserver_encoder_frames_total", "counter", "Frames handed to the encoder");
+            w.sample("avserver_encoder_frames_total", encoding.total_frames_processed);
+            w.family("avserver_encoder_failures_total", "counter", "Frames the encoder failed to encode");
+            w.sample("avserver_encoder_failures_total", encoding.failed_encodings);
+            w.family("avserver_encoder_input_bytes_total", "counter", "Raw bytes fed to the encoder");
+            w.sample("avserver_encoder_input_bytes_total", encoding.total_input_bytes);
+            w.family("avserver_encoder_output_bytes_total", "counter", "Encoded bytes produced");
+            w.sample("avserver_encoder_output_bytes_total", encoding.total_output_bytes);
+            w.family("avserver_encoder_time_avg_ms", "gauge", "Average encode time per frame");
+            w.sample("avserver_encoder_time_avg_ms", encoding.average_encoding_time_ms);
+            w.family("avserver_encoder_bitrate_bps", "gauge", "Current encoder bitrate");
+            w.sample("avserver_encoder_bitrate_bps", static_cast<uint64_t>(encoding.current_bitrate));
+        }
+
+        // ===== 媒体处理 =====
+        if (media_processor_) {
+            ProcessingStatistics processing = media_processor_->get_statistics();
+            w.family("avserver_processor_frames_total", "counter", "Frames encoded and queued for fanout");
+            w.sample("avserver_processor_frames_total", processing.total_video_frames, "kind=\"video\"");
+            w.sample("avserver_processor_frames_total", processing.total_audio_frames, "kind=\"audio\"");
+            w.family("avserver_processor_queue_depth", "gauge", "Messages waiting in the fanout queues");
+            w.sample("avserver_processor_queue_depth",
+                     static_cast<uint64_t>(processing.current_output_queue_size));
+            w.family("avserver_processor_queue_age_ms", "gauge", "Age of the oldest queued message");
+            w.sample("avserver_processor_queue_age_ms", processing.output_queue_duration_ms);
+            w.family("avserver_processor_shed_total", "counter", "Frames shed under overload");
+            w.sample("avserver_processor_shed_total", processing.shed_b_frames, "reason=\"b_frame\"");
+            w.sample("avserver_processor_shed_total", processing.shed_p_frames, "reason=\"p_frame\"");
+            w.sample("avserver_processor_shed_total", processing.shed_dependent_frames, "reason=\"dependent\"");
+            w.family("avserver_processor_rejected_total", "counter", "Messages rejected at the hard queue limit");
+            w.sample("avserver_processor_rejected_total", processing.rejected_messages);
+            w.family("avserver_processor_bitrate_reductions_total", "counter", "Bitrate reductions caused by overload");
+            w.sample("avserver_processor_bitrate_reductions_total", processing.bitrate_reductions);
+        }
+
+        // ===== 阶段图 =====
+        if (stage_graph_) {
+            std::vector<StageMetrics> stages = stage_graph_->get_metrics();
+            w.family("avserver_stage_items_total", "counter", "Items processed by each pipeline stage");
+            for (const auto& stage : stages) {
+                w.sample("avserver_stage_items_total", stage.items_processed,
+                         PrometheusWriter::label("stage", stage.name));
+            }
+            w.family("avserver_stage_dropped_total", "counter", "Items dropped because the downstream channel was full");
+            for (const auto& stage : stages) {
+                w.sample("avserver_stage_dropped_total", stage.items_dropped,
+                         PrometheusWriter::label("stage", stage.name));
+            }
+            w.family("avserver_stage_queue_depth", "gauge", "Items waiting in each stage input channel");
+            for (const auto& stage : stages) {
+                w.sample("avserver_stage_queue_depth", static_cast<uint64_t>(stage.queue_depth),
+                         PrometheusWriter::label("stage", stage.name));
+            }
+            w.family("avserver_stage_utilization", "gauge", "Fraction of stage run time spent in the kernel");
+            for (const auto& stage : stages) {
+                w.sample("avserver_stage_utilization", stage.utilization,
+                         PrometheusWriter::label("stage", stage.name));
+            }
+        }
+
+        // ===== 流媒体与按客户端指标 =====
+        if (streaming_service_) {
+            StreamingStatistics streaming = streaming_service_->get_statistics();
+            w.family("avserver_streaming_clients", "gauge", "Active streaming sessions");
+            w.sample("avserver_streaming_clients", static_cast<uint64_t>(streaming.current_active_clients));
+            w.family("avserver_streaming_clients_total", "counter", "Streaming sessions created");
+            w.sample("avserver_streaming_clients_total", streaming.total_clients_connected);
+
+            struct ClientRow {
+                std::string label;
+                uint64_t bytes_sent = 0;
+                uint64_t messages_sent = 0;
+                uint64_t frames_expired = 0;
+                uint64_t frames_gop_dropped = 0;
+                uint64_t queue_depth = 0;
+                TcpTransportInfo transport;
+            };
+            std::vector<ClientRow> rows;
+            ClientRow other;
+            other.label = PrometheusWriter::label("client", "other");
+            bool folded = false;
+
+            for (const auto& [client_id, session] : streaming_service_->get_all_clients()) {
+                ClientRow row;
+                auto conn = tcp_server_.get_connection(client_id);
+                row.bytes_sent = session.bytes_sent;
+                row.messages_sent = session.messages_sent;
+                row.frames_expired = session.frames_expired;
+                row.frames_gop_dropped = session.frames_gop_dropped;
+                row.queue_depth = conn ? conn->get_send_queue_statistics().current_depth : 0;
+                row.transport = session.transport;
+
+                if (rows.size() < label_limit) {
+                    row.label = PrometheusWriter::label("client", std::to_string(client_id));
+                    rows.push_back(std::move(row));
+                } else {
+                    other.bytes_sent += row.bytes_sent;
+                    other.messages_sent += row.messages_sent;
+                    other.frames_expired += row.frames_expired;
+                    other.frames_gop_dropped += row.frames_gop_dropped;
+                    other.queue_depth += row.queue_depth;
+                    folded = true;
+                }
+            }
+            if (folded) {
+                rows.push_back(std::move(other));
+            }
+
+            w.family("avserver_client_bytes_sent_total", "counter", "Bytes sent to each client");
+            for (const auto& row : rows) {
+                w.sample("avserver_client_bytes_sent_total", row.bytes_sent, row.label);
+            }
+            w.family("avserver_client_messages_sent_total", "counter", "Messages sent to each client");
+            for (const auto& row : rows) {
+                w.sample("avserver_client_messages_sent_total", row.messages_sent, row.label);
+            }
+            w.family("avserver_client_frames_expired_total", "counter", "Frames dropped past their deadline");
+            for (const auto& row : rows) {
+                w.sample("avserver_client_frames_expired_total", row.frames_expired, row.label);
+            }
+            w.family("avserver_client_frames_gop_dropped_total", "counter", "Frames dropped with their reference frame");
+            for (const auto& row : rows) {
+                w.sample("avserver_client_frames_gop_dropped_total", row.frames_gop_dropped, row.label);
+            }
+            w.family("avserver_client_send_queue_depth", "gauge", "Messages waiting in each client send queue");
+            for (const auto& row : rows) {
+                w.sample("avserver_client_send_queue_depth", row.queue_depth, row.label);
+            }
+
+            // 传输层状态不能相加，合并的"other"行不输出
+            struct TransportGauge {
+                const char* name;
+                const char* type;
+                const char* help;
+                double (*value)(const TcpTransportInfo&);
+            };
+            static const TransportGauge transport_gauges[] = {
+                {"avserver_client_tcp_srtt_seconds", "gauge", "Smoothed TCP round-trip time",
+                 [](const TcpTransportInfo& t) { return t.srtt_us / 1e6; }},
+                {"avserver_client_tcp_rttvar_seconds", "gauge", "TCP round-trip time variance",
+                 [](const TcpTransportInfo& t) { return t.rttvar_us / 1e6; }},
+                {"avserver_client_tcp_cwnd_segments", "gauge", "TCP congestion window",
+                 [](const TcpTransportInfo& t) { return static_cast<double>(t.cwnd_segments); }},
+                {"avserver_client_tcp_delivery_rate_bps", "gauge", "Most recent TCP delivery rate",
+                 [](const TcpTransportInfo& t) { return static_cast<double>(t.delivery_rate_bps); }},
+                {"avserver_client_tcp_retransmits_total", "counter", "TCP segments retransmitted",
+                 [](const TcpTransportInfo& t) { return static_cast<double>(t.total_retransmits); }},
+                {"avserver_client_tcp_unacked_segments", "gauge", "TCP segments sent but not acknowledged",
+                 [](const TcpTransportInfo& t) { return static_cast<double>(t.unacked_segments); }},
+                {"avserver_client_tcp_notsent_bytes", "gauge", "Bytes in the socket buffer not yet sent",
+                 [](const TcpTransportInfo& t) { return static_cast<double>(t.notsent_bytes); }},
+            };
+            for (const auto& gauge : transport_gauges) {
+                w.family(gauge.name, gauge.type, gauge.help);
+                for (const auto& row : rows) {
+                    if (row.transport.valid()) {
+                        w.sample(gauge.name, gauge.value(row.transport), row.label);
+                    }
+                }
+            }
+        }
+
+        // ===== 帧延迟分段 =====
+        LatencyTraceStatistics latency = LatencyTracer::instance().get_statistics();
+        w.family("avserver_frame_latency_seconds", "histogram", "Per-stage frame latency");
+        for (const auto& stream : latency.streams) {  // 流数已由LatencyTracer按label_limit合并
+            for (int s = 0; s < LATENCY_SEGMENT_COUNT; ++s) {
+                if (stream.segments[s].count == 0) {
+                    continue;
+                }
+                w.histogram("avserver_frame_latency_seconds", stream.segments[s],
+                            PrometheusWriter::label("stream", stream.name) + "," +
+                            PrometheusWriter::label("segment", latency_segment_name(s)));
+            }
+        }
+
+#if AVSERVER_LOCK_PROFILING
+        // ===== 锁竞争 =====
+        LockContentionStatistics locks = LockProfiler::instance().get_statistics(label_limit);
+        w.family("avserver_lock_acquisitions_total", "counter", "Mutex acquisitions per lock site");
+        for (const auto& site : locks.sites) {
+            w.sample("avserver_lock_acquisitions_total", site.acquisitions,
+                     PrometheusWriter::label("site", site.name));
+        }
+        w.family("avserver_lock_contended_total", "counter", "Mutex acquisitions that had to wait");
+        for (const auto& site : locks.sites) {
+            w.sample("avserver_lock_contended_total", site.contended,
+                     PrometheusWriter::label("site", site.name));
+        }
+        w.family("avserver_lock_wait_seconds", "histogram", "Time spent waiting for a contended mutex");
+        for (const auto& site : locks.sites) {
+            w.histogram("avserver_lock_wait_seconds", site.wait, PrometheusWriter::label("site", site.name));
+        }
+        w.family("avserver_lock_hold_seconds", "histogram", "Time a mutex was held per acquisition");
+        for (const auto& site : locks.sites) {
+            w.histogram("avserver_lock_hold_seconds", site.hold, PrometheusWriter::label("site", site.name));
+        }
+#endif
+
+        w.family("avserver_flight_recorder_events_total", "counter", "Pipeline events recorded by the flight recorder");
+        w.sample("avserver_flight_recorder_events_total", FlightRecorder::instance().get_recorded_count());
+
+        w.family("avserver_metrics_render_timestamp_ms", "gauge", "Wall clock time this page was rendered");
+        w.sample("avserver_metrics_render_timestamp_ms",
+                 static_cast<uint64_t>(TimeService::instance().wall_now_ms()));
+        return w.take();
     }
 
     /**
@@ -516,6 +914,20 @@ public:
         return tcp_server_.get_config();
     }
 
+    /**
+     * @brief 导出飞行记录仪中最近flight_recorder_window_ms毫秒的事件
+     *
+     * @param path 输出文件（空表示flight_recorder_path）
+     * @return 写出的事件数；写出失败时返回-1
+     *
+     * @note 输出Chrome trace JSON，可在chrome://tracing或ui.perfetto.dev中打开
+     */
+    long dump_flight_trace(const std::string& path) const {
+        const ServerConfig& config = tcp_server_.get_config();
+        return FlightRecorder::instance().dump_chrome_trace(
+            path.empty() ? config.flight_recorder_path : path, config.flight_recorder_window_ms);
+    }
+
     /**
      * @brief 获取帧缓冲池
      *
@@ -532,16 +944,10 @@ public:
      *
      * @param[in] message 要发送的消息
      *
-     * @note 向所有活跃连接发送相同的消息
+     * @note 向所有活跃连接发送相同的消息；发送统计在消息写出时累加（见on_message_sent）
      */
     void broadcast(const Message& message) {
         tcp_server_.broadcast(message);
-
-        // 更新发送统计
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        stats_.total_messages_sent++;
-        auto bytes = message.to_bytes();
-        stats_.total_bytes_sent += bytes.size();
     }
 
     /**
@@ -557,15 +963,29 @@ public:
             return false;
         }
 
-        bool success = conn->send(message);
-        if (success) {
-            std::lock_guard<std::mutex> lock(stats_mutex_);
-            stats_.total_messages_sent++;
-            auto bytes = message.to_bytes();
-            stats_.total_bytes_sent += bytes.size();
+        return conn->send(message);
+    }
+
+    /**
+     * @brief 设置客户端的延迟目标
+     *
+     * @param connection_id 客户端连接ID
+     * @param latency_target_ms 延迟目标（毫秒）
+     * @return true 如果客户端存在
+     *
+     * @note 之后发往该客户端的视频帧在PTS + 延迟目标之后仍未发出就会被丢弃
+     */
+    bool set_client_latency_target(uint32_t connection_id, int latency_target_ms) {
+        auto conn = tcp_server_.get_connection(connection_id);
+        if (!conn) {
+            return false;
         }
 
-        return success;
+        conn->set_latency_target_ms(latency_target_ms);
+        if (streaming_service_) {
+            streaming_service_->set_client_latency_target(connection_id, latency_target_ms);
+        }
+        return true;
     }
 
 private:
@@ -582,20 +1002,21 @@ private:
      *       3. 发送欢迎消息
      */
     void on_client_connected(const std::shared_ptr<Connection>& connection) {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        stats_.total_connections++;
+        counters_.add(COUNTER_CONNECTIONS);
 
-        std::cout << "[AVServer] Client connected: " << connection->get_addr()
-                  << " (ID: " << connection->get_id() << ")" << std::endl;
+        AV_LOG_INFO("AVServer", "Client connected: {} (ID: {})", connection->get_addr(), connection->get_id());
 
         // 在流媒体服务中注册客户端（用于接收压缩的流媒体数据）
         if (streaming_service_) {
             streaming_service_->register_client(
                 connection->get_id(),
                 connection->get_addr(),
-                5000000  // 默认码率限制：5Mbps
+                5000000,  // 默认码率限制：5Mbps
+                connection
             );
-            std::cout << "[AVServer] Client registered with streaming service" << std::endl;
+            streaming_service_->set_client_latency_target(
+                connection->get_id(), connection->get_latency_target_ms());
+            AV_LOG_DEBUG("AVServer", "Client {} registered with streaming service", connection->get_id());
         }
 
         // 发送欢迎消息
@@ -615,13 +1036,8 @@ private:
     void on_message_received(const std::shared_ptr<Connection>& connection,
                             const Message& message) {
         // 更新接收统计
-        {
-            std::lock_guard<std::mutex> lock(stats_mutex_);
-            stats_.total_messages_received++;
-
-            auto bytes = message.to_bytes();
-            stats_.total_bytes_received += bytes.size();
-        }
+        counters_.add(COUNTER_MESSAGES_RECEIVED);
+        counters_.add(COUNTER_BYTES_RECEIVED, message.total_size());
 
         // 根据消息类型处理
         MessageType msg_type = message.get_type();
@@ -652,8 +1068,8 @@ private:
                 break;
 
             default:
-                std::cout << "Unknown message type: "
-                         << ProtocolHelper::message_type_to_string(msg_type) << std::endl;
+                AV_LOG_WARN("AVServer", "Unknown message type: {}",
+                            ProtocolHelper::message_type_to_string(msg_type));
                 break;
         }
     }
@@ -669,14 +1085,31 @@ private:
      *       2. 输出连接关闭信息
      */
     void on_client_disconnected(const std::shared_ptr<Connection>& connection) {
-        std::cout << "[AVServer] Client disconnected: " << connection->get_addr()
-                  << " (ID: " << connection->get_id() << ")" << std::endl;
+        AV_LOG_INFO("AVServer", "Client disconnected: {} (ID: {})", connection->get_addr(), connection->get_id());
 
         // 从流媒体服务中注销客户端
         if (streaming_service_) {
             streaming_service_->unregister_client(connection->get_id());
-            std::cout << "[AVServer] Client unregistered from streaming service" << std::endl;
+            AV_LOG_DEBUG("AVServer", "Client {} unregistered from streaming service", connection->get_id());
+        }
+    }
+
+    /**
+     * @brief 消息完整写入套接字后的回调，累加发送统计
+     *
+     * @param type 消息类型
+     * @param bytes 写入的字节数（含消息头）
+     *
+     * @note 在发送线程中、持有连接发送锁时调用；入队后被丢弃或因断开未发出的消息不计入
+     */
+    void on_message_sent(MessageType type, size_t bytes) {
+        if (type == MessageType::VIDEO_FRAME) {
+            counters_.add(COUNTER_VIDEO_SENT);
+        } else if (type == MessageType::AUDIO_FRAME) {
+            counters_.add(COUNTER_AUDIO_SENT);
         }
+        counters_.add(COUNTER_MESSAGES_SENT);
+        counters_.add(COUNTER_BYTES_SENT, bytes);
     }
 
     /**
@@ -687,15 +1120,44 @@ private:
      */
     void handle_video_frame(const std::shared_ptr<Connection>& connection,
                            const Message& message) {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        stats_.video_frames_received++;
+        counters_.add(COUNTER_VIDEO_RECEIVED);
+
+        if (!streaming_service_) {
+            return;
+        }
+
+        // 转发的帧以服务器收到的时刻作为CAPTURE，流ID在解析帧头后填入
+        FrameTimestamps stamps;
+        stamps.begin(0);
+
+        // Simulcast层帧：选择性转发给当前选中该层的订阅者
+        // 没人选中的层直接丢弃，不做任何复制
+        // 服务器不解码发布端的码流，没有simulcast帧头的帧无法选择接收者，计数后丢弃
+        SimulcastRoute route;
+        if (!streaming_service_->route_simulcast_frame(message, connection->get_id(), route)) {
+            counters_.add(COUNTER_VIDEO_UNROUTED);
+            AV_LOG_DEBUG("AVServer", "Dropped video frame without simulcast header from client {} ({} bytes)",
+                         connection->get_id(), message.get_payload_size());
+            return;
+        }
+
+        if (route.targets.empty()) {
+            return;
+        }
 
-        // TODO: 实现视频帧处理逻辑
-        // 可能的操作：
-        // 1. 获取帧缓冲
-        // 2. 复制消息数据到帧缓冲
-        // 3. 进行编解码处理
-        // 4. 转发给其他客户端或保存
+        // 所有目标共享同一份消息，帧类型用于各连接发送队列的优先级排序
+        auto shared = std::make_shared<Message>(message);
+        shared->set_frame_type(static_cast<FrameType>(route.header.frame_type));
+        stamps.stream = route.header.stream_id;
+        shared->set_stamps(stamps);
+        shared->stamp(FrameStage::FANOUT_ENQUEUE);
+        flight_record(FlightEvent::FRAME_ENQUEUED, route.header.stream_id, message.get_payload_size());
+        std::shared_ptr<const Message> frame = shared;
+
+        // 发送计数在消息真正写出时累加（见on_message_sent），这里只负责入队
+        for (const auto& conn : route.targets) {
+            conn->send_shared(frame);
+        }
     }
 
     /**
@@ -706,8 +1168,7 @@ private:
      */
     void handle_audio_frame(const std::shared_ptr<Connection>& connection,
                            const Message& message) {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        stats_.audio_frames_received++;
+        counters_.add(COUNTER_AUDIO_RECEIVED);
 
         // TODO: 实现音频帧处理逻辑
     }
@@ -720,7 +1181,19 @@ private:
      */
     void handle_start_stream(const std::shared_ptr<Connection>& connection,
                             const Message& message) {
-        std::cout << "Start stream request from: " << connection->get_addr() << std::endl;
+        AV_LOG_INFO("AVServer", "Start stream request from: {}", connection->get_addr());
+
+        // 消息体可选地携带要订阅的simulcast逻辑流ID：[stream_id:4 bytes (uint32_t)]
+        const uint8_t* payload = message.get_payload();
+        if (payload && message.get_payload_size() >= 4 && streaming_service_) {
+            uint32_t stream_id = 0;
+            stream_id |= (static_cast<uint32_t>(payload[0]) << 0);
+            stream_id |= (static_cast<uint32_t>(payload[1]) << 8);
+            stream_id |= (static_cast<uint32_t>(payload[2]) << 16);
+            stream_id |= (static_cast<uint32_t>(payload[3]) << 24);
+
+            streaming_service_->subscribe_stream(connection->get_id(), stream_id);
+        }
 
         // 发送ACK
         Message ack(MessageType::ACK, 0, ProtocolHelper::get_timestamp_ms());
@@ -735,7 +1208,11 @@ private:
      */
     void handle_stop_stream(const std::shared_ptr<Connection>& connection,
                            const Message& message) {
-        std::cout << "Stop stream request from: " << connection->get_addr() << std::endl;
+        AV_LOG_INFO("AVServer", "Stop stream request from: {}", connection->get_addr());
+
+        if (streaming_service_) {
+            streaming_service_->unsubscribe_stream(connection->get_id());
+        }
 
         // 发送ACK
         Message ack(MessageType::ACK, 0, ProtocolHelper::get_timestamp_ms());
@@ -755,9 +1232,9 @@ private:
                            const Message& message) {
         // 从消息体中解析码率值
         // 预期格式：4字节的uint32_t码率值
-        auto payload = message.get_payload();
+        const uint8_t* payload = message.get_payload();
 
-        if (payload.size() >= 4) {
+        if (payload != nullptr && message.get_payload_size() >= 4) {
             // 解析码率值（小端序）
             uint32_t bitrate = 0;
             bitrate |= (static_cast<uint32_t>(payload[0]) << 0);
@@ -765,21 +1242,22 @@ private:
             bitrate |= (static_cast<uint32_t>(payload[2]) << 16);
             bitrate |= (static_cast<uint32_t>(payload[3]) << 24);
 
-            std::cout << "[AVServer] Set bitrate request from: " << connection->get_addr()
-                      << " Bitrate: " << bitrate << " bps (" << (bitrate / 1000000.0)
-                      << " Mbps)" << std::endl;
+            AV_LOG_INFO("AVServer", "Set bitrate request from: {} Bitrate: {} bps ({} Mbps)",
+                        connection->get_addr(), bitrate, bitrate / 1000000.0);
 
             // 设置客户端的码率限制
             if (streaming_service_) {
                 streaming_service_->set_client_bitrate_limit(connection->get_id(), bitrate);
             }
 
-            // 同时更新压缩引擎的目标码率
-            if (compression_engine_) {
+            // 同时更新压缩引擎的目标码率（经由处理器，作为过载降码率后的恢复上限）
+            if (media_processor_) {
+                media_processor_->set_target_bitrate(bitrate);
+            } else if (compression_engine_) {
                 compression_engine_->set_target_bitrate(bitrate);
             }
         } else {
-            std::cout << "[AVServer] Invalid bitrate message format" << std::endl;
+            AV_LOG_WARN("AVServer", "Invalid bitrate message format from: {}", connection->get_addr());
         }
 
         // 发送ACK
@@ -817,31 +1295,8 @@ private:
                 auto msg = media_processor_->try_get_message();
 
                 if (msg) {
-                    // 向所有连接的客户端发送
-                    // 获取所有客户端
-                    auto clients = streaming_service_->get_all_clients();
-
-                    for (const auto& [client_id, session] : clients) {
-                        if (session.is_active) {
-                            // 向客户端发送消息
-                            auto conn = tcp_server_.get_connection(client_id);
-                            if (conn) {
-                                conn->send(*msg);
-
-                                // 更新统计
-                                {
-                                    std::lock_guard<std::mutex> lock(stats_mutex_);
-                                    if (msg->get_type() == MessageType::VIDEO_FRAME) {
-                                        stats_.video_frames_sent++;
-                                    } else if (msg->get_type() == MessageType::AUDIO_FRAME) {
-                                        stats_.audio_frames_sent++;
-                                    }
-                                    stats_.total_messages_sent++;
-                                    stats_.total_bytes_sent += msg->to_bytes().size();
-                                }
-                            }
-                        }
-                    }
+                    // 所有连接共享同一份只读消息，不为每个客户端复制消息体
+                    broadcast_frame(std::shared_ptr<const Message>(std::move(msg)));
                 } else {
                     // 队列为空，短暂睡眠以避免忙轮询
                     std::this_thread::sleep_for(std::chrono::milliseconds(5));
@@ -852,6 +1307,33 @@ private:
         }
     }
 
+    /**
+     * @brief 向所有连接的客户端发送一帧
+     *
+     * @param frame 共享的只读消息
+     *
+     * @note 由分发线程或阶段图的fanout阶段调用
+     */
+    void broadcast_frame(const std::shared_ptr<const Message>& frame) {
+        if (!streaming_service_) {
+            return;
+        }
+
+        // 获取所有客户端
+        auto clients = streaming_service_->get_all_clients();
+
+        // 会话里保存了连接，不必逐个按ID查TcpServer的连接表；发送统计在写出时累加
+        for (const auto& [client_id, session] : clients) {
+            // simulcast订阅者只接收其订阅的逻辑流
+            if (session.is_active && !session.simulcast_subscriber) {
+                auto conn = session.connection.lock();
+                if (conn) {
+                    conn->send_shared(frame);
+                }
+            }
+        }
+    }
+
     /**
      * @brief 统计信息更新线程主循环
      *
@@ -883,8 +1365,27 @@ private:
             if (streaming_service_) {
                 auto stream_stats = streaming_service_->get_statistics();
                 // 统计信息已在流媒体服务中维护
+
+                // 把各连接发送队列的过期丢帧计数同步到客户端会话
+                for (const auto& [client_id, session] : streaming_service_->get_all_clients()) {
+                    auto conn = tcp_server_.get_connection(client_id);
+                    if (conn) {
+                        auto queue_stats = conn->get_send_queue_statistics();
+                        streaming_service_->update_client_expirations(
+                            client_id, queue_stats.total_expired(), queue_stats.gop_dropped);
+                    }
+                }
             }
 
+            // 发布统计快照和指标页面（读者和抓取请求只读取已发布的数据）
+            published_stats_.store(get_statistics());
+            if (metrics_server_) {
+                metrics_server_->publish(render_metrics());
+            }
+
+            // SIGUSR1请求的飞行记录导出（信号处理函数只设置标志）
+            FlightRecorder::instance().service_dump_request();
+
             // 定期输出性能日志
             log_interval++;
             if (log_interval >= LOG_INTERVAL_THRESHOLD) {
@@ -893,8 +1394,18 @@ private:
                 std::cout << "\n[AVServer] === Performance Monitor ===" << std::endl;
 
                 if (media_processor_) {
+                    auto proc_stats = media_processor_->get_statistics();
                     std::cout << "[AVServer] Media Processor: Queue size = "
-                              << media_processor_->get_queue_size() << std::endl;
+                              << proc_stats.current_output_queue_size
+                              << " (" << proc_stats.output_queue_duration_ms << " ms)"
+                              << ", Shed: " << (proc_stats.shed_b_frames + proc_stats.shed_p_frames +
+                                               proc_stats.shed_dependent_frames)
+                              << ", Rejected: " << proc_stats.rejected_messages << std::endl;
+                }
+
+                if (stage_graph_) {
+                    std::cout << "[AVServer] Media Pipeline:" << std::endl;
+                    stage_graph_->print_metrics();
                 }
 
                 if (streaming_service_) {
@@ -919,8 +1430,6 @@ private:
     FrameBufferPool frame_buffer_pool_;             // 帧缓冲池
 
     // ===== 音视频捕获模块 =====
-    std::unique_ptr<VideoCapture> video_capture_;           // 视频捕获模块
-    std::unique_ptr<AudioCapture> audio_capture_;           // 音频捕获模块
     std::unique_ptr<CaptureManager> capture_manager_;       // 统一捕获管理
 
     // ===== 编码压缩模块 =====
@@ -928,6 +1437,7 @@ private:
 
     // ===== 媒体处理流程 =====
     std::unique_ptr<MediaProcessor> media_processor_;       // 媒体处理器
+    std::unique_ptr<StageGraph> stage_graph_;               // 阶段图管道（配置了pipeline_spec时代替媒体处理器）
 
     // ===== 流媒体分发 =====
     std::unique_ptr<StreamingService> streaming_service_;   // 流媒体服务
@@ -936,10 +1446,26 @@ private:
     std::atomic<bool> running_;                             // 运行状态标志
     std::thread distribution_thread_;                       // 消息分发线程
     std::thread stats_update_thread_;                       // 统计更新线程
+    std::unique_ptr<MetricsHttpServer> metrics_server_;     // Prometheus指标导出（metrics_port为0时为空）
 
     // ===== 统计信息 =====
-    mutable std::mutex stats_mutex_;                        // 保护统计信息的互斥锁
-    ServerStatistics stats_;                                // 服务器统计信息
+    enum ServerCounter {
+        COUNTER_CONNECTIONS = 0,
+        COUNTER_MESSAGES_RECEIVED,
+        COUNTER_MESSAGES_SENT,
+        COUNTER_BYTES_RECEIVED,
+        COUNTER_BYTES_SENT,
+        COUNTER_VIDEO_RECEIVED,
+        COUNTER_AUDIO_RECEIVED,
+        COUNTER_VIDEO_SENT,
+        COUNTER_AUDIO_SENT,
+        COUNTER_VIDEO_UNROUTED,
+        SERVER_COUNTER_COUNT
+    };
+
+    ShardedCounters<SERVER_COUNTER_COUNT> counters_;        // 每条消息更新的计数（按线程分片，无锁）
+    std::chrono::steady_clock::time_point start_time_;      // 服务器创建时间
+    SeqLock<ServerStatistics> published_stats_;             // 统计线程每周期发布的快照
 };
 
 #endif // AV_SERVER_H
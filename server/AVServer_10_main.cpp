@@ -11,6 +11,7 @@
  * Linux/Unix:
  *   g++ -std=c++17 -pthread -o avserver main.cpp
  *   clang++ -std=c++17 -pthread -o avserver main.cpp
+ *   g++ -std=c++20 -pthread -o avserver main.cpp    # 协程会话（事件循环模型）
  *
  * Windows:
  *   需要链接 ws2_32.lib（已在TcpServer.h中设置）
@@ -19,13 +20,36 @@
  *   ./avserver
  *   # 或指定端口
  *   ./avserver 9999
+ *   # 或用阶段图描述文件配置媒体管道（格式见StageGraph.h）
+ *   ./avserver --pipeline pipeline.txt
+ *   # 线程池在默认大小和16之间按负载自动扩缩容
+ *   ./avserver --pool-max 16
+ *   # 媒体流绑定到NUMA节点0（捕获、编码、发送线程和帧缓冲池）
+ *   ./avserver --numa-node 0
+ *   # 低延迟：事件循环阻塞前忙轮询50微秒
+ *   ./avserver --busy-poll 50
+ *   # 在127.0.0.1:9100/metrics导出Prometheus指标
+ *   ./avserver --metrics-port 9100
+ *   # 每5秒采样一次各连接的TCP_INFO（0表示不采样）
+ *   ./avserver --tcp-info-ms 5000
+ *   # 连接事件等运行日志只输出warn及以上
+ *   ./avserver --log-level warn
+ *   # trace命令和SIGUSR1导出最近30秒的流水线事件到指定文件
+ *   ./avserver --trace-file /tmp/avserver.json --trace-window-ms 30000
+ *   # 录制所有入站字节流，之后用bench/avserver_replay回放
+ *   ./avserver --capture-ingest ingest.avcap
  *
  * 交互命令：
  *   help     - 显示帮助信息
  *   status   - 显示服务器状态
  *   stats    - 显示统计信息
  *   conns    - 显示当前连接数
+ *   locks    - 显示竞争最严重的锁（需要-DAVSERVER_LOCK_PROFILING=1编译）
+ *   trace [file] - 导出最近的流水线事件（Chrome trace JSON）
  *   quit/exit - 优雅关闭服务器
+ *
+ * 信号：
+ *   SIGUSR1  - 导出最近的流水线事件到--trace-file指定的文件（kill -USR1 <pid>）
  */
 
 #include <iostream>
@@ -35,6 +59,7 @@
 #include <csignal>
 #include <atomic>
 #include <memory>
+#include <fstream>
 
 #include "AVServer_09_AVServer.h"
 
@@ -66,6 +91,15 @@ void signal_handler(int sig) {
     g_shutdown_requested = true;
 }
 
+/**
+ * @brief SIGUSR1处理函数：请求导出飞行记录
+ *
+ * @note 只设置标志，由统计线程在下一个周期（约1秒内）写出文件
+ */
+void trace_signal_handler(int) {
+    FlightRecorder::instance().request_dump();
+}
+
 // ============================================================================
 // ======================== 命令处理 ===========================================
 // ============================================================================
@@ -80,6 +114,8 @@ void show_help() {
     std::cout << "stats      - Show server statistics" << std::endl;
     std::cout << "conns      - Show current connection count" << std::endl;
     std::cout << "fullstats  - Show comprehensive statistics (all modules)" << std::endl;
+    std::cout << "locks      - Show the most contended locks (lock profiling builds)" << std::endl;
+    std::cout << "trace [f]  - Dump recent pipeline events as a Chrome trace (JSON)" << std::endl;
     std::cout << "quit/exit  - Shutdown server gracefully" << std::endl;
     std::cout << "clear      - Clear screen" << std::endl;
     std::cout << "" << std::endl;
@@ -128,6 +164,28 @@ bool process_command(const std::string& command) {
             std::cout << "" << std::endl;
         }
     }
+    else if (cmd == "locks") {
+        std::cout << LockProfiler::instance().get_statistics(LockProfiler::REPORT_SITES).to_string()
+                  << std::endl;
+    }
+    else if (cmd == "trace" || cmd.rfind("trace ", 0) == 0) {
+        if (g_server) {
+            // 文件名从原始输入中取，保留大小写
+            std::istringstream words(command);
+            std::string name;
+            std::string path;
+            words >> name >> path;
+            if (path.empty()) {
+                path = g_server->get_config().flight_recorder_path;
+            }
+            long events = g_server->dump_flight_trace(path);
+            if (events >= 0) {
+                std::cout << "[TRACE] Wrote " << events << " events to " << path << std::endl;
+            } else {
+                std::cout << "[ERROR] Cannot write trace file: " << path << std::endl;
+            }
+        }
+    }
     else if (cmd == "conns") {
         if (g_server) {
             size_t conns = g_server->get_tcp_server().get_connection_count();
@@ -214,6 +272,18 @@ void command_loop() {
  *   avserver                    # 使用默认配置（端口8888）
  *   avserver 9999              # 使用自定义端口
  *   avserver --port 9999       # 使用--port参数指定端口
+ *   avserver --pipeline p.txt  # 使用阶段图描述文件配置媒体管道
+ *   avserver --pool-max 16     # 线程池自动扩缩容上限
+ *   avserver --numa-node 0     # 媒体流绑定的NUMA节点
+ *   avserver --busy-poll 50    # 事件循环忙轮询时间（微秒）
+ *   avserver --metrics-port 9100            # Prometheus指标端口
+ *   avserver --metrics-addr 0.0.0.0         # 指标监听地址（默认127.0.0.1）
+ *   avserver --log-level debug              # 运行日志级别（默认info）
+ *   avserver --tcp-info-ms 5000             # TCP_INFO采样周期（毫秒，默认1000）
+ *   avserver --trace-file t.json            # trace命令和SIGUSR1的默认导出文件
+ *   avserver --trace-window-ms 30000        # 导出最近多少毫秒的事件（默认10000）
+ *   avserver --no-flight-recorder           # 不记录流水线事件
+ *   avserver --capture-ingest in.avcap      # 录制入站字节流（退出时写入索引）
  */
 int main(int argc, char* argv[]) {
     std::cout << "=== AVServer - Audio/Video Server ===" << std::endl;
@@ -224,22 +294,125 @@ int main(int argc, char* argv[]) {
     // ===== 1. 解析命令行参数 =====
     ServerConfig config;
 
-    // 检查端口参数
-    if (argc >= 2) {
-        std::string arg = argv[1];
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
 
         // 检查是否是--port参数
-        if (arg == "--port" && argc >= 3) {
+        if (arg == "--port" && i + 1 < argc) {
             try {
-                config.port = std::stoi(argv[2]);
+                config.port = std::stoi(argv[++i]);
                 std::cout << "[CONFIG] Port set to: " << config.port << std::endl;
             } catch (...) {
-                std::cerr << "[ERROR] Invalid port number: " << argv[2] << std::endl;
+                std::cerr << "[ERROR] Invalid port number: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        // 检查是否是--pipeline参数
+        else if (arg == "--pipeline" && i + 1 < argc) {
+            std::ifstream file(argv[++i]);
+            if (!file) {
+                std::cerr << "[ERROR] Cannot open pipeline file: " << argv[i] << std::endl;
+                return 1;
+            }
+            std::stringstream content;
+            content << file.rdbuf();
+            config.pipeline_spec = content.str();
+            std::cout << "[CONFIG] Pipeline loaded from: " << argv[i] << std::endl;
+        }
+        // 检查是否是--pool-max参数
+        else if (arg == "--pool-max" && i + 1 < argc) {
+            try {
+                config.thread_pool_max_size = static_cast<size_t>(std::stoul(argv[++i]));
+                std::cout << "[CONFIG] Thread pool max size: " << config.thread_pool_max_size << std::endl;
+            } catch (...) {
+                std::cerr << "[ERROR] Invalid pool size: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        // 检查是否是--numa-node参数
+        else if (arg == "--numa-node" && i + 1 < argc) {
+            try {
+                config.numa_node = std::stoi(argv[++i]);
+                std::cout << "[CONFIG] NUMA node: " << config.numa_node << std::endl;
+            } catch (...) {
+                std::cerr << "[ERROR] Invalid NUMA node: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        // 检查是否是--busy-poll参数
+        else if (arg == "--busy-poll" && i + 1 < argc) {
+            try {
+                config.busy_poll_us = std::stoi(argv[++i]);
+                std::cout << "[CONFIG] Busy poll: " << config.busy_poll_us << "us" << std::endl;
+            } catch (...) {
+                std::cerr << "[ERROR] Invalid busy poll time: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        // 检查是否是--metrics-port参数
+        else if (arg == "--metrics-port" && i + 1 < argc) {
+            try {
+                config.metrics_port = static_cast<uint16_t>(std::stoi(argv[++i]));
+                std::cout << "[CONFIG] Metrics port: " << config.metrics_port << std::endl;
+            } catch (...) {
+                std::cerr << "[ERROR] Invalid metrics port: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        // 检查是否是--metrics-addr参数
+        else if (arg == "--metrics-addr" && i + 1 < argc) {
+            config.metrics_addr = argv[++i];
+            std::cout << "[CONFIG] Metrics address: " << config.metrics_addr << std::endl;
+        }
+        // 检查是否是--tcp-info-ms参数
+        else if (arg == "--tcp-info-ms" && i + 1 < argc) {
+            try {
+                config.tcp_info_interval_ms = std::stoi(argv[++i]);
+                std::cout << "[CONFIG] TCP_INFO sampling interval: " << config.tcp_info_interval_ms
+                          << "ms" << std::endl;
+            } catch (...) {
+                std::cerr << "[ERROR] Invalid TCP_INFO sampling interval: " << argv[i] << std::endl;
                 return 1;
             }
         }
+        // 检查是否是--trace-file参数
+        else if (arg == "--trace-file" && i + 1 < argc) {
+            config.flight_recorder_path = argv[++i];
+            std::cout << "[CONFIG] Trace file: " << config.flight_recorder_path << std::endl;
+        }
+        // 检查是否是--trace-window-ms参数
+        else if (arg == "--trace-window-ms" && i + 1 < argc) {
+            try {
+                config.flight_recorder_window_ms = std::stoi(argv[++i]);
+                std::cout << "[CONFIG] Trace window: " << config.flight_recorder_window_ms
+                          << "ms" << std::endl;
+            } catch (...) {
+                std::cerr << "[ERROR] Invalid trace window: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        // 检查是否是--no-flight-recorder参数
+        else if (arg == "--no-flight-recorder") {
+            config.flight_recorder = false;
+            std::cout << "[CONFIG] Flight recorder disabled" << std::endl;
+        }
+        // 检查是否是--capture-ingest参数
+        else if (arg == "--capture-ingest" && i + 1 < argc) {
+            config.ingest_capture_path = argv[++i];
+            std::cout << "[CONFIG] Ingest capture: " << config.ingest_capture_path << std::endl;
+        }
+        // 检查是否是--log-level参数
+        else if (arg == "--log-level" && i + 1 < argc) {
+            LogLevel level;
+            if (!parse_log_level(argv[++i], level)) {
+                std::cerr << "[ERROR] Invalid log level: " << argv[i] << std::endl;
+                return 1;
+            }
+            AsyncLogger::instance().set_level(level);
+            std::cout << "[CONFIG] Log level: " << argv[i] << std::endl;
+        }
         // 或直接指定端口号
-        else if (arg[0] != '-') {
+        else if (!arg.empty() && arg[0] != '-') {
             try {
                 config.port = std::stoi(arg);
                 std::cout << "[CONFIG] Port set to: " << config.port << std::endl;
@@ -255,9 +428,15 @@ int main(int argc, char* argv[]) {
     std::cout << "  Listen Address: " << config.listen_addr << std::endl;
     std::cout << "  Listen Port: " << config.port << std::endl;
     std::cout << "  Max Connections: " << config.max_connections << std::endl;
-    std::cout << "  Thread Pool Size: " << config.thread_pool_size << std::endl;
+    std::cout << "  Thread Pool Size: " << config.thread_pool_size;
+    if (config.thread_pool_max_size > config.thread_pool_size) {
+        std::cout << " (autoscale up to " << config.thread_pool_max_size << ")";
+    }
+    std::cout << std::endl;
     std::cout << "  Recv Buffer: " << (config.recv_buffer_size / 1024) << " KB" << std::endl;
     std::cout << "  Send Buffer: " << (config.send_buffer_size / 1024) << " KB" << std::endl;
+    std::cout << "  Media Pipeline: "
+              << (config.pipeline_spec.empty() ? "MediaProcessor" : "stage graph") << std::endl;
     std::cout << "" << std::endl;
 
     // ===== 3. 创建服务器实例 =====
@@ -268,6 +447,7 @@ int main(int argc, char* argv[]) {
     std::signal(SIGINT, signal_handler);
     #ifndef _WIN32
         std::signal(SIGTERM, signal_handler);
+        std::signal(SIGUSR1, trace_signal_handler);
     #endif
 
     // ===== 5. 启动服务器 =====
@@ -334,6 +514,9 @@ Linux/Unix (GCC/Clang):
     # 调试编译
     g++ -std=c++17 -pthread -g -O0 -o avserver main.cpp
 
+    # C++20编译：事件循环上的会话写成协程（C++17下同样在事件循环上，以回调方式运行）
+    g++ -std=c++20 -pthread -O2 -o avserver main.cpp
+
 Windows (Visual Studio):
     # 在Visual Studio中创建项目，添加所有.h文件到项目中
     # 确保项目配置为C++17或更新
@@ -37,6 +37,9 @@
 
 #include "AVServer_03_FrameBuffer.h"
 #include "AVServer_01_SafeQueue.h"
+#include "AVServer_27_Numa.h"
+#include "AVServer_29_TimeService.h"
+#include "AVServer_36_FlightRecorder.h"
 
 // ============================================================================
 // ======================== 视频捕获配置 =======================================
@@ -71,6 +74,8 @@ struct VideoCaptureConfig {
     uint32_t buffer_size;           // 缓冲区大小（帧数）
     int timeout_ms;                 // 超时时间（毫秒）
 
+    int numa_node;                  // 捕获线程绑定的NUMA节点（-1表示不绑定）
+
     /**
      * @brief 构造函数 - 初始化为默认值
      */
@@ -84,7 +89,8 @@ struct VideoCaptureConfig {
           bitrate(5000000),         // 5Mbps
           quality(80),
           buffer_size(30),
-          timeout_ms(5000) {
+          timeout_ms(5000),
+          numa_node(-1) {
     }
 };
 
@@ -146,6 +152,7 @@ public:
           running_(false),
           frame_count_(0),
           dropped_frames_(0),
+          frame_queue_("VideoCapture.frames"),
           capture_thread_() {
 
         // 如果没有提供帧池，创建一个
@@ -448,6 +455,10 @@ private:
      * 5. 如果队列满，丢弃帧
      */
     void capture_loop() {
+        if (config_.numa_node >= 0) {
+            pin_current_thread_to_node(config_.numa_node);
+        }
+
         while (running_.load()) {
             // 获取或创建帧对象
             auto frame = frame_pool_->get();
@@ -470,6 +481,9 @@ private:
                 if (frame_queue_.try_pop(old_frame)) {
                     frame_pool_->return_frame(old_frame);
                     dropped_frames_++;
+                    flight_record(FlightEvent::FRAME_DROPPED,
+                                  static_cast<uint64_t>(FlightDropReason::CAPTURE_QUEUE_FULL),
+                                  FrameTimestamps::LOCAL_VIDEO_STREAM);
                 } else {
                     break;
                 }
@@ -507,14 +521,15 @@ private:
         frame->height = config_.height;
         frame->bitrate = config_.bitrate;
         frame->quality = config_.quality;
-        frame->timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
+        frame->timestamp = TimeService::instance().wall_now_ms();
+        frame->stamps.begin(FrameTimestamps::LOCAL_VIDEO_STREAM);
 
         // 模拟帧数据（实际应该是真实的压缩或未压缩数据）
         // 这里只是设置一个虚拟的数据大小
         uint32_t frame_size = (config_.width * config_.height * 3) / 2;  // YUV420
         frame->data.resize(std::min(frame_size, 100000U));  // 限制大小以加快演示
         frame->size = frame->data.size();
+        flight_record(FlightEvent::FRAME_CAPTURED, FrameTimestamps::LOCAL_VIDEO_STREAM, frame->size);
 
         frame_count_++;
         return true;
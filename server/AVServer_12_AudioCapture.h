@@ -37,6 +37,9 @@
 
 #include "AVServer_03_FrameBuffer.h"
 #include "AVServer_01_SafeQueue.h"
+#include "AVServer_27_Numa.h"
+#include "AVServer_29_TimeService.h"
+#include "AVServer_36_FlightRecorder.h"
 
 // ============================================================================
 // ======================== 音频捕获配置 =======================================
@@ -70,6 +73,8 @@ struct AudioCaptureConfig {
     uint32_t buffer_size;           // 缓冲区大小（音频帧数）
     int timeout_ms;                 // 超时时间（毫秒）
 
+    int numa_node;                  // 捕获线程绑定的NUMA节点（-1表示不绑定）
+
     /**
      * @brief 构造函数 - 初始化为默认值
      */
@@ -82,7 +87,8 @@ struct AudioCaptureConfig {
           bitrate(128000),          // 128kbps
           quality(90),
           buffer_size(100),
-          timeout_ms(5000) {
+          timeout_ms(5000),
+          numa_node(-1) {
     }
 };
 
@@ -143,6 +149,7 @@ public:
           running_(false),
           frame_count_(0),
           dropped_frames_(0),
+          frame_queue_("AudioCapture.frames"),
           capture_thread_() {
 
         // 如果没有提供帧池，创建一个
@@ -433,6 +440,10 @@ private:
      * 5. 如果队列满，丢弃帧
      */
     void capture_loop() {
+        if (config_.numa_node >= 0) {
+            pin_current_thread_to_node(config_.numa_node);
+        }
+
         while (running_.load()) {
             // 获取或创建帧对象
             auto frame = frame_pool_->get();
@@ -455,6 +466,9 @@ private:
                 if (frame_queue_.try_pop(old_frame)) {
                     frame_pool_->return_frame(old_frame);
                     dropped_frames_++;
+                    flight_record(FlightEvent::FRAME_DROPPED,
+                                  static_cast<uint64_t>(FlightDropReason::CAPTURE_QUEUE_FULL),
+                                  FrameTimestamps::LOCAL_AUDIO_STREAM);
                 } else {
                     break;
                 }
@@ -495,8 +509,8 @@ private:
         frame->channels = config_.channels;
         frame->bitrate = config_.bitrate;
         frame->quality = config_.quality;
-        frame->timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
+        frame->timestamp = TimeService::instance().wall_now_ms();
+        frame->stamps.begin(FrameTimestamps::LOCAL_AUDIO_STREAM);
 
         // 模拟音频帧数据
         // 一个音频帧通常包含固定数量的采样点
@@ -507,6 +521,7 @@ private:
 
         frame->data.resize(std::min(frame_size, 100000U));
         frame->size = frame->data.size();
+        flight_record(FlightEvent::FRAME_CAPTURED, FrameTimestamps::LOCAL_AUDIO_STREAM, frame->size);
 
         frame_count_++;
         return true;
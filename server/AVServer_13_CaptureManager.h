@@ -171,7 +171,8 @@ public:
           frame_pool_(nullptr),
           running_(false),
           video_enabled_(false),
-          audio_enabled_(false) {
+          audio_enabled_(false),
+          numa_node_(-1) {
 
         // 创建共享的帧缓冲池
         if (shared_pool) {
@@ -216,6 +217,22 @@ public:
                   << "Hz, " << config.channels << "ch" << std::endl;
     }
 
+    /**
+     * @brief 把捕获线程和帧缓冲池放到指定NUMA节点上
+     *
+     * @param node 节点编号（-1表示不绑定）
+     *
+     * @note 该函数必须在start()之前调用
+     * @note 与处理这些帧的编码、发送线程绑定到同一节点，避免跨节点访问帧内存
+     */
+    void set_numa_node(int node) {
+        numa_node_ = node;
+        if (shared_pool_) {
+            frame_pool_ = make_node_local_frame_pool(node, 100);
+        }
+        std::cout << "[CaptureManager] NUMA node set: " << node << std::endl;
+    }
+
     /**
      * @brief 启动音视频捕获
      *
@@ -244,7 +261,8 @@ public:
 
         // 启动视频捕获
         if (video_enabled_) {
-            auto pool = shared_pool_ ? frame_pool_ : std::make_shared<FrameBufferPool>(30);
+            auto pool = shared_pool_ ? frame_pool_ : make_node_local_frame_pool(numa_node_, 30);
+            video_config_.numa_node = numa_node_;
             video_capture_ = std::make_shared<VideoCapture>(video_config_, pool);
 
             if (!video_capture_->start()) {
@@ -255,7 +273,8 @@ public:
 
         // 启动音频捕获
         if (audio_enabled_) {
-            auto pool = shared_pool_ ? frame_pool_ : std::make_shared<FrameBufferPool>(100);
+            auto pool = shared_pool_ ? frame_pool_ : make_node_local_frame_pool(numa_node_, 100);
+            audio_config_.numa_node = numa_node_;
             audio_capture_ = std::make_shared<AudioCapture>(audio_config_, pool);
 
             if (!audio_capture_->start()) {
@@ -502,6 +521,7 @@ private:
     std::atomic<bool> running_;                     // 运行状态
     bool video_enabled_;                            // 视频捕获是否启用
     bool audio_enabled_;                            // 音频捕获是否启用
+    int numa_node_;                                 // 捕获线程和缓冲池所在的NUMA节点（-1表示不绑定）
 
     mutable std::mutex stats_mutex_;                // 保护统计信息的互斥锁
     CaptureStatistics stats_;                       // 捕获统计信息
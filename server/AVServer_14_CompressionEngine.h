@@ -32,6 +32,7 @@
 
 #include <memory>
 #include <atomic>
+#include <mutex>
 #include <vector>
 #include <chrono>
 #include <cstdint>
@@ -39,6 +40,8 @@
 #include <zlib.h>
 
 #include "AVServer_03_FrameBuffer.h"
+#include "AVServer_33_AsyncLogger.h"
+#include "AVServer_34_LockProfiler.h"
 
 // ============================================================================
 // ======================== 压缩和编码配置 =====================================
@@ -219,8 +222,11 @@ public:
      */
     explicit CompressionEngine(const CompressionConfig& config = CompressionConfig())
         : config_(config),
+          target_bitrate_(config.target_bitrate),
+          quality_(config.quality),
           is_running_(false),
           frame_count_(0),
+          video_frame_index_(0),
           last_frame_time_(std::chrono::steady_clock::now()),
           stats_() {
         std::cout << "[CompressionEngine] Initialized with quality=" << config.quality
@@ -308,14 +314,20 @@ public:
         // TODO: 实际实现应该调用FFmpeg或x264/x265编码库
         // 当前实现为模拟版本
 
-        // 模拟编码过程
-        output->frame_type = FrameType::VIDEO_I_FRAME;
+        // 模拟编码过程：每个GOP以I帧开头，其余为P帧
+        uint64_t gop_size = static_cast<uint64_t>(config_.keyframe_interval) *
+                            config_.target_framerate;
+        uint64_t index = video_frame_index_.fetch_add(1);
+        bool is_keyframe = gop_size == 0 || index % gop_size == 0;
+        output->frame_type = is_keyframe ? FrameType::VIDEO_I_FRAME
+                                         : FrameType::VIDEO_P_FRAME;
         output->codec_type = input->codec_type;
         output->width = input->width;
         output->height = input->height;
-        output->bitrate = config_.target_bitrate;
-        output->quality = config_.quality;
+        output->bitrate = target_bitrate_.load(std::memory_order_relaxed);
+        output->quality = quality_.load(std::memory_order_relaxed);
         output->timestamp = input->timestamp;
+        output->stamps = input->stamps;
 
         // 模拟压缩数据（实际大小应该是编码后的大小）
         uint32_t original_size = (input->width * input->height * 3) / 2;  // YUV420
@@ -353,9 +365,10 @@ public:
         output->codec_type = input->codec_type;
         output->sample_rate = input->sample_rate;
         output->channels = input->channels;
-        output->bitrate = config_.target_bitrate;
-        output->quality = config_.quality;
+        output->bitrate = target_bitrate_.load(std::memory_order_relaxed);
+        output->quality = quality_.load(std::memory_order_relaxed);
         output->timestamp = input->timestamp;
+        output->stamps = input->stamps;
 
         // 模拟压缩数据
         uint32_t original_size = input->size;
@@ -396,7 +409,7 @@ public:
                           6);  // 压缩级别6
 
         if (ret != Z_OK) {
-            std::cerr << "[CompressionEngine] zlib compression failed: " << ret << std::endl;
+            AV_LOG_ERROR("CompressionEngine", "zlib compression failed: {}", ret);
             return false;
         }
 
@@ -427,7 +440,7 @@ public:
                            input_data, input_size);
 
         if (ret != Z_OK) {
-            std::cerr << "[CompressionEngine] zlib decompression failed: " << ret << std::endl;
+            AV_LOG_ERROR("CompressionEngine", "zlib decompression failed: {}", ret);
             return false;
         }
 
@@ -441,10 +454,11 @@ public:
      * @param bitrate 新的目标比特率（bps）
      *
      * @note 用于自适应码率调整
+     * @note 可以在编码线程运行时从其他线程调用
      */
     void set_target_bitrate(uint32_t bitrate) {
-        config_.target_bitrate = bitrate;
-        std::cout << "[CompressionEngine] Bitrate adjusted to " << bitrate << "bps" << std::endl;
+        target_bitrate_.store(bitrate, std::memory_order_relaxed);
+        AV_LOG_INFO("CompressionEngine", "Bitrate adjusted to {}bps", bitrate);
     }
 
     /**
@@ -453,7 +467,16 @@ public:
      * @param quality 质量等级（0-100）
      */
     void set_quality(int quality) {
-        config_.quality = std::max(0, std::min(100, quality));
+        quality_.store(std::max(0, std::min(100, quality)), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 获取当前目标比特率
+     *
+     * @return 目标比特率（bps）
+     */
+    uint32_t get_target_bitrate() const {
+        return target_bitrate_.load(std::memory_order_relaxed);
     }
 
     /**
@@ -462,6 +485,7 @@ public:
      * @return 编码统计结构体
      */
     EncodingStatistics get_statistics() const {
+        std::lock_guard<ProfiledMutex> lock(stats_mutex_);
         return stats_;
     }
 
@@ -469,7 +493,7 @@ public:
      * @brief 输出统计信息
      */
     void print_statistics() const {
-        std::cout << stats_.to_string() << std::endl;
+        std::cout << get_statistics().to_string() << std::endl;
     }
 
     /**
@@ -478,6 +502,7 @@ public:
      * @return 实际码率（bps）
      */
     uint32_t get_actual_bitrate() const {
+        std::lock_guard<ProfiledMutex> lock(stats_mutex_);
         return stats_.current_bitrate;
     }
 
@@ -493,10 +518,13 @@ public:
     /**
      * @brief 获取配置信息
      *
-     * @return 常量引用到配置
+     * @return 配置的副本（目标比特率和质量为当前值）
      */
-    const CompressionConfig& get_config() const {
-        return config_;
+    CompressionConfig get_config() const {
+        CompressionConfig config = config_;
+        config.target_bitrate = target_bitrate_.load(std::memory_order_relaxed);
+        config.quality = quality_.load(std::memory_order_relaxed);
+        return config;
     }
 
 private:
@@ -517,9 +545,10 @@ private:
 
         double compression_ratio = 0.5;  // 基础压缩率
 
-        if (config_.quality >= 80) {
+        const int quality = quality_.load(std::memory_order_relaxed);
+        if (quality >= 80) {
             compression_ratio = 0.75;  // 高质量
-        } else if (config_.quality >= 50) {
+        } else if (quality >= 50) {
             compression_ratio = 0.60;  // 中质量
         } else {
             compression_ratio = 0.40;  // 低质量
@@ -534,6 +563,8 @@ private:
      * @param input 输入帧
      * @param output 输出帧
      * @param start_time 编码开始时间
+     *
+     * @note 音频和视频可能在不同线程中同时编码，统计信息由stats_mutex_保护
      */
     void update_stats(const std::shared_ptr<AVFrame>& input,
                      const std::shared_ptr<AVFrame>& output,
@@ -543,6 +574,8 @@ private:
         auto encoding_time = std::chrono::duration_cast<std::chrono::milliseconds>(
             end_time - start_time).count();
 
+        std::lock_guard<ProfiledMutex> lock(stats_mutex_);
+
         // 更新计数
         stats_.total_frames_processed++;
         stats_.total_frames_encoded++;
@@ -567,12 +600,16 @@ private:
     }
 
 private:
-    CompressionConfig config_;                      // 压缩配置
+    CompressionConfig config_;                      // 压缩配置（目标比特率和质量以下面的原子变量为准）
+    std::atomic<uint32_t> target_bitrate_;          // 目标比特率（码率调整与编码线程并发访问）
+    std::atomic<int> quality_;                      // 质量级别（同上）
     std::atomic<bool> is_running_;                  // 运行状态
 
     std::atomic<uint64_t> frame_count_;             // 处理的帧数
+    std::atomic<uint64_t> video_frame_index_;       // 视频帧序号（用于确定GOP位置）
     std::chrono::steady_clock::time_point last_frame_time_;  // 最后一帧时间
 
+    mutable ProfiledMutex stats_mutex_{"CompressionEngine.stats"};  // 保护统计信息的互斥锁
     mutable EncodingStatistics stats_;              // 编码统计信息
 };
 
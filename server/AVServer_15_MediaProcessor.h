@@ -11,9 +11,12 @@
  * Capture -> Encode -> Package -> Send to Network
  * 视频/音频帧 -> 压缩编码 -> 消息格式化 -> TCP发送
  *
+ * 音频和视频各自一条处理通道（独立线程 + 独立输出队列），
+ * 只在取消息（分发）时按时间戳合并，音频延迟不受视频编码耗时影响。
+ *
  * 设计特点：
  * - 模块化的处理管道
- * - 自动的流量控制
+ * - 自动的流量控制（有界输出队列，过载时按帧类型丢帧并降低码率）
  * - 实时的性能监控
  * - 线程安全的操作
  *
@@ -34,10 +37,15 @@
 #include <chrono>
 #include <iostream>
 #include <queue>
+#include <condition_variable>
+#include <algorithm>
 
 #include "AVServer_13_CaptureManager.h"
 #include "AVServer_14_CompressionEngine.h"
 #include "AVServer_06_MessageProtocol.h"
+#include "AVServer_19_SheddingMessageQueue.h"
+#include "AVServer_34_LockProfiler.h"
+#include "AVServer_36_FlightRecorder.h"
 
 // ============================================================================
 // ======================== 媒体处理统计 =====================================
@@ -64,6 +72,15 @@ struct ProcessingStatistics {
     // 队列统计
     size_t current_video_queue_size;    // 当前视频队列大小
     size_t current_audio_queue_size;    // 当前音频队列大小
+    size_t current_output_queue_size;   // 当前输出队列大小
+    double output_queue_duration_ms;    // 输出队列队首消息已排队的时间（毫秒）
+
+    // 过载丢帧统计
+    uint64_t shed_b_frames;             // 过载时丢弃的B帧数
+    uint64_t shed_p_frames;             // 过载时丢弃的P帧数
+    uint64_t shed_dependent_frames;     // 因参考帧被丢弃而连带丢弃的帧数
+    uint64_t rejected_messages;         // 输出队列达到硬上限被拒绝的消息数
+    uint64_t bitrate_reductions;        // 因持续过载降低码率的次数
 
     /**
      * @brief 构造函数
@@ -77,7 +94,14 @@ struct ProcessingStatistics {
           average_fps(0.0),
           average_latency_ms(0.0),
           current_video_queue_size(0),
-          current_audio_queue_size(0) {
+          current_audio_queue_size(0),
+          current_output_queue_size(0),
+          output_queue_duration_ms(0.0),
+          shed_b_frames(0),
+          shed_p_frames(0),
+          shed_dependent_frames(0),
+          rejected_messages(0),
+          bitrate_reductions(0) {
     }
 
     /**
@@ -86,20 +110,57 @@ struct ProcessingStatistics {
      * @return 格式化的统计信息
      */
     std::string to_string() const {
-        char buffer[512];
+        char buffer[640];
         std::snprintf(buffer, sizeof(buffer),
             "Processing Stats [Video: %llu frames/%.2fMB, Audio: %llu frames/%.2fMB, "
             "Messages: %llu, FPS: %.1f, Latency: %.2fms, "
-            "Queues: V:%zu A:%zu]",
+            "Queues: V:%zu A:%zu Out:%zu (%.1fms), "
+            "Shed B/P/Dep: %llu/%llu/%llu, Rejected: %llu, Bitrate cuts: %llu]",
             total_video_frames, total_video_bytes_sent / (1024.0 * 1024.0),
             total_audio_frames, total_audio_bytes_sent / (1024.0 * 1024.0),
             total_messages_sent,
             average_fps, average_latency_ms,
-            current_video_queue_size, current_audio_queue_size);
+            current_video_queue_size, current_audio_queue_size,
+            current_output_queue_size, output_queue_duration_ms,
+            static_cast<unsigned long long>(shed_b_frames),
+            static_cast<unsigned long long>(shed_p_frames),
+            static_cast<unsigned long long>(shed_dependent_frames),
+            static_cast<unsigned long long>(rejected_messages),
+            static_cast<unsigned long long>(bitrate_reductions));
         return std::string(buffer);
     }
 };
 
+// ============================================================================
+// ======================== 媒体处理器配置 ====================================
+// ============================================================================
+
+/**
+ * @struct MediaProcessorConfig
+ * @brief 媒体处理器的配置参数
+ */
+struct MediaProcessorConfig {
+    OutputQueueConfig output_queue;     // 输出队列配置（容量、丢帧策略、过载判定）
+
+    // 过载时的码率控制
+    uint32_t min_bitrate;               // 降码率的下限（bps）
+    double bitrate_backoff;             // 每次降码率的比例（新码率 = 当前码率 * 该值）
+    int backoff_interval_ms;            // 两次降码率之间的最短间隔（毫秒）
+    int recovery_interval_ms;           // 无过载多久后开始恢复码率（毫秒）
+    double bitrate_recovery;            // 每次恢复码率的比例（新码率 = 当前码率 * 该值）
+
+    int numa_node;                      // 通道线程和编码缓冲池所在的NUMA节点（-1表示不绑定）
+
+    MediaProcessorConfig()
+        : min_bitrate(500000),          // 500kbps
+          bitrate_backoff(0.8),
+          backoff_interval_ms(2000),
+          recovery_interval_ms(10000),
+          bitrate_recovery(1.1),
+          numa_node(-1) {
+    }
+};
+
 // ============================================================================
 // ======================== 媒体处理器 ========================================
 // ============================================================================
@@ -109,11 +170,11 @@ struct ProcessingStatistics {
  * @brief 音视频媒体处理器
  *
  * 工作流程：
- * 1. 从CaptureManager获取原始帧
+ * 1. 视频通道和音频通道分别从CaptureManager获取原始帧
  * 2. 通过CompressionEngine进行编码压缩
  * 3. 格式化为Message消息格式
- * 4. 放入发送队列
- * 5. 由外部发送到客户端
+ * 4. 放入各自通道的输出队列
+ * 5. 由外部取出（按时间戳合并两个通道）并发送到客户端
  *
  * 使用示例：
  * @code
@@ -142,21 +203,28 @@ struct ProcessingStatistics {
  */
 class MediaProcessor {
 public:
+    static constexpr int LANE_WAIT_TIMEOUT_MS = 10;  // 通道等待采集帧的超时（用于及时响应停止）
+
     /**
      * @brief 构造函数
      *
      * @param capture_mgr 捕获管理器指针
      * @param compress_engine 压缩引擎指针
+     * @param config 处理器配置
      */
     MediaProcessor(CaptureManager* capture_mgr,
-                  CompressionEngine* compress_engine)
+                  CompressionEngine* compress_engine,
+                  const MediaProcessorConfig& config = MediaProcessorConfig())
         : capture_manager_(capture_mgr),
           compress_engine_(compress_engine),
+          config_(config),
           running_(false),
-          process_thread_(),
-          message_queue_(std::make_shared<SafeQueue<Message>>()),
-          stats_(),
-          stats_mutex_() {
+          video_thread_(),
+          audio_thread_(),
+          video_queue_(config.output_queue),
+          audio_queue_(config.output_queue),
+          nominal_bitrate_(0),
+          stats_() {
         std::cout << "[MediaProcessor] Initialized" << std::endl;
     }
 
@@ -190,8 +258,20 @@ public:
             return false;
         }
 
+        // 过载降码率之后恢复的上限
+        nominal_bitrate_ = compress_engine_->get_target_bitrate();
+        last_backoff_time_ = std::chrono::steady_clock::now();
+        last_overload_time_ = last_backoff_time_;
+
         running_ = true;
-        process_thread_ = std::thread(&MediaProcessor::process_loop, this);
+
+        // 每种媒体一条独立通道，互不阻塞
+        if (capture_manager_->is_video_enabled()) {
+            video_thread_ = std::thread(&MediaProcessor::video_lane_loop, this);
+        }
+        if (capture_manager_->is_audio_enabled()) {
+            audio_thread_ = std::thread(&MediaProcessor::audio_lane_loop, this);
+        }
 
         std::cout << "[MediaProcessor] Started processing" << std::endl;
         return true;
@@ -200,8 +280,7 @@ public:
     /**
      * @brief 停止媒体处理
      *
-     * @note 停止处理线程
-     * @note 清空待处理队列
+     * @note 停止音视频处理通道的线程
      */
     void stop() {
         bool expected = true;
@@ -210,8 +289,11 @@ public:
         }
 
         // 等待处理线程完成
-        if (process_thread_.joinable()) {
-            process_thread_.join();
+        if (video_thread_.joinable()) {
+            video_thread_.join();
+        }
+        if (audio_thread_.joinable()) {
+            audio_thread_.join();
         }
 
         std::cout << "[MediaProcessor] Stopped" << std::endl;
@@ -233,25 +315,23 @@ public:
      * @return 消息对象，如果超时返回nullptr
      *
      * @note 该函数从发送队列获取已处理的消息
+     * @note 两个通道都有消息时返回时间戳较早的一条
      */
     std::unique_ptr<Message> get_message(int timeout_ms = 1000) {
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeout_ms);
         Message msg;
-        auto start = std::chrono::steady_clock::now();
-
-        while (true) {
-            if (message_queue_->pop(msg)) {
-                return std::make_unique<Message>(msg);
-            }
 
-            // 检查超时
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now() - start).count();
-            if (elapsed > timeout_ms) {
+        while (!pop_earliest(msg)) {
+            ProfiledUniqueLock lock(output_mutex_);
+            if (!output_cv_.wait_until(lock, deadline, [this] {
+                    return !video_queue_.empty() || !audio_queue_.empty();
+                })) {
                 return nullptr;
             }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
+
+        return std::make_unique<Message>(msg);
     }
 
     /**
@@ -261,7 +341,7 @@ public:
      */
     std::unique_ptr<Message> try_get_message() {
         Message msg;
-        if (message_queue_->try_pop(msg)) {
+        if (pop_earliest(msg)) {
             return std::make_unique<Message>(msg);
         }
         return nullptr;
@@ -270,10 +350,10 @@ public:
     /**
      * @brief 获取队列中的消息数
      *
-     * @return 待发送的消息数
+     * @return 待发送的消息数（音视频两个通道之和）
      */
     size_t get_queue_size() const {
-        return message_queue_->size();
+        return video_queue_.size() + audio_queue_.size();
     }
 
     /**
@@ -282,7 +362,7 @@ public:
      * @return 处理统计结构体
      */
     ProcessingStatistics get_statistics() const {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
+        std::lock_guard<ProfiledMutex> lock(stats_mutex_);
         auto stats = stats_;
 
         // 更新队列大小
@@ -291,6 +371,17 @@ public:
             stats.current_audio_queue_size = capture_manager_->get_audio_queue_size();
         }
 
+        auto video_stats = video_queue_.get_statistics();
+        auto audio_stats = audio_queue_.get_statistics();
+        stats.current_output_queue_size = video_stats.current_size + audio_stats.current_size;
+        stats.output_queue_duration_ms = std::max(video_stats.queue_duration_ms,
+                                                  audio_stats.queue_duration_ms);
+        stats.shed_b_frames = video_stats.shed_b_frames;
+        stats.shed_p_frames = video_stats.shed_p_frames;
+        stats.shed_dependent_frames = video_stats.shed_dependents;
+        stats.rejected_messages = video_stats.rejected_hard_limit +
+                                  audio_stats.rejected_hard_limit;
+
         return stats;
     }
 
@@ -310,6 +401,7 @@ public:
         if (compress_engine_) {
             compress_engine_->set_target_bitrate(bitrate);
         }
+        nominal_bitrate_ = bitrate;
     }
 
     /**
@@ -318,45 +410,48 @@ public:
      * @return 队列中的消息数
      */
     size_t get_pending_messages() const {
-        return message_queue_->size();
+        return get_queue_size();
     }
 
 private:
     /**
-     * @brief 处理线程主循环
+     * @brief 视频通道主循环
      *
      * 工作流程：
-     * 1. 获取视频帧，进行编码
-     * 2. 获取音频帧，进行编码
-     * 3. 格式化为消息
-     * 4. 放入发送队列
-     * 5. 更新统计信息
+     * 1. 等待视频帧，进行编码
+     * 2. 格式化为消息，放入视频输出队列
+     * 3. 更新统计信息
+     * 4. 根据视频输出队列的过载状态调整码率
      */
-    void process_loop() {
-        auto frame_pool = std::make_shared<FrameBufferPool>(30);
+    void video_lane_loop() {
+        pin_lane_thread();
+        auto frame_pool = std::make_shared<FrameBufferPool>(30, 1024 * 1024, config_.numa_node);
 
         while (running_.load()) {
-            bool has_frame = false;
-
-            // 处理视频帧
-            auto raw_video = capture_manager_->try_get_video_frame();
+            auto raw_video = capture_manager_->get_video_frame(LANE_WAIT_TIMEOUT_MS);
             if (raw_video) {
-                has_frame = true;
+                numa_record_frame_access(*raw_video);
+                raw_video->stamps.stamp(FrameStage::ENCODE_DEQUEUE);
 
                 // 编码视频帧
                 auto encoded_video = frame_pool->get();
                 if (encoded_video && compress_engine_->encode_video(raw_video, encoded_video)) {
+                    encoded_video->stamps.stamp(FrameStage::ENCODE_DONE);
+                    flight_record(FlightEvent::FRAME_ENCODED, encoded_video->stamps.stream, encoded_video->size);
+
                     // 创建消息
                     Message msg(MessageType::VIDEO_FRAME, encoded_video->size,
                                ProtocolHelper::get_timestamp_ms());
                     msg.set_payload(encoded_video->data.data(), encoded_video->size);
-
-                    // 放入发送队列
-                    message_queue_->push(msg);
-
-                    // 更新统计
-                    {
-                        std::lock_guard<std::mutex> lock(stats_mutex_);
+                    msg.set_frame_type(encoded_video->frame_type);
+                    msg.set_pts_ms(encoded_video->timestamp);
+                    msg.set_stamps(encoded_video->stamps);
+                    msg.stamp(FrameStage::FANOUT_ENQUEUE);
+
+                    // 放入视频输出队列（过载时可能被丢弃）
+                    if (publish(video_queue_, msg)) {
+                        flight_record(FlightEvent::FRAME_ENQUEUED, msg.get_meta().stamps.stream, msg.get_payload_size());
+                        std::lock_guard<ProfiledMutex> lock(stats_mutex_);
                         stats_.total_video_frames++;
                         stats_.total_video_bytes_sent += encoded_video->size;
                         stats_.total_messages_sent++;
@@ -364,55 +459,184 @@ private:
 
                     frame_pool->return_frame(encoded_video);
                 }
-                capture_manager_->get_video_capture()->get_frame_pool()->return_frame(raw_video);
+                capture_manager_->get_video_capture()->return_frame(raw_video);
             }
 
-            // 处理音频帧
-            auto raw_audio = capture_manager_->try_get_audio_frame();
-            if (raw_audio) {
-                has_frame = true;
+            // 根据视频输出队列的过载状态调整码率
+            adjust_bitrate_for_overload();
+        }
+    }
 
-                // 编码音频帧
-                auto encoded_audio = frame_pool->get();
-                if (encoded_audio && compress_engine_->encode_audio(raw_audio, encoded_audio)) {
-                    // 创建消息
-                    Message msg(MessageType::AUDIO_FRAME, encoded_audio->size,
-                               ProtocolHelper::get_timestamp_ms());
-                    msg.set_payload(encoded_audio->data.data(), encoded_audio->size);
+    /**
+     * @brief 把通道线程绑定到配置的NUMA节点（线程启动后、分配缓冲池之前调用）
+     */
+    void pin_lane_thread() {
+        if (config_.numa_node >= 0 && !pin_current_thread_to_node(config_.numa_node)) {
+            std::cerr << "[MediaProcessor] Failed to pin lane to NUMA node "
+                      << config_.numa_node << std::endl;
+        }
+    }
 
-                    // 放入发送队列
-                    message_queue_->push(msg);
+    /**
+     * @brief 音频通道主循环
+     *
+     * 工作流程：
+     * 1. 等待音频帧，进行编码
+     * 2. 格式化为消息，放入音频输出队列
+     * 3. 更新统计信息
+     *
+     * @note 不等待视频编码，音频延迟只取决于音频本身的处理时间
+     */
+    void audio_lane_loop() {
+        pin_lane_thread();
+        auto frame_pool = std::make_shared<FrameBufferPool>(30, 1024 * 1024, config_.numa_node);
 
-                    // 更新统计
-                    {
-                        std::lock_guard<std::mutex> lock(stats_mutex_);
-                        stats_.total_audio_frames++;
-                        stats_.total_audio_bytes_sent += encoded_audio->size;
-                        stats_.total_messages_sent++;
-                    }
+        while (running_.load()) {
+            auto raw_audio = capture_manager_->get_audio_frame(LANE_WAIT_TIMEOUT_MS);
+            if (!raw_audio) {
+                continue;
+            }
 
-                    frame_pool->return_frame(encoded_audio);
+            raw_audio->stamps.stamp(FrameStage::ENCODE_DEQUEUE);
+
+            // 编码音频帧
+            auto encoded_audio = frame_pool->get();
+            if (encoded_audio && compress_engine_->encode_audio(raw_audio, encoded_audio)) {
+                encoded_audio->stamps.stamp(FrameStage::ENCODE_DONE);
+                flight_record(FlightEvent::FRAME_ENCODED, encoded_audio->stamps.stream, encoded_audio->size);
+
+                // 创建消息
+                Message msg(MessageType::AUDIO_FRAME, encoded_audio->size,
+                           ProtocolHelper::get_timestamp_ms());
+                msg.set_payload(encoded_audio->data.data(), encoded_audio->size);
+                msg.set_frame_type(encoded_audio->frame_type);
+                msg.set_pts_ms(encoded_audio->timestamp);
+                msg.set_stamps(encoded_audio->stamps);
+                msg.stamp(FrameStage::FANOUT_ENQUEUE);
+
+                // 放入音频输出队列
+                if (publish(audio_queue_, msg)) {
+                    flight_record(FlightEvent::FRAME_ENQUEUED, msg.get_meta().stamps.stream, msg.get_payload_size());
+                    std::lock_guard<ProfiledMutex> lock(stats_mutex_);
+                    stats_.total_audio_frames++;
+                    stats_.total_audio_bytes_sent += encoded_audio->size;
+                    stats_.total_messages_sent++;
                 }
-                capture_manager_->get_audio_capture()->get_frame_pool()->return_frame(raw_audio);
+
+                frame_pool->return_frame(encoded_audio);
             }
+            capture_manager_->get_audio_capture()->return_frame(raw_audio);
+        }
+    }
+
+    /**
+     * @brief 把消息放入通道的输出队列并唤醒等待的消费者
+     *
+     * @param queue 通道的输出队列
+     * @param msg 要放入的消息
+     * @return true 如果消息被接纳
+     */
+    bool publish(SheddingMessageQueue& queue, const Message& msg) {
+        if (!queue.push(msg)) {
+            return false;
+        }
+
+        // 先获取output_mutex_再通知，避免消费者检查条件后、等待前错过通知
+        {
+            std::lock_guard<ProfiledMutex> lock(output_mutex_);
+        }
+        output_cv_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 从两个通道中取出时间戳较早的消息
+     *
+     * @param[out] out 取出的消息
+     * @return true 如果取到消息
+     *
+     * @note 只合并已经就绪的消息，不会为了严格排序而等待较慢的通道
+     * @note 假设只有一个消费者（分发线程）
+     */
+    bool pop_earliest(Message& out) {
+        uint64_t video_ts = 0;
+        uint64_t audio_ts = 0;
+        bool has_video = video_queue_.peek_timestamp_ms(video_ts);
+        bool has_audio = audio_queue_.peek_timestamp_ms(audio_ts);
+
+        if (has_audio && (!has_video || audio_ts <= video_ts)) {
+            return audio_queue_.try_pop(out) || video_queue_.try_pop(out);
+        }
+        if (has_video) {
+            return video_queue_.try_pop(out) || audio_queue_.try_pop(out);
+        }
+        return false;
+    }
 
-            // 如果没有帧，短暂睡眠以避免CPU浪费
-            if (!has_frame) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    /**
+     * @brief 持续过载时降低编码码率，过载消失一段时间后逐步恢复
+     *
+     * @note 只在压缩引擎启用了自适应码率时生效
+     * @note 恢复不会超过过载前的码率（nominal_bitrate_）
+     */
+    void adjust_bitrate_for_overload() {
+        if (!compress_engine_->get_config().enable_adaptive_bitrate) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        uint32_t current = compress_engine_->get_target_bitrate();
+
+        if (video_queue_.is_overloaded()) {
+            last_overload_time_ = now;
+
+            if (now - last_backoff_time_ < std::chrono::milliseconds(config_.backoff_interval_ms) ||
+                current <= config_.min_bitrate) {
+                return;
             }
+
+            uint32_t reduced = std::max(config_.min_bitrate,
+                                        static_cast<uint32_t>(current * config_.bitrate_backoff));
+            AV_LOG_WARN("MediaProcessor", "Output queue overloaded, reducing bitrate to {}bps", reduced);
+            compress_engine_->set_target_bitrate(reduced);
+            last_backoff_time_ = now;
+
+            std::lock_guard<ProfiledMutex> lock(stats_mutex_);
+            stats_.bitrate_reductions++;
+            return;
+        }
+
+        if (current < nominal_bitrate_ &&
+            now - last_overload_time_ >= std::chrono::milliseconds(config_.recovery_interval_ms) &&
+            now - last_backoff_time_ >= std::chrono::milliseconds(config_.recovery_interval_ms)) {
+            uint32_t raised = std::min(nominal_bitrate_.load(),
+                                       static_cast<uint32_t>(current * config_.bitrate_recovery));
+            compress_engine_->set_target_bitrate(raised);
+            last_backoff_time_ = now;
         }
     }
 
 private:
     CaptureManager* capture_manager_;               // 捕获管理器指针
     CompressionEngine* compress_engine_;            // 压缩引擎指针
+    MediaProcessorConfig config_;                   // 处理器配置
 
     std::atomic<bool> running_;                     // 运行状态
-    std::thread process_thread_;                    // 处理线程
+    std::thread video_thread_;                      // 视频处理通道线程
+    std::thread audio_thread_;                      // 音频处理通道线程
+
+    // 每个通道一个有界输出队列，取消息时按时间戳合并
+    SheddingMessageQueue video_queue_;              // 视频输出队列（待发送）
+    SheddingMessageQueue audio_queue_;              // 音频输出队列（待发送）
+    ProfiledMutex output_mutex_{"MediaProcessor.output"};   // 配合output_cv_使用
+    ProfiledConditionVariable output_cv_;           // 任一通道有新消息时通知消费者
 
-    std::shared_ptr<SafeQueue<Message>> message_queue_;  // 消息队列（待发送）
+    // 过载码率控制（nominal_bitrate_可被外部设置，其余只在视频通道线程中访问）
+    std::atomic<uint32_t> nominal_bitrate_;         // 过载前的目标码率（恢复上限）
+    std::chrono::steady_clock::time_point last_backoff_time_;   // 上次调整码率的时间
+    std::chrono::steady_clock::time_point last_overload_time_;  // 上次检测到过载的时间
 
-    mutable std::mutex stats_mutex_;                // 保护统计信息的互斥锁
+    mutable ProfiledMutex stats_mutex_{"MediaProcessor.stats"};  // 保护统计信息的互斥锁
     ProcessingStatistics stats_;                    // 处理统计信息
 };
 
@@ -34,11 +34,24 @@
 
 #include "AVServer_15_MediaProcessor.h"
 #include "AVServer_07_TcpServer.h"
+#include "AVServer_17_SimulcastForwarder.h"
+#include "AVServer_32_ShardedCounter.h"
+#include "AVServer_34_LockProfiler.h"
+#include "AVServer_35_TcpInfo.h"
 
 // ============================================================================
 // ======================== 客户端流媒体会话 ===================================
 // ============================================================================
 
+/**
+ * @struct SimulcastRoute
+ * @brief 一帧simulcast层帧的路由结果
+ */
+struct SimulcastRoute {
+    SimulcastFrameHeader header;                        // 解析出的simulcast帧头
+    std::vector<std::shared_ptr<Connection>> targets;   // 应接收该帧的连接（不含发布端）
+};
+
 /**
  * @struct ClientSession
  * @brief 客户端流媒体会话信息
@@ -52,6 +65,21 @@ struct ClientSession {
     std::chrono::steady_clock::time_point start_time;  // 会话开始时间
     bool is_active;                     // 是否仍在活跃
 
+    // Simulcast订阅信息
+    bool simulcast_subscriber;          // 是否订阅了simulcast逻辑流
+    uint32_t simulcast_stream_id;       // 订阅的逻辑流ID
+
+    // 截止时间过期统计
+    int latency_target_ms;              // 会话延迟目标（毫秒）
+    uint64_t frames_expired;            // 超过截止时间被丢弃的视频帧数
+    uint64_t frames_gop_dropped;        // 因参考帧丢失被连带丢弃的视频帧数
+
+    // 传输层状态（TcpServer按周期采样的TCP_INFO，见TcpInfo.h）
+    TcpTransportInfo transport;
+
+    // 该客户端的连接（转发时直接取用，不必再按ID查TcpServer的连接表）
+    std::weak_ptr<Connection> connection;
+
     /**
      * @brief 构造函数
      */
@@ -62,7 +90,12 @@ struct ClientSession {
           bytes_sent(0),
           messages_sent(0),
           start_time(std::chrono::steady_clock::now()),
-          is_active(true) {
+          is_active(true),
+          simulcast_subscriber(false),
+          simulcast_stream_id(0),
+          latency_target_ms(500),
+          frames_expired(0),
+          frames_gop_dropped(0) {
     }
 
     /**
@@ -184,16 +217,14 @@ public:
     /**
      * @brief 构造函数
      *
-     * @param processor 媒体处理器指针
+     * @param processor 媒体处理器指针（可以为空：媒体由阶段图管道直接分发，
+     *                  服务只管理客户端会话）
      */
     explicit StreamingService(MediaProcessor* processor)
         : processor_(processor),
           running_(false),
           distribution_thread_(),
-          clients_(),
-          clients_mutex_(),
-          stats_(),
-          stats_mutex_() {
+          clients_() {
         std::cout << "[StreamingService] Initialized" << std::endl;
     }
 
@@ -214,13 +245,12 @@ public:
             return true;
         }
 
-        if (!processor_) {
-            std::cerr << "[StreamingService] Missing media processor" << std::endl;
-            return false;
-        }
-
         running_ = true;
-        distribution_thread_ = std::thread(&StreamingService::distribution_loop, this);
+        if (processor_) {
+            distribution_thread_ = std::thread(&StreamingService::distribution_loop, this);
+        } else {
+            std::cout << "[StreamingService] No media processor, managing sessions only" << std::endl;
+        }
 
         std::cout << "[StreamingService] Started" << std::endl;
         return true;
@@ -242,7 +272,7 @@ public:
 
         // 清理客户端
         {
-            std::lock_guard<std::mutex> lock(clients_mutex_);
+            std::lock_guard<ProfiledMutex> lock(clients_mutex_);
             clients_.clear();
         }
 
@@ -255,24 +285,21 @@ public:
      * @param client_id 客户端连接ID
      * @param client_addr 客户端地址
      * @param bitrate_limit 该客户端的码率限制（bps）
+     * @param connection 客户端的连接；为空时该客户端不会出现在simulcast路由结果中
      *
      * @note 当客户端连接时调用
      */
     void register_client(uint32_t client_id, const std::string& client_addr,
-                        uint32_t bitrate_limit = 5000000) {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
+                        uint32_t bitrate_limit = 5000000,
+                        const std::shared_ptr<Connection>& connection = nullptr) {
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
 
         clients_[client_id] = ClientSession(client_id, client_addr);
         clients_[client_id].bitrate_limit = bitrate_limit;
+        clients_[client_id].connection = connection;
+        counters_.add(COUNTER_CLIENTS_CONNECTED);
 
-        {
-            std::lock_guard<std::mutex> stats_lock(stats_mutex_);
-            stats_.total_clients_connected++;
-            stats_.current_active_clients++;
-        }
-
-        std::cout << "[StreamingService] Client " << client_id << " (" << client_addr
-                  << ") registered" << std::endl;
+        AV_LOG_INFO("StreamingService", "Client {} ({}) registered", client_id, client_addr);
     }
 
     /**
@@ -283,18 +310,15 @@ public:
      * @note 当客户端断开连接时调用
      */
     void unregister_client(uint32_t client_id) {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
 
         auto it = clients_.find(client_id);
         if (it != clients_.end()) {
-            {
-                std::lock_guard<std::mutex> stats_lock(stats_mutex_);
-                stats_.current_active_clients--;
-            }
-
-            std::cout << "[StreamingService] Client " << client_id << " unregistered" << std::endl;
+            AV_LOG_INFO("StreamingService", "Client {} unregistered", client_id);
             clients_.erase(it);
         }
+
+        forwarder_.unsubscribe(client_id);
     }
 
     /**
@@ -307,7 +331,7 @@ public:
      */
     size_t get_client_queue_size(uint32_t client_id) const {
         // 这是一个简化实现，实际应该维护每个客户端的消息队列
-        return processor_->get_pending_messages();
+        return processor_ ? processor_->get_pending_messages() : 0;
     }
 
     /**
@@ -317,14 +341,172 @@ public:
      * @param bitrate 新的码率限制（bps）
      */
     void set_client_bitrate_limit(uint32_t client_id, uint32_t bitrate) {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
 
         auto it = clients_.find(client_id);
         if (it != clients_.end()) {
             it->second.bitrate_limit = bitrate;
-            std::cout << "[StreamingService] Client " << client_id
-                     << " bitrate limit set to " << bitrate << "bps" << std::endl;
+            AV_LOG_INFO("StreamingService", "Client {} bitrate limit set to {}bps", client_id, bitrate);
+        }
+
+        // simulcast订阅者在下一个关键帧处切换到新预算对应的层
+        forwarder_.set_subscriber_budget(client_id, bitrate);
+    }
+
+    /**
+     * @brief 设置客户端的延迟目标
+     *
+     * @param client_id 客户端ID
+     * @param latency_target_ms 延迟目标（毫秒）
+     *
+     * @note 只记录在会话中，实际生效需要同时设置到连接的发送队列
+     */
+    void set_client_latency_target(uint32_t client_id, int latency_target_ms) {
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+
+        auto it = clients_.find(client_id);
+        if (it != clients_.end()) {
+            it->second.latency_target_ms = latency_target_ms;
+        }
+    }
+
+    /**
+     * @brief 更新客户端的过期丢帧计数
+     *
+     * @param client_id 客户端ID
+     * @param frames_expired 累计过期丢弃的视频帧数
+     * @param frames_gop_dropped 累计因GOP依赖丢弃的视频帧数
+     *
+     * @note 计数来自连接的发送队列，是累计值而不是增量
+     */
+    void update_client_expirations(uint32_t client_id, uint64_t frames_expired,
+                                   uint64_t frames_gop_dropped) {
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+
+        auto it = clients_.find(client_id);
+        if (it != clients_.end()) {
+            it->second.frames_expired = frames_expired;
+            it->second.frames_gop_dropped = frames_gop_dropped;
+        }
+    }
+
+    /**
+     * @brief 更新一批客户端的传输层状态
+     *
+     * @param samples 一个事件循环上所有会话的TCP_INFO采样
+     *
+     * @note 由TcpServer的采样回调调用，整批只获取一次clients_mutex_
+     */
+    void update_clients_transport(const std::vector<TcpServer::TransportSample>& samples) {
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+
+        for (const auto& [client_id, info] : samples) {
+            auto it = clients_.find(client_id);
+            if (it != clients_.end()) {
+                it->second.transport = info;
+            }
+        }
+    }
+
+    // ===== Simulcast选择性转发 =====
+
+    /**
+     * @brief 订阅simulcast逻辑流
+     *
+     * @param client_id 客户端ID
+     * @param stream_id 逻辑流ID
+     * @return true 如果客户端已注册
+     *
+     * @note 订阅者以会话的bitrate_limit作为码率预算选层
+     * @note 订阅后该客户端不再接收本地媒体管道的广播
+     */
+    bool subscribe_stream(uint32_t client_id, uint32_t stream_id) {
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+
+        auto it = clients_.find(client_id);
+        if (it == clients_.end()) {
+            return false;
+        }
+
+        it->second.simulcast_subscriber = true;
+        it->second.simulcast_stream_id = stream_id;
+        forwarder_.subscribe(stream_id, client_id, it->second.bitrate_limit);
+
+        AV_LOG_INFO("StreamingService", "Client {} subscribed to simulcast stream {}", client_id, stream_id);
+        return true;
+    }
+
+    /**
+     * @brief 退订simulcast逻辑流
+     *
+     * @param client_id 客户端ID
+     */
+    void unsubscribe_stream(uint32_t client_id) {
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+
+        auto it = clients_.find(client_id);
+        if (it != clients_.end()) {
+            it->second.simulcast_subscriber = false;
+            it->second.simulcast_stream_id = 0;
+        }
+
+        forwarder_.unsubscribe(client_id);
+    }
+
+    /**
+     * @brief 为发布端的simulcast层帧选择接收者
+     *
+     * @param msg 发布端发来的VIDEO_FRAME消息
+     * @param sender_id 发布端的客户端ID（不会出现在route.targets中）
+     * @param[out] route 解析出的帧头和应接收该帧的连接
+     * @return true 如果消息带有有效的simulcast帧头
+     *
+     * @note route.targets为空时该层帧不应被复制或发送
+     * @note 每个客户端只会收到其当前层的帧，层切换发生在关键帧处
+     * @note 帧头只解析一次；目标连接在已持有的clients_mutex_下取出，每帧不再查TcpServer的连接表
+     */
+    bool route_simulcast_frame(const Message& msg, uint32_t sender_id, SimulcastRoute& route) {
+        route.targets.clear();
+        if (!route.header.parse(msg.get_payload(), msg.get_payload_size())) {
+            return false;
+        }
+
+        std::vector<uint32_t> ids = forwarder_.route_frame(route.header, msg.total_size(), sender_id);
+        if (ids.empty()) {
+            return true;
+        }
+
+        const size_t message_size = msg.total_size();
+        {
+            std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+            route.targets.reserve(ids.size());
+            for (uint32_t id : ids) {
+                auto it = clients_.find(id);
+                if (it == clients_.end()) {
+                    continue;
+                }
+                auto conn = it->second.connection.lock();
+                if (!conn) {
+                    continue;
+                }
+                it->second.bytes_sent += message_size;
+                it->second.messages_sent++;
+                route.targets.push_back(std::move(conn));
+            }
         }
+
+        counters_.add(COUNTER_MESSAGES_DISTRIBUTED, route.targets.size());
+        counters_.add(COUNTER_BYTES_DISTRIBUTED, route.targets.size() * message_size);
+        return true;
+    }
+
+    /**
+     * @brief 获取simulcast转发统计
+     *
+     * @return Simulcast统计结构体
+     */
+    SimulcastStatistics get_simulcast_statistics() const {
+        return forwarder_.get_statistics();
     }
 
     /**
@@ -334,7 +516,7 @@ public:
      * @return 客户端会话信息
      */
     ClientSession get_client_info(uint32_t client_id) const {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
 
         auto it = clients_.find(client_id);
         if (it != clients_.end()) {
@@ -350,7 +532,7 @@ public:
      * @return 客户端会话信息的映射
      */
     std::map<uint32_t, ClientSession> get_all_clients() const {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
         return clients_;
     }
 
@@ -358,10 +540,26 @@ public:
      * @brief 获取流媒体统计信息
      *
      * @return 流媒体统计结构体
+     *
+     * @note 码率等派生值在读取时由各会话计算，分发路径只累加计数
      */
     StreamingStatistics get_statistics() const {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        return stats_;
+        StreamingStatistics stats;
+        stats.total_clients_connected = counters_.sum(COUNTER_CLIENTS_CONNECTED);
+        stats.total_messages_distributed = counters_.sum(COUNTER_MESSAGES_DISTRIBUTED);
+        stats.total_bytes_distributed = counters_.sum(COUNTER_BYTES_DISTRIBUTED);
+
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+        stats.current_active_clients = static_cast<uint32_t>(clients_.size());
+        if (!clients_.empty()) {
+            uint32_t total_bitrate = 0;
+            for (const auto& [id, session] : clients_) {
+                total_bitrate += session.get_actual_bitrate();
+            }
+            stats.average_client_bitrate = total_bitrate / clients_.size();
+            stats.total_bandwidth_usage = total_bitrate * clients_.size();
+        }
+        return stats;
     }
 
     /**
@@ -369,13 +567,14 @@ public:
      */
     void print_statistics() const {
         std::cout << get_statistics().to_string() << std::endl;
+        forwarder_.print_statistics();
     }
 
     /**
      * @brief 输出所有客户端的连接信息
      */
     void print_clients_info() const {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
+        std::lock_guard<ProfiledMutex> lock(clients_mutex_);
 
         std::cout << "\n=== Connected Clients ===" << std::endl;
         std::cout << "Total: " << clients_.size() << std::endl;
@@ -385,7 +584,22 @@ public:
                      << " | Bitrate: " << (session.get_actual_bitrate() / 1000000.0)
                      << " Mbps | Duration: " << session.get_duration_seconds() << "s"
                      << " | Sent: " << (session.bytes_sent / (1024.0 * 1024.0)) << " MB"
-                     << std::endl;
+                     << " | Expired: " << session.frames_expired
+                     << " (+" << session.frames_gop_dropped << " GOP)"
+                     << " @ " << session.latency_target_ms << "ms";
+
+            SimulcastSubscriber sub;
+            if (session.simulcast_subscriber && forwarder_.get_subscriber(id, sub)) {
+                std::cout << " | Stream: " << session.simulcast_stream_id
+                          << " Layer: " << sub.current_layer
+                          << " (target " << sub.target_layer << ")"
+                          << " Switches: " << sub.layer_switches;
+            }
+
+            std::cout << std::endl;
+            if (session.transport.valid()) {
+                std::cout << "    " << session.transport.to_string() << std::endl;
+            }
         }
 
         std::cout << "" << std::endl;
@@ -435,32 +649,26 @@ private:
      * @note 实际应该维护每个客户端的消息队列
      */
     void distribute_message(const Message& msg) {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
-        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
-
-        for (auto& [id, session] : clients_) {
-            if (session.is_active) {
-                // 检查该客户端的码率限制
-                // 这里简化处理，实际应该实现更复杂的流量控制
-
-                // 记录统计
-                session.bytes_sent += msg.total_size();
-                session.messages_sent++;
-
-                stats_.total_messages_distributed++;
-                stats_.total_bytes_distributed += msg.total_size();
+        const size_t message_size = msg.total_size();
+        uint64_t delivered = 0;
+        {
+            std::lock_guard<ProfiledMutex> lock(clients_mutex_);
+            for (auto& [id, session] : clients_) {
+                if (session.is_active) {
+                    // 检查该客户端的码率限制
+                    // 这里简化处理，实际应该实现更复杂的流量控制
+
+                    // 记录统计
+                    session.bytes_sent += message_size;
+                    session.messages_sent++;
+                    delivered++;
+                }
             }
         }
 
-        // 计算平均码率
-        if (!clients_.empty()) {
-            uint32_t total_bitrate = 0;
-            for (const auto& [id, session] : clients_) {
-                total_bitrate += session.get_actual_bitrate();
-            }
-            stats_.average_client_bitrate = total_bitrate / clients_.size();
-            stats_.total_bandwidth_usage = total_bitrate * clients_.size();
-        }
+        // 平均码率在get_statistics()中计算，不在每条消息上遍历会话
+        counters_.add(COUNTER_MESSAGES_DISTRIBUTED, delivered);
+        counters_.add(COUNTER_BYTES_DISTRIBUTED, delivered * message_size);
     }
 
 private:
@@ -469,11 +677,18 @@ private:
     std::atomic<bool> running_;                          // 运行状态
     std::thread distribution_thread_;                    // 分发线程
 
-    mutable std::mutex clients_mutex_;                   // 保护客户端映射的互斥锁
+    mutable ProfiledMutex clients_mutex_{"StreamingService.clients"};  // 保护客户端映射的互斥锁
     std::map<uint32_t, ClientSession> clients_;          // 客户端会话映射（ID -> Session）
 
-    mutable std::mutex stats_mutex_;                     // 保护统计信息的互斥锁
-    StreamingStatistics stats_;                          // 流媒体统计信息
+    enum StreamingCounter {
+        COUNTER_CLIENTS_CONNECTED = 0,
+        COUNTER_MESSAGES_DISTRIBUTED,
+        COUNTER_BYTES_DISTRIBUTED,
+        STREAMING_COUNTER_COUNT
+    };
+    ShardedCounters<STREAMING_COUNTER_COUNT> counters_;  // 流媒体统计计数（按线程分片，无锁）
+
+    SimulcastForwarder forwarder_;                       // Simulcast选择性转发器
 };
 
 #endif // STREAMING_SERVICE_H
@@ -0,0 +1,553 @@
+/*
+ * SimulcastForwarder.h - Simulcast选择性转发单元（SFU）
+ *
+ * 功能：
+ * - 在一个逻辑流下接收发布端的多路编码层（simulcast layers）
+ * - 为每个订阅者选择不超过其码率预算的最佳层
+ * - 仅在目标层的关键帧处切换层，保证解码连续
+ * - 未被任何订阅者选中的层不会进入任何发送路径
+ *
+ * 设计特点：
+ * - 服务器端不做转码，只做转发决策
+ * - 转发决策返回订阅者ID列表，消息对象本身只有一份
+ * - 线程安全，可在线程池线程中直接调用
+ *
+ * 帧格式：
+ * 发布端发送的VIDEO_FRAME消息体以固定12字节的simulcast帧头开始：
+ * [stream_id:4][layer_id:1][frame_type:1][reserved:2][layer_bitrate:4][编码数据...]
+ *
+ * stream_id:     逻辑流ID（同一源的所有层共享）
+ * layer_id:      层ID（0为最低层）
+ * frame_type:    FrameType枚举值（I/P/B）
+ * layer_bitrate: 该层的标称码率（bps），用于订阅者选层
+ *
+ * 使用场景：
+ * - 会议场景下的多码率转发
+ * - 异构带宽的订阅者共享同一发布源
+ */
+
+#ifndef SIMULCAST_FORWARDER_H
+#define SIMULCAST_FORWARDER_H
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "AVServer_03_FrameBuffer.h"
+
+// ============================================================================
+// ======================== Simulcast帧头 ====================================
+// ============================================================================
+
+/**
+ * @struct SimulcastFrameHeader
+ * @brief 发布端VIDEO_FRAME消息体前的simulcast帧头
+ *
+ * 大小：12字节（固定，小端序）
+ */
+struct SimulcastFrameHeader {
+    static constexpr size_t HEADER_SIZE = 12;       // 帧头固定大小
+
+    uint32_t stream_id;          // [0-3]   逻辑流ID
+    uint8_t layer_id;            // [4]     层ID
+    uint8_t frame_type;          // [5]     FrameType枚举值
+    uint16_t reserved;           // [6-7]   保留
+    uint32_t layer_bitrate;      // [8-11]  该层的标称码率（bps）
+
+    /**
+     * @brief 构造函数 - 初始化为0
+     */
+    SimulcastFrameHeader()
+        : stream_id(0),
+          layer_id(0),
+          frame_type(static_cast<uint8_t>(FrameType::VIDEO_P_FRAME)),
+          reserved(0),
+          layer_bitrate(0) {
+    }
+
+    /**
+     * @brief 从消息体解析帧头
+     *
+     * @param[in] data 消息体指针
+     * @param size 消息体大小
+     * @return true 如果消息体足够长且frame_type是视频帧类型
+     */
+    bool parse(const uint8_t* data, size_t size) {
+        if (!data || size < HEADER_SIZE) {
+            return false;
+        }
+
+        stream_id = read_u32(data);
+        layer_id = data[4];
+        frame_type = data[5];
+        reserved = static_cast<uint16_t>(data[6] | (data[7] << 8));
+        layer_bitrate = read_u32(data + 8);
+
+        return frame_type <= static_cast<uint8_t>(FrameType::VIDEO_B_FRAME);
+    }
+
+    /**
+     * @brief 序列化帧头
+     *
+     * @param[out] buffer 输出缓冲区（至少12字节）
+     * @return 写入的字节数
+     */
+    size_t serialize(uint8_t* buffer) const {
+        if (!buffer) {
+            return 0;
+        }
+
+        write_u32(buffer, stream_id);
+        buffer[4] = layer_id;
+        buffer[5] = frame_type;
+        buffer[6] = static_cast<uint8_t>(reserved & 0xFF);
+        buffer[7] = static_cast<uint8_t>(reserved >> 8);
+        write_u32(buffer + 8, layer_bitrate);
+        return HEADER_SIZE;
+    }
+
+    /**
+     * @brief 是否为关键帧
+     */
+    bool is_keyframe() const {
+        return frame_type == static_cast<uint8_t>(FrameType::VIDEO_I_FRAME);
+    }
+
+private:
+    static uint32_t read_u32(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0]) |
+               (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) |
+               (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    static void write_u32(uint8_t* p, uint32_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+        p[2] = static_cast<uint8_t>(v >> 16);
+        p[3] = static_cast<uint8_t>(v >> 24);
+    }
+};
+
+// ============================================================================
+// ======================== 层和订阅者状态 ====================================
+// ============================================================================
+
+/**
+ * @struct SimulcastLayer
+ * @brief 逻辑流中的一路编码层
+ */
+struct SimulcastLayer {
+    uint8_t layer_id;                   // 层ID
+    uint32_t bitrate;                   // 发布端声明的码率（bps）
+    uint64_t frames_received;           // 收到的帧数
+    uint64_t bytes_received;            // 收到的字节数
+    uint64_t frames_forwarded;          // 被转发的帧数（按订阅者计）
+    std::chrono::steady_clock::time_point last_frame_time;  // 最后收到帧的时间
+
+    SimulcastLayer(uint8_t id = 0, uint32_t rate = 0)
+        : layer_id(id),
+          bitrate(rate),
+          frames_received(0),
+          bytes_received(0),
+          frames_forwarded(0),
+          last_frame_time(std::chrono::steady_clock::now()) {
+    }
+
+    /**
+     * @brief 检查该层最近是否仍有数据
+     *
+     * @param timeout_ms 无数据超时阈值（毫秒）
+     */
+    bool is_active(int timeout_ms) const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - last_frame_time).count();
+        return elapsed <= timeout_ms;
+    }
+};
+
+/**
+ * @struct SimulcastSubscriber
+ * @brief 订阅者在某个逻辑流上的转发状态
+ *
+ * current_layer是当前正在转发的层，target_layer是根据预算选出的层。
+ * 两者不同时，等待target_layer的下一个关键帧再切换。
+ */
+struct SimulcastSubscriber {
+    static constexpr int NO_LAYER = -1;
+
+    uint32_t client_id;                 // 订阅者连接ID
+    uint32_t budget_bps;                // 订阅者的码率预算
+    int current_layer;                  // 当前转发的层（NO_LAYER表示尚未开始）
+    int target_layer;                   // 目标层
+    uint64_t layer_switches;            // 层切换次数
+    uint64_t frames_forwarded;          // 已转发帧数
+    uint64_t bytes_forwarded;           // 已转发字节数
+
+    SimulcastSubscriber(uint32_t id = 0, uint32_t budget = 0)
+        : client_id(id),
+          budget_bps(budget),
+          current_layer(NO_LAYER),
+          target_layer(NO_LAYER),
+          layer_switches(0),
+          frames_forwarded(0),
+          bytes_forwarded(0) {
+    }
+};
+
+/**
+ * @struct SimulcastStatistics
+ * @brief Simulcast转发统计
+ */
+struct SimulcastStatistics {
+    uint32_t active_streams;            // 逻辑流数量
+    uint32_t total_layers;              // 所有流的层数之和
+    uint32_t total_subscribers;         // 订阅者数量
+    uint64_t frames_ingested;           // 收到的层帧数
+    uint64_t frames_forwarded;          // 转发的帧数（按订阅者计）
+    uint64_t frames_unused;             // 没有任何订阅者需要的层帧数
+    uint64_t layer_switches;            // 层切换总次数
+
+    SimulcastStatistics()
+        : active_streams(0),
+          total_layers(0),
+          total_subscribers(0),
+          frames_ingested(0),
+          frames_forwarded(0),
+          frames_unused(0),
+          layer_switches(0) {
+    }
+
+    std::string to_string() const {
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer),
+            "Simulcast Stats [Streams: %u, Layers: %u, Subscribers: %u, "
+            "Ingested: %llu, Forwarded: %llu, Unused: %llu, Switches: %llu]",
+            active_streams, total_layers, total_subscribers,
+            static_cast<unsigned long long>(frames_ingested),
+            static_cast<unsigned long long>(frames_forwarded),
+            static_cast<unsigned long long>(frames_unused),
+            static_cast<unsigned long long>(layer_switches));
+        return std::string(buffer);
+    }
+};
+
+// ============================================================================
+// ======================== Simulcast转发器 ==================================
+// ============================================================================
+
+/**
+ * @class SimulcastForwarder
+ * @brief 选择性转发单元：决定每个层帧应该发给哪些订阅者
+ *
+ * 工作流程：
+ * 1. 发布端的层帧到达，更新该层的码率和活跃状态
+ * 2. 对该流的每个订阅者，按预算重新计算目标层
+ * 3. 订阅者的current_layer等于该层时转发
+ * 4. 目标层的关键帧到达时，订阅者切换到目标层并从该关键帧开始转发
+ *
+ * 使用示例：
+ * @code
+ *   SimulcastForwarder forwarder;
+ *   forwarder.subscribe(stream_id, client_id, 1500000);
+ *
+ *   // 收到发布端的VIDEO_FRAME
+ *   SimulcastFrameHeader header;
+ *   if (header.parse(msg.get_payload(), msg.get_payload_size())) {
+ *       auto targets = forwarder.route_frame(header, msg.total_size(), publisher_id);
+ *       for (uint32_t id : targets) {
+ *           // 向订阅者id发送同一个msg对象
+ *       }
+ *   }
+ * @endcode
+ */
+class SimulcastForwarder {
+public:
+    /**
+     * @brief 构造函数
+     *
+     * @param layer_timeout_ms 层无数据多久后不再作为候选层（毫秒）
+     */
+    explicit SimulcastForwarder(int layer_timeout_ms = 2000)
+        : layer_timeout_ms_(layer_timeout_ms) {
+    }
+
+    /**
+     * @brief 订阅逻辑流
+     *
+     * @param stream_id 逻辑流ID
+     * @param client_id 订阅者连接ID
+     * @param budget_bps 订阅者码率预算（bps）
+     *
+     * @note 一个连接同时只订阅一个逻辑流，重复订阅会先退订旧流
+     */
+    void subscribe(uint32_t stream_id, uint32_t client_id, uint32_t budget_bps) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        remove_subscriber_locked(client_id);
+
+        auto& stream = streams_[stream_id];
+        stream.subscribers[client_id] = SimulcastSubscriber(client_id, budget_bps);
+        subscriptions_[client_id] = stream_id;
+    }
+
+    /**
+     * @brief 退订（连接断开或STOP_STREAM时调用）
+     *
+     * @param client_id 订阅者连接ID
+     */
+    void unsubscribe(uint32_t client_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        remove_subscriber_locked(client_id);
+    }
+
+    /**
+     * @brief 更新订阅者的码率预算
+     *
+     * @param client_id 订阅者连接ID
+     * @param budget_bps 新的码率预算（bps）
+     *
+     * @note 新目标层在其下一个关键帧处生效
+     */
+    void set_subscriber_budget(uint32_t client_id, uint32_t budget_bps) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto sub_it = subscriptions_.find(client_id);
+        if (sub_it == subscriptions_.end()) {
+            return;
+        }
+
+        auto stream_it = streams_.find(sub_it->second);
+        if (stream_it == streams_.end()) {
+            return;
+        }
+
+        SimulcastStream& stream = stream_it->second;
+        auto it = stream.subscribers.find(client_id);
+        if (it != stream.subscribers.end()) {
+            it->second.budget_bps = budget_bps;
+            it->second.target_layer = select_layer(stream, budget_bps);
+        }
+    }
+
+    /**
+     * @brief 检查连接是否是simulcast订阅者
+     */
+    bool is_subscribed(uint32_t client_id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return subscriptions_.count(client_id) > 0;
+    }
+
+    /**
+     * @brief 为一个层帧做转发决策
+     *
+     * @param header 已解析的simulcast帧头
+     * @param message_size 完整消息大小（字节，用于统计）
+     * @param sender_id 发布者连接ID（即使订阅了同一个流也不会回送给它）
+     * @return 应该接收该帧的订阅者ID列表（可能为空）
+     *
+     * @note 返回空列表意味着该层当前没人用，调用方不应复制或排队该消息
+     * @note 只为有订阅者的流记录层状态，流ID由客户端决定，不能为任意ID建状态
+     */
+    std::vector<uint32_t> route_frame(const SimulcastFrameHeader& header,
+                                      size_t message_size,
+                                      uint32_t sender_id) {
+        std::vector<uint32_t> targets;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.frames_ingested++;
+
+        auto stream_it = streams_.find(header.stream_id);
+        if (stream_it == streams_.end()) {
+            // 没有订阅者的流（最后一个订阅者离开时流已被移除）
+            stats_.frames_unused++;
+            return targets;
+        }
+        SimulcastStream& stream = stream_it->second;
+
+        // 更新层信息
+        auto layer_it = stream.layers.find(header.layer_id);
+        bool new_layer = (layer_it == stream.layers.end());
+        if (new_layer) {
+            layer_it = stream.layers.emplace(
+                header.layer_id,
+                SimulcastLayer(header.layer_id, header.layer_bitrate)).first;
+        }
+
+        SimulcastLayer& layer = layer_it->second;
+        bool bitrate_changed = (layer.bitrate != header.layer_bitrate);
+        layer.bitrate = header.layer_bitrate;
+        layer.frames_received++;
+        layer.bytes_received += message_size;
+        layer.last_frame_time = std::chrono::steady_clock::now();
+
+        const int layer_id = header.layer_id;
+        const bool keyframe = header.is_keyframe();
+
+        for (auto& [id, sub] : stream.subscribers) {
+            // 层集合或码率变化，或者只有在关键帧处才可能切换时，重新选择目标层
+            if (new_layer || bitrate_changed || keyframe ||
+                sub.target_layer == SimulcastSubscriber::NO_LAYER) {
+                sub.target_layer = select_layer(stream, sub.budget_bps);
+            }
+
+            // 在目标层的关键帧处切换
+            if (keyframe && layer_id == sub.target_layer &&
+                sub.current_layer != layer_id) {
+                if (sub.current_layer != SimulcastSubscriber::NO_LAYER) {
+                    sub.layer_switches++;
+                    stats_.layer_switches++;
+                }
+                sub.current_layer = layer_id;
+            }
+
+            if (sub.current_layer == layer_id && id != sender_id) {
+                sub.frames_forwarded++;
+                sub.bytes_forwarded += message_size;
+                layer.frames_forwarded++;
+                targets.push_back(id);
+            }
+        }
+
+        if (targets.empty()) {
+            stats_.frames_unused++;
+        } else {
+            stats_.frames_forwarded += targets.size();
+        }
+
+        return targets;
+    }
+
+    /**
+     * @brief 获取订阅者状态
+     *
+     * @param client_id 订阅者连接ID
+     * @param[out] out 订阅者状态
+     * @return true 如果该连接是订阅者
+     */
+    bool get_subscriber(uint32_t client_id, SimulcastSubscriber& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto sub_it = subscriptions_.find(client_id);
+        if (sub_it == subscriptions_.end()) {
+            return false;
+        }
+
+        auto stream_it = streams_.find(sub_it->second);
+        if (stream_it == streams_.end()) {
+            return false;
+        }
+
+        auto it = stream_it->second.subscribers.find(client_id);
+        if (it == stream_it->second.subscribers.end()) {
+            return false;
+        }
+
+        out = it->second;
+        return true;
+    }
+
+    /**
+     * @brief 获取转发统计
+     */
+    SimulcastStatistics get_statistics() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        SimulcastStatistics stats = stats_;
+        stats.active_streams = static_cast<uint32_t>(streams_.size());
+        stats.total_layers = 0;
+        stats.total_subscribers = static_cast<uint32_t>(subscriptions_.size());
+        for (const auto& [id, stream] : streams_) {
+            stats.total_layers += static_cast<uint32_t>(stream.layers.size());
+        }
+        return stats;
+    }
+
+    /**
+     * @brief 输出统计信息
+     */
+    void print_statistics() const {
+        std::cout << get_statistics().to_string() << std::endl;
+    }
+
+private:
+    /**
+     * @struct SimulcastStream
+     * @brief 一个逻辑流：多路层 + 订阅者
+     */
+    struct SimulcastStream {
+        std::map<uint8_t, SimulcastLayer> layers;             // 层ID -> 层
+        std::map<uint32_t, SimulcastSubscriber> subscribers;  // 连接ID -> 订阅者
+    };
+
+    /**
+     * @brief 为给定预算选择最佳层
+     *
+     * @return 码率不超过预算的最高层；都超预算时返回最低层；没有活跃层返回NO_LAYER
+     *
+     * @note 调用者必须持有mutex_
+     */
+    int select_layer(const SimulcastStream& stream, uint32_t budget_bps) const {
+        int best = SimulcastSubscriber::NO_LAYER;
+        uint32_t best_bitrate = 0;
+        int lowest = SimulcastSubscriber::NO_LAYER;
+        uint32_t lowest_bitrate = UINT32_MAX;
+
+        for (const auto& [id, layer] : stream.layers) {
+            if (!layer.is_active(layer_timeout_ms_)) {
+                continue;
+            }
+
+            if (layer.bitrate < lowest_bitrate) {
+                lowest_bitrate = layer.bitrate;
+                lowest = id;
+            }
+
+            if (layer.bitrate <= budget_bps &&
+                (best == SimulcastSubscriber::NO_LAYER || layer.bitrate > best_bitrate)) {
+                best_bitrate = layer.bitrate;
+                best = id;
+            }
+        }
+
+        return best != SimulcastSubscriber::NO_LAYER ? best : lowest;
+    }
+
+    /**
+     * @brief 移除订阅者，流为空时一并移除
+     *
+     * @note 调用者必须持有mutex_
+     */
+    void remove_subscriber_locked(uint32_t client_id) {
+        auto sub_it = subscriptions_.find(client_id);
+        if (sub_it == subscriptions_.end()) {
+            return;
+        }
+
+        auto stream_it = streams_.find(sub_it->second);
+        if (stream_it != streams_.end()) {
+            stream_it->second.subscribers.erase(client_id);
+            if (stream_it->second.subscribers.empty()) {
+                streams_.erase(stream_it);
+            }
+        }
+
+        subscriptions_.erase(sub_it);
+    }
+
+private:
+    const int layer_timeout_ms_;                        // 层超时阈值（毫秒）
+
+    mutable std::mutex mutex_;                          // 保护以下所有状态
+    std::map<uint32_t, SimulcastStream> streams_;       // 流ID -> 逻辑流
+    std::map<uint32_t, uint32_t> subscriptions_;        // 连接ID -> 流ID
+    SimulcastStatistics stats_;                         // 转发统计
+};
+
+#endif // SIMULCAST_FORWARDER_H
@@ -0,0 +1,588 @@
+/*
+ * PrioritySendQueue.h - 连接级优先级发送队列
+ *
+ * 功能：
+ * - 按严格优先级调度发往同一连接的消息
+ * - 优先级：控制/心跳 > 音频 > 关键帧(I) > 非关键帧(P/B)
+ * - 同一优先级内保持FIFO顺序
+ * - 防饿死：低优先级连续被跳过一定次数后强制服务一次
+ * - 过期丢弃：超过截止时间（PTS + 会话延迟目标）的视频帧在发送前被丢弃
+ * - GOP依赖：丢弃参考帧（I/P）时一并丢弃依赖它的后续帧，直到下一个I帧
+ *
+ * 设计思想：
+ * - 拥塞时心跳和音频继续流动，会话不会因超时断开，声音保持可懂
+ * - 视频质量下降，而不是整个连接卡死
+ * - 队列元素是共享的只读消息，扇出到多个连接时不复制消息体
+ *
+ * 使用场景：
+ * - Connection的出站队列
+ * - 任何需要按媒体类型区分优先级的发送路径
+ */
+
+#ifndef PRIORITY_SEND_QUEUE_H
+#define PRIORITY_SEND_QUEUE_H
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "AVServer_06_MessageProtocol.h"
+#include "AVServer_36_FlightRecorder.h"
+
+// ============================================================================
+// ======================== 优先级定义 ========================================
+// ============================================================================
+
+/**
+ * @enum SendPriority
+ * @brief 发送优先级（数值越小优先级越高）
+ */
+enum class SendPriority : uint8_t {
+    CONTROL = 0,                    // 控制消息、心跳、确认、错误
+    AUDIO = 1,                      // 音频帧
+    KEYFRAME = 2,                   // 视频关键帧（I帧）
+    DELTA = 3,                      // 视频非关键帧（P帧、B帧）
+};
+
+/**
+ * @brief 优先级数量
+ */
+constexpr size_t SEND_PRIORITY_COUNT = 4;
+
+/**
+ * @brief 根据消息类型和元数据确定发送优先级
+ *
+ * @param msg 要发送的消息
+ * @return 发送优先级
+ *
+ * @note 没有标记帧类型的视频消息按非关键帧处理
+ */
+inline SendPriority classify_send_priority(const Message& msg) {
+    switch (msg.get_type()) {
+        case MessageType::AUDIO_FRAME:
+            return SendPriority::AUDIO;
+
+        case MessageType::VIDEO_FRAME:
+        case MessageType::FRAME_DATA: {
+            const MessageMeta& meta = msg.get_meta();
+            if (meta.has_frame_type) {
+                if (meta.frame_type == FrameType::AUDIO_FRAME) {
+                    return SendPriority::AUDIO;
+                }
+                if (meta.frame_type == FrameType::VIDEO_I_FRAME) {
+                    return SendPriority::KEYFRAME;
+                }
+            }
+            return SendPriority::DELTA;
+        }
+
+        default:
+            // 控制消息和状态消息
+            return SendPriority::CONTROL;
+    }
+}
+
+/**
+ * @brief 获取优先级的字符串描述
+ */
+inline const char* send_priority_to_string(SendPriority priority) {
+    switch (priority) {
+        case SendPriority::CONTROL:  return "CONTROL";
+        case SendPriority::AUDIO:    return "AUDIO";
+        case SendPriority::KEYFRAME: return "KEYFRAME";
+        case SendPriority::DELTA:    return "DELTA";
+        default:                     return "UNKNOWN";
+    }
+}
+
+// ============================================================================
+// ======================== 队列配置和统计 ====================================
+// ============================================================================
+
+/**
+ * @struct SendQueueConfig
+ * @brief 优先级发送队列的配置参数
+ */
+struct SendQueueConfig {
+    size_t max_messages;            // 队列中最多排队的消息数（超出时丢弃最旧的非关键帧）
+    uint32_t starvation_limit;      // 非空的低优先级被连续跳过多少次后强制服务
+    int latency_target_ms;          // 默认会话延迟目标（毫秒），视频帧截止时间 = PTS + 该值
+
+    SendQueueConfig()
+        : max_messages(1024),
+          starvation_limit(16),
+          latency_target_ms(500) {
+    }
+};
+
+/**
+ * @struct SendQueueStatistics
+ * @brief 优先级发送队列的统计信息
+ */
+struct SendQueueStatistics {
+    std::array<uint64_t, SEND_PRIORITY_COUNT> enqueued;   // 各优先级入队数
+    std::array<uint64_t, SEND_PRIORITY_COUNT> dequeued;   // 各优先级出队（发送）数
+    std::array<uint64_t, SEND_PRIORITY_COUNT> expired;    // 各优先级过期丢弃数
+    uint64_t overflow_dropped;      // 队列满时丢弃的消息数
+    uint64_t gop_dropped;           // 因参考帧被丢弃或已被新GOP取代而丢弃的依赖帧数
+    uint64_t starvation_grants;     // 因防饿死而提前服务低优先级的次数
+    size_t current_depth;           // 当前排队消息数
+    size_t max_depth;               // 历史最大排队消息数
+
+    SendQueueStatistics()
+        : overflow_dropped(0),
+          gop_dropped(0),
+          starvation_grants(0),
+          current_depth(0),
+          max_depth(0) {
+        enqueued.fill(0);
+        dequeued.fill(0);
+        expired.fill(0);
+    }
+
+    /**
+     * @brief 获取所有优先级的过期丢弃总数
+     */
+    uint64_t total_expired() const {
+        uint64_t total = 0;
+        for (auto n : expired) {
+            total += n;
+        }
+        return total;
+    }
+
+    std::string to_string() const {
+        char buffer[384];
+        std::snprintf(buffer, sizeof(buffer),
+            "SendQueue [Depth: %zu/%zu, Sent C/A/K/D: %llu/%llu/%llu/%llu, "
+            "Expired K/D: %llu/%llu, GOP dropped: %llu, Overflow: %llu, "
+            "Starvation grants: %llu]",
+            current_depth, max_depth,
+            static_cast<unsigned long long>(dequeued[0]),
+            static_cast<unsigned long long>(dequeued[1]),
+            static_cast<unsigned long long>(dequeued[2]),
+            static_cast<unsigned long long>(dequeued[3]),
+            static_cast<unsigned long long>(expired[2]),
+            static_cast<unsigned long long>(expired[3]),
+            static_cast<unsigned long long>(gop_dropped),
+            static_cast<unsigned long long>(overflow_dropped),
+            static_cast<unsigned long long>(starvation_grants));
+        return std::string(buffer);
+    }
+};
+
+// ============================================================================
+// ======================== 优先级发送队列 ====================================
+// ============================================================================
+
+/**
+ * @class PrioritySendQueue
+ * @brief 严格优先级 + 防饿死 + 视频过期丢弃的发送队列
+ *
+ * 调度规则：
+ * 1. 先丢弃各视频队列头部已过期的帧
+ * 2. 如果某个非空的低优先级已被连续跳过starvation_limit次，先服务它
+ * 3. 否则服务最高的非空优先级
+ *
+ * 截止时间：
+ * - 带PTS的视频帧：PTS + 延迟目标（换算到steady_clock）
+ * - 不带PTS的视频帧：入队时间 + 延迟目标
+ * - 入队时已经过期的帧直接丢弃，不占用队列
+ *
+ * GOP依赖（假设每个连接只承载一路视频）：
+ * - 丢弃I帧或P帧后，队列中在它之后、下一个I帧之前的非关键帧全部丢弃
+ * - 如果队列中没有后续I帧，新到的非关键帧也会被拒绝，直到下一个I帧入队
+ * - B帧不被其他帧参考，丢弃B帧不影响后续帧
+ * - I帧发出后，比它更早入队的非关键帧属于旧GOP，随之丢弃
+ *
+ * 使用示例：
+ * @code
+ *   PrioritySendQueue queue;
+ *   queue.push(std::make_shared<const Message>(heartbeat));
+ *   queue.push(video_msg);
+ *
+ *   std::shared_ptr<const Message> next;
+ *   while (queue.pop(next)) {
+ *       // 发送next...
+ *   }
+ * @endcode
+ *
+ * @note 线程安全，push和pop可以在不同线程中调用
+ */
+class PrioritySendQueue {
+public:
+    using MessagePtr = std::shared_ptr<const Message>;
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief 构造函数
+     *
+     * @param config 队列配置
+     */
+    explicit PrioritySendQueue(const SendQueueConfig& config = SendQueueConfig())
+        : config_(config),
+          depth_(0),
+          next_seq_(0),
+          gop_broken_(false) {
+        skipped_.fill(0);
+    }
+
+    PrioritySendQueue(const PrioritySendQueue&) = delete;
+    PrioritySendQueue& operator=(const PrioritySendQueue&) = delete;
+
+    /**
+     * @brief 消息入队
+     *
+     * @param msg 要发送的消息（共享只读）
+     * @return true 如果入队成功
+     *
+     * @note 队列满时优先丢弃最旧的非关键帧，再丢弃最旧的关键帧
+     * @note 控制消息和音频永远不会因队列满被丢弃
+     */
+    bool push(MessagePtr msg) {
+        if (!msg) {
+            return false;
+        }
+
+        SendPriority priority = classify_send_priority(*msg);
+        size_t cls = static_cast<size_t>(priority);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Entry entry;
+        entry.enqueue_time = Clock::now();
+        entry.deadline = Clock::time_point::max();
+        entry.reference = is_reference(*msg, priority);
+
+        if (is_video(priority)) {
+            if (priority == SendPriority::KEYFRAME) {
+                gop_broken_ = false;
+            } else if (gop_broken_) {
+                // 参考帧已丢，依赖它的帧解不出来，不必发送
+                stats_.gop_dropped++;
+                record_drop(FlightDropReason::SEND_GOP_BROKEN, *msg);
+                return false;
+            }
+
+            entry.deadline = compute_deadline_locked(*msg, entry.enqueue_time);
+            if (entry.deadline <= entry.enqueue_time) {
+                stats_.expired[cls]++;
+                record_drop(FlightDropReason::SEND_EXPIRED, *msg);
+                if (entry.reference) {
+                    gop_broken_ = true;
+                }
+                return false;
+            }
+        }
+
+        if (depth_ >= config_.max_messages && !make_room_locked(priority)) {
+            stats_.overflow_dropped++;
+            record_drop(FlightDropReason::SEND_OVERFLOW, *msg);
+            if (entry.reference) {
+                gop_broken_ = true;
+            }
+            return false;
+        }
+
+        entry.message = std::move(msg);
+        entry.seq = next_seq_++;
+        queues_[cls].push_back(std::move(entry));
+        depth_++;
+
+        stats_.enqueued[cls]++;
+        if (depth_ > stats_.max_depth) {
+            stats_.max_depth = depth_;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 取出下一条应发送的消息
+     *
+     * @param[out] out 下一条消息
+     * @return true 如果取到消息，false如果队列为空
+     */
+    bool pop(MessagePtr& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        expire_locked(Clock::now());
+
+        // 找出最高的非空优先级
+        size_t serve = SEND_PRIORITY_COUNT;
+        for (size_t cls = 0; cls < SEND_PRIORITY_COUNT; ++cls) {
+            if (!queues_[cls].empty()) {
+                serve = cls;
+                break;
+            }
+        }
+
+        if (serve == SEND_PRIORITY_COUNT) {
+            return false;
+        }
+
+        // 防饿死：被跳过太久的低优先级先服务
+        for (size_t cls = serve + 1; cls < SEND_PRIORITY_COUNT; ++cls) {
+            if (!queues_[cls].empty() && skipped_[cls] >= config_.starvation_limit) {
+                serve = cls;
+                stats_.starvation_grants++;
+                break;
+            }
+        }
+
+        for (size_t cls = 0; cls < SEND_PRIORITY_COUNT; ++cls) {
+            if (cls == serve) {
+                skipped_[cls] = 0;
+            } else if (cls > serve && !queues_[cls].empty()) {
+                skipped_[cls]++;
+            }
+        }
+
+        uint64_t seq = queues_[serve].front().seq;
+        out = std::move(queues_[serve].front().message);
+        queues_[serve].pop_front();
+        depth_--;
+        stats_.dequeued[serve]++;
+
+        if (serve == static_cast<size_t>(SendPriority::KEYFRAME)) {
+            drop_superseded_locked(seq);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 队列中的消息总数
+     */
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return depth_;
+    }
+
+    /**
+     * @brief 队列是否为空
+     */
+    bool empty() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return depth_ == 0;
+    }
+
+    /**
+     * @brief 清空队列
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& q : queues_) {
+            q.clear();
+        }
+        skipped_.fill(0);
+        depth_ = 0;
+        gop_broken_ = false;
+    }
+
+    /**
+     * @brief 设置会话延迟目标
+     *
+     * @param latency_target_ms 延迟目标（毫秒）
+     *
+     * @note 只影响之后入队的帧
+     */
+    void set_latency_target_ms(int latency_target_ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        config_.latency_target_ms = latency_target_ms;
+    }
+
+    /**
+     * @brief 获取会话延迟目标（毫秒）
+     */
+    int get_latency_target_ms() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return config_.latency_target_ms;
+    }
+
+    /**
+     * @brief 获取统计信息
+     */
+    SendQueueStatistics get_statistics() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SendQueueStatistics stats = stats_;
+        stats.current_depth = depth_;
+        return stats;
+    }
+
+private:
+    /**
+     * @struct Entry
+     * @brief 队列元素
+     */
+    struct Entry {
+        MessagePtr message;                 // 待发送消息
+        uint64_t seq;                       // 入队序号（跨优先级单调递增）
+        bool reference;                     // 是否被后续帧参考（I/P帧）
+        Clock::time_point enqueue_time;     // 入队时间
+        Clock::time_point deadline;         // 截止时间（非视频为max）
+    };
+
+    static bool is_video(SendPriority priority) {
+        return priority == SendPriority::KEYFRAME || priority == SendPriority::DELTA;
+    }
+
+    /**
+     * @brief 在飞行记录仪中记录一次丢帧（b为消息所属的流）
+     */
+    static void record_drop(FlightDropReason reason, const Message& msg) {
+        flight_record(FlightEvent::FRAME_DROPPED, static_cast<uint64_t>(reason), msg.get_meta().stamps.stream);
+    }
+
+    /**
+     * @brief 判断视频帧是否被后续帧参考
+     *
+     * @note 未标记帧类型的非关键帧没有依赖信息，按非参考帧处理
+     */
+    static bool is_reference(const Message& msg, SendPriority priority) {
+        if (priority == SendPriority::KEYFRAME) {
+            return true;
+        }
+        if (priority != SendPriority::DELTA) {
+            return false;
+        }
+        const MessageMeta& meta = msg.get_meta();
+        return meta.has_frame_type && meta.frame_type == FrameType::VIDEO_P_FRAME;
+    }
+
+    /**
+     * @brief 计算视频帧的截止时间
+     *
+     * @note PTS使用系统时钟毫秒，这里换算成相对于now的steady_clock时间点
+     * @note 调用者必须持有mutex_
+     */
+    Clock::time_point compute_deadline_locked(const Message& msg, Clock::time_point now) const {
+        const MessageMeta& meta = msg.get_meta();
+        if (!meta.has_pts) {
+            return now + std::chrono::milliseconds(config_.latency_target_ms);
+        }
+
+        int64_t deadline_ms = static_cast<int64_t>(meta.pts_ms) + config_.latency_target_ms;
+        int64_t now_ms = static_cast<int64_t>(ProtocolHelper::get_timestamp_ms());
+        return now + std::chrono::milliseconds(deadline_ms - now_ms);
+    }
+
+    /**
+     * @brief 丢弃视频队列头部已过期的帧
+     *
+     * @note 调用者必须持有mutex_
+     */
+    void expire_locked(Clock::time_point now) {
+        for (size_t cls : {static_cast<size_t>(SendPriority::KEYFRAME),
+                           static_cast<size_t>(SendPriority::DELTA)}) {
+            auto& q = queues_[cls];
+            while (!q.empty() && q.front().deadline <= now) {
+                stats_.expired[cls]++;
+                record_drop(FlightDropReason::SEND_EXPIRED, *q.front().message);
+                drop_front_locked(cls);
+            }
+        }
+    }
+
+    /**
+     * @brief 丢弃某个视频队列的队首帧，并处理GOP依赖
+     *
+     * @param cls 视频队列的优先级下标
+     *
+     * @note 调用者负责统计该帧的丢弃原因
+     * @note 调用者必须持有mutex_
+     */
+    void drop_front_locked(size_t cls) {
+        Entry dropped = std::move(queues_[cls].front());
+        queues_[cls].pop_front();
+        depth_--;
+
+        if (!dropped.reference) {
+            return;
+        }
+
+        // 依赖链一直延续到下一个I帧（I帧队列按seq有序）
+        uint64_t repair_seq = UINT64_MAX;
+        for (const auto& e : queues_[static_cast<size_t>(SendPriority::KEYFRAME)]) {
+            if (e.seq > dropped.seq) {
+                repair_seq = e.seq;
+                break;
+            }
+        }
+
+        auto& deltas = queues_[static_cast<size_t>(SendPriority::DELTA)];
+        for (auto it = deltas.begin(); it != deltas.end();) {
+            if (it->seq > dropped.seq && it->seq < repair_seq) {
+                record_drop(FlightDropReason::SEND_GOP_BROKEN, *it->message);
+                it = deltas.erase(it);
+                depth_--;
+                stats_.gop_dropped++;
+            } else {
+                ++it;
+            }
+        }
+
+        if (repair_seq == UINT64_MAX) {
+            gop_broken_ = true;
+        }
+    }
+
+    /**
+     * @brief I帧发出后丢弃比它更早入队的非关键帧（已被新GOP取代）
+     *
+     * @param keyframe_seq 刚发出的I帧序号
+     *
+     * @note 调用者必须持有mutex_
+     */
+    void drop_superseded_locked(uint64_t keyframe_seq) {
+        auto& deltas = queues_[static_cast<size_t>(SendPriority::DELTA)];
+        while (!deltas.empty() && deltas.front().seq < keyframe_seq) {
+            record_drop(FlightDropReason::SEND_GOP_BROKEN, *deltas.front().message);
+            deltas.pop_front();
+            depth_--;
+            stats_.gop_dropped++;
+        }
+    }
+
+    /**
+     * @brief 队列满时为新消息腾出空间
+     *
+     * @param incoming 新消息的优先级
+     * @return true 如果腾出了空间
+     *
+     * @note 只丢弃比新消息优先级低或相同的视频帧
+     * @note 控制消息和音频总是被接纳（可以短暂超过max_messages）
+     * @note 调用者必须持有mutex_
+     */
+    bool make_room_locked(SendPriority incoming) {
+        for (size_t cls = SEND_PRIORITY_COUNT; cls-- > static_cast<size_t>(SendPriority::KEYFRAME);) {
+            if (cls < static_cast<size_t>(incoming)) {
+                break;
+            }
+            if (!queues_[cls].empty()) {
+                stats_.overflow_dropped++;
+                record_drop(FlightDropReason::SEND_OVERFLOW, *queues_[cls].front().message);
+                drop_front_locked(cls);
+                return true;
+            }
+        }
+
+        return !is_video(incoming);
+    }
+
+private:
+    SendQueueConfig config_;                                    // 队列配置
+
+    mutable std::mutex mutex_;                                  // 保护以下所有状态
+    std::array<std::deque<Entry>, SEND_PRIORITY_COUNT> queues_; // 各优先级的FIFO队列
+    std::array<uint32_t, SEND_PRIORITY_COUNT> skipped_;         // 各优先级被连续跳过的次数
+    size_t depth_;                                              // 排队消息总数
+    uint64_t next_seq_;                                         // 下一个入队序号
+    bool gop_broken_;                                           // 参考帧已丢且尚无新I帧
+    SendQueueStatistics stats_;                                 // 统计信息
+};
+
+#endif // PRIORITY_SEND_QUEUE_H
@@ -0,0 +1,557 @@
+/*
+ * SheddingMessageQueue.h - 有界的媒体消息输出队列（过载时按帧类型丢弃）
+ *
+ * 功能：
+ * - 限制MediaProcessor输出队列的长度，分发跟不上时不会无限增长
+ * - 过载时按帧类型丢弃：先丢B帧，再丢P帧（连同依赖它的帧），永不丢I帧和音频
+ * - 检测持续过载，供上层降低编码码率
+ * - 统计丢弃数量和队列时长（队首消息已排队的时间）
+ *
+ * 设计思想：
+ * - 丢B帧不影响其他帧解码，代价最小
+ * - 丢P帧会让后续帧无法解码，所以一并丢弃到下一个I帧为止
+ * - I帧和音频是恢复画面和保持声音的关键，只在达到硬上限时才拒绝
+ * - 丢帧只能应急，持续过载时应该从源头降低码率
+ *
+ * 使用场景：
+ * - MediaProcessor到分发线程之间的消息队列
+ */
+
+#ifndef SHEDDING_MESSAGE_QUEUE_H
+#define SHEDDING_MESSAGE_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "AVServer_06_MessageProtocol.h"
+#include "AVServer_34_LockProfiler.h"
+#include "AVServer_36_FlightRecorder.h"
+
+// ============================================================================
+// ======================== 队列配置 ==========================================
+// ============================================================================
+
+/**
+ * @enum OverflowPolicy
+ * @brief 队列满时的处理策略
+ */
+enum class OverflowPolicy {
+    DROP_INCOMING,          // 丢弃新到的可丢弃帧（B/P），不动已排队的消息
+    SHED_BY_FRAME_TYPE,     // 按帧类型丢弃已排队的帧：B帧 -> P帧（连同依赖帧）
+};
+
+/**
+ * @struct OutputQueueConfig
+ * @brief 输出队列的配置参数
+ */
+struct OutputQueueConfig {
+    size_t max_messages;            // 软上限：超过后开始丢帧
+    size_t hard_limit;              // 硬上限：超过后连I帧和音频也拒绝
+    OverflowPolicy policy;          // 队列满时的处理策略
+    int sustained_overload_ms;      // 连续丢帧多久算持续过载（毫秒）
+
+    OutputQueueConfig()
+        : max_messages(256),
+          hard_limit(512),
+          policy(OverflowPolicy::SHED_BY_FRAME_TYPE),
+          sustained_overload_ms(1000) {
+    }
+};
+
+/**
+ * @struct OutputQueueStatistics
+ * @brief 输出队列的统计信息
+ */
+struct OutputQueueStatistics {
+    uint64_t shed_b_frames;         // 丢弃的B帧数
+    uint64_t shed_p_frames;         // 丢弃的P帧数
+    uint64_t shed_dependents;       // 因参考帧被丢弃而连带丢弃的帧数
+    uint64_t rejected_hard_limit;   // 达到硬上限被拒绝的消息数（I帧、音频、控制）
+    size_t current_size;            // 当前消息数
+    size_t max_size;                // 历史最大消息数
+    double queue_duration_ms;       // 队首消息已排队的时间（毫秒）
+    bool overloaded;                // 当前是否处于持续过载
+
+    OutputQueueStatistics()
+        : shed_b_frames(0),
+          shed_p_frames(0),
+          shed_dependents(0),
+          rejected_hard_limit(0),
+          current_size(0),
+          max_size(0),
+          queue_duration_ms(0.0),
+          overloaded(false) {
+    }
+
+    /**
+     * @brief 获取丢弃总数
+     */
+    uint64_t total_shed() const {
+        return shed_b_frames + shed_p_frames + shed_dependents + rejected_hard_limit;
+    }
+
+    std::string to_string() const {
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer),
+            "OutputQueue [Size: %zu/%zu, Duration: %.1fms, Shed B/P/Dep: %llu/%llu/%llu, "
+            "Rejected: %llu%s]",
+            current_size, max_size, queue_duration_ms,
+            static_cast<unsigned long long>(shed_b_frames),
+            static_cast<unsigned long long>(shed_p_frames),
+            static_cast<unsigned long long>(shed_dependents),
+            static_cast<unsigned long long>(rejected_hard_limit),
+            overloaded ? ", OVERLOADED" : "");
+        return std::string(buffer);
+    }
+};
+
+// ============================================================================
+// ======================== 有界输出队列 ======================================
+// ============================================================================
+
+/**
+ * @class SheddingMessageQueue
+ * @brief 有界的媒体消息FIFO队列，过载时按帧类型丢弃
+ *
+ * 丢弃顺序（SHED_BY_FRAME_TYPE）：
+ * 1. 最旧的B帧
+ * 2. 新到的B帧本身
+ * 3. 最旧的P帧，以及它之后、下一个I帧之前的所有非关键帧
+ * 4. I帧、音频和控制消息不丢，超过硬上限时才拒绝
+ *
+ * 使用示例：
+ * @code
+ *   SheddingMessageQueue queue;
+ *   queue.push(msg);                   // 生产者
+ *
+ *   Message out;
+ *   if (queue.pop_for(out, 100)) {     // 消费者
+ *       // 发送...
+ *   }
+ *
+ *   if (queue.is_overloaded()) {
+ *       // 降低编码码率
+ *   }
+ * @endcode
+ *
+ * @note 线程安全
+ * @note 假设队列中只有一路视频，GOP依赖按入队顺序判断
+ */
+class SheddingMessageQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief 构造函数
+     *
+     * @param config 队列配置
+     */
+    explicit SheddingMessageQueue(const OutputQueueConfig& config = OutputQueueConfig())
+        : config_(config),
+          gop_broken_(false),
+          overload_active_(false) {
+    }
+
+    SheddingMessageQueue(const SheddingMessageQueue&) = delete;
+    SheddingMessageQueue& operator=(const SheddingMessageQueue&) = delete;
+
+    /**
+     * @brief 消息入队
+     *
+     * @param msg 要入队的消息
+     * @return true 如果消息被接纳，false如果被丢弃
+     */
+    bool push(const Message& msg) {
+        FrameClass cls = classify(msg);
+
+        {
+            std::lock_guard<ProfiledMutex> lock(mutex_);
+
+            if (is_delta(cls) && gop_broken_) {
+                // 参考帧已被丢弃，依赖它的帧无法解码
+                stats_.shed_dependents++;
+                record_shed(msg);
+                return false;
+            }
+
+            if (queue_.size() >= config_.max_messages &&
+                !make_room_locked(cls) && !admit_over_limit_locked(cls)) {
+                if (cls == FrameClass::KEYFRAME) {
+                    gop_broken_ = true;  // 之后的非关键帧依赖这个被拒绝的关键帧
+                }
+                record_shed(msg);
+                return false;
+            }
+
+            if (cls == FrameClass::KEYFRAME) {
+                // 新GOP从这个关键帧开始：放在腾空间之后，
+                // 腾空间时丢掉旧GOP的参考链不会连累新GOP的非关键帧
+                gop_broken_ = false;
+            } else if (is_delta(cls) && gop_broken_) {
+                // 腾空间时丢掉了最后一条参考链，新到的非关键帧也无法解码
+                stats_.shed_dependents++;
+                record_shed(msg);
+                return false;
+            }
+
+            Entry entry;
+            entry.message = msg;
+            entry.frame_class = cls;
+            entry.enqueue_time = Clock::now();
+            queue_.push_back(std::move(entry));
+
+            if (queue_.size() > stats_.max_size) {
+                stats_.max_size = queue_.size();
+            }
+        }
+
+        condition_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 带超时的阻塞式出队
+     *
+     * @param[out] out 出队的消息
+     * @param timeout_ms 超时时间（毫秒）
+     * @return true 如果取到消息，false如果超时
+     */
+    bool pop_for(Message& out, int timeout_ms) {
+        ProfiledUniqueLock lock(mutex_);
+
+        if (!condition_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                 [this] { return !queue_.empty(); })) {
+            return false;
+        }
+
+        pop_front_locked(out);
+        return true;
+    }
+
+    /**
+     * @brief 非阻塞式出队
+     *
+     * @param[out] out 出队的消息
+     * @return true 如果取到消息，false如果队列为空
+     */
+    bool try_pop(Message& out) {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+
+        if (queue_.empty()) {
+            return false;
+        }
+
+        pop_front_locked(out);
+        return true;
+    }
+
+    /**
+     * @brief 查看队首消息的时间戳（不出队）
+     *
+     * @param[out] timestamp_ms 队首消息的PTS，没有PTS时为消息头时间戳
+     * @return true 如果队列非空
+     *
+     * @note 用于多个队列之间按时间戳合并
+     */
+    bool peek_timestamp_ms(uint64_t& timestamp_ms) const {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+
+        if (queue_.empty()) {
+            return false;
+        }
+
+        const Message& front = queue_.front().message;
+        timestamp_ms = front.get_meta().has_pts ? front.get_meta().pts_ms
+                                                : front.get_timestamp();
+        return true;
+    }
+
+    /**
+     * @brief 队列中的消息数
+     */
+    size_t size() const {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        return queue_.size();
+    }
+
+    /**
+     * @brief 队列是否为空
+     */
+    bool empty() const {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        return queue_.empty();
+    }
+
+    /**
+     * @brief 清空队列
+     */
+    void clear() {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        queue_.clear();
+        gop_broken_ = false;
+        overload_active_ = false;
+    }
+
+    /**
+     * @brief 是否处于持续过载
+     *
+     * @return true 如果从第一次丢帧起已持续sustained_overload_ms且仍在丢帧
+     *
+     * @note 超过sustained_overload_ms没有再丢帧，或队列回落到软上限的一半以下时过载状态解除
+     */
+    bool is_overloaded() const {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        return is_overloaded_locked(Clock::now());
+    }
+
+    /**
+     * @brief 获取队首消息已排队的时间（毫秒）
+     */
+    double get_queue_duration_ms() const {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        return queue_duration_ms_locked(Clock::now());
+    }
+
+    /**
+     * @brief 获取统计信息
+     */
+    OutputQueueStatistics get_statistics() const {
+        std::lock_guard<ProfiledMutex> lock(mutex_);
+        auto now = Clock::now();
+
+        OutputQueueStatistics stats = stats_;
+        stats.current_size = queue_.size();
+        stats.queue_duration_ms = queue_duration_ms_locked(now);
+        stats.overloaded = is_overloaded_locked(now);
+        return stats;
+    }
+
+private:
+    /**
+     * @enum FrameClass
+     * @brief 消息的丢弃等级
+     */
+    enum class FrameClass {
+        PROTECTED,          // 音频、控制消息：永不主动丢弃
+        KEYFRAME,           // I帧：永不主动丢弃
+        P_FRAME,            // P帧：丢弃时连带依赖帧
+        B_FRAME,            // B帧：可以单独丢弃
+    };
+
+    /**
+     * @struct Entry
+     * @brief 队列元素
+     */
+    struct Entry {
+        Message message;                    // 消息
+        FrameClass frame_class;             // 丢弃等级
+        Clock::time_point enqueue_time;     // 入队时间
+    };
+
+    static bool is_delta(FrameClass cls) {
+        return cls == FrameClass::P_FRAME || cls == FrameClass::B_FRAME;
+    }
+
+    /**
+     * @brief 根据消息类型和帧类型确定丢弃等级
+     *
+     * @note 未标记帧类型的视频消息没有依赖信息，按关键帧保护
+     */
+    static FrameClass classify(const Message& msg) {
+        if (msg.get_type() != MessageType::VIDEO_FRAME &&
+            msg.get_type() != MessageType::FRAME_DATA) {
+            return FrameClass::PROTECTED;
+        }
+
+        const MessageMeta& meta = msg.get_meta();
+        if (!meta.has_frame_type) {
+            return FrameClass::KEYFRAME;
+        }
+
+        switch (meta.frame_type) {
+            case FrameType::VIDEO_P_FRAME: return FrameClass::P_FRAME;
+            case FrameType::VIDEO_B_FRAME: return FrameClass::B_FRAME;
+            case FrameType::AUDIO_FRAME:   return FrameClass::PROTECTED;
+            default:                       return FrameClass::KEYFRAME;
+        }
+    }
+
+    /**
+     * @brief 队列满时按策略腾出空间
+     *
+     * @param incoming 新消息的丢弃等级
+     * @return true 如果丢弃了已排队的帧
+     *
+     * @note 返回false时由调用者决定新消息是否超限接纳
+     * @note 调用者必须持有mutex_
+     */
+    bool make_room_locked(FrameClass incoming) {
+        if (config_.policy == OverflowPolicy::DROP_INCOMING) {
+            return false;
+        }
+
+        if (shed_oldest_locked(FrameClass::B_FRAME)) {
+            return true;
+        }
+
+        if (incoming == FrameClass::B_FRAME) {
+            return false;
+        }
+
+        return shed_oldest_locked(FrameClass::P_FRAME);
+    }
+
+    /**
+     * @brief 无法腾出空间时决定新消息的去留
+     *
+     * @param incoming 新消息的丢弃等级
+     * @return true 如果仍然接纳（超过软上限但未到硬上限的I帧、音频、控制消息）
+     *
+     * @note 调用者必须持有mutex_
+     */
+    bool admit_over_limit_locked(FrameClass incoming) {
+        if (incoming == FrameClass::B_FRAME) {
+            stats_.shed_b_frames++;
+            note_shed_locked();
+            return false;
+        }
+
+        if (incoming == FrameClass::P_FRAME) {
+            // 丢弃新到的P帧，之后的非关键帧都依赖它
+            stats_.shed_p_frames++;
+            gop_broken_ = true;
+            note_shed_locked();
+            return false;
+        }
+
+        if (queue_.size() >= config_.hard_limit) {
+            stats_.rejected_hard_limit++;
+            note_shed_locked();
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief 丢弃指定等级中最旧的一帧
+     *
+     * @param cls B_FRAME或P_FRAME
+     * @return true 如果找到并丢弃了一帧
+     *
+     * @note 丢弃P帧时，它之后到下一个I帧之前的非关键帧一并丢弃
+     * @note 调用者必须持有mutex_
+     */
+    bool shed_oldest_locked(FrameClass cls) {
+        auto it = queue_.begin();
+        while (it != queue_.end() && it->frame_class != cls) {
+            ++it;
+        }
+
+        if (it == queue_.end()) {
+            return false;
+        }
+
+        record_shed(it->message);
+        it = queue_.erase(it);
+        note_shed_locked();
+
+        if (cls == FrameClass::B_FRAME) {
+            stats_.shed_b_frames++;
+            return true;
+        }
+
+        stats_.shed_p_frames++;
+
+        while (it != queue_.end() && it->frame_class != FrameClass::KEYFRAME) {
+            if (is_delta(it->frame_class)) {
+                record_shed(it->message);
+                it = queue_.erase(it);
+                stats_.shed_dependents++;
+            } else {
+                ++it;
+            }
+        }
+
+        if (it == queue_.end()) {
+            gop_broken_ = true;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 出队并在队列回落时解除过载状态
+     *
+     * @note 调用者必须持有mutex_
+     */
+    void pop_front_locked(Message& out) {
+        out = std::move(queue_.front().message);
+        queue_.pop_front();
+
+        if (overload_active_ && queue_.size() <= config_.max_messages / 2) {
+            overload_active_ = false;
+        }
+    }
+
+    /**
+     * @brief 在飞行记录仪中记录一条被丢弃的消息（b为消息所属的流）
+     */
+    static void record_shed(const Message& msg) {
+        flight_record(FlightEvent::FRAME_DROPPED, static_cast<uint64_t>(FlightDropReason::OUTPUT_SHED),
+                      msg.get_meta().stamps.stream);
+    }
+
+    /**
+     * @brief 记录一次丢帧，开始或延续过载期
+     *
+     * @note 调用者必须持有mutex_
+     * @note 距上次丢帧已超过sustained_overload_ms时，上一个过载期视为已结束，重新开始计时
+     */
+    void note_shed_locked() {
+        auto now = Clock::now();
+        if (!overload_active_ || shed_quiet_locked(now)) {
+            overload_active_ = true;
+            overload_since_ = now;
+        }
+        last_shed_ = now;
+    }
+
+    /**
+     * @brief 距上次丢帧是否已超过sustained_overload_ms（过载期随之结束）
+     */
+    bool shed_quiet_locked(Clock::time_point now) const {
+        return now - last_shed_ >= std::chrono::milliseconds(config_.sustained_overload_ms);
+    }
+
+    bool is_overloaded_locked(Clock::time_point now) const {
+        return overload_active_ && !shed_quiet_locked(now) &&
+               now - overload_since_ >= std::chrono::milliseconds(config_.sustained_overload_ms);
+    }
+
+    double queue_duration_ms_locked(Clock::time_point now) const {
+        if (queue_.empty()) {
+            return 0.0;
+        }
+        return std::chrono::duration<double, std::milli>(
+            now - queue_.front().enqueue_time).count();
+    }
+
+private:
+    OutputQueueConfig config_;                      // 队列配置
+
+    mutable ProfiledMutex mutex_{"SheddingMessageQueue"};  // 保护以下所有状态（锁竞争分析见LockProfiler.h）
+    ProfiledConditionVariable condition_;           // 有新消息时通知消费者
+    std::deque<Entry> queue_;                       // 消息FIFO
+    bool gop_broken_;                               // 参考帧已丢且尚无新I帧
+    bool overload_active_;                          // 是否处于过载期
+    Clock::time_point overload_since_;              // 过载期开始时间
+    Clock::time_point last_shed_;                   // 最近一次丢帧的时间
+    OutputQueueStatistics stats_;                   // 统计信息
+};
+
+#endif // SHEDDING_MESSAGE_QUEUE_H
@@ -0,0 +1,455 @@
+/*
+ * PipelineKernels.h - 媒体管道的处理内核
+ *
+ * 功能：
+ * - 把采集、格式转换、缩放、编码、打包、分发拆成独立的处理内核
+ * - 每个内核只做一件事，输入输出类型固定
+ * - 同一组内核既可以放进运行时的阶段图（StageGraph），
+ *   也可以在编译期组合成融合管道（FusedPipeline）
+ *
+ * 内核约定：
+ * - using input_type  = 输入类型（源内核为NoData）
+ * - using output_type = 输出类型（汇内核为NoData）
+ * - static constexpr bool is_stateless：处理结果只取决于输入，不依赖帧间状态
+ * - bool process(input_type& in, output_type& out)：
+ *   返回true表示产生了输出，false表示本次没有输出（无数据或丢弃）
+ *
+ * 数据类型：
+ * - MediaFramePtr：原始或编码后的帧（可变，沿管道单线传递）
+ * - MediaMessagePtr：打包后的只读消息（可以安全地广播给多个下游）
+ */
+
+#ifndef PIPELINE_KERNELS_H
+#define PIPELINE_KERNELS_H
+
+#include <memory>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+
+#include "AVServer_03_FrameBuffer.h"
+#include "AVServer_04_ThreadPool.h"
+#include "AVServer_06_MessageProtocol.h"
+#include "AVServer_13_CaptureManager.h"
+#include "AVServer_14_CompressionEngine.h"
+#include "AVServer_27_Numa.h"
+#include "AVServer_36_FlightRecorder.h"
+
+// ============================================================================
+// ======================== 管道数据类型 ======================================
+// ============================================================================
+
+/**
+ * @struct NoData
+ * @brief 占位类型：源内核的输入、汇内核的输出
+ */
+struct NoData {};
+
+using MediaFramePtr = std::shared_ptr<AVFrame>;
+using MediaMessagePtr = std::shared_ptr<const Message>;
+
+/**
+ * @brief 获取管道数据类型的可读名称（用于错误信息和指标输出）
+ */
+template<typename T>
+inline const char* pipeline_type_name() {
+    return typeid(T).name();
+}
+
+template<>
+inline const char* pipeline_type_name<NoData>() {
+    return "none";
+}
+
+template<>
+inline const char* pipeline_type_name<MediaFramePtr>() {
+    return "frame";
+}
+
+template<>
+inline const char* pipeline_type_name<MediaMessagePtr>() {
+    return "message";
+}
+
+/**
+ * @struct PipelineResources
+ * @brief 内核运行需要的外部资源
+ *
+ * @note 由管道的所有者（AVServer或基准测试）提供，生命周期必须长于管道
+ */
+struct PipelineResources {
+    CaptureManager* capture;                                // 采集管理器
+    CompressionEngine* engine;                              // 压缩引擎
+    std::shared_ptr<FrameBufferPool> frame_pool;            // 编码输出帧的缓冲池
+    std::function<void(const MediaMessagePtr&)> fanout;     // 把消息分发给客户端
+    ThreadPool* workers;                                    // 帧内并行使用的线程池（可以为空）
+    int numa_node;                                          // 管道线程和缓冲池所在的NUMA节点（-1表示不绑定）
+
+    PipelineResources()
+        : capture(nullptr),
+          engine(nullptr),
+          frame_pool(std::make_shared<FrameBufferPool>(30)),
+          workers(nullptr),
+          numa_node(-1) {
+    }
+};
+
+/**
+ * @brief 创建把原始帧归还给采集缓冲池的函数（用于EncodeKernel::release_input）
+ *
+ * @return 没有视频采集时返回空函数
+ */
+inline std::function<void(MediaFramePtr)> make_capture_release(CaptureManager* capture) {
+    if (!capture || !capture->get_video_capture()) {
+        return nullptr;
+    }
+    VideoCapture* video = capture->get_video_capture();
+    return [video](MediaFramePtr frame) {
+        video->return_frame(std::move(frame));
+    };
+}
+
+/**
+ * @brief 丢弃内核的输入帧：有release_input时交给它，避免采集缓冲池被耗尽
+ */
+inline void drop_input(MediaFramePtr& in, const std::function<void(MediaFramePtr)>& release_input) {
+    if (release_input) {
+        release_input(std::move(in));
+    }
+    in.reset();
+}
+
+// ============================================================================
+// ======================== 源内核 ============================================
+// ============================================================================
+
+/**
+ * @struct CaptureKernel
+ * @brief 从CaptureManager取视频帧
+ *
+ * @note 非阻塞：没有帧时立即返回false
+ */
+struct CaptureKernel {
+    using input_type = NoData;
+    using output_type = MediaFramePtr;
+    static constexpr bool is_stateless = false;
+
+    CaptureManager* capture;
+
+    explicit CaptureKernel(CaptureManager* capture_mgr = nullptr)
+        : capture(capture_mgr) {
+    }
+
+    bool process(NoData&, MediaFramePtr& out) {
+        if (!capture) {
+            return false;
+        }
+        out = capture->try_get_video_frame();
+        return static_cast<bool>(out);
+    }
+};
+
+/**
+ * @struct TestSourceKernel
+ * @brief 生成测试图案帧（不依赖采集设备）
+ *
+ * @note framerate为0时不限速，用于吞吐量测试
+ */
+struct TestSourceKernel {
+    using input_type = NoData;
+    using output_type = MediaFramePtr;
+    static constexpr bool is_stateless = false;
+
+    std::shared_ptr<FrameBufferPool> pool;
+    uint32_t width;
+    uint32_t height;
+    uint32_t framerate;
+    uint64_t frame_index;
+    std::chrono::steady_clock::time_point next_frame_time;
+
+    TestSourceKernel(std::shared_ptr<FrameBufferPool> frame_pool = nullptr,
+                     uint32_t w = 1280, uint32_t h = 720, uint32_t fps = 30)
+        : pool(frame_pool ? frame_pool : std::make_shared<FrameBufferPool>(8)),
+          width(w),
+          height(h),
+          framerate(fps),
+          frame_index(0),
+          next_frame_time(std::chrono::steady_clock::now()) {
+    }
+
+    bool process(NoData&, MediaFramePtr& out) {
+        if (framerate > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now < next_frame_time) {
+                return false;
+            }
+            next_frame_time += std::chrono::microseconds(1000000 / framerate);
+            if (next_frame_time < now) {
+                next_frame_time = now;  // 落后太多时不补帧
+            }
+        }
+
+        out = pool->get();
+        out->frame_type = FrameType::VIDEO_I_FRAME;
+        out->codec_type = CodecType::H264;
+        out->width = width;
+        out->height = height;
+        out->timestamp = ProtocolHelper::get_timestamp_ms();
+        out->pts = frame_index;
+        out->stamps.begin(FrameTimestamps::LOCAL_VIDEO_STREAM);
+
+        // 滚动的灰度渐变图案（打包RGB）
+        out->size = width * height * 3;
+        out->data.resize(out->size);
+        uint8_t base = static_cast<uint8_t>(frame_index++);
+        for (uint32_t i = 0; i < out->size; ++i) {
+            out->data[i] = static_cast<uint8_t>(base + (i >> 4));
+        }
+        flight_record(FlightEvent::FRAME_CAPTURED, FrameTimestamps::LOCAL_VIDEO_STREAM, out->size);
+        return true;
+    }
+};
+
+// ============================================================================
+// ======================== 变换内核 ==========================================
+// ============================================================================
+
+/**
+ * @struct ConvertKernel
+ * @brief 像素格式转换（打包RGB -> YUV420，模拟）
+ *
+ * 对亮度平面做全范围到限制范围（16-235）的映射，
+ * 色度平面截断为亮度的一半，结果原地写回。
+ *
+ * @note 设置了workers时按行分块并行转换
+ * @note 尺寸为0或数据不足的帧被丢弃，release_input非空时交给它（例如归还给采集缓冲池）
+ */
+struct ConvertKernel {
+    using input_type = MediaFramePtr;
+    using output_type = MediaFramePtr;
+    static constexpr bool is_stateless = true;
+    static constexpr size_t ROWS_PER_CHUNK = 32;    // 并行时每块的行数
+
+    ThreadPool* workers;
+    std::function<void(MediaFramePtr)> release_input;
+
+    explicit ConvertKernel(ThreadPool* pool = nullptr)
+        : workers(pool) {
+    }
+
+    static void convert_luma(uint8_t* data, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            data[i] = static_cast<uint8_t>(((data[i] * 219) >> 8) + 16);
+        }
+    }
+
+    bool process(MediaFramePtr& in, MediaFramePtr& out) {
+        if (!in) {
+            return false;
+        }
+
+        uint32_t luma_size = in->width * in->height;
+        uint32_t yuv_size = luma_size * 3 / 2;
+        if (luma_size == 0 || in->data.size() < yuv_size) {
+            drop_input(in, release_input);
+            return false;
+        }
+
+        numa_record_frame_access(*in);
+
+        uint8_t* data = in->data.data();
+        if (workers) {
+            size_t width = in->width;
+            workers->parallel_for(0, in->height, ROWS_PER_CHUNK, [data, width](size_t y0, size_t y1) {
+                convert_luma(data, y0 * width, y1 * width);
+            });
+        } else {
+            convert_luma(data, 0, luma_size);
+        }
+
+        in->data.resize(yuv_size);
+        in->size = yuv_size;
+        out = std::move(in);
+        return true;
+    }
+};
+
+/**
+ * @struct ScaleKernel
+ * @brief 最近邻缩小（只处理亮度平面，模拟）
+ *
+ * @note 目标尺寸为0或大于源尺寸时原样通过
+ * @note 原地缩小：目标像素的位置总不在尚未读取的源像素之后，可以安全覆盖
+ * @note 尺寸为0或数据不足的帧被丢弃，release_input非空时交给它
+ */
+struct ScaleKernel {
+    using input_type = MediaFramePtr;
+    using output_type = MediaFramePtr;
+    static constexpr bool is_stateless = true;
+
+    uint32_t target_width;
+    uint32_t target_height;
+    std::function<void(MediaFramePtr)> release_input;
+
+    ScaleKernel(uint32_t w = 0, uint32_t h = 0)
+        : target_width(w),
+          target_height(h) {
+    }
+
+    bool process(MediaFramePtr& in, MediaFramePtr& out) {
+        if (!in) {
+            return false;
+        }
+
+        uint32_t src_w = in->width;
+        uint32_t src_h = in->height;
+        if (src_w == 0 || src_h == 0 || in->data.size() < static_cast<size_t>(src_w) * src_h) {
+            drop_input(in, release_input);
+            return false;
+        }
+
+        if (target_width == 0 || target_height == 0 ||
+            target_width > src_w || target_height > src_h) {
+            out = std::move(in);
+            return true;
+        }
+
+        uint8_t* data = in->data.data();
+        for (uint32_t y = 0; y < target_height; ++y) {
+            uint32_t src_row = (y * src_h / target_height) * src_w;
+            for (uint32_t x = 0; x < target_width; ++x) {
+                data[y * target_width + x] = data[src_row + x * src_w / target_width];
+            }
+        }
+
+        in->width = target_width;
+        in->height = target_height;
+        in->size = target_width * target_height * 3 / 2;
+        in->data.resize(in->size);
+        out = std::move(in);
+        return true;
+    }
+};
+
+/**
+ * @struct EncodeKernel
+ * @brief 调用CompressionEngine编码视频帧
+ *
+ * @note 输出帧来自frame_pool，由打包内核归还
+ * @note release_input非空时，编码完成后把原始帧交给它（例如归还给采集缓冲池）
+ */
+struct EncodeKernel {
+    using input_type = MediaFramePtr;
+    using output_type = MediaFramePtr;
+    static constexpr bool is_stateless = false;  // 编码器有GOP状态
+
+    CompressionEngine* engine;
+    std::shared_ptr<FrameBufferPool> pool;
+    std::function<void(MediaFramePtr)> release_input;
+
+    EncodeKernel(CompressionEngine* compress_engine = nullptr,
+                 std::shared_ptr<FrameBufferPool> frame_pool = nullptr)
+        : engine(compress_engine),
+          pool(frame_pool ? frame_pool : std::make_shared<FrameBufferPool>(8)) {
+    }
+
+    bool process(MediaFramePtr& in, MediaFramePtr& out) {
+        if (!engine || !in) {
+            return false;
+        }
+
+        numa_record_frame_access(*in);
+        in->stamps.stamp(FrameStage::ENCODE_DEQUEUE);
+        out = pool->get();
+        bool ok = engine->encode_video(in, out);
+        if (ok) {
+            out->stamps.stamp(FrameStage::ENCODE_DONE);
+            flight_record(FlightEvent::FRAME_ENCODED, out->stamps.stream, out->size);
+        }
+
+        if (release_input) {
+            release_input(std::move(in));
+        }
+        if (!ok) {
+            pool->return_frame(out);
+            out.reset();
+        }
+        return ok;
+    }
+};
+
+/**
+ * @struct PacketizeKernel
+ * @brief 把编码后的帧打包为只读消息
+ *
+ * @note 消息携带帧类型和PTS，供发送队列调度
+ * @note pool非空时，打包完成后把编码帧归还给它
+ */
+struct PacketizeKernel {
+    using input_type = MediaFramePtr;
+    using output_type = MediaMessagePtr;
+    static constexpr bool is_stateless = true;
+
+    std::shared_ptr<FrameBufferPool> pool;
+
+    explicit PacketizeKernel(std::shared_ptr<FrameBufferPool> frame_pool = nullptr)
+        : pool(std::move(frame_pool)) {
+    }
+
+    bool process(MediaFramePtr& in, MediaMessagePtr& out) {
+        if (!in) {
+            return false;
+        }
+
+        MessageType type = in->frame_type == FrameType::AUDIO_FRAME
+                           ? MessageType::AUDIO_FRAME : MessageType::VIDEO_FRAME;
+        auto msg = std::make_shared<Message>(type, in->size, ProtocolHelper::get_timestamp_ms());
+        msg->set_payload(in->data.data(), in->size);
+        msg->set_frame_type(in->frame_type);
+        msg->set_pts_ms(in->timestamp);
+        msg->set_stamps(in->stamps);
+        msg->stamp(FrameStage::FANOUT_ENQUEUE);
+        flight_record(FlightEvent::FRAME_ENQUEUED, in->stamps.stream, in->size);
+        out = std::move(msg);
+
+        if (pool) {
+            pool->return_frame(std::move(in));
+        }
+        return true;
+    }
+};
+
+// ============================================================================
+// ======================== 汇内核 ============================================
+// ============================================================================
+
+/**
+ * @struct FanoutKernel
+ * @brief 把消息交给分发回调（通常发送给所有客户端）
+ */
+struct FanoutKernel {
+    using input_type = MediaMessagePtr;
+    using output_type = NoData;
+    static constexpr bool is_stateless = false;  // 有外部副作用
+
+    std::function<void(const MediaMessagePtr&)> fanout;
+
+    explicit FanoutKernel(std::function<void(const MediaMessagePtr&)> fn = nullptr)
+        : fanout(std::move(fn)) {
+    }
+
+    bool process(MediaMessagePtr& in, NoData&) {
+        if (!in) {
+            return false;
+        }
+        if (fanout) {
+            fanout(in);
+        }
+        return true;
+    }
+};
+
+#endif // PIPELINE_KERNELS_H
@@ -0,0 +1,1338 @@
+/*
+ * StageGraph.h - 可配置的媒体管道阶段图
+ *
+ * 功能：
+ * - 把媒体管道描述为阶段（stage）和连接（link）组成的有向无环图
+ * - 每个阶段包装一个处理内核（见PipelineKernels.h），带类型化的输入/输出端口
+ * - 阶段之间用有界通道连接，下游处理不过来时丢弃并计数，不会无限堆积
+ * - 每个阶段选择执行方式：独立线程、共享线程池、或内联在上游线程中执行
+ * - 导出每个阶段的利用率、队列深度、排队延迟和处理延迟
+ * - 拓扑由文本描述，部署时修改配置即可，不需要改代码
+ *
+ * 管道描述格式（每行一条，#开头为注释）：
+ *   pool <线程数>                                  共享线程池的大小
+ *   numa <节点>                                    阶段线程和缓冲池绑定到NUMA节点（见Numa.h）
+ *   stage <名称> <类型> <执行方式> [key=value ...]  定义阶段
+ *   link <阶段A> <阶段B> [<阶段C> ...]             依次连接 A->B->C
+ *
+ * 阶段类型：capture, test_source, convert, scale, encode, packetize, fanout
+ * 执行方式：thread, pool, inline
+ * 通用参数：queue=N（输入通道容量，默认32）
+ *           spin=US（输入为空时先自旋US微秒再阻塞，只对thread阶段有效，见BusyPoll.h）
+ * 专用参数：scale width=W height=H；test_source width=W height=H fps=N
+ *
+ * 示例：
+ * @code
+ *   pool 2
+ *   stage capture   capture   thread
+ *   stage convert   convert   pool    queue=8
+ *   stage encode    encode    thread  queue=8
+ *   stage packetize packetize inline
+ *   stage fanout    fanout    pool    queue=64
+ *   link capture convert encode packetize fanout
+ * @endcode
+ */
+
+#ifndef STAGE_GRAPH_H
+#define STAGE_GRAPH_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <sstream>
+#include <functional>
+#include <typeindex>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "AVServer_20_PipelineKernels.h"
+#include "AVServer_28_BusyPoll.h"
+#include "AVServer_29_TimeService.h"
+
+// ============================================================================
+// ======================== 执行方式 ==========================================
+// ============================================================================
+
+/**
+ * @enum ExecutorKind
+ * @brief 阶段的执行方式
+ */
+enum class ExecutorKind {
+    THREAD,                 // 独占一个线程
+    POOL,                   // 在共享线程池中轮流执行
+    INLINE,                 // 在上游阶段的线程中直接调用，没有输入通道
+};
+
+inline const char* executor_kind_to_string(ExecutorKind kind) {
+    switch (kind) {
+        case ExecutorKind::THREAD: return "thread";
+        case ExecutorKind::POOL:   return "pool";
+        case ExecutorKind::INLINE: return "inline";
+        default:                   return "unknown";
+    }
+}
+
+inline bool parse_executor_kind(const std::string& text, ExecutorKind& kind) {
+    if (text == "thread") {
+        kind = ExecutorKind::THREAD;
+    } else if (text == "pool") {
+        kind = ExecutorKind::POOL;
+    } else if (text == "inline") {
+        kind = ExecutorKind::INLINE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// ======================== 线程池唤醒 ========================================
+// ============================================================================
+
+/**
+ * @class StageReadySignal
+ * @brief 线程池阶段的输入通道有新元素时唤醒空闲的工作线程
+ *
+ * @note 工作线程在一轮扫描之前读取generation()，扫描没有工作时用它等待，
+ *       扫描期间到达的元素会改变generation，不会丢失唤醒
+ */
+class StageReadySignal {
+public:
+    StageReadySignal()
+        : generation_(0) {
+    }
+
+    uint64_t generation() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return generation_;
+    }
+
+    /**
+     * @brief 有一个元素就绪，唤醒一个工作线程
+     */
+    void notify() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_++;
+        }
+        condition_.notify_one();
+    }
+
+    /**
+     * @brief 唤醒所有工作线程（停止时调用）
+     */
+    void notify_all() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_++;
+        }
+        condition_.notify_all();
+    }
+
+    /**
+     * @brief 等到generation不再是seen，最多等待timeout
+     */
+    template<typename Duration>
+    void wait(uint64_t seen, Duration timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait_for(lock, timeout, [this, seen] { return generation_ != seen; });
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    uint64_t generation_;                           // 每次通知加一
+};
+
+// ============================================================================
+// ======================== 有界通道 ==========================================
+// ============================================================================
+
+/**
+ * @class BoundedChannel
+ * @brief 阶段之间的有界FIFO通道
+ *
+ * @note 满时push失败而不是阻塞：实时媒体宁可丢帧也不要让上游停下
+ * @note 记录每个元素的入队时间（细粒度时钟），用于统计排队延迟
+ * @note 设置了自旋预算时，出队在阻塞之前先自旋检查元素个数（不加锁）
+ */
+template<typename T>
+class BoundedChannel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit BoundedChannel(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1),
+          spin_us_(0),
+          count_(0),
+          ready_signal_(nullptr) {
+    }
+
+    /**
+     * @brief 设置入队时通知的线程池信号（消费者是线程池阶段时）
+     *
+     * @note 应在生产者开始入队之前设置
+     */
+    void set_ready_signal(StageReadySignal* signal) {
+        ready_signal_ = signal;
+    }
+
+    /**
+     * @brief 设置出队的自旋预算（微秒，0表示直接阻塞）
+     *
+     * @note 应在消费者开始出队之前设置
+     */
+    void set_spin_us(int spin_us) {
+        spin_us_ = spin_us > 0 ? spin_us : 0;
+    }
+
+    int spin_us() const {
+        return spin_us_;
+    }
+
+    /**
+     * @brief 非阻塞入队
+     *
+     * @return false 如果通道已满
+     */
+    bool try_push(const T& item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (items_.size() >= capacity_) {
+                return false;
+            }
+            items_.emplace_back(item, TimeService::instance().fine_ticks());
+            count_.store(items_.size(), std::memory_order_release);
+        }
+        if (ready_signal_) {
+            ready_signal_->notify();
+        } else {
+            condition_.notify_one();
+        }
+        return true;
+    }
+
+    /**
+     * @brief 出队，最多等待timeout_ms
+     *
+     * @param[out] item 出队的元素
+     * @param timeout_ms 等待时间（0表示不等待）
+     * @param[out] wait_ns 元素在通道中排队的时间（纳秒）
+     * @return true 如果取到元素
+     */
+    bool pop_for(T& item, int timeout_ms, uint64_t& wait_ns) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        bool waited = false;
+        bool spun = false;
+        if (items_.empty()) {
+            if (timeout_ms <= 0) {
+                return false;
+            }
+
+            if (spin_us_ > 0) {
+                lock.unlock();
+                auto spin_start = Clock::now();
+                spun = spin_until([this] { return count_.load(std::memory_order_acquire) > 0; },
+                                  spin_us_);
+                spin_.record_spin(spun, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - spin_start).count());
+                lock.lock();
+            }
+
+            if (items_.empty() &&
+                !condition_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                     [this] { return !items_.empty(); })) {
+                return false;
+            }
+            waited = true;
+        }
+
+        item = std::move(items_.front().first);
+        wait_ns = TimeService::instance().fine_elapsed_ns(items_.front().second);
+        items_.pop_front();
+        count_.store(items_.size(), std::memory_order_release);
+
+        // 等待期间到达的元素：排队时间就是从入队到被消费者拿到的延迟
+        if (waited && spin_us_ > 0) {
+            spin_.record_pickup(spun, wait_ns);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 出队自旋的统计（未设置自旋预算时全为0）
+     */
+    SpinStatistics get_spin_statistics() const {
+        return spin_.get_statistics();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::pair<T, uint64_t>> items_;      // 元素和入队时的fine_ticks()
+    int spin_us_;                                   // 出队自旋预算（微秒）
+    std::atomic<size_t> count_;                     // 元素个数（供自旋时无锁读取）
+    SpinCounters spin_;                             // 自旋统计
+    StageReadySignal* ready_signal_;                // 线程池消费者的唤醒信号（可为空）
+};
+
+// ============================================================================
+// ======================== 阶段指标 ==========================================
+// ============================================================================
+
+/**
+ * @struct StageMetrics
+ * @brief 单个阶段的运行指标
+ */
+struct StageMetrics {
+    std::string name;               // 阶段名称
+    std::string kind;               // 阶段类型
+    ExecutorKind executor;          // 执行方式
+    uint64_t items_processed;       // 内核处理的元素数
+    uint64_t items_emitted;         // 发往下游的元素数
+    uint64_t items_rejected;        // 内核没有产生输出的元素数
+    uint64_t items_dropped;         // 因下游通道已满而丢弃的元素数
+    size_t queue_depth;             // 输入通道当前深度
+    size_t queue_capacity;          // 输入通道容量（inline和源阶段为0）
+    double utilization;             // 内核耗时占运行时间的比例（0-1）
+    double avg_latency_us;          // 平均每个元素的内核处理时间（微秒）
+    double max_latency_us;          // 最大内核处理时间（微秒）
+    double avg_queue_wait_us;       // 平均排队时间（微秒）
+    int spin_us;                    // 输入自旋预算（微秒，0表示不自旋）
+    SpinStatistics spin;            // 输入自旋统计
+
+    StageMetrics()
+        : executor(ExecutorKind::THREAD),
+          items_processed(0),
+          items_emitted(0),
+          items_rejected(0),
+          items_dropped(0),
+          queue_depth(0),
+          queue_capacity(0),
+          utilization(0.0),
+          avg_latency_us(0.0),
+          max_latency_us(0.0),
+          avg_queue_wait_us(0.0),
+          spin_us(0) {
+    }
+
+    std::string to_string() const {
+        char buffer[384];
+        std::snprintf(buffer, sizeof(buffer),
+            "Stage %-12s [%s/%s] Items: %llu, Out: %llu, Rejected: %llu, Dropped: %llu, "
+            "Queue: %zu/%zu, Util: %.1f%%, Latency: %.1fus (max %.1fus), Wait: %.1fus",
+            name.c_str(), kind.c_str(), executor_kind_to_string(executor),
+            static_cast<unsigned long long>(items_processed),
+            static_cast<unsigned long long>(items_emitted),
+            static_cast<unsigned long long>(items_rejected),
+            static_cast<unsigned long long>(items_dropped),
+            queue_depth, queue_capacity,
+            utilization * 100.0, avg_latency_us, max_latency_us, avg_queue_wait_us);
+        if (spin_us > 0) {
+            return std::string(buffer) + "\n    spin=" + std::to_string(spin_us) + "us " +
+                   spin.to_string();
+        }
+        return std::string(buffer);
+    }
+};
+
+// ============================================================================
+// ======================== 阶段基类 ==========================================
+// ============================================================================
+
+/**
+ * @class StageBase
+ * @brief 类型擦除的阶段接口，供StageGraph统一调度
+ */
+class StageBase {
+public:
+    StageBase(const std::string& name, const std::string& kind,
+              ExecutorKind executor, size_t queue_capacity)
+        : name_(name),
+          kind_(kind),
+          executor_(executor),
+          queue_capacity_(queue_capacity),
+          busy_(false),
+          items_processed_(0),
+          items_emitted_(0),
+          items_rejected_(0),
+          items_dropped_(0),
+          busy_ns_(0),
+          max_latency_ns_(0),
+          queue_wait_ns_(0),
+          start_time_(std::chrono::steady_clock::now()) {
+    }
+
+    virtual ~StageBase() = default;
+
+    StageBase(const StageBase&) = delete;
+    StageBase& operator=(const StageBase&) = delete;
+
+    const std::string& name() const { return name_; }
+    const std::string& kind() const { return kind_; }
+    ExecutorKind executor() const { return executor_; }
+    size_t queue_capacity() const { return queue_capacity_; }
+
+    // ===== 端口信息 =====
+
+    virtual bool has_input() const = 0;
+    virtual bool has_output() const = 0;
+    virtual std::type_index input_type() const = 0;
+    virtual std::type_index output_type() const = 0;
+    virtual const char* input_type_name() const = 0;
+    virtual const char* output_type_name() const = 0;
+
+    /**
+     * @brief 输出是否可以连接到多个下游
+     *
+     * @note 只读的共享对象（如MediaMessagePtr）可以广播，可变的帧不行
+     */
+    virtual bool output_shareable() const = 0;
+
+    /**
+     * @brief 把本阶段的输出连接到下游阶段的输入
+     *
+     * @param downstream 下游阶段
+     * @return false 如果端口类型不匹配
+     */
+    virtual bool connect(StageBase& downstream) = 0;
+
+    /**
+     * @brief 执行一个工作单元
+     *
+     * @param wait_ms 输入为空时最多等待的时间（毫秒）
+     * @return true 如果处理了一个元素
+     */
+    virtual bool step(int wait_ms) = 0;
+
+    /**
+     * @brief 设置输入通道的自旋预算（微秒）
+     *
+     * @return false 如果本阶段没有输入通道（源阶段、inline阶段）
+     */
+    virtual bool set_input_spin_us(int spin_us) = 0;
+
+    /**
+     * @brief 输入通道有新元素时通知signal（线程池阶段）
+     *
+     * @return false 如果本阶段没有输入通道
+     */
+    virtual bool set_ready_signal(StageReadySignal* signal) = 0;
+
+    // ===== 线程池调度 =====
+
+    /**
+     * @brief 尝试独占本阶段（线程池中同一阶段同一时刻只由一个线程执行）
+     */
+    bool try_acquire() {
+        bool expected = false;
+        return busy_.compare_exchange_strong(expected, true, std::memory_order_acquire);
+    }
+
+    void release() {
+        busy_.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief 重置运行时间起点（启动管道时调用）
+     */
+    void mark_started() {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        start_time_ = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * @brief 获取阶段指标
+     */
+    StageMetrics get_metrics() const {
+        StageMetrics m;
+        m.name = name_;
+        m.kind = kind_;
+        m.executor = executor_;
+        m.items_processed = items_processed_.load();
+        m.items_emitted = items_emitted_.load();
+        m.items_rejected = items_rejected_.load();
+        m.items_dropped = items_dropped_.load();
+        m.queue_depth = input_depth();
+        m.queue_capacity = (has_input() && executor_ != ExecutorKind::INLINE) ? queue_capacity_ : 0;
+
+        std::chrono::steady_clock::time_point start;
+        {
+            std::lock_guard<std::mutex> lock(metrics_mutex_);
+            start = start_time_;
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        double busy_ns = static_cast<double>(busy_ns_.load());
+
+        if (elapsed_ns > 0) {
+            m.utilization = busy_ns / elapsed_ns;
+        }
+        if (m.items_processed > 0) {
+            m.avg_latency_us = busy_ns / m.items_processed / 1000.0;
+            m.avg_queue_wait_us = static_cast<double>(queue_wait_ns_.load()) /
+                                  m.items_processed / 1000.0;
+        }
+        m.max_latency_us = max_latency_ns_.load() / 1000.0;
+        input_spin(m.spin_us, m.spin);
+        return m;
+    }
+
+protected:
+    virtual size_t input_depth() const = 0;
+    virtual void input_spin(int& spin_us, SpinStatistics& stats) const = 0;
+
+    /**
+     * @brief 记录一次内核调用
+     */
+    void record_item(uint64_t busy_ns, uint64_t wait_ns, bool produced) {
+        items_processed_++;
+        if (!produced) {
+            items_rejected_++;
+        }
+        busy_ns_ += busy_ns;
+        queue_wait_ns_ += wait_ns;
+
+        uint64_t prev = max_latency_ns_.load(std::memory_order_relaxed);
+        while (busy_ns > prev &&
+               !max_latency_ns_.compare_exchange_weak(prev, busy_ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    void record_emitted() { items_emitted_++; }
+    void record_dropped() { items_dropped_++; }
+
+private:
+    std::string name_;
+    std::string kind_;
+    ExecutorKind executor_;
+    size_t queue_capacity_;
+
+    std::atomic<bool> busy_;                        // 线程池独占标志
+
+    std::atomic<uint64_t> items_processed_;
+    std::atomic<uint64_t> items_emitted_;
+    std::atomic<uint64_t> items_rejected_;
+    std::atomic<uint64_t> items_dropped_;
+    std::atomic<uint64_t> busy_ns_;
+    std::atomic<uint64_t> max_latency_ns_;
+    std::atomic<uint64_t> queue_wait_ns_;
+
+    mutable std::mutex metrics_mutex_;              // 保护start_time_
+    std::chrono::steady_clock::time_point start_time_;
+};
+
+/**
+ * @class StageInput
+ * @brief 类型化的输入端口（连接时通过dynamic_cast检查类型）
+ */
+template<typename T>
+class StageInput {
+public:
+    virtual ~StageInput() = default;
+
+    /**
+     * @brief 获取输入通道（非inline阶段）
+     */
+    virtual std::shared_ptr<BoundedChannel<T>> input_channel() = 0;
+
+    /**
+     * @brief 在调用者线程中直接处理一个元素（inline阶段）
+     */
+    virtual void consume(T& item) = 0;
+};
+
+template<typename T>
+struct is_shareable_item : std::false_type {};
+
+template<typename U>
+struct is_shareable_item<std::shared_ptr<const U>> : std::true_type {};
+
+// ============================================================================
+// ======================== 内核阶段 ==========================================
+// ============================================================================
+
+/**
+ * @class KernelStage
+ * @brief 用一个处理内核实现的阶段
+ *
+ * @tparam Kernel 满足PipelineKernels.h中内核约定的类型
+ */
+template<typename Kernel>
+class KernelStage : public StageBase, public StageInput<typename Kernel::input_type> {
+public:
+    using In = typename Kernel::input_type;
+    using Out = typename Kernel::output_type;
+    static constexpr bool kIsSource = std::is_same<In, NoData>::value;
+    static constexpr bool kIsSink = std::is_same<Out, NoData>::value;
+
+    KernelStage(const std::string& name, const std::string& kind,
+                ExecutorKind executor, size_t queue_capacity, Kernel kernel)
+        : StageBase(name, kind, executor, queue_capacity),
+          kernel_(std::move(kernel)) {
+        if (!kIsSource && executor != ExecutorKind::INLINE) {
+            input_ = std::make_shared<BoundedChannel<In>>(queue_capacity);
+        }
+    }
+
+    bool has_input() const override { return !kIsSource; }
+    bool has_output() const override { return !kIsSink; }
+    std::type_index input_type() const override { return std::type_index(typeid(In)); }
+    std::type_index output_type() const override { return std::type_index(typeid(Out)); }
+    const char* input_type_name() const override { return pipeline_type_name<In>(); }
+    const char* output_type_name() const override { return pipeline_type_name<Out>(); }
+    bool output_shareable() const override { return is_shareable_item<Out>::value; }
+
+    bool connect(StageBase& downstream) override {
+        if (kIsSink) {
+            return false;
+        }
+
+        auto* input = dynamic_cast<StageInput<Out>*>(&downstream);
+        if (!input || !downstream.has_input()) {
+            return false;
+        }
+
+        if (downstream.executor() == ExecutorKind::INLINE) {
+            inline_targets_.push_back(input);
+        } else {
+            channels_.push_back(input->input_channel());
+        }
+        return true;
+    }
+
+    bool step(int wait_ms) override {
+        if constexpr (kIsSource) {
+            NoData none;
+            return run(none, 0, false);
+        } else {
+            if (!input_) {
+                return false;
+            }
+            In item;
+            uint64_t wait_ns = 0;
+            if (!input_->pop_for(item, wait_ms, wait_ns)) {
+                return false;
+            }
+            run(item, wait_ns, true);
+            return true;
+        }
+    }
+
+    std::shared_ptr<BoundedChannel<In>> input_channel() override {
+        return input_;
+    }
+
+    bool set_input_spin_us(int spin_us) override {
+        if (!input_) {
+            return false;
+        }
+        input_->set_spin_us(spin_us);
+        return true;
+    }
+
+    bool set_ready_signal(StageReadySignal* signal) override {
+        if (!input_) {
+            return false;
+        }
+        input_->set_ready_signal(signal);
+        return true;
+    }
+
+    void consume(In& item) override {
+        // 多个上游可能同时内联调用同一个阶段，内核本身不要求线程安全
+        std::lock_guard<std::mutex> lock(inline_mutex_);
+        run(item, 0, true);
+    }
+
+protected:
+    size_t input_depth() const override {
+        return input_ ? input_->size() : 0;
+    }
+
+    void input_spin(int& spin_us, SpinStatistics& stats) const override {
+        if (input_) {
+            spin_us = input_->spin_us();
+            stats = input_->get_spin_statistics();
+        }
+    }
+
+private:
+    /**
+     * @brief 调用内核并把输出发往下游
+     *
+     * @param count_empty 内核没有输出时是否计为一次处理（源阶段的空轮询不计）
+     * @return true 如果内核产生了输出
+     */
+    bool run(In& item, uint64_t wait_ns, bool count_empty) {
+        Out out{};
+        const TimeService& time = TimeService::instance();
+        uint64_t t0 = time.fine_ticks();
+        bool produced = kernel_.process(item, out);
+        uint64_t busy_ns = time.fine_elapsed_ns(t0);
+
+        if (produced || count_empty) {
+            record_item(busy_ns, wait_ns, produced);
+        }
+
+        if constexpr (!kIsSink) {
+            if (produced) {
+                emit(out);
+            }
+        }
+        return produced;
+    }
+
+    void emit(Out& out) {
+        for (auto& channel : channels_) {
+            if (channel->try_push(out)) {
+                record_emitted();
+            } else {
+                record_dropped();
+            }
+        }
+        for (auto* target : inline_targets_) {
+            record_emitted();
+            target->consume(out);
+        }
+    }
+
+private:
+    Kernel kernel_;                                         // 处理内核
+    std::shared_ptr<BoundedChannel<In>> input_;             // 输入通道（inline和源阶段为空）
+    std::vector<std::shared_ptr<BoundedChannel<Out>>> channels_;  // 下游输入通道
+    std::vector<StageInput<Out>*> inline_targets_;          // 内联执行的下游
+    std::mutex inline_mutex_;                               // 串行化内联调用
+};
+
+/**
+ * @brief 用内核创建阶段
+ */
+template<typename Kernel>
+std::unique_ptr<StageBase> make_kernel_stage(const std::string& name, const std::string& kind,
+                                             ExecutorKind executor, size_t queue_capacity,
+                                             Kernel kernel) {
+    return std::unique_ptr<StageBase>(
+        new KernelStage<Kernel>(name, kind, executor, queue_capacity, std::move(kernel)));
+}
+
+// ============================================================================
+// ======================== 管道描述 ==========================================
+// ============================================================================
+
+/**
+ * @struct StageSpec
+ * @brief 一个阶段的描述
+ */
+struct StageSpec {
+    std::string name;                               // 阶段名称（图内唯一）
+    std::string kind;                               // 阶段类型
+    ExecutorKind executor;                          // 执行方式
+    size_t queue_capacity;                          // 输入通道容量
+    std::map<std::string, std::string> params;      // 其他参数
+
+    StageSpec()
+        : executor(ExecutorKind::THREAD),
+          queue_capacity(32) {
+    }
+
+    /**
+     * @brief 读取整数参数
+     */
+    int get_int(const std::string& key, int default_value) const {
+        auto it = params.find(key);
+        if (it == params.end()) {
+            return default_value;
+        }
+        try {
+            return std::stoi(it->second);
+        } catch (...) {
+            return default_value;
+        }
+    }
+};
+
+/**
+ * @struct PipelineSpec
+ * @brief 整个管道的描述（由文本解析得到）
+ */
+struct PipelineSpec {
+    size_t pool_threads;                                    // 共享线程池大小
+    int numa_node;                                          // NUMA节点（-1表示沿用PipelineResources）
+    std::vector<StageSpec> stages;                          // 阶段（按定义顺序）
+    std::vector<std::pair<std::string, std::string>> links; // 连接（上游, 下游）
+
+    PipelineSpec()
+        : pool_threads(2),
+          numa_node(-1) {
+    }
+
+    /**
+     * @brief 解析管道描述文本
+     *
+     * @param text 描述文本
+     * @param[out] error 解析失败时的错误信息（含行号）
+     * @return true 如果解析成功
+     */
+    bool parse(const std::string& text, std::string& error) {
+        stages.clear();
+        links.clear();
+
+        std::istringstream input(text);
+        std::string line;
+        int line_no = 0;
+
+        while (std::getline(input, line)) {
+            line_no++;
+
+            auto comment = line.find('#');
+            if (comment != std::string::npos) {
+                line.erase(comment);
+            }
+
+            std::istringstream tokens(line);
+            std::vector<std::string> words;
+            std::string word;
+            while (tokens >> word) {
+                words.push_back(word);
+            }
+
+            if (words.empty()) {
+                continue;
+            }
+
+            if (words[0] == "pool" && words.size() == 2) {
+                try {
+                    pool_threads = static_cast<size_t>(std::stoul(words[1]));
+                } catch (...) {
+                    error = "line " + std::to_string(line_no) + ": invalid pool size";
+                    return false;
+                }
+            } else if (words[0] == "numa" && words.size() == 2) {
+                try {
+                    numa_node = std::stoi(words[1]);
+                } catch (...) {
+                    error = "line " + std::to_string(line_no) + ": invalid numa node";
+                    return false;
+                }
+            } else if (words[0] == "stage" && words.size() >= 4) {
+                StageSpec spec;
+                spec.name = words[1];
+                spec.kind = words[2];
+                if (!parse_executor_kind(words[3], spec.executor)) {
+                    error = "line " + std::to_string(line_no) + ": unknown executor '" +
+                            words[3] + "'";
+                    return false;
+                }
+
+                for (size_t i = 4; i < words.size(); ++i) {
+                    auto eq = words[i].find('=');
+                    if (eq == std::string::npos || eq == 0) {
+                        error = "line " + std::to_string(line_no) + ": expected key=value, got '" +
+                                words[i] + "'";
+                        return false;
+                    }
+                    spec.params[words[i].substr(0, eq)] = words[i].substr(eq + 1);
+                }
+
+                int queue = spec.get_int("queue", static_cast<int>(spec.queue_capacity));
+                spec.queue_capacity = queue > 0 ? static_cast<size_t>(queue) : 1;
+                stages.push_back(spec);
+            } else if (words[0] == "link" && words.size() >= 3) {
+                for (size_t i = 1; i + 1 < words.size(); ++i) {
+                    links.emplace_back(words[i], words[i + 1]);
+                }
+            } else {
+                error = "line " + std::to_string(line_no) + ": cannot parse '" + line + "'";
+                return false;
+            }
+        }
+
+        if (stages.empty()) {
+            error = "no stages defined";
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief 默认管道：与MediaProcessor的视频路径等价
+ */
+inline const char* default_pipeline_spec() {
+    return "pool 2\n"
+           "stage capture   capture   thread\n"
+           "stage convert   convert   pool    queue=8\n"
+           "stage encode    encode    thread  queue=8\n"
+           "stage packetize packetize inline\n"
+           "stage fanout    fanout    pool    queue=64\n"
+           "link capture convert encode packetize fanout\n";
+}
+
+// ============================================================================
+// ======================== 阶段注册表 ========================================
+// ============================================================================
+
+/**
+ * @class StageRegistry
+ * @brief 阶段类型名到创建函数的映射
+ *
+ * @note 内置类型在首次使用时注册，新类型可以通过register_kind扩展
+ */
+class StageRegistry {
+public:
+    using Creator = std::function<std::unique_ptr<StageBase>(const StageSpec&,
+                                                             const PipelineResources&)>;
+
+    static StageRegistry& instance() {
+        static StageRegistry registry;
+        return registry;
+    }
+
+    void register_kind(const std::string& kind, Creator creator) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        creators_[kind] = std::move(creator);
+    }
+
+    std::unique_ptr<StageBase> create(const StageSpec& spec,
+                                      const PipelineResources& resources) const {
+        Creator creator;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = creators_.find(spec.kind);
+            if (it == creators_.end()) {
+                return nullptr;
+            }
+            creator = it->second;
+        }
+        return creator(spec, resources);
+    }
+
+private:
+    StageRegistry() {
+        register_kind("capture", [](const StageSpec& s, const PipelineResources& r) {
+            return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                     CaptureKernel(r.capture));
+        });
+
+        register_kind("test_source", [](const StageSpec& s, const PipelineResources& r) {
+            std::shared_ptr<FrameBufferPool> pool;
+            if (r.numa_node >= 0) {
+                pool = make_node_local_frame_pool(r.numa_node, 8);
+            }
+            return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                     TestSourceKernel(pool,
+                                                      s.get_int("width", 1280),
+                                                      s.get_int("height", 720),
+                                                      s.get_int("fps", 30)));
+        });
+
+        register_kind("convert", [](const StageSpec& s, const PipelineResources& r) {
+            ConvertKernel kernel(r.workers);
+            kernel.release_input = make_capture_release(r.capture);
+            return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                     std::move(kernel));
+        });
+
+        register_kind("scale", [](const StageSpec& s, const PipelineResources& r) {
+            ScaleKernel kernel(s.get_int("width", 0), s.get_int("height", 0));
+            kernel.release_input = make_capture_release(r.capture);
+            return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                     std::move(kernel));
+        });
+
+        register_kind("encode", [](const StageSpec& s, const PipelineResources& r) {
+            EncodeKernel kernel(r.engine, r.frame_pool);
+            kernel.release_input = make_capture_release(r.capture);
+            return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                     std::move(kernel));
+        });
+
+        register_kind("packetize", [](const StageSpec& s, const PipelineResources& r) {
+            return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                     PacketizeKernel(r.frame_pool));
+        });
+
+        register_kind("fanout", [](const StageSpec& s, const PipelineResources& r) {
+            return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                     FanoutKernel(r.fanout));
+        });
+    }
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Creator> creators_;
+};
+
+// ============================================================================
+// ======================== 阶段图运行时 ======================================
+// ============================================================================
+
+/**
+ * @class StageGraph
+ * @brief 按管道描述构建并运行阶段图
+ *
+ * 使用示例：
+ * @code
+ *   PipelineResources resources;
+ *   resources.capture = &capture;
+ *   resources.engine = &engine;
+ *   resources.fanout = [](const MediaMessagePtr& msg) { ... };
+ *
+ *   StageGraph graph(resources);
+ *   if (graph.build(default_pipeline_spec())) {
+ *       graph.start();
+ *       ...
+ *       graph.print_metrics();
+ *       graph.stop();
+ *   }
+ * @endcode
+ */
+class StageGraph {
+public:
+    static constexpr int STAGE_WAIT_MS = 10;        // 独占线程等待输入的超时（用于及时响应停止）
+
+    explicit StageGraph(const PipelineResources& resources)
+        : resources_(resources),
+          pool_threads_(0),
+          running_(false) {
+    }
+
+    ~StageGraph() {
+        stop();
+    }
+
+    StageGraph(const StageGraph&) = delete;
+    StageGraph& operator=(const StageGraph&) = delete;
+
+    /**
+     * @brief 解析管道描述并创建、连接所有阶段
+     *
+     * @param spec_text 管道描述文本
+     * @return true 如果构建成功
+     *
+     * 检查项：
+     * - 阶段名称唯一、类型已注册
+     * - 连接两端存在且端口类型一致
+     * - 源阶段不能inline，非源阶段必须有上游
+     * - 可变的帧不能广播给多个下游
+     * - 图中没有环
+     */
+    bool build(const std::string& spec_text) {
+        if (running_.load()) {
+            return false;
+        }
+
+        // 失败时不保留半成品：在局部构建，全部检查通过后才替换stages_
+        stages_.clear();
+        std::vector<std::unique_ptr<StageBase>> stages;
+
+        PipelineSpec spec;
+        std::string error;
+        if (!spec.parse(spec_text, error)) {
+            std::cerr << "[StageGraph] Invalid pipeline spec: " << error << std::endl;
+            return false;
+        }
+
+        // NUMA绑定：编码输出帧的缓冲池也放到该节点上（必须在创建阶段之前）
+        if (spec.numa_node >= 0) {
+            resources_.numa_node = spec.numa_node;
+        }
+        if (resources_.numa_node >= 0) {
+            resources_.frame_pool = make_node_local_frame_pool(resources_.numa_node, 30);
+            std::cout << "[StageGraph] Pipeline bound to NUMA node " << resources_.numa_node << std::endl;
+        }
+
+        std::map<std::string, size_t> index;
+        for (const auto& stage_spec : spec.stages) {
+            if (index.count(stage_spec.name)) {
+                std::cerr << "[StageGraph] Duplicate stage: " << stage_spec.name << std::endl;
+                return false;
+            }
+
+            auto stage = StageRegistry::instance().create(stage_spec, resources_);
+            if (!stage) {
+                std::cerr << "[StageGraph] Unknown stage kind: " << stage_spec.kind << std::endl;
+                return false;
+            }
+
+            if (!stage->has_input() && stage->executor() == ExecutorKind::INLINE) {
+                std::cerr << "[StageGraph] Source stage cannot be inline: "
+                          << stage_spec.name << std::endl;
+                return false;
+            }
+
+            // 自旋只对独占线程有意义：线程池阶段step(0)不等待，自旋会占住共享线程
+            int spin_us = stage_spec.get_int("spin", 0);
+            if (spin_us > 0) {
+                if (stage->executor() != ExecutorKind::THREAD || !stage->set_input_spin_us(spin_us)) {
+                    std::cerr << "[StageGraph] spin= ignored for stage '" << stage_spec.name
+                              << "' (only thread stages with an input can spin)" << std::endl;
+                }
+            }
+
+            if (stage->executor() == ExecutorKind::POOL) {
+                stage->set_ready_signal(&pool_signal_);
+            }
+
+            index[stage_spec.name] = stages.size();
+            stages.push_back(std::move(stage));
+        }
+
+        std::vector<size_t> in_degree(stages.size(), 0);
+        std::vector<size_t> out_degree(stages.size(), 0);
+        std::vector<std::vector<size_t>> edges(stages.size());
+
+        for (const auto& link : spec.links) {
+            auto from = index.find(link.first);
+            auto to = index.find(link.second);
+            if (from == index.end() || to == index.end()) {
+                std::cerr << "[StageGraph] Link refers to unknown stage: "
+                          << link.first << " -> " << link.second << std::endl;
+                return false;
+            }
+
+            StageBase& up = *stages[from->second];
+            StageBase& down = *stages[to->second];
+
+            if (out_degree[from->second] > 0 && !up.output_shareable()) {
+                std::cerr << "[StageGraph] Stage '" << up.name() << "' outputs "
+                          << up.output_type_name()
+                          << " which cannot be broadcast; insert a packetize stage first" << std::endl;
+                return false;
+            }
+
+            if (!up.has_output() || !down.has_input() ||
+                up.output_type() != down.input_type() || !up.connect(down)) {
+                std::cerr << "[StageGraph] Type mismatch: " << up.name() << " ("
+                          << up.output_type_name() << ") -> " << down.name() << " ("
+                          << down.input_type_name() << ")" << std::endl;
+                return false;
+            }
+
+            out_degree[from->second]++;
+            in_degree[to->second]++;
+            edges[from->second].push_back(to->second);
+        }
+
+        for (size_t i = 0; i < stages.size(); ++i) {
+            if (stages[i]->has_input() && in_degree[i] == 0) {
+                std::cerr << "[StageGraph] Stage has no upstream: " << stages[i]->name() << std::endl;
+                return false;
+            }
+        }
+
+        if (has_cycle(edges, in_degree)) {
+            std::cerr << "[StageGraph] Pipeline graph contains a cycle" << std::endl;
+            return false;
+        }
+
+        stages_ = std::move(stages);
+        pool_threads_ = spec.pool_threads;
+        std::cout << "[StageGraph] Built pipeline with " << stages_.size() << " stages, "
+                  << spec.links.size() << " links" << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief 启动所有阶段的执行线程
+     */
+    bool start() {
+        if (running_.load() || stages_.empty()) {
+            return running_.load();
+        }
+
+        running_ = true;
+
+        bool has_pool_stage = false;
+        for (auto& stage : stages_) {
+            stage->mark_started();
+            if (stage->executor() == ExecutorKind::THREAD) {
+                StageBase* s = stage.get();
+                threads_.emplace_back([this, s] { thread_loop(s); });
+            } else if (stage->executor() == ExecutorKind::POOL) {
+                has_pool_stage = true;
+            }
+        }
+
+        if (has_pool_stage) {
+            size_t workers = pool_threads_ > 0 ? pool_threads_ : 1;
+            for (size_t i = 0; i < workers; ++i) {
+                threads_.emplace_back([this, i] { pool_loop(i); });
+            }
+        }
+
+        std::cout << "[StageGraph] Started with " << threads_.size() << " threads" << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief 停止所有执行线程
+     *
+     * @note 通道中尚未处理的元素被丢弃
+     */
+    void stop() {
+        bool expected = true;
+        if (!running_.compare_exchange_strong(expected, false)) {
+            return;
+        }
+        pool_signal_.notify_all();
+
+        for (auto& t : threads_) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+        threads_.clear();
+
+        std::cout << "[StageGraph] Stopped" << std::endl;
+    }
+
+    bool is_running() const {
+        return running_.load();
+    }
+
+    size_t stage_count() const {
+        return stages_.size();
+    }
+
+    /**
+     * @brief 获取所有阶段的指标（按定义顺序）
+     */
+    std::vector<StageMetrics> get_metrics() const {
+        std::vector<StageMetrics> metrics;
+        metrics.reserve(stages_.size());
+        for (const auto& stage : stages_) {
+            metrics.push_back(stage->get_metrics());
+        }
+        return metrics;
+    }
+
+    /**
+     * @brief 输出所有阶段的指标
+     */
+    void print_metrics() const {
+        for (const auto& m : get_metrics()) {
+            std::cout << m.to_string() << std::endl;
+        }
+    }
+
+private:
+    /**
+     * @brief 把当前阶段线程绑定到管道的NUMA节点
+     */
+    void pin_to_numa_node() {
+        if (resources_.numa_node >= 0 && !pin_current_thread_to_node(resources_.numa_node)) {
+            std::cerr << "[StageGraph] Failed to pin thread to NUMA node "
+                      << resources_.numa_node << std::endl;
+        }
+    }
+
+    /**
+     * @brief 独占线程的主循环
+     */
+    void thread_loop(StageBase* stage) {
+        pin_to_numa_node();
+        while (running_.load()) {
+            if (!stage->step(STAGE_WAIT_MS) && !stage->has_input()) {
+                // 源阶段没有数据时短暂让出CPU
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    /**
+     * @brief 共享线程池工作线程的主循环
+     *
+     * 轮流尝试每个POOL阶段，一轮都没有工作时阻塞在pool_signal_上，
+     * 直到某个POOL阶段的输入通道有新元素。
+     * 线程池中有源阶段时（没有输入可以通知）最多等待1ms再轮询，与独占线程的源阶段一致。
+     * 不同工作线程从不同的阶段开始，减少争抢。
+     */
+    void pool_loop(size_t worker_index) {
+        pin_to_numa_node();
+        std::vector<StageBase*> pool_stages;
+        bool has_source = false;
+        for (auto& stage : stages_) {
+            if (stage->executor() == ExecutorKind::POOL) {
+                pool_stages.push_back(stage.get());
+                has_source |= !stage->has_input();
+            }
+        }
+        const auto idle_wait = has_source ? std::chrono::milliseconds(1)
+                                          : std::chrono::milliseconds(STAGE_WAIT_MS);
+
+        size_t offset = worker_index;
+        while (running_.load()) {
+            bool did_work = false;
+            const uint64_t seen = pool_signal_.generation();
+
+            for (size_t i = 0; i < pool_stages.size(); ++i) {
+                StageBase* stage = pool_stages[(offset + i) % pool_stages.size()];
+                if (stage->try_acquire()) {
+                    did_work |= stage->step(0);
+                    stage->release();
+                }
+            }
+
+            offset++;
+            if (!did_work) {
+                pool_signal_.wait(seen, idle_wait);
+            }
+        }
+    }
+
+    /**
+     * @brief 拓扑排序检查环
+     */
+    static bool has_cycle(const std::vector<std::vector<size_t>>& edges,
+                          std::vector<size_t> in_degree) {
+        std::vector<size_t> ready;
+        for (size_t i = 0; i < in_degree.size(); ++i) {
+            if (in_degree[i] == 0) {
+                ready.push_back(i);
+            }
+        }
+
+        size_t visited = 0;
+        while (!ready.empty()) {
+            size_t node = ready.back();
+            ready.pop_back();
+            visited++;
+            for (size_t next : edges[node]) {
+                if (--in_degree[next] == 0) {
+                    ready.push_back(next);
+                }
+            }
+        }
+        return visited != in_degree.size();
+    }
+
+private:
+    PipelineResources resources_;                           // 内核使用的外部资源
+    std::vector<std::unique_ptr<StageBase>> stages_;        // 所有阶段（按定义顺序）
+    size_t pool_threads_;                                   // 共享线程池大小
+    std::vector<std::thread> threads_;                      // 执行线程
+    StageReadySignal pool_signal_;                          // POOL阶段有输入时唤醒空闲工作线程
+    std::atomic<bool> running_;                             // 运行状态
+};
+
+#endif // STAGE_GRAPH_H
@@ -0,0 +1,315 @@
+/*
+ * FusedPipeline.h - 编译期组合的融合管道
+ *
+ * 功能：
+ * - 在编译期把一串处理内核（见PipelineKernels.h）组合成一个内核
+ * - 相邻内核之间直接传值，没有通道、没有虚函数、没有额外线程切换
+ * - 端口类型在编译期检查，不匹配时无法通过编译
+ * - 融合后的内核满足同样的内核约定，可以作为一个阶段放进StageGraph
+ * - FusedPipeline在一个线程中循环执行“源 -> 变换 -> 汇”的完整链路
+ *
+ * 适用场景：
+ * - 拓扑固定、吞吐量要求高的配置（例如测试源 -> 转换 -> 编码 -> 分发）
+ * - 需要运行时调整拓扑时仍使用StageGraph
+ *
+ * 使用示例：
+ * @code
+ *   auto pipeline = make_fused_pipeline(
+ *       TestSourceKernel(pool, 1280, 720, 0),
+ *       ConvertKernel(),
+ *       EncodeKernel(&engine),
+ *       PacketizeKernel(),
+ *       FanoutKernel([](const MediaMessagePtr& msg) { ... }));
+ *
+ *   pipeline.start();
+ *   ...
+ *   pipeline.stop();
+ *   std::cout << pipeline.get_statistics().to_string() << std::endl;
+ * @endcode
+ */
+
+#ifndef FUSED_PIPELINE_H
+#define FUSED_PIPELINE_H
+
+#include <type_traits>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <iostream>
+
+#include "AVServer_20_PipelineKernels.h"
+#include "AVServer_21_StageGraph.h"
+
+// ============================================================================
+// ======================== 融合内核 ==========================================
+// ============================================================================
+
+/**
+ * @class FusedKernel
+ * @brief 把多个内核在编译期串联为一个内核
+ *
+ * @tparam Kernels 按处理顺序排列的内核类型，相邻内核的输出/输入类型必须一致
+ *
+ * @note 任一内核没有输出时，后续内核不再执行
+ * @note is_stateless为所有内核is_stateless的与
+ */
+template<typename... Kernels>
+class FusedKernel;
+
+template<typename Kernel>
+class FusedKernel<Kernel> {
+public:
+    using input_type = typename Kernel::input_type;
+    using output_type = typename Kernel::output_type;
+    static constexpr bool is_stateless = Kernel::is_stateless;
+
+    explicit FusedKernel(Kernel kernel = Kernel())
+        : kernel_(std::move(kernel)) {
+    }
+
+    bool process(input_type& in, output_type& out) {
+        return kernel_.process(in, out);
+    }
+
+private:
+    Kernel kernel_;
+};
+
+template<typename First, typename Second, typename... Rest>
+class FusedKernel<First, Second, Rest...> {
+    using Tail = FusedKernel<Second, Rest...>;
+    using Intermediate = typename First::output_type;
+
+    static_assert(std::is_same<Intermediate, typename Second::input_type>::value,
+                  "FusedKernel: adjacent kernels must have matching output/input types");
+
+public:
+    using input_type = typename First::input_type;
+    using output_type = typename Tail::output_type;
+    static constexpr bool is_stateless = First::is_stateless && Tail::is_stateless;
+
+    FusedKernel(First first = First(), Second second = Second(), Rest... rest)
+        : head_(std::move(first)),
+          tail_(std::move(second), std::move(rest)...) {
+    }
+
+    bool process(input_type& in, output_type& out) {
+        Intermediate mid{};
+        return head_.process(in, mid) && tail_.process(mid, out);
+    }
+
+private:
+    First head_;
+    Tail tail_;
+};
+
+/**
+ * @brief 融合多个内核（类型由参数推导）
+ */
+template<typename... Kernels>
+FusedKernel<Kernels...> fuse_kernels(Kernels... kernels) {
+    return FusedKernel<Kernels...>(std::move(kernels)...);
+}
+
+// ============================================================================
+// ======================== 融合管道统计 ======================================
+// ============================================================================
+
+/**
+ * @struct FusedPipelineStatistics
+ * @brief 融合管道的运行统计
+ */
+struct FusedPipelineStatistics {
+    uint64_t iterations;            // 循环次数（包括源没有数据的轮次）
+    uint64_t items_completed;       // 完整走完整条链路的元素数
+    double elapsed_seconds;         // 运行时间（秒）
+    double items_per_second;        // 吞吐量
+
+    FusedPipelineStatistics()
+        : iterations(0),
+          items_completed(0),
+          elapsed_seconds(0.0),
+          items_per_second(0.0) {
+    }
+
+    std::string to_string() const {
+        char buffer[192];
+        std::snprintf(buffer, sizeof(buffer),
+            "Iterations: %llu, Completed: %llu, Elapsed: %.2fs, Throughput: %.1f items/s",
+            static_cast<unsigned long long>(iterations),
+            static_cast<unsigned long long>(items_completed),
+            elapsed_seconds, items_per_second);
+        return std::string(buffer);
+    }
+};
+
+// ============================================================================
+// ======================== 融合管道 ==========================================
+// ============================================================================
+
+/**
+ * @class FusedPipeline
+ * @brief 在单个线程中循环执行一条从源到汇的融合链路
+ *
+ * @tparam Kernels 第一个必须是源内核（输入NoData），最后一个必须是汇内核（输出NoData）
+ */
+template<typename... Kernels>
+class FusedPipeline {
+public:
+    using Chain = FusedKernel<Kernels...>;
+
+    static_assert(std::is_same<typename Chain::input_type, NoData>::value,
+                  "FusedPipeline: first kernel must be a source (input_type = NoData)");
+    static_assert(std::is_same<typename Chain::output_type, NoData>::value,
+                  "FusedPipeline: last kernel must be a sink (output_type = NoData)");
+
+    explicit FusedPipeline(Kernels... kernels)
+        : chain_(std::move(kernels)...),
+          running_(false),
+          iterations_(0),
+          items_completed_(0),
+          start_time_(std::chrono::steady_clock::now()),
+          stop_time_(start_time_) {
+    }
+
+    ~FusedPipeline() {
+        stop();
+    }
+
+    FusedPipeline(const FusedPipeline&) = delete;
+    FusedPipeline& operator=(const FusedPipeline&) = delete;
+
+    FusedPipeline(FusedPipeline&& other)
+        : chain_(std::move(other.chain_)),
+          running_(false),
+          iterations_(0),
+          items_completed_(0),
+          start_time_(std::chrono::steady_clock::now()),
+          stop_time_(start_time_) {
+    }
+
+    /**
+     * @brief 执行一轮完整链路
+     *
+     * @return true 如果有元素走完了整条链路
+     *
+     * @note 不要与start()同时使用
+     */
+    bool run_once() {
+        NoData in;
+        NoData out;
+        iterations_.fetch_add(1, std::memory_order_relaxed);
+        if (chain_.process(in, out)) {
+            items_completed_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief 在后台线程中循环执行
+     */
+    bool start() {
+        bool expected = false;
+        if (!running_.compare_exchange_strong(expected, true)) {
+            return true;
+        }
+
+        start_time_ = std::chrono::steady_clock::now();
+        worker_ = std::thread([this] {
+            while (running_.load(std::memory_order_relaxed)) {
+                if (!run_once()) {
+                    // 源没有数据时短暂让出CPU
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+        });
+        return true;
+    }
+
+    void stop() {
+        bool expected = true;
+        if (!running_.compare_exchange_strong(expected, false)) {
+            return;
+        }
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        stop_time_ = std::chrono::steady_clock::now();
+    }
+
+    bool is_running() const {
+        return running_.load();
+    }
+
+    FusedPipelineStatistics get_statistics() const {
+        FusedPipelineStatistics stats;
+        stats.iterations = iterations_.load();
+        stats.items_completed = items_completed_.load();
+
+        auto end = running_.load() ? std::chrono::steady_clock::now() : stop_time_;
+        stats.elapsed_seconds = std::chrono::duration<double>(end - start_time_).count();
+        if (stats.elapsed_seconds > 0) {
+            stats.items_per_second = stats.items_completed / stats.elapsed_seconds;
+        }
+        return stats;
+    }
+
+private:
+    Chain chain_;
+    std::atomic<bool> running_;
+    std::thread worker_;
+    std::atomic<uint64_t> iterations_;
+    std::atomic<uint64_t> items_completed_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::chrono::steady_clock::time_point stop_time_;
+};
+
+/**
+ * @brief 创建融合管道（类型由参数推导）
+ */
+template<typename... Kernels>
+FusedPipeline<Kernels...> make_fused_pipeline(Kernels... kernels) {
+    return FusedPipeline<Kernels...>(std::move(kernels)...);
+}
+
+// ============================================================================
+// ======================== 阶段图中的融合阶段 ================================
+// ============================================================================
+
+/**
+ * @brief 向StageRegistry注册融合阶段类型
+ *
+ * - convert_scale：转换+缩放（都是无状态内核），参数width/height同scale
+ * - encode_packetize：编码+打包，省去编码帧的通道
+ *
+ * @note 包含本头文件即自动注册
+ */
+inline bool register_fused_stage_kinds() {
+    StageRegistry& registry = StageRegistry::instance();
+
+    registry.register_kind("convert_scale", [](const StageSpec& s, const PipelineResources& r) {
+        ConvertKernel convert(r.workers);
+        convert.release_input = make_capture_release(r.capture);
+        ScaleKernel scale(s.get_int("width", 0), s.get_int("height", 0));
+        scale.release_input = convert.release_input;
+        return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                 fuse_kernels(std::move(convert), std::move(scale)));
+    });
+
+    registry.register_kind("encode_packetize", [](const StageSpec& s, const PipelineResources& r) {
+        EncodeKernel encode(r.engine, r.frame_pool);
+        encode.release_input = make_capture_release(r.capture);
+        return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                 fuse_kernels(std::move(encode), PacketizeKernel(r.frame_pool)));
+    });
+
+    return true;
+}
+
+inline const bool g_fused_stage_kinds_registered = register_fused_stage_kinds();
+
+#endif // FUSED_PIPELINE_H
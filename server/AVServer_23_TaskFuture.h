@@ -0,0 +1,546 @@
+/*
+ * TaskFuture.h - 支持延续（continuation）的轻量级任务future
+ *
+ * 功能：
+ * - Executor接口：统一线程池、内联执行等调度方式
+ * - TaskPromise / TaskFuture：一次性结果传递，可以阻塞等待，也可以挂延续
+ * - then()：上游完成后在指定执行器上运行下一步，不占用等待线程
+ * - when_all()：等待一组future全部完成（切片并行编码的汇合点）
+ *
+ * 与std::future的区别：
+ * - std::future只能阻塞get()，串联 编码 -> 打包 -> 入队 需要每一步都有线程等待
+ * - TaskFuture在结果就绪时直接把下一步提交给执行器，工作线程不会被挂起
+ *
+ * 使用示例：
+ * @code
+ *   ThreadPool pool(4);
+ *
+ *   // 编码 -> 打包 -> 入队，每一步就绪后立即在线程池上执行
+ *   pool.submit([&] { return encode(frame); })
+ *       .then(pool, [&](MediaFramePtr encoded) { return packetize(encoded); })
+ *       .then([&](MediaMessagePtr msg) { enqueue(msg); });   // 内联执行
+ *
+ *   // 切片并行：扇出N个切片，全部完成后再合并
+ *   std::vector<TaskFuture<Slice>> slices;
+ *   for (int i = 0; i < n; ++i) {
+ *       slices.push_back(pool.submit([=] { return encode_slice(i); }));
+ *   }
+ *   when_all(std::move(slices)).then(pool, [](std::vector<Slice> parts) { merge(parts); });
+ * @endcode
+ *
+ * @note TaskFuture只能被消费一次：get()、then()、on_complete()之后future失效
+ * @note 上游抛出的异常沿着then()链传递，中间的延续不会执行
+ */
+
+#ifndef TASK_FUTURE_H
+#define TASK_FUTURE_H
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// ============================================================================
+// ======================== 执行器接口 ========================================
+// ============================================================================
+
+/**
+ * @class Executor
+ * @brief 任务执行器接口
+ *
+ * @note 实现者负责把任务安排到某个线程上执行；任务被丢弃时必须析构它，
+ *       这样任务持有的TaskPromise会以broken_promise结束，等待者不会永远挂起
+ */
+class Executor {
+public:
+    virtual ~Executor() = default;
+
+    /**
+     * @brief 安排执行一个任务
+     */
+    virtual void execute(std::function<void()> task) = 0;
+};
+
+/**
+ * @class InlineExecutor
+ * @brief 在调用者线程中立即执行任务
+ *
+ * @note 用于很短的延续（如把消息放入队列），避免一次线程切换
+ */
+class InlineExecutor : public Executor {
+public:
+    static InlineExecutor& instance() {
+        static InlineExecutor executor;
+        return executor;
+    }
+
+    void execute(std::function<void()> task) override {
+        task();
+    }
+};
+
+// ============================================================================
+// ======================== 共享状态 ==========================================
+// ============================================================================
+
+template<typename T> class TaskFuture;
+template<typename T> class TaskPromise;
+
+/**
+ * @class TaskState
+ * @brief promise与future之间的共享状态
+ *
+ * @note 内部类型，不直接使用
+ */
+template<typename T>
+class TaskState {
+public:
+    // void结果用bool占位
+    using Stored = std::conditional_t<std::is_void<T>::value, bool, T>;
+
+    TaskState()
+        : ready_(false) {
+    }
+
+    void set_value(Stored value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ready_) {
+                throw std::future_error(std::future_errc::promise_already_satisfied);
+            }
+            value_.emplace(std::move(value));
+        }
+        complete();
+    }
+
+    void set_exception(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ready_) {
+                throw std::future_error(std::future_errc::promise_already_satisfied);
+            }
+            error_ = error;
+        }
+        complete();
+    }
+
+    /**
+     * @brief 注册完成回调
+     *
+     * @note 已经完成时在当前线程立即执行，否则在完成结果的线程中执行
+     */
+    void add_callback(std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ready_) {
+                callbacks_.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+    bool is_ready() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ready_;
+    }
+
+    void wait() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return ready_; });
+    }
+
+    bool wait_for(int timeout_ms) const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return condition_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                   [this] { return ready_; });
+    }
+
+    /**
+     * @brief 取出结果（必须已完成），有异常时重新抛出
+     */
+    Stored take() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(*value_);
+    }
+
+private:
+    /**
+     * @brief 标记完成，唤醒等待者并执行回调（回调在锁外执行）
+     */
+    void complete() {
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_ = true;
+            callbacks.swap(callbacks_);
+        }
+        condition_.notify_all();
+
+        for (auto& callback : callbacks) {
+            callback();
+        }
+    }
+
+private:
+    mutable std::mutex mutex_;
+    mutable std::condition_variable condition_;
+    bool ready_;
+    std::optional<Stored> value_;
+    std::exception_ptr error_;
+    std::vector<std::function<void()>> callbacks_;
+};
+
+// ============================================================================
+// ======================== TaskPromise =======================================
+// ============================================================================
+
+/**
+ * @class TaskPromise
+ * @brief 结果的生产端
+ *
+ * @note 没有设置结果就被销毁时，future以std::future_errc::broken_promise异常完成
+ */
+template<typename T>
+class TaskPromise {
+public:
+    TaskPromise()
+        : state_(std::make_shared<TaskState<T>>()),
+          satisfied_(false),
+          future_retrieved_(false) {
+    }
+
+    ~TaskPromise() {
+        if (state_ && !satisfied_) {
+            state_->set_exception(std::make_exception_ptr(
+                std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+    TaskPromise(TaskPromise&& other) noexcept
+        : state_(std::move(other.state_)),
+          satisfied_(other.satisfied_),
+          future_retrieved_(other.future_retrieved_) {
+    }
+
+    TaskPromise(const TaskPromise&) = delete;
+    TaskPromise& operator=(const TaskPromise&) = delete;
+    TaskPromise& operator=(TaskPromise&&) = delete;
+
+    TaskFuture<T> get_future() {
+        if (future_retrieved_) {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        future_retrieved_ = true;
+        return TaskFuture<T>(state_);
+    }
+
+    /**
+     * @brief 设置结果（T为void时不带参数）
+     */
+    template<typename... V>
+    void set_value(V&&... value) {
+        satisfied_ = true;
+        state_->set_value(typename TaskState<T>::Stored(std::forward<V>(value)...));
+    }
+
+    void set_exception(std::exception_ptr error) {
+        satisfied_ = true;
+        state_->set_exception(error);
+    }
+
+private:
+    std::shared_ptr<TaskState<T>> state_;
+    bool satisfied_;
+    bool future_retrieved_;
+};
+
+/**
+ * @brief 调用函数并把返回值（或异常）写入promise
+ */
+template<typename R, typename F, typename... Args>
+void fulfill_promise(TaskPromise<R>& promise, F& fn, Args&&... args) {
+    try {
+        if constexpr (std::is_void<R>::value) {
+            fn(std::forward<Args>(args)...);
+            promise.set_value();
+        } else {
+            promise.set_value(fn(std::forward<Args>(args)...));
+        }
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+// ============================================================================
+// ======================== TaskFuture ========================================
+// ============================================================================
+
+/**
+ * @class TaskFuture
+ * @brief 结果的消费端，支持阻塞等待和延续
+ */
+template<typename T>
+class TaskFuture {
+public:
+    TaskFuture() = default;
+
+    explicit TaskFuture(std::shared_ptr<TaskState<T>> state)
+        : state_(std::move(state)) {
+    }
+
+    TaskFuture(TaskFuture&&) noexcept = default;
+    TaskFuture& operator=(TaskFuture&&) noexcept = default;
+    TaskFuture(const TaskFuture&) = delete;
+    TaskFuture& operator=(const TaskFuture&) = delete;
+
+    /**
+     * @brief 是否关联了结果（被消费后为false）
+     */
+    bool valid() const {
+        return static_cast<bool>(state_);
+    }
+
+    bool is_ready() const {
+        return state_ && state_->is_ready();
+    }
+
+    void wait() const {
+        check_valid();
+        state_->wait();
+    }
+
+    /**
+     * @return true 如果在超时前完成
+     */
+    bool wait_for(int timeout_ms) const {
+        check_valid();
+        return state_->wait_for(timeout_ms);
+    }
+
+    /**
+     * @brief 阻塞等待并取出结果
+     *
+     * @note 有异常时重新抛出
+     */
+    T get() {
+        check_valid();
+        auto state = std::move(state_);
+        state->wait();
+        if constexpr (std::is_void<T>::value) {
+            state->take();
+        } else {
+            return state->take();
+        }
+    }
+
+    /**
+     * @brief 完成时调用fn(已完成的future)
+     *
+     * @param fn 在完成结果的线程中执行（已经完成时在当前线程执行），应当很短
+     *
+     * @note 底层原语：then()和when_all()都基于它实现
+     */
+    template<typename F>
+    void on_complete(F&& fn) {
+        check_valid();
+        auto state = std::move(state_);
+        auto callback = std::make_shared<std::decay_t<F>>(std::forward<F>(fn));
+        state->add_callback([state, callback]() mutable {
+            (*callback)(TaskFuture<T>(std::move(state)));
+        });
+    }
+
+    /**
+     * @brief 完成后在executor上执行fn(结果)，返回fn结果的future
+     *
+     * @param executor 执行延续的执行器（生命周期必须长于本次调用链）
+     * @param fn 延续函数，参数为上游结果（T为void时无参数）
+     *
+     * @note 上游有异常时不执行fn，异常直接传给返回的future
+     */
+    template<typename F>
+    auto then(Executor& executor, F&& fn) {
+        using R = typename ContinuationResult<F>::type;
+
+        auto promise = std::make_shared<TaskPromise<R>>();
+        TaskFuture<R> result = promise->get_future();
+        auto continuation = std::make_shared<std::decay_t<F>>(std::forward<F>(fn));
+        Executor* target = &executor;
+
+        on_complete([promise, continuation, target](TaskFuture<T> ready) {
+            auto upstream = std::make_shared<TaskFuture<T>>(std::move(ready));
+            target->execute([promise, continuation, upstream]() {
+                try {
+                    if constexpr (std::is_void<T>::value) {
+                        upstream->get();
+                        fulfill_promise(*promise, *continuation);
+                    } else {
+                        fulfill_promise(*promise, *continuation, upstream->get());
+                    }
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        });
+
+        return result;
+    }
+
+    /**
+     * @brief 完成后在完成结果的线程中直接执行fn
+     */
+    template<typename F>
+    auto then(F&& fn) {
+        return then(InlineExecutor::instance(), std::forward<F>(fn));
+    }
+
+private:
+    template<typename F, bool IsVoid = std::is_void<T>::value>
+    struct ContinuationResult {
+        using type = std::invoke_result_t<std::decay_t<F>&, T>;
+    };
+
+    template<typename F>
+    struct ContinuationResult<F, true> {
+        using type = std::invoke_result_t<std::decay_t<F>&>;
+    };
+
+    void check_valid() const {
+        if (!state_) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+    }
+
+private:
+    std::shared_ptr<TaskState<T>> state_;
+};
+
+// ============================================================================
+// ======================== 辅助函数 ==========================================
+// ============================================================================
+
+/**
+ * @brief 创建已经完成的future
+ */
+template<typename T>
+TaskFuture<std::decay_t<T>> make_ready_future(T&& value) {
+    TaskPromise<std::decay_t<T>> promise;
+    TaskFuture<std::decay_t<T>> future = promise.get_future();
+    promise.set_value(std::forward<T>(value));
+    return future;
+}
+
+inline TaskFuture<void> make_ready_future() {
+    TaskPromise<void> promise;
+    TaskFuture<void> future = promise.get_future();
+    promise.set_value();
+    return future;
+}
+
+/**
+ * @brief 在executor上执行fn，返回结果的future
+ */
+template<typename F>
+auto async_on(Executor& executor, F&& fn) {
+    using R = std::invoke_result_t<std::decay_t<F>&>;
+
+    auto promise = std::make_shared<TaskPromise<R>>();
+    TaskFuture<R> result = promise->get_future();
+    auto task = std::make_shared<std::decay_t<F>>(std::forward<F>(fn));
+
+    executor.execute([promise, task]() {
+        fulfill_promise(*promise, *task);
+    });
+    return result;
+}
+
+/**
+ * @brief 等待一组future全部完成
+ *
+ * @param futures 输入future（被消费）
+ * @return 按输入顺序排列的结果；T为void时返回TaskFuture<void>
+ *
+ * @note 不占用等待线程：最后一个完成的输入负责完成结果
+ * @note 任一输入有异常时，结果以第一个异常完成（仍等待所有输入结束）
+ */
+template<typename T>
+auto when_all(std::vector<TaskFuture<T>> futures) {
+    using R = std::conditional_t<std::is_void<T>::value, void, std::vector<T>>;
+    using Slot = std::conditional_t<std::is_void<T>::value, bool, std::optional<T>>;
+
+    struct JoinState {
+        TaskPromise<R> promise;
+        std::vector<Slot> slots;
+        std::atomic<size_t> remaining;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+        explicit JoinState(size_t count)
+            : slots(count),
+              remaining(count) {
+        }
+
+        void finish() {
+            if (error) {
+                promise.set_exception(error);
+                return;
+            }
+            if constexpr (std::is_void<T>::value) {
+                promise.set_value();
+            } else {
+                std::vector<T> results;
+                results.reserve(slots.size());
+                for (auto& slot : slots) {
+                    results.push_back(std::move(*slot));
+                }
+                promise.set_value(std::move(results));
+            }
+        }
+    };
+
+    auto join = std::make_shared<JoinState>(futures.size());
+    TaskFuture<R> result = join->promise.get_future();
+
+    if (futures.empty()) {
+        join->finish();
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].on_complete([join, i](TaskFuture<T> ready) {
+            try {
+                if constexpr (std::is_void<T>::value) {
+                    ready.get();
+                } else {
+                    join->slots[i].emplace(ready.get());
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(join->error_mutex);
+                if (!join->error) {
+                    join->error = std::current_exception();
+                }
+            }
+
+            if (join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                join->finish();
+            }
+        });
+    }
+
+    return result;
+}
+
+#endif // TASK_FUTURE_H
@@ -0,0 +1,560 @@
+/*
+ * EventLoop.h - 基于epoll的事件循环（Reactor）
+ *
+ * 功能：
+ * - 在一个线程中等待大量套接字的可读/可写事件
+ * - 一次性IO等待：await_io(fd, 方向, 超时, 回调)，就绪、超时或关闭时回调一次
+ * - 定时器：run_after(毫秒, 回调)，可以取消
+ * - 跨线程投递：post(回调) 通过eventfd唤醒循环线程
+ * - 可选的忙轮询：阻塞在epoll_wait之前先自旋轮询一段时间（见BusyPoll.h）
+ *
+ * 线程模型：
+ * - 所有回调都在循环线程中执行
+ * - post()和stop()可以在任意线程调用，其他接口应在循环线程中调用
+ *   （在其他线程调用时会自动投递到循环线程）
+ *
+ * 使用示例：
+ * @code
+ *   EventLoop loop;
+ *   loop.start();
+ *
+ *   loop.post([&] {
+ *       loop.await_io(fd, IoEvent::READABLE, 5000, [](IoResult result) {
+ *           if (result == IoResult::READY) { ... }
+ *       });
+ *   });
+ *
+ *   loop.stop();
+ * @endcode
+ *
+ * @note 仅支持Linux（epoll、eventfd）
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <functional>
+#include <vector>
+#include <map>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <iostream>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "AVServer_28_BusyPoll.h"
+#include "AVServer_29_TimeService.h"
+
+// ============================================================================
+// ======================== IO事件类型 ========================================
+// ============================================================================
+
+/**
+ * @enum IoEvent
+ * @brief 等待的IO方向
+ */
+enum class IoEvent {
+    READABLE,
+    WRITABLE,
+};
+
+/**
+ * @enum IoResult
+ * @brief 一次IO等待的结果
+ */
+enum class IoResult {
+    READY,                  // 套接字就绪（或出错/对端关闭，由后续读写判断）
+    TIMEOUT,                // 超时
+    CLOSED,                 // 等待被取消（remove_fd或事件循环停止）
+    ERROR,                  // 无法注册等待
+};
+
+inline const char* io_result_to_string(IoResult result) {
+    switch (result) {
+        case IoResult::READY:   return "READY";
+        case IoResult::TIMEOUT: return "TIMEOUT";
+        case IoResult::CLOSED:  return "CLOSED";
+        case IoResult::ERROR:   return "ERROR";
+        default:                return "UNKNOWN";
+    }
+}
+
+/**
+ * @brief 把套接字设为非阻塞模式
+ */
+inline bool set_nonblocking(int fd) {
+    int flags = ::fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// ============================================================================
+// ======================== 事件循环 ==========================================
+// ============================================================================
+
+/**
+ * @class EventLoop
+ * @brief 单线程epoll事件循环
+ */
+class EventLoop {
+public:
+    using Callback = std::function<void()>;
+    using IoCallback = std::function<void(IoResult)>;
+    using TimerId = uint64_t;
+
+    static constexpr int MAX_EVENTS = 256;          // 每次epoll_wait最多处理的事件数
+
+    EventLoop()
+        : epoll_fd_(-1),
+          wake_fd_(-1),
+          running_(false),
+          spin_us_(0),
+          next_timer_id_(1) {
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (epoll_fd_ >= 0 && wake_fd_ >= 0) {
+            struct epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = wake_fd_;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+        } else {
+            std::cerr << "[EventLoop] Failed to create epoll/eventfd" << std::endl;
+        }
+    }
+
+    ~EventLoop() {
+        stop();
+        if (wake_fd_ >= 0) {
+            ::close(wake_fd_);
+        }
+        if (epoll_fd_ >= 0) {
+            ::close(epoll_fd_);
+        }
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /**
+     * @brief 启动循环线程
+     */
+    bool start() {
+        if (epoll_fd_ < 0 || wake_fd_ < 0) {
+            return false;
+        }
+        bool expected = false;
+        if (!running_.compare_exchange_strong(expected, true)) {
+            return true;
+        }
+        thread_ = std::thread(&EventLoop::run, this);
+        return true;
+    }
+
+    /**
+     * @brief 停止循环线程
+     *
+     * @note 退出前以IoResult::CLOSED完成所有未结束的IO等待，
+     *       等待者（如会话协程）借此完成清理；未触发的定时器被丢弃
+     * @note 循环线程退出后才投递的回调不会执行，在这里销毁（释放其捕获的资源）
+     */
+    void stop() {
+        bool expected = true;
+        if (!running_.compare_exchange_strong(expected, false)) {
+            return;
+        }
+        wake();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        std::vector<Callback> discarded;
+        {
+            std::lock_guard<std::mutex> lock(post_mutex_);
+            discarded.swap(posted_);
+            posted_times_.clear();
+        }
+    }
+
+    bool is_running() const {
+        return running_.load();
+    }
+
+    /**
+     * @brief 设置忙轮询预算（微秒，0表示直接阻塞）
+     *
+     * 没有就绪事件时，先以零超时反复调用epoll_wait最多spin_us微秒，
+     * 仍没有事件才阻塞等待。应在start()之前调用。
+     *
+     * @note 自旋期间循环线程占满一个CPU；只给延迟敏感的循环打开
+     */
+    void set_busy_poll(int spin_us) {
+        spin_us_ = spin_us > 0 ? spin_us : 0;
+    }
+
+    /**
+     * @brief 忙轮询统计
+     *
+     * @note 取数延迟用跨线程投递的回调衡量（从post()到开始执行）
+     */
+    SpinStatistics get_spin_statistics() const {
+        return spin_.get_statistics();
+    }
+
+    /**
+     * @brief 当前线程是否是循环线程
+     */
+    bool in_loop_thread() const {
+        return std::this_thread::get_id() == loop_thread_id_.load();
+    }
+
+    /**
+     * @brief 投递回调到循环线程执行（线程安全）
+     */
+    void post(Callback callback) {
+        {
+            std::lock_guard<std::mutex> lock(post_mutex_);
+            posted_.push_back(std::move(callback));
+            if (spin_us_ > 0) {
+                posted_times_.push_back(std::chrono::steady_clock::now());
+            }
+        }
+        wake();
+    }
+
+    /**
+     * @brief 等待fd在指定方向上就绪（一次性）
+     *
+     * @param fd 非阻塞套接字
+     * @param event 等待的方向
+     * @param timeout_ms 超时（毫秒，<0表示不超时）
+     * @param callback 就绪、超时或取消时调用一次
+     * @return false 如果同一fd同一方向已经有等待者、注册失败或循环已停止（此时不会回调）
+     */
+    bool await_io(int fd, IoEvent event, int timeout_ms, IoCallback callback) {
+        if (!running_.load()) {
+            return false;
+        }
+
+        if (!in_loop_thread()) {
+            post([this, fd, event, timeout_ms, callback]() mutable {
+                if (!await_io(fd, event, timeout_ms, callback)) {
+                    callback(IoResult::ERROR);
+                }
+            });
+            return true;
+        }
+
+        FdWatch& watch = watches_[fd];
+        Waiter& waiter = event == IoEvent::READABLE ? watch.reader : watch.writer;
+        if (waiter.callback) {
+            return false;
+        }
+
+        waiter.callback = std::move(callback);
+        waiter.timer = 0;
+        if (!update_interest(fd, watch)) {
+            waiter.callback = nullptr;
+            if (!watch.reader.callback && !watch.writer.callback) {
+                watches_.erase(fd);
+            }
+            return false;
+        }
+
+        if (timeout_ms >= 0) {
+            waiter.timer = run_after(timeout_ms, [this, fd, event]() {
+                complete_waiter(fd, event, IoResult::TIMEOUT);
+            });
+        }
+        return true;
+    }
+
+    /**
+     * @brief 取消fd上的所有等待（在关闭套接字之前调用）
+     *
+     * @note 等待者以IoResult::CLOSED完成
+     */
+    void remove_fd(int fd) {
+        if (!in_loop_thread()) {
+            post([this, fd] { remove_fd(fd); });
+            return;
+        }
+        complete_waiter(fd, IoEvent::READABLE, IoResult::CLOSED);
+        complete_waiter(fd, IoEvent::WRITABLE, IoResult::CLOSED);
+    }
+
+    /**
+     * @brief 在delay_ms之后执行回调
+     *
+     * @return 定时器ID（用于cancel_timer）
+     *
+     * @note 应在循环线程中调用
+     */
+    TimerId run_after(int delay_ms, Callback callback) {
+        TimerId id = next_timer_id_++;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms);
+        timers_.push(TimerEntry{deadline, id});
+        timer_callbacks_[id] = std::move(callback);
+        return id;
+    }
+
+    /**
+     * @brief 取消定时器
+     *
+     * @return false 如果定时器已触发或不存在
+     */
+    bool cancel_timer(TimerId id) {
+        return timer_callbacks_.erase(id) > 0;
+    }
+
+    /**
+     * @brief 当前注册的fd数量
+     */
+    size_t watched_fd_count() const {
+        return watches_.size();
+    }
+
+private:
+    struct Waiter {
+        IoCallback callback;
+        TimerId timer = 0;
+    };
+
+    struct FdWatch {
+        Waiter reader;
+        Waiter writer;
+        uint32_t registered = 0;                    // 当前在epoll中注册的事件
+    };
+
+    struct TimerEntry {
+        std::chrono::steady_clock::time_point deadline;
+        TimerId id;
+
+        bool operator>(const TimerEntry& other) const {
+            return deadline > other.deadline;
+        }
+    };
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wake_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    /**
+     * @brief 按当前等待者更新fd在epoll中的兴趣集合
+     */
+    bool update_interest(int fd, FdWatch& watch) {
+        uint32_t wanted = 0;
+        if (watch.reader.callback) wanted |= EPOLLIN | EPOLLRDHUP;
+        if (watch.writer.callback) wanted |= EPOLLOUT;
+
+        if (wanted == watch.registered) {
+            return true;
+        }
+
+        struct epoll_event ev{};
+        ev.events = wanted;
+        ev.data.fd = fd;
+
+        int rc;
+        if (watch.registered == 0) {
+            rc = ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+        } else if (wanted == 0) {
+            rc = ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        } else {
+            rc = ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+        }
+
+        if (rc != 0 && wanted != 0) {
+            return false;
+        }
+        watch.registered = wanted;
+        return true;
+    }
+
+    /**
+     * @brief 结束一个等待者并调用其回调
+     */
+    void complete_waiter(int fd, IoEvent event, IoResult result) {
+        auto it = watches_.find(fd);
+        if (it == watches_.end()) {
+            return;
+        }
+
+        FdWatch& watch = it->second;
+        Waiter& waiter = event == IoEvent::READABLE ? watch.reader : watch.writer;
+        if (!waiter.callback) {
+            return;
+        }
+
+        IoCallback callback = std::move(waiter.callback);
+        waiter.callback = nullptr;
+        if (waiter.timer != 0) {
+            cancel_timer(waiter.timer);
+            waiter.timer = 0;
+        }
+
+        update_interest(fd, watch);
+        if (watch.registered == 0) {
+            watches_.erase(it);
+        }
+
+        // 回调可能再次注册同一fd，所以放在最后
+        callback(result);
+    }
+
+    /**
+     * @brief 距离最近的定时器到期的毫秒数（没有定时器时返回-1）
+     */
+    int next_timeout_ms() {
+        while (!timers_.empty() && !timer_callbacks_.count(timers_.top().id)) {
+            timers_.pop();
+        }
+        if (timers_.empty()) {
+            return -1;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            timers_.top().deadline - std::chrono::steady_clock::now()).count();
+        return remaining > 0 ? static_cast<int>(remaining) : 0;
+    }
+
+    void run_due_timers() {
+        auto now = std::chrono::steady_clock::now();
+        while (!timers_.empty() && timers_.top().deadline <= now) {
+            TimerId id = timers_.top().id;
+            timers_.pop();
+
+            auto it = timer_callbacks_.find(id);
+            if (it == timer_callbacks_.end()) {
+                continue;
+            }
+            Callback callback = std::move(it->second);
+            timer_callbacks_.erase(it);
+            callback();
+        }
+    }
+
+    /**
+     * @param spun 本轮是否由自旋取到事件（记录投递延迟时区分两类）
+     */
+    void run_posted(bool spun = false) {
+        std::vector<Callback> callbacks;
+        std::vector<std::chrono::steady_clock::time_point> times;
+        {
+            std::lock_guard<std::mutex> lock(post_mutex_);
+            callbacks.swap(posted_);
+            times.swap(posted_times_);
+        }
+        if (!times.empty()) {
+            auto now = std::chrono::steady_clock::now();
+            for (const auto& posted_at : times) {
+                spin_.record_pickup(spun, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - posted_at).count());
+            }
+        }
+        for (auto& callback : callbacks) {
+            callback();
+        }
+    }
+
+    /**
+     * @brief 循环线程主函数
+     */
+    void run() {
+        loop_thread_id_ = std::this_thread::get_id();
+        struct epoll_event events[MAX_EVENTS];
+
+        while (running_.load()) {
+            int timeout_ms = next_timeout_ms();
+            int n = 0;
+            bool spun = false;
+
+            if (spin_us_ > 0 && timeout_ms != 0) {
+                // 自旋不超过最近定时器的到期时间
+                int budget_us = spin_us_;
+                if (timeout_ms > 0 && timeout_ms * 1000 < budget_us) {
+                    budget_us = timeout_ms * 1000;
+                }
+                auto spin_start = std::chrono::steady_clock::now();
+                spun = spin_until([&] {
+                    n = ::epoll_wait(epoll_fd_, events, MAX_EVENTS, 0);
+                    return n != 0;
+                }, budget_us);
+                spin_.record_spin(spun, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - spin_start).count());
+                if (!spun) {
+                    n = ::epoll_wait(epoll_fd_, events, MAX_EVENTS, next_timeout_ms());
+                }
+            } else {
+                n = ::epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout_ms);
+            }
+
+            // 本轮回调中读取的粗粒度时间都是唤醒之后的
+            TimeService::instance().tick();
+
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                uint32_t ready = events[i].events;
+
+                if (fd == wake_fd_) {
+                    uint64_t value;
+                    while (::read(wake_fd_, &value, sizeof(value)) > 0) {
+                    }
+                    continue;
+                }
+
+                // 出错或挂断时两个方向的等待者都唤醒，由读写调用发现错误
+                bool failed = ready & (EPOLLERR | EPOLLHUP);
+                if (ready & (EPOLLIN | EPOLLRDHUP) || failed) {
+                    complete_waiter(fd, IoEvent::READABLE, IoResult::READY);
+                }
+                if (ready & EPOLLOUT || failed) {
+                    complete_waiter(fd, IoEvent::WRITABLE, IoResult::READY);
+                }
+            }
+
+            run_due_timers();
+            run_posted(spun);
+        }
+
+        // 以CLOSED结束所有IO等待，让等待者完成清理
+        run_posted();
+        while (!watches_.empty()) {
+            int fd = watches_.begin()->first;
+            remove_fd(fd);
+        }
+        timer_callbacks_.clear();
+
+        loop_thread_id_ = std::thread::id();
+    }
+
+private:
+    int epoll_fd_;
+    int wake_fd_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+    std::atomic<std::thread::id> loop_thread_id_;
+
+    std::mutex post_mutex_;                             // 保护posted_
+    std::vector<Callback> posted_;                      // 跨线程投递的回调
+    std::vector<std::chrono::steady_clock::time_point> posted_times_;  // 投递时间（仅忙轮询时记录）
+
+    int spin_us_;                                       // 忙轮询预算（微秒）
+    SpinCounters spin_;                                 // 忙轮询统计
+
+    std::map<int, FdWatch> watches_;                    // fd -> 等待者
+    std::priority_queue<TimerEntry, std::vector<TimerEntry>,
+                        std::greater<TimerEntry>> timers_;  // 定时器最小堆
+    std::map<TimerId, Callback> timer_callbacks_;      // 未触发的定时器回调
+    TimerId next_timer_id_;
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,293 @@
+/*
+ * Coroutine.h - 事件循环上的C++20协程支持
+ *
+ * 功能：
+ * - CoTask<T>：惰性启动、可co_await的协程任务（完成时对称转移回等待者）
+ * - DetachedTask：独立运行的协程（如每个连接的会话），结束时自动释放协程帧
+ * - 可等待对象：套接字可读/可写、定时睡眠，都挂在EventLoop上
+ *
+ * 与线程模型的区别：
+ * - 每个会话是一个无栈协程，等待IO时只占用一个协程帧（几百字节），不占线程
+ * - 会话逻辑（握手、心跳、发送背压）按顺序写在一个函数里，状态保存在局部变量中
+ *
+ * 使用示例：
+ * @code
+ *   DetachedTask echo(EventLoop& loop, int fd) {
+ *       while (true) {
+ *           IoResult r = co_await wait_readable(loop, fd, 5000);
+ *           if (r != IoResult::READY) break;
+ *           ...
+ *           co_await async_sleep(loop, 10);
+ *       }
+ *   }
+ * @endcode
+ *
+ * 编译要求：
+ * - 需要C++20（g++ -std=c++20 或 clang++ -std=c++20）
+ * - C++17编译时本文件只定义AVSERVER_HAS_COROUTINES为0，服务器的会话在事件循环上以回调方式运行
+ */
+
+#ifndef AV_COROUTINE_H
+#define AV_COROUTINE_H
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+    #define AVSERVER_HAS_COROUTINES 1
+#else
+    #define AVSERVER_HAS_COROUTINES 0
+#endif
+
+#if AVSERVER_HAS_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <iostream>
+
+#include "AVServer_24_EventLoop.h"
+
+// ============================================================================
+// ======================== CoTask ============================================
+// ============================================================================
+
+template<typename T> class CoTask;
+
+/**
+ * @brief CoTask承诺对象的公共部分
+ */
+struct CoTaskPromiseBase {
+    std::coroutine_handle<> continuation;           // 等待本任务的协程
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    /**
+     * @brief 结束时直接切换到等待者（对称转移，不增加栈深度）
+     */
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            auto next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() {
+        error = std::current_exception();
+    }
+};
+
+template<typename T>
+struct CoTaskPromise : CoTaskPromiseBase {
+    std::optional<T> value;
+
+    CoTask<T> get_return_object();
+
+    template<typename V>
+    void return_value(V&& v) {
+        value.emplace(std::forward<V>(v));
+    }
+
+    T take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct CoTaskPromise<void> : CoTaskPromiseBase {
+    CoTask<void> get_return_object();
+
+    void return_void() {}
+
+    void take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+/**
+ * @class CoTask
+ * @brief 惰性启动的协程任务，被co_await时才开始执行
+ *
+ * @note 只能co_await一次；异常在co_await处重新抛出
+ */
+template<typename T = void>
+class CoTask {
+public:
+    using promise_type = CoTaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit CoTask(Handle handle)
+        : handle_(handle) {
+    }
+
+    CoTask(CoTask&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) {
+    }
+
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    CoTask& operator=(CoTask&&) = delete;
+
+    ~CoTask() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume() {
+        return handle_.promise().take();
+    }
+
+private:
+    Handle handle_;
+};
+
+template<typename T>
+CoTask<T> CoTaskPromise<T>::get_return_object() {
+    return CoTask<T>(std::coroutine_handle<CoTaskPromise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> CoTaskPromise<void>::get_return_object() {
+    return CoTask<void>(std::coroutine_handle<CoTaskPromise<void>>::from_promise(*this));
+}
+
+// ============================================================================
+// ======================== DetachedTask ======================================
+// ============================================================================
+
+/**
+ * @struct DetachedTask
+ * @brief 立即开始、独立运行的协程，结束时自动销毁协程帧
+ *
+ * @note 协程内未捕获的异常被记录后丢弃
+ */
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept {
+            try {
+                std::rethrow_exception(std::current_exception());
+            } catch (const std::exception& e) {
+                std::cerr << "[Coroutine] Unhandled exception: " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "[Coroutine] Unhandled exception" << std::endl;
+            }
+        }
+    };
+};
+
+// ============================================================================
+// ======================== 事件循环上的可等待对象 ============================
+// ============================================================================
+
+/**
+ * @class IoAwaitable
+ * @brief 等待套接字可读/可写
+ *
+ * @note co_await的结果为IoResult；循环已停止或已有同方向等待者时立即返回ERROR
+ */
+class IoAwaitable {
+public:
+    IoAwaitable(EventLoop& loop, int fd, IoEvent event, int timeout_ms)
+        : loop_(loop),
+          fd_(fd),
+          event_(event),
+          timeout_ms_(timeout_ms),
+          result_(IoResult::ERROR) {
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return loop_.await_io(fd_, event_, timeout_ms_, [this, handle](IoResult result) {
+            result_ = result;
+            handle.resume();
+        });
+    }
+
+    IoResult await_resume() const noexcept {
+        return result_;
+    }
+
+private:
+    EventLoop& loop_;
+    int fd_;
+    IoEvent event_;
+    int timeout_ms_;
+    IoResult result_;
+};
+
+/**
+ * @class SleepAwaitable
+ * @brief 在事件循环上睡眠指定毫秒
+ */
+class SleepAwaitable {
+public:
+    SleepAwaitable(EventLoop& loop, int delay_ms)
+        : loop_(loop),
+          delay_ms_(delay_ms) {
+    }
+
+    bool await_ready() const noexcept {
+        return delay_ms_ < 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        loop_.run_after(delay_ms_, [handle]() { handle.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop& loop_;
+    int delay_ms_;
+};
+
+inline IoAwaitable wait_readable(EventLoop& loop, int fd, int timeout_ms = -1) {
+    return IoAwaitable(loop, fd, IoEvent::READABLE, timeout_ms);
+}
+
+inline IoAwaitable wait_writable(EventLoop& loop, int fd, int timeout_ms = -1) {
+    return IoAwaitable(loop, fd, IoEvent::WRITABLE, timeout_ms);
+}
+
+/**
+ * @note 事件循环停止时未到期的睡眠不会被唤醒，长期会话应同时等待IO
+ */
+inline SleepAwaitable async_sleep(EventLoop& loop, int delay_ms) {
+    return SleepAwaitable(loop, delay_ms);
+}
+
+#endif // AVSERVER_HAS_COROUTINES
+
+#endif // AV_COROUTINE_H
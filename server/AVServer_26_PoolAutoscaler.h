@@ -0,0 +1,335 @@
+/*
+ * PoolAutoscaler.h - 线程池自动扩缩容与CPU配额检测
+ *
+ * 功能：
+ * - 读取容器（cgroup v1/v2）的CPU配额，计算进程实际可用的CPU数
+ * - 按排队时间和工作线程利用率在[min, max]之间调整ThreadPool的线程数
+ * - 配额在运行时变化时（容器被调整CPU限制）跟随调整上限，不需要重启
+ *
+ * 控制规则（每个采样周期一次）：
+ * 1. 上限 = min(max_threads, CPU配额)，线程数超过上限时立即降到上限
+ * 2. 平均排队时间超过scale_up_wait_ms：增加约25%的线程（至少1个）
+ * 3. 利用率连续scale_down_intervals个周期低于scale_down_utilization且队列为空：减少1个线程
+ *
+ * 使用示例：
+ * @code
+ *   ThreadPool pool(default_thread_pool_size());
+ *
+ *   AutoscaleConfig config;
+ *   config.min_threads = 2;
+ *   config.max_threads = 16;
+ *   ThreadPoolAutoscaler autoscaler(pool, config);
+ *   autoscaler.start();
+ *   ...
+ *   autoscaler.stop();     // 必须在线程池销毁之前停止
+ * @endcode
+ */
+
+#ifndef POOL_AUTOSCALER_H
+#define POOL_AUTOSCALER_H
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+
+#include "AVServer_04_ThreadPool.h"
+
+// ============================================================================
+// ======================== CPU配额 ===========================================
+// ============================================================================
+
+/**
+ * @brief 读取cgroup的CPU配额
+ *
+ * @return 可用的CPU数（可以是小数，如1.5）；没有限制或读取失败时返回0
+ *
+ * 读取顺序：
+ * - cgroup v2：/sys/fs/cgroup/cpu.max，格式 "<quota> <period>" 或 "max <period>"
+ * - cgroup v1：/sys/fs/cgroup/cpu/cpu.cfs_quota_us 和 cpu.cfs_period_us（quota为-1表示不限制）
+ *
+ * @note 每次调用都重新读取文件，配额变化后立即生效
+ */
+inline double read_cgroup_cpu_limit() {
+    {
+        std::ifstream file("/sys/fs/cgroup/cpu.max");
+        std::string quota;
+        long long period = 0;
+        if (file >> quota >> period) {
+            if (quota == "max" || period <= 0) {
+                return 0.0;
+            }
+            try {
+                return static_cast<double>(std::stoll(quota)) / period;
+            } catch (...) {
+                return 0.0;
+            }
+        }
+    }
+
+    std::ifstream quota_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream period_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    long long quota = 0;
+    long long period = 0;
+    if ((quota_file >> quota) && (period_file >> period) && quota > 0 && period > 0) {
+        return static_cast<double>(quota) / period;
+    }
+    return 0.0;
+}
+
+/**
+ * @brief 进程实际可用的CPU数
+ *
+ * @return min(hardware_concurrency, ceil(cgroup配额))，至少为1
+ */
+inline size_t effective_cpu_count() {
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    double limit = read_cgroup_cpu_limit();
+    if (limit > 0.0) {
+        size_t quota = static_cast<size_t>(std::ceil(limit));
+        return std::max<size_t>(1, std::min(hardware, quota));
+    }
+    return hardware;
+}
+
+/**
+ * @brief 线程池的默认大小：可用CPU数，至少2个
+ *
+ * @note 至少2个线程，避免单个长任务阻塞所有请求
+ */
+inline size_t default_thread_pool_size() {
+    return std::max<size_t>(2, effective_cpu_count());
+}
+
+// ============================================================================
+// ======================== 自动扩缩容 ========================================
+// ============================================================================
+
+/**
+ * @struct AutoscaleConfig
+ * @brief 自动扩缩容参数
+ */
+struct AutoscaleConfig {
+    size_t min_threads;                 // 最少线程数
+    size_t max_threads;                 // 最多线程数
+    int interval_ms;                    // 采样周期（毫秒）
+    double scale_up_wait_ms;            // 平均排队时间超过此值时扩容
+    double scale_down_utilization;      // 利用率低于此值时考虑缩容（0~1）
+    int scale_down_intervals;           // 连续多少个周期空闲后才缩容
+    bool follow_cpu_quota;              // 上限是否跟随cgroup CPU配额
+
+    AutoscaleConfig()
+        : min_threads(1),
+          max_threads(default_thread_pool_size()),
+          interval_ms(500),
+          scale_up_wait_ms(5.0),
+          scale_down_utilization(0.3),
+          scale_down_intervals(4),
+          follow_cpu_quota(true) {
+    }
+};
+
+/**
+ * @struct AutoscaleStatistics
+ * @brief 扩缩容统计
+ */
+struct AutoscaleStatistics {
+    size_t threads;                     // 当前线程数
+    size_t limit;                       // 当前上限（考虑CPU配额后）
+    double last_wait_ms;                // 最近一个周期的平均排队时间
+    double last_utilization;            // 最近一个周期的利用率
+    uint64_t scale_ups;                 // 扩容次数
+    uint64_t scale_downs;               // 缩容次数（包括配额下降导致的）
+
+    AutoscaleStatistics()
+        : threads(0), limit(0),
+          last_wait_ms(0.0), last_utilization(0.0),
+          scale_ups(0), scale_downs(0) {
+    }
+
+    std::string to_string() const {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer),
+                 "Autoscale Stats: threads=%zu limit=%zu wait=%.2fms util=%.1f%% ups=%llu downs=%llu",
+                 threads, limit, last_wait_ms, last_utilization * 100.0,
+                 static_cast<unsigned long long>(scale_ups),
+                 static_cast<unsigned long long>(scale_downs));
+        return std::string(buffer);
+    }
+};
+
+/**
+ * @class ThreadPoolAutoscaler
+ * @brief 周期性采样ThreadPool统计，按排队时间和利用率调整线程数
+ *
+ * @note 不拥有线程池；必须在线程池销毁之前stop()
+ */
+class ThreadPoolAutoscaler {
+public:
+    ThreadPoolAutoscaler(ThreadPool& pool, const AutoscaleConfig& config = AutoscaleConfig())
+        : pool_(pool),
+          config_(config),
+          running_(false),
+          idle_intervals_(0),
+          has_sample_(false) {
+        config_.min_threads = std::max<size_t>(config_.min_threads, 1);
+        config_.max_threads = std::max(config_.max_threads, config_.min_threads);
+    }
+
+    ~ThreadPoolAutoscaler() {
+        stop();
+    }
+
+    ThreadPoolAutoscaler(const ThreadPoolAutoscaler&) = delete;
+    ThreadPoolAutoscaler& operator=(const ThreadPoolAutoscaler&) = delete;
+
+    void start() {
+        if (running_.exchange(true)) {
+            return;
+        }
+        thread_ = std::thread(&ThreadPoolAutoscaler::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_.exchange(false)) {
+                return;
+            }
+        }
+        cond_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    /**
+     * @brief 采样一次并做出调整
+     *
+     * @note 由后台线程周期调用；第一次调用只记录基准
+     */
+    void evaluate() {
+        auto now = std::chrono::steady_clock::now();
+        ThreadPoolStatistics sample = pool_.get_statistics();
+
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if (!has_sample_) {
+            last_sample_ = sample;
+            last_time_ = now;
+            has_sample_ = true;
+            return;
+        }
+
+        // 本周期的平均排队时间和利用率
+        uint64_t dequeued = sample.tasks_dequeued - last_sample_.tasks_dequeued;
+        uint64_t wait_ns = sample.queue_wait_ns - last_sample_.queue_wait_ns;
+        uint64_t busy_ns = sample.busy_ns - last_sample_.busy_ns;
+        double elapsed_ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_time_).count());
+
+        double wait_ms = dequeued > 0 ? wait_ns / 1e6 / dequeued : 0.0;
+        double utilization = (elapsed_ns > 0 && sample.threads > 0)
+            ? busy_ns / (elapsed_ns * sample.threads) : 0.0;
+
+        last_sample_ = sample;
+        last_time_ = now;
+        stats_.last_wait_ms = wait_ms;
+        stats_.last_utilization = utilization;
+
+        // 排队中的任务还没出队，也要算进去：队首等待时间只会更长
+        if (sample.queue_size > 0 && dequeued == 0) {
+            wait_ms = config_.scale_up_wait_ms + 1.0;
+        }
+
+        size_t limit = current_limit();
+        size_t threads = sample.threads;
+        stats_.limit = limit;
+
+        if (threads > limit) {
+            threads = pool_.resize(limit);
+            stats_.scale_downs++;
+            idle_intervals_ = 0;
+            std::cout << "[Autoscale] CPU limit " << limit << ", threads -> " << threads << std::endl;
+        } else if (threads < config_.min_threads) {
+            threads = pool_.resize(config_.min_threads);
+            stats_.scale_ups++;
+        } else if (wait_ms > config_.scale_up_wait_ms && threads < limit) {
+            size_t step = std::max<size_t>(1, threads / 4);
+            threads = pool_.resize(std::min(limit, threads + step));
+            stats_.scale_ups++;
+            idle_intervals_ = 0;
+            std::cout << "[Autoscale] wait " << wait_ms << "ms, threads -> " << threads << std::endl;
+        } else if (utilization < config_.scale_down_utilization && sample.queue_size == 0 &&
+                   threads > config_.min_threads) {
+            if (++idle_intervals_ >= config_.scale_down_intervals) {
+                threads = pool_.resize(threads - 1);
+                stats_.scale_downs++;
+                idle_intervals_ = 0;
+                std::cout << "[Autoscale] utilization " << utilization * 100.0
+                          << "%, threads -> " << threads << std::endl;
+            }
+        } else {
+            idle_intervals_ = 0;
+        }
+
+        stats_.threads = threads;
+    }
+
+    AutoscaleStatistics get_statistics() const {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        return stats_;
+    }
+
+    const AutoscaleConfig& config() const {
+        return config_;
+    }
+
+private:
+    /**
+     * @brief 线程数上限：max_threads与CPU配额取小，不低于min_threads
+     */
+    size_t current_limit() const {
+        size_t limit = config_.max_threads;
+        if (config_.follow_cpu_quota) {
+            limit = std::min(limit, effective_cpu_count());
+        }
+        return std::max(limit, config_.min_threads);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_.load()) {
+            lock.unlock();
+            evaluate();
+            lock.lock();
+            cond_.wait_for(lock, std::chrono::milliseconds(config_.interval_ms),
+                           [this] { return !running_.load(); });
+        }
+    }
+
+private:
+    ThreadPool& pool_;
+    AutoscaleConfig config_;
+
+    std::atomic<bool> running_;
+    std::thread thread_;
+    std::mutex mutex_;                          // 配合cond_实现可中断的周期等待
+    std::condition_variable cond_;
+
+    mutable std::mutex stats_mutex_;            // 保护采样状态和统计
+    ThreadPoolStatistics last_sample_;
+    std::chrono::steady_clock::time_point last_time_;
+    int idle_intervals_;
+    bool has_sample_;
+    AutoscaleStatistics stats_;
+};
+
+#endif // POOL_AUTOSCALER_H
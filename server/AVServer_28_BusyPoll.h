@@ -0,0 +1,297 @@
+/*
+ * BusyPoll.h - 低延迟模式：自旋等待与套接字忙轮询
+ *
+ * 功能：
+ * - cpu_relax()：自旋循环中的暂停指令（x86为PAUSE，ARM为YIELD）
+ * - spin_until()：在预算时间内自旋检查条件，超时后由调用者再去阻塞等待
+ * - enable_socket_busy_poll()：为套接字打开SO_BUSY_POLL / SO_PREFER_BUSY_POLL
+ * - SpinCounters：统计自旋消耗的CPU时间和节省的唤醒延迟
+ *
+ * 为什么需要：
+ * 条件变量（futex）和epoll_wait的阻塞唤醒要经过调度器，通常需要几十微秒，
+ * 负载高时更久。对交互式的低延迟流，关键线程在阻塞之前先自旋一小段时间，
+ * 数据在自旋期间到达就省掉了一次唤醒。代价是自旋期间占满一个CPU，
+ * 所以按线程角色单独开启：
+ * - 事件循环（Reactor）：ServerConfig::busy_poll_us
+ * - 管道阶段：阶段参数 spin=微秒（只对thread执行方式的阶段有效）
+ *
+ * 使用示例：
+ * @code
+ *   SpinCounters counters;
+ *   auto t0 = std::chrono::steady_clock::now();
+ *   bool hit = spin_until([&] { return ready.load(); }, 50);
+ *   counters.record_spin(hit, std::chrono::duration_cast<std::chrono::nanoseconds>(
+ *       std::chrono::steady_clock::now() - t0).count());
+ *   if (!hit) {
+ *       // 阻塞等待
+ *   }
+ *   std::cout << counters.get_statistics().to_string() << std::endl;
+ * @endcode
+ */
+
+#ifndef BUSY_POLL_H
+#define BUSY_POLL_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#endif
+
+#ifdef __linux__
+    #include <sys/socket.h>
+    #include <cerrno>
+    #include <cstring>
+#endif
+
+// 较旧的内核头文件没有这些选项（Linux 5.11加入）
+#ifndef SO_PREFER_BUSY_POLL
+    #define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+    #define SO_BUSY_POLL_BUDGET 70
+#endif
+
+// ============================================================================
+// ======================== 自旋原语 ==========================================
+// ============================================================================
+
+/**
+ * @brief 自旋循环中的暂停指令
+ *
+ * @note 降低自旋对同一物理核上超线程的干扰，并避免退出循环时的内存序冲刷
+ */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * @brief 在预算时间内自旋等待条件成立
+ *
+ * @param ready 要检查的条件（应只读原子变量，不要加锁）
+ * @param budget_us 自旋预算（微秒，<=0时只检查一次）
+ * @return true 如果条件在预算内成立
+ *
+ * @note 每64次检查读一次时钟，时钟读取本身不会成为自旋的主要开销
+ */
+template<typename Predicate>
+bool spin_until(Predicate&& ready, int budget_us) {
+    if (ready()) {
+        return true;
+    }
+    if (budget_us <= 0) {
+        return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us);
+    for (uint32_t i = 1; ; ++i) {
+        cpu_relax();
+        if (ready()) {
+            return true;
+        }
+        if ((i & 63) == 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+}
+
+// ============================================================================
+// ======================== 套接字忙轮询 ======================================
+// ============================================================================
+
+/**
+ * @brief 为套接字打开内核忙轮询
+ *
+ * @param fd 套接字
+ * @param busy_poll_us 阻塞读取/epoll等待时在驱动队列上忙轮询的时间（微秒）
+ * @param prefer 设置SO_PREFER_BUSY_POLL：负载高时由忙轮询而不是软中断收包
+ * @return true 如果SO_BUSY_POLL设置成功
+ *
+ * @note 超过net.core.busy_read的值需要CAP_NET_ADMIN；失败时套接字照常工作
+ * @note epoll的忙轮询要求同一epoll实例中的套接字来自同一个网卡队列（NAPI ID）
+ */
+inline bool enable_socket_busy_poll(int fd, int busy_poll_us, bool prefer) {
+#ifdef __linux__
+    if (busy_poll_us <= 0) {
+        return false;
+    }
+    if (::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) != 0) {
+        static std::atomic<bool> warned(false);
+        if (!warned.exchange(true)) {
+            std::cerr << "[BusyPoll] SO_BUSY_POLL failed: " << std::strerror(errno)
+                      << " (needs CAP_NET_ADMIN above net.core.busy_read)" << std::endl;
+        }
+        return false;
+    }
+    if (prefer) {
+        int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+    }
+    return true;
+#else
+    (void)fd;
+    (void)busy_poll_us;
+    (void)prefer;
+    return false;
+#endif
+}
+
+// ============================================================================
+// ======================== 自旋统计 ==========================================
+// ============================================================================
+
+/**
+ * @struct SpinStatistics
+ * @brief 自旋的代价（CPU时间）和收益（取到数据的延迟）
+ *
+ * 取数延迟 = 数据就绪到消费者拿到数据的时间，按消费者是否阻塞过分两类：
+ * - 自旋命中：数据在自旋期间到达，没有阻塞
+ * - 阻塞唤醒：自旋预算用完后阻塞，被唤醒后才拿到数据
+ * 节省的延迟按 命中次数 × (阻塞唤醒平均延迟 - 自旋命中平均延迟) 估算
+ */
+struct SpinStatistics {
+    uint64_t spins;                 // 开始自旋的次数（输入为空时）
+    uint64_t spin_hits;             // 自旋期间等到数据的次数
+    uint64_t parks;                 // 自旋预算用完后阻塞的次数
+    uint64_t spin_ns;               // 自旋消耗的总时间（纳秒，约等于CPU时间）
+    uint64_t spin_pickups;          // 自旋命中的取数次数（有延迟样本的）
+    uint64_t spin_pickup_ns;        // 自旋命中的取数延迟总和
+    uint64_t park_pickups;          // 阻塞唤醒的取数次数（有延迟样本的）
+    uint64_t park_pickup_ns;        // 阻塞唤醒的取数延迟总和
+
+    SpinStatistics()
+        : spins(0), spin_hits(0), parks(0), spin_ns(0),
+          spin_pickups(0), spin_pickup_ns(0),
+          park_pickups(0), park_pickup_ns(0) {
+    }
+
+    double hit_rate() const {
+        return spins > 0 ? static_cast<double>(spin_hits) / spins : 0.0;
+    }
+
+    double avg_spin_pickup_us() const {
+        return spin_pickups > 0 ? spin_pickup_ns / 1000.0 / spin_pickups : 0.0;
+    }
+
+    double avg_park_pickup_us() const {
+        return park_pickups > 0 ? park_pickup_ns / 1000.0 / park_pickups : 0.0;
+    }
+
+    /**
+     * @brief 估算节省的总延迟（毫秒）；没有两类样本时为0
+     */
+    double latency_saved_ms() const {
+        if (spin_pickups == 0 || park_pickups == 0) {
+            return 0.0;
+        }
+        double saved_us = avg_park_pickup_us() - avg_spin_pickup_us();
+        return saved_us > 0 ? saved_us * spin_pickups / 1000.0 : 0.0;
+    }
+
+    std::string to_string() const {
+        char buffer[320];
+        int len = std::snprintf(buffer, sizeof(buffer),
+            "Spin Stats: spins=%llu hits=%llu (%.1f%%) parks=%llu cpu=%.1fms",
+            static_cast<unsigned long long>(spins),
+            static_cast<unsigned long long>(spin_hits), hit_rate() * 100.0,
+            static_cast<unsigned long long>(parks), spin_ns / 1e6);
+        if (spin_pickups + park_pickups > 0 && len > 0 && static_cast<size_t>(len) < sizeof(buffer)) {
+            std::snprintf(buffer + len, sizeof(buffer) - len,
+                " pickup spin=%.1fus park=%.1fus saved=%.1fms",
+                avg_spin_pickup_us(), avg_park_pickup_us(), latency_saved_ms());
+        }
+        return std::string(buffer);
+    }
+
+    SpinStatistics& operator+=(const SpinStatistics& other) {
+        spins += other.spins;
+        spin_hits += other.spin_hits;
+        parks += other.parks;
+        spin_ns += other.spin_ns;
+        spin_pickups += other.spin_pickups;
+        spin_pickup_ns += other.spin_pickup_ns;
+        park_pickups += other.park_pickups;
+        park_pickup_ns += other.park_pickup_ns;
+        return *this;
+    }
+};
+
+/**
+ * @class SpinCounters
+ * @brief 线程安全的自旋统计计数器
+ */
+class SpinCounters {
+public:
+    SpinCounters()
+        : spins_(0), spin_hits_(0), parks_(0), spin_ns_(0),
+          spin_pickups_(0), spin_pickup_ns_(0),
+          park_pickups_(0), park_pickup_ns_(0) {
+    }
+
+    /**
+     * @brief 记录一次自旋
+     *
+     * @param hit 是否在预算内等到数据（否则随后会阻塞）
+     * @param spin_ns 本次自旋的时间
+     */
+    void record_spin(bool hit, uint64_t spin_ns) {
+        spins_.fetch_add(1, std::memory_order_relaxed);
+        if (hit) {
+            spin_hits_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            parks_.fetch_add(1, std::memory_order_relaxed);
+        }
+        spin_ns_.fetch_add(spin_ns, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 记录一次取数延迟
+     *
+     * @param spun true表示自旋命中，false表示阻塞后被唤醒
+     */
+    void record_pickup(bool spun, uint64_t latency_ns) {
+        if (spun) {
+            spin_pickups_.fetch_add(1, std::memory_order_relaxed);
+            spin_pickup_ns_.fetch_add(latency_ns, std::memory_order_relaxed);
+        } else {
+            park_pickups_.fetch_add(1, std::memory_order_relaxed);
+            park_pickup_ns_.fetch_add(latency_ns, std::memory_order_relaxed);
+        }
+    }
+
+    SpinStatistics get_statistics() const {
+        SpinStatistics stats;
+        stats.spins = spins_.load(std::memory_order_relaxed);
+        stats.spin_hits = spin_hits_.load(std::memory_order_relaxed);
+        stats.parks = parks_.load(std::memory_order_relaxed);
+        stats.spin_ns = spin_ns_.load(std::memory_order_relaxed);
+        stats.spin_pickups = spin_pickups_.load(std::memory_order_relaxed);
+        stats.spin_pickup_ns = spin_pickup_ns_.load(std::memory_order_relaxed);
+        stats.park_pickups = park_pickups_.load(std::memory_order_relaxed);
+        stats.park_pickup_ns = park_pickup_ns_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    std::atomic<uint64_t> spins_;
+    std::atomic<uint64_t> spin_hits_;
+    std::atomic<uint64_t> parks_;
+    std::atomic<uint64_t> spin_ns_;
+    std::atomic<uint64_t> spin_pickups_;
+    std::atomic<uint64_t> spin_pickup_ns_;
+    std::atomic<uint64_t> park_pickups_;
+    std::atomic<uint64_t> park_pickup_ns_;
+};
+
+#endif // BUSY_POLL_H
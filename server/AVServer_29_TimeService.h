@@ -0,0 +1,325 @@
+/*
+ * TimeService.h - 热路径上的低开销时间服务
+ *
+ * 提供三种时钟：
+ * - 粗粒度时钟（coarse）：缓存的steady_clock值，由时钟线程每毫秒和事件循环每轮更新，
+ *   读取只是一次原子load。用于活动时间、超时判断、消息时间戳等毫秒级用途
+ * - 细粒度时钟（fine）：x86上用校准过的TSC（rdtsc，约几纳秒），
+ *   其他平台或TSC不可靠时退回steady_clock。用于阶段处理耗时、排队延迟等纳秒级统计
+ * - 墙钟映射（wall）：启动时记录一次steady_clock与system_clock的差值，
+ *   之后墙钟时间 = 单调时间 + 差值，不随NTP调整跳变。只在需要绝对时间的边界使用
+ *   （如发给客户端的消息时间戳）
+ *
+ * 为什么需要：
+ * 每条消息、每次收发都调用now()，在高吞吐时占比可观；system_clock还可能被NTP
+ * 向回调整，导致延迟计算出现负值。把时钟读取集中到这里，内循环只读缓存值。
+ *
+ * 使用示例：
+ * @code
+ *   TimeService& time = TimeService::instance();
+ *   time.start_ticker();                        // 服务器启动时
+ *
+ *   auto now = time.coarse_now();               // 替代steady_clock::now()
+ *   uint64_t t0 = time.fine_ticks();
+ *   process();
+ *   uint64_t ns = time.ticks_to_ns(time.fine_ticks() - t0);
+ *   int64_t wall_ms = time.wall_now_ms();       // 替代system_clock
+ *
+ *   time.stop_ticker();                         // 服务器停止时
+ * @endcode
+ *
+ * @note 时钟线程没有运行时，粗粒度时钟直接读取steady_clock，结果正确只是不省开销
+ */
+
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #include <cpuid.h>
+    #define AVSERVER_HAS_TSC 1
+#else
+    #define AVSERVER_HAS_TSC 0
+#endif
+
+/**
+ * @class TimeService
+ * @brief 进程级的时间服务（单例）
+ */
+class TimeService {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int TICK_INTERVAL_MS = 1;          // 时钟线程的更新周期
+    static constexpr int CALIBRATION_MS = 10;           // TSC校准时长
+
+    static TimeService& instance() {
+        static TimeService service;
+        return service;
+    }
+
+    TimeService(const TimeService&) = delete;
+    TimeService& operator=(const TimeService&) = delete;
+
+    ~TimeService() {
+        {
+            std::lock_guard<std::mutex> lock(ticker_mutex_);
+            ticker_refs_ = 0;
+        }
+        ticker_cond_.notify_all();
+        if (ticker_.joinable()) {
+            ticker_.join();
+        }
+    }
+
+    // ========================================================================
+    // ======================== 粗粒度时钟 =====================================
+    // ========================================================================
+
+    /**
+     * @brief 缓存的当前时间（精度约TICK_INTERVAL_MS）
+     */
+    Clock::time_point coarse_now() const {
+        if (ticker_running_.load(std::memory_order_relaxed)) {
+            return Clock::time_point(Clock::duration(coarse_ns_.load(std::memory_order_relaxed)));
+        }
+        return Clock::now();
+    }
+
+    /**
+     * @brief 缓存的单调时间（毫秒）
+     */
+    int64_t coarse_now_ms() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            coarse_now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief 刷新缓存的时间
+     *
+     * @note 时钟线程周期调用；事件循环每轮调用一次，繁忙时精度更高
+     */
+    void tick() {
+        int64_t now = std::chrono::duration_cast<Clock::duration>(
+            Clock::now().time_since_epoch()).count();
+
+        // 多个线程同时tick时只向前推进
+        int64_t prev = coarse_ns_.load(std::memory_order_relaxed);
+        while (now > prev &&
+               !coarse_ns_.compare_exchange_weak(prev, now, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief 启动时钟线程（引用计数，可以多次调用）
+     */
+    void start_ticker() {
+        std::lock_guard<std::mutex> lock(ticker_mutex_);
+        if (ticker_refs_++ > 0) {
+            return;
+        }
+        if (ticker_.joinable()) {
+            ticker_.join();
+        }
+        tick();
+        ticker_running_.store(true, std::memory_order_release);
+        ticker_ = std::thread(&TimeService::ticker_loop, this);
+    }
+
+    /**
+     * @brief 停止时钟线程（与start_ticker配对，最后一次调用时真正停止）
+     */
+    void stop_ticker() {
+        std::thread finished;
+        {
+            std::lock_guard<std::mutex> lock(ticker_mutex_);
+            if (ticker_refs_ == 0 || --ticker_refs_ > 0) {
+                return;
+            }
+            ticker_running_.store(false, std::memory_order_release);
+            finished = std::move(ticker_);
+        }
+        ticker_cond_.notify_all();
+        if (finished.joinable()) {
+            finished.join();
+        }
+    }
+
+    bool ticker_running() const {
+        return ticker_running_.load(std::memory_order_relaxed);
+    }
+
+    // ========================================================================
+    // ======================== 细粒度时钟 =====================================
+    // ========================================================================
+
+    /**
+     * @brief 细粒度时间戳（单位不定，只能用ticks_to_ns换算差值）
+     */
+    uint64_t fine_ticks() const {
+#if AVSERVER_HAS_TSC
+        if (use_tsc_) {
+            return __rdtsc();
+        }
+#endif
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count());
+    }
+
+    /**
+     * @brief 把两个fine_ticks()的差值换算为纳秒
+     */
+    uint64_t ticks_to_ns(uint64_t ticks) const {
+        return use_tsc_ ? static_cast<uint64_t>(ticks * ns_per_tick_) : ticks;
+    }
+
+    /**
+     * @brief 从start到现在经过的纳秒数
+     */
+    uint64_t fine_elapsed_ns(uint64_t start_ticks) const {
+        uint64_t now = fine_ticks();
+        return now > start_ticks ? ticks_to_ns(now - start_ticks) : 0;
+    }
+
+    /**
+     * @brief 细粒度的单调时间（纳秒，起点不定）
+     *
+     * @note 不同线程、不同核心读到的值可以直接相减（不变TSC各核同步）
+     */
+    uint64_t fine_now_ns() const {
+        return ticks_to_ns(fine_ticks());
+    }
+
+    bool fine_uses_tsc() const {
+        return use_tsc_;
+    }
+
+    /**
+     * @brief TSC频率（GHz）；不使用TSC时为0
+     */
+    double tsc_ghz() const {
+        return use_tsc_ ? 1.0 / ns_per_tick_ : 0.0;
+    }
+
+    // ========================================================================
+    // ======================== 墙钟映射 =======================================
+    // ========================================================================
+
+    /**
+     * @brief 把单调时间换算为Unix毫秒时间戳
+     *
+     * @note 差值只在启动和resync_wall_clock()时更新，两次调用之间结果单调
+     */
+    int64_t to_wall_ms(Clock::time_point t) const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count() +
+               wall_offset_ms_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 当前的Unix毫秒时间戳（基于粗粒度时钟）
+     */
+    int64_t wall_now_ms() const {
+        return to_wall_ms(coarse_now());
+    }
+
+    /**
+     * @brief 重新测量单调时钟与墙钟的差值
+     *
+     * @note 墙钟被大幅调整后由运维操作触发；差值变小时时间戳会向回跳
+     */
+    void resync_wall_clock() {
+        auto steady = Clock::now();
+        auto wall = std::chrono::system_clock::now();
+        int64_t offset = std::chrono::duration_cast<std::chrono::milliseconds>(
+            wall.time_since_epoch()).count() -
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+            steady.time_since_epoch()).count();
+        wall_offset_ms_.store(offset, std::memory_order_relaxed);
+    }
+
+    std::string to_string() const {
+        char buffer[160];
+        std::snprintf(buffer, sizeof(buffer),
+                      "Time Service: coarse=%s fine=%s (%.3f GHz) wall_offset=%lldms",
+                      ticker_running() ? "ticker" : "direct",
+                      use_tsc_ ? "tsc" : "steady_clock", tsc_ghz(),
+                      static_cast<long long>(wall_offset_ms_.load()));
+        return std::string(buffer);
+    }
+
+private:
+    TimeService()
+        : coarse_ns_(0),
+          wall_offset_ms_(0),
+          ticker_running_(false),
+          ticker_refs_(0),
+          use_tsc_(false),
+          ns_per_tick_(1.0) {
+        tick();
+        resync_wall_clock();
+        calibrate_tsc();
+    }
+
+    /**
+     * @brief 检测不变TSC并校准频率
+     *
+     * 不变TSC（CPUID 0x80000007 EDX bit 8）的频率不随变频和节能状态变化，
+     * 各核之间同步。没有这个特性时不使用TSC。
+     */
+    void calibrate_tsc() {
+#if AVSERVER_HAS_TSC
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+            return;
+        }
+
+        auto steady_start = Clock::now();
+        uint64_t tsc_start = __rdtsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(CALIBRATION_MS));
+        auto steady_end = Clock::now();
+        uint64_t tsc_end = __rdtsc();
+
+        double elapsed_ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(steady_end - steady_start).count());
+        if (tsc_end > tsc_start && elapsed_ns > 0) {
+            ns_per_tick_ = elapsed_ns / static_cast<double>(tsc_end - tsc_start);
+            use_tsc_ = true;
+        }
+#endif
+    }
+
+    void ticker_loop() {
+        std::unique_lock<std::mutex> lock(ticker_mutex_);
+        while (ticker_refs_ > 0) {
+            lock.unlock();
+            tick();
+            lock.lock();
+            ticker_cond_.wait_for(lock, std::chrono::milliseconds(TICK_INTERVAL_MS),
+                                  [this] { return ticker_refs_ == 0; });
+        }
+    }
+
+private:
+    std::atomic<int64_t> coarse_ns_;            // 缓存的steady_clock时间（Clock::duration计数）
+    std::atomic<int64_t> wall_offset_ms_;       // 墙钟 - 单调时钟（毫秒）
+
+    std::atomic<bool> ticker_running_;          // 时钟线程是否在更新缓存
+    std::mutex ticker_mutex_;                   // 保护ticker_refs_和ticker_
+    std::condition_variable ticker_cond_;
+    int ticker_refs_;
+    std::thread ticker_;
+
+    bool use_tsc_;                              // 细粒度时钟是否使用TSC（构造后不变）
+    double ns_per_tick_;                        // 每个TSC周期的纳秒数
+};
+
+#endif // TIME_SERVICE_H
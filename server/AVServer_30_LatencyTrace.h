@@ -0,0 +1,544 @@
+/*
+ * LatencyTrace.h - 帧级的分阶段延迟追踪
+ *
+ * 每一帧在流经服务器时，在以下时刻打上单调纳秒时间戳：
+ * - CAPTURE          采集完成（转发的simulcast帧为服务器收到的时刻）
+ * - ENCODE_DEQUEUE   编码通道从采集队列取出
+ * - ENCODE_DONE      编码完成
+ * - FANOUT_ENQUEUE   打包为消息并放入分发队列
+ * - FIRST_BYTE_SENT  某个连接写出该消息的第一个字节
+ * - LAST_BYTE_SENT   某个连接写完该消息的最后一个字节
+ *
+ * 时间戳随AVFrame::stamps和MessageMeta::stamps一路传递（不参与序列化）。
+ * 连接写完消息时把相邻阶段的差值记入该流的直方图（LatencyTracer），
+ * 由fullstats命令输出各段的p50/p99/p999/max。
+ *
+ * 使用示例：
+ * @code
+ *   frame->stamps.begin(FrameTimestamps::LOCAL_VIDEO_STREAM);   // 采集时
+ *   frame->stamps.stamp(FrameStage::ENCODE_DEQUEUE);            // 各阶段
+ *   ...
+ *   LatencyTracer::instance().record(stamps);                   // 发送完成时
+ *   std::cout << LatencyTracer::instance().get_statistics().to_string();
+ * @endcode
+ *
+ * @note 只有相邻的两个阶段都打了时间戳才记录该段，缺失的阶段不会把耗时算到别的段
+ * @note 一条共享消息扇出给N个连接时，发送相关的段和端到端延迟各记录N次
+ */
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+#include "AVServer_29_TimeService.h"
+
+// ============================================================================
+// ======================== 帧时间戳 ==========================================
+// ============================================================================
+
+/**
+ * @enum FrameStage
+ * @brief 帧处理路径上打时间戳的位置（按先后顺序）
+ */
+enum class FrameStage : uint8_t {
+    CAPTURE = 0,
+    ENCODE_DEQUEUE,
+    ENCODE_DONE,
+    FANOUT_ENQUEUE,
+    FIRST_BYTE_SENT,
+    LAST_BYTE_SENT,
+};
+
+static constexpr int FRAME_STAGE_COUNT = 6;
+
+/**
+ * @struct FrameTimestamps
+ * @brief 一帧在各阶段的单调时间戳（TimeService::fine_now_ns，0表示未经过该阶段）
+ */
+struct FrameTimestamps {
+    static constexpr uint32_t NO_STREAM = 0xFFFFFFFFu;          // 未参与追踪
+    static constexpr uint32_t LOCAL_VIDEO_STREAM = 0xFFFFFFF0u; // 本地采集的视频
+    static constexpr uint32_t LOCAL_AUDIO_STREAM = 0xFFFFFFF1u; // 本地采集的音频
+    static constexpr uint32_t OTHER_STREAM = 0xFFFFFFF2u;       // 超出流上限后合并的流
+
+    uint32_t stream;                                    // 所属流（simulcast流ID或LOCAL_*）
+    std::array<uint64_t, FRAME_STAGE_COUNT> ns;         // 各阶段时间戳
+
+    FrameTimestamps()
+        : stream(NO_STREAM) {
+        ns.fill(0);
+    }
+
+    /**
+     * @brief 开始追踪：清空旧时间戳并打上CAPTURE
+     *
+     * @param stream_id 所属流
+     */
+    void begin(uint32_t stream_id) {
+        ns.fill(0);
+        stream = stream_id;
+        stamp(FrameStage::CAPTURE);
+    }
+
+    /**
+     * @brief 在指定阶段打上当前时间
+     *
+     * @note 未调用begin()的帧不打时间戳
+     */
+    void stamp(FrameStage stage) {
+        if (stream != NO_STREAM) {
+            ns[static_cast<int>(stage)] = TimeService::instance().fine_now_ns();
+        }
+    }
+
+    bool traced() const {
+        return stream != NO_STREAM;
+    }
+
+    uint64_t at(FrameStage stage) const {
+        return ns[static_cast<int>(stage)];
+    }
+
+    void reset() {
+        stream = NO_STREAM;
+        ns.fill(0);
+    }
+};
+
+// ============================================================================
+// ======================== 直方图 ============================================
+// ============================================================================
+
+/**
+ * @struct StageHistogramSnapshot
+ * @brief StageHistogram某一时刻的副本（用于计算百分位）
+ */
+struct StageHistogramSnapshot {
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+
+    StageHistogramSnapshot()
+        : count(0),
+          sum_ns(0),
+          max_ns(0) {
+    }
+
+    double mean_us() const {
+        return count > 0 ? sum_ns / 1000.0 / count : 0.0;
+    }
+
+    /**
+     * @brief 第p百分位的延迟（微秒）
+     *
+     * @param p 百分位（0-100）
+     * @return 所在桶的上界，相对误差不超过1/16
+     */
+    double percentile_us(double p) const;
+};
+
+/**
+ * @class StageHistogram
+ * @brief 无锁的对数-线性直方图（HDR风格）
+ *
+ * 每个2的幂区间再等分为16个子桶，任何值的相对误差不超过1/16；
+ * 覆盖0到2^40纳秒（约18分钟），更大的值记入最后一个桶。
+ * record()只有几次relaxed原子操作，可以在发送路径上调用。
+ */
+class StageHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_MAGNITUDE = 40;
+    static constexpr int BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    StageHistogram()
+        : sum_ns_(0),
+          max_ns_(0) {
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t ns) {
+        buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t prev = max_ns_.load(std::memory_order_relaxed);
+        while (ns > prev &&
+               !max_ns_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    StageHistogramSnapshot snapshot() const {
+        StageHistogramSnapshot snap;
+        snap.buckets.resize(BUCKET_COUNT);
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            snap.count += snap.buckets[i];
+        }
+        snap.sum_ns = sum_ns_.load(std::memory_order_relaxed);
+        snap.max_ns = max_ns_.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    /**
+     * @brief 值所在的桶
+     *
+     * 小于16的值每个值一个桶；否则按最高位确定区间，再取其后4位确定子桶。
+     */
+    static int bucket_index(uint64_t ns) {
+        if (ns < static_cast<uint64_t>(SUB_BUCKETS)) {
+            return static_cast<int>(ns);
+        }
+        int magnitude = 63 - __builtin_clzll(ns);
+        if (magnitude > MAX_MAGNITUDE) {
+            return BUCKET_COUNT - 1;
+        }
+        int shift = magnitude - SUB_BUCKET_BITS;
+        int sub = static_cast<int>((ns >> shift) & (SUB_BUCKETS - 1));
+        return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    /**
+     * @brief 桶内最大的值（纳秒）
+     */
+    static uint64_t bucket_upper_ns(int index) {
+        if (index < SUB_BUCKETS) {
+            return static_cast<uint64_t>(index);
+        }
+        int magnitude = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        int shift = magnitude - SUB_BUCKET_BITS;
+        uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_;
+    std::atomic<uint64_t> sum_ns_;
+    std::atomic<uint64_t> max_ns_;
+};
+
+inline double StageHistogramSnapshot::percentile_us(double p) const {
+    if (count == 0) {
+        return 0.0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * count);
+    if (rank >= count) {
+        rank = count - 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+            uint64_t upper = StageHistogram::bucket_upper_ns(static_cast<int>(i));
+            return (upper < max_ns ? upper : max_ns) / 1000.0;
+        }
+    }
+    return max_ns / 1000.0;
+}
+
+// ============================================================================
+// ======================== 追踪器 ============================================
+// ============================================================================
+
+/**
+ * @enum LatencySegment
+ * @brief 直方图记录的延迟段
+ */
+enum LatencySegment {
+    SEGMENT_CAPTURE_QUEUE = 0,  // CAPTURE -> ENCODE_DEQUEUE
+    SEGMENT_ENCODE,             // ENCODE_DEQUEUE -> ENCODE_DONE
+    SEGMENT_PACKETIZE,          // ENCODE_DONE -> FANOUT_ENQUEUE
+    SEGMENT_SEND_QUEUE,         // FANOUT_ENQUEUE -> FIRST_BYTE_SENT
+    SEGMENT_SOCKET_WRITE,       // FIRST_BYTE_SENT -> LAST_BYTE_SENT
+    SEGMENT_END_TO_END,         // CAPTURE -> LAST_BYTE_SENT
+    LATENCY_SEGMENT_COUNT
+};
+
+/**
+ * @brief 延迟段的名称
+ */
+inline const char* latency_segment_name(int segment) {
+    switch (segment) {
+        case SEGMENT_CAPTURE_QUEUE: return "capture_queue";
+        case SEGMENT_ENCODE: return "encode";
+        case SEGMENT_PACKETIZE: return "packetize";
+        case SEGMENT_SEND_QUEUE: return "send_queue";
+        case SEGMENT_SOCKET_WRITE: return "socket_write";
+        case SEGMENT_END_TO_END: return "end_to_end";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief 流的显示名称
+ */
+inline std::string latency_stream_name(uint32_t stream) {
+    if (stream == FrameTimestamps::LOCAL_VIDEO_STREAM) {
+        return "local-video";
+    }
+    if (stream == FrameTimestamps::LOCAL_AUDIO_STREAM) {
+        return "local-audio";
+    }
+    if (stream == FrameTimestamps::OTHER_STREAM) {
+        return "other";
+    }
+    return "simulcast-" + std::to_string(stream);
+}
+
+/**
+ * @struct LatencyTraceStatistics
+ * @brief 所有流的分段延迟
+ */
+struct LatencyTraceStatistics {
+    struct StreamEntry {
+        uint32_t stream;
+        std::string name;
+        std::array<StageHistogramSnapshot, LATENCY_SEGMENT_COUNT> segments;
+    };
+
+    std::vector<StreamEntry> streams;
+    uint64_t frames_recorded;
+
+    LatencyTraceStatistics()
+        : frames_recorded(0) {
+    }
+
+    std::string to_string() const {
+        std::string result = "Frame Latency (us, " + std::to_string(frames_recorded) +
+                             " deliveries):";
+        if (streams.empty()) {
+            return result + " no traced frames";
+        }
+
+        char buffer[192];
+        for (const auto& entry : streams) {
+            result += "\n  [" + entry.name + "]";
+            for (int s = 0; s < LATENCY_SEGMENT_COUNT; ++s) {
+                const StageHistogramSnapshot& h = entry.segments[s];
+                if (h.count == 0) {
+                    continue;
+                }
+                std::snprintf(buffer, sizeof(buffer),
+                              "\n    %-14s n=%-8llu mean=%-9.1f p50=%-9.1f p99=%-9.1f p999=%-9.1f max=%.1f",
+                              latency_segment_name(s),
+                              static_cast<unsigned long long>(h.count), h.mean_us(),
+                              h.percentile_us(50.0), h.percentile_us(99.0),
+                              h.percentile_us(99.9), h.max_ns / 1000.0);
+                result += buffer;
+            }
+        }
+        return result;
+    }
+};
+
+/**
+ * @class LatencyTracer
+ * @brief 按流聚合帧时间戳的分段延迟（单例）
+ *
+ * @note 流ID来自客户端，分开追踪的流最多stream_limit个，其余合并到OTHER_STREAM
+ * @note 已登记的流通过无锁开放寻址表查找，只有首次出现的流才持锁创建
+ */
+class LatencyTracer {
+public:
+    static LatencyTracer& instance() {
+        static LatencyTracer tracer;
+        return tracer;
+    }
+
+    LatencyTracer(const LatencyTracer&) = delete;
+    LatencyTracer& operator=(const LatencyTracer&) = delete;
+
+    /**
+     * @brief 启用或停用记录（停用后record()直接返回，时间戳照常传递）
+     */
+    void set_enabled(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool is_enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 设置分开追踪的流数上限（LOCAL_*不计入，超出的流合并为"other"）
+     *
+     * @note 上限被限制在MAX_STREAM_LIMIT以内，保证查找表的装载率不超过一半
+     */
+    void set_stream_limit(size_t limit) {
+        stream_limit_.store(std::min(limit, MAX_STREAM_LIMIT), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 把一帧的时间戳记入所属流的直方图
+     *
+     * @param stamps 发送完成时的时间戳（LAST_BYTE_SENT应已打上）
+     */
+    void record(const FrameTimestamps& stamps) {
+        if (!stamps.traced() || !is_enabled()) {
+            return;
+        }
+
+        StreamHistograms* histograms = find(stamps.stream);
+        if (histograms == nullptr) {
+            histograms = find_or_create(stamps.stream);
+        }
+
+        for (int stage = 1; stage < FRAME_STAGE_COUNT; ++stage) {
+            uint64_t from = stamps.ns[stage - 1];
+            uint64_t to = stamps.ns[stage];
+            if (from != 0 && to >= from) {
+                histograms->segments[stage - 1].record(to - from);
+            }
+        }
+
+        uint64_t start = stamps.at(FrameStage::CAPTURE);
+        uint64_t end = stamps.at(FrameStage::LAST_BYTE_SENT);
+        if (start != 0 && end >= start) {
+            histograms->segments[SEGMENT_END_TO_END].record(end - start);
+        }
+
+        frames_recorded_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    LatencyTraceStatistics get_statistics() const {
+        LatencyTraceStatistics stats;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [stream, histograms] : streams_) {
+            LatencyTraceStatistics::StreamEntry entry;
+            entry.stream = stream;
+            entry.name = latency_stream_name(stream);
+            for (int s = 0; s < LATENCY_SEGMENT_COUNT; ++s) {
+                entry.segments[s] = histograms->segments[s].snapshot();
+            }
+            stats.streams.push_back(std::move(entry));
+        }
+        stats.frames_recorded = frames_recorded_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct StreamHistograms {
+        std::array<StageHistogram, LATENCY_SEGMENT_COUNT> segments;
+    };
+
+    static constexpr size_t TABLE_SIZE = 1024;                  // 查找表槽数（2的幂）
+    static constexpr size_t MAX_STREAM_LIMIT = TABLE_SIZE / 2 - 8;  // 留出LOCAL_*和OTHER的槽位
+
+    /**
+     * @struct Slot
+     * @brief 查找表槽位：key为流ID+1（0表示空），先发布histograms再发布key
+     */
+    struct Slot {
+        std::atomic<uint64_t> key{0};
+        std::atomic<StreamHistograms*> histograms{nullptr};
+    };
+
+    LatencyTracer()
+        : enabled_(true),
+          frames_recorded_(0),
+          stream_limit_(64),
+          tracked_streams_(0),
+          table_(new Slot[TABLE_SIZE]) {
+    }
+
+    static size_t slot_index(uint32_t stream) {
+        return (stream * 2654435761u) & (TABLE_SIZE - 1);
+    }
+
+    static bool is_reserved(uint32_t stream) {
+        return stream >= FrameTimestamps::LOCAL_VIDEO_STREAM;
+    }
+
+    /**
+     * @brief 无锁查找已登记的流（超出上限的流命中OTHER的缓存）
+     *
+     * @return 未登记时返回nullptr
+     */
+    StreamHistograms* find(uint32_t stream) const {
+        const uint64_t key = static_cast<uint64_t>(stream) + 1;
+        for (size_t i = slot_index(stream), probes = 0; probes < TABLE_SIZE;
+             i = (i + 1) & (TABLE_SIZE - 1), ++probes) {
+            uint64_t current = table_[i].key.load(std::memory_order_acquire);
+            if (current == key) {
+                return table_[i].histograms.load(std::memory_order_relaxed);
+            }
+            if (current == 0) {
+                break;
+            }
+        }
+        if (!is_reserved(stream)) {
+            // 达到上限后所有新流都落到OTHER，此后不再进入慢路径
+            return other_.load(std::memory_order_acquire);
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief 持锁登记新流；超出上限时返回OTHER
+     */
+    StreamHistograms* find_or_create(uint32_t stream) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = streams_.find(stream);
+        if (it != streams_.end()) {
+            return it->second.get();
+        }
+
+        if (!is_reserved(stream) &&
+            tracked_streams_ >= stream_limit_.load(std::memory_order_relaxed)) {
+            StreamHistograms* other = create_locked(FrameTimestamps::OTHER_STREAM);
+            other_.store(other, std::memory_order_release);
+            return other;
+        }
+
+        if (!is_reserved(stream)) {
+            ++tracked_streams_;
+        }
+        return create_locked(stream);
+    }
+
+    StreamHistograms* create_locked(uint32_t stream) {
+        auto& entry = streams_[stream];
+        if (entry) {
+            return entry.get();
+        }
+        entry = std::make_unique<StreamHistograms>();
+
+        const uint64_t key = static_cast<uint64_t>(stream) + 1;
+        for (size_t i = slot_index(stream);; i = (i + 1) & (TABLE_SIZE - 1)) {
+            if (table_[i].key.load(std::memory_order_relaxed) == 0) {
+                table_[i].histograms.store(entry.get(), std::memory_order_relaxed);
+                table_[i].key.store(key, std::memory_order_release);
+                break;
+            }
+        }
+        return entry.get();
+    }
+
+private:
+    std::atomic<bool> enabled_;
+    std::atomic<uint64_t> frames_recorded_;
+    std::atomic<size_t> stream_limit_;                  // 分开追踪的流数上限
+    size_t tracked_streams_;                            // 已分开追踪的非LOCAL流数（受mutex_保护）
+
+    mutable std::mutex mutex_;                                      // 保护streams_的结构和查找表的写入
+    std::map<uint32_t, std::unique_ptr<StreamHistograms>> streams_; // 流ID -> 直方图（只增不删，地址稳定）
+    std::unique_ptr<Slot[]> table_;                                 // 流ID -> 直方图的无锁查找表
+    std::atomic<StreamHistograms*> other_{nullptr};                 // OTHER_STREAM的直方图（达到上限后才创建）
+};
+
+#endif // LATENCY_TRACE_H
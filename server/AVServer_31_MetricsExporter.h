@@ -0,0 +1,423 @@
+/*
+ * MetricsExporter.h - Prometheus文本格式的指标导出
+ *
+ * 组成：
+ * - PrometheusWriter：按Prometheus文本格式（0.0.4）拼接计数器、仪表和直方图
+ * - MetricsHttpServer：极简的HTTP监听器，只响应GET /metrics
+ *
+ * 为什么这样设计：
+ * 抓取请求不应该碰媒体路径上的任何锁。指标页面由统计线程每秒渲染一次，
+ * 渲染结果作为不可变字符串发布；HTTP线程只复制一次shared_ptr就能响应，
+ * 抓取频率再高也不会和采集、编码、发送线程争抢。代价是数据最多滞后一个统计周期。
+ *
+ * 使用示例：
+ * @code
+ *   MetricsHttpServer metrics("127.0.0.1", 9100);
+ *   metrics.start();
+ *
+ *   PrometheusWriter writer;
+ *   writer.family("avserver_messages_sent_total", "counter", "Messages sent to clients");
+ *   writer.sample("avserver_messages_sent_total", sent);
+ *   metrics.publish(writer.take());             // 统计线程周期调用
+ *
+ *   // curl http://127.0.0.1:9100/metrics
+ * @endcode
+ *
+ * @note 默认只监听本机地址；指标里有客户端ID等信息，对外暴露前应确认访问控制
+ * @note 一次只处理一个抓取请求，处理完即关闭连接（不支持keep-alive）
+ */
+
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "AVServer_30_LatencyTrace.h"
+
+// ============================================================================
+// ======================== 文本格式 ==========================================
+// ============================================================================
+
+/**
+ * @class PrometheusWriter
+ * @brief 拼接Prometheus文本格式的指标页面
+ *
+ * 同一指标族的所有样本必须连续输出：先调用family()写HELP/TYPE，再逐个写样本。
+ */
+class PrometheusWriter {
+public:
+    /**
+     * @brief 直方图的桶上界（秒），覆盖50us到5s
+     */
+    static constexpr double LATENCY_BOUNDS_SECONDS[] = {
+        0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+        0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0
+    };
+
+    PrometheusWriter() {
+        text_.reserve(16 * 1024);
+    }
+
+    /**
+     * @brief 开始一个指标族
+     *
+     * @param name 指标名
+     * @param type counter / gauge / histogram
+     * @param help 说明文字
+     */
+    void family(const char* name, const char* type, const char* help) {
+        text_ += "# HELP ";
+        text_ += name;
+        text_ += ' ';
+        text_ += help;
+        text_ += "\n# TYPE ";
+        text_ += name;
+        text_ += ' ';
+        text_ += type;
+        text_ += '\n';
+    }
+
+    void sample(const char* name, uint64_t value, const std::string& labels = "") {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(value));
+        write_sample(name, "", labels, buffer);
+    }
+
+    void sample(const char* name, double value, const std::string& labels = "") {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        write_sample(name, "", labels, buffer);
+    }
+
+    /**
+     * @brief 写一个直方图样本（_bucket/_sum/_count）
+     *
+     * @param name 指标名（family()的类型应为histogram）
+     * @param snapshot 纳秒直方图
+     * @param labels 已格式化的标签（不含花括号，可以为空）
+     *
+     * @note 细粒度桶合并到LATENCY_BOUNDS_SECONDS，上界的相对误差不超过1/16
+     */
+    void histogram(const char* name, const StageHistogramSnapshot& snapshot,
+                   const std::string& labels = "") {
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        char bound_text[32];
+        char buffer[32];
+
+        size_t bucket = 0;
+        uint64_t cumulative = 0;
+        for (double bound : LATENCY_BOUNDS_SECONDS) {
+            uint64_t bound_ns = static_cast<uint64_t>(bound * 1e9);
+            while (bucket < snapshot.buckets.size() &&
+                   StageHistogram::bucket_upper_ns(static_cast<int>(bucket)) <= bound_ns) {
+                cumulative += snapshot.buckets[bucket++];
+            }
+            std::snprintf(bound_text, sizeof(bound_text), "%g", bound);
+            std::snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(cumulative));
+            write_sample(name, "_bucket", prefix + "le=\"" + bound_text + "\"", buffer);
+        }
+
+        std::snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(snapshot.count));
+        write_sample(name, "_bucket", prefix + "le=\"+Inf\"", buffer);
+        write_sample(name, "_count", labels, buffer);
+        std::snprintf(buffer, sizeof(buffer), "%.9g", snapshot.sum_ns / 1e9);
+        write_sample(name, "_sum", labels, buffer);
+    }
+
+    /**
+     * @brief 格式化一个标签（值中的反斜杠、引号和换行会被转义）
+     */
+    static std::string label(const char* key, const std::string& value) {
+        std::string result = key;
+        result += "=\"";
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                result += '\\';
+                result += c;
+            } else if (c == '\n') {
+                result += "\\n";
+            } else {
+                result += c;
+            }
+        }
+        result += '"';
+        return result;
+    }
+
+    const std::string& str() const {
+        return text_;
+    }
+
+    std::string take() {
+        return std::move(text_);
+    }
+
+private:
+    void write_sample(const char* name, const char* suffix,
+                      const std::string& labels, const char* value) {
+        text_ += name;
+        text_ += suffix;
+        if (!labels.empty()) {
+            text_ += '{';
+            text_ += labels;
+            text_ += '}';
+        }
+        text_ += ' ';
+        text_ += value;
+        text_ += '\n';
+    }
+
+private:
+    std::string text_;
+};
+
+// ============================================================================
+// ======================== HTTP监听器 ========================================
+// ============================================================================
+
+/**
+ * @class MetricsHttpServer
+ * @brief 在独立线程上响应GET /metrics
+ *
+ * @note 页面内容由publish()提供，监听线程从不调用任何模块的统计接口
+ */
+class MetricsHttpServer {
+public:
+    static constexpr int POLL_INTERVAL_MS = 200;        // 检查停止标志的周期
+    static constexpr int REQUEST_TIMEOUT_MS = 1000;     // 读取整个请求头的总时限
+    static constexpr int RESPONSE_TIMEOUT_MS = 5000;    // 写完整个响应的总时限
+    static constexpr size_t MAX_REQUEST_SIZE = 4096;    // 请求头上限
+
+    MetricsHttpServer(const std::string& bind_addr, uint16_t port)
+        : bind_addr_(bind_addr),
+          port_(port),
+          listen_fd_(-1),
+          running_(false),
+          scrapes_(0),
+          page_(std::make_shared<const std::string>("# no metrics snapshot yet\n")) {
+    }
+
+    ~MetricsHttpServer() {
+        stop();
+    }
+
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+    /**
+     * @brief 绑定端口并启动监听线程
+     *
+     * @return true 如果监听成功
+     */
+    bool start() {
+        if (running_.load()) {
+            return true;
+        }
+
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listen_fd_ < 0) {
+            std::cerr << "[Metrics] Failed to create socket" << std::endl;
+            return false;
+        }
+
+        int reuse_addr = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr));
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        if (::inet_pton(AF_INET, bind_addr_.c_str(), &addr.sin_addr) != 1) {
+            std::cerr << "[Metrics] Invalid bind address: " << bind_addr_ << std::endl;
+            close_listen_socket();
+            return false;
+        }
+
+        if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            ::listen(listen_fd_, 16) < 0) {
+            std::cerr << "[Metrics] Failed to listen on " << bind_addr_ << ":" << port_
+                      << ": " << std::strerror(errno) << std::endl;
+            close_listen_socket();
+            return false;
+        }
+
+        running_ = true;
+        thread_ = std::thread(&MetricsHttpServer::serve_loop, this);
+        std::cout << "[Metrics] Serving http://" << bind_addr_ << ":" << port_
+                  << "/metrics" << std::endl;
+        return true;
+    }
+
+    void stop() {
+        bool expected = true;
+        if (!running_.compare_exchange_strong(expected, false)) {
+            return;
+        }
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        close_listen_socket();
+    }
+
+    /**
+     * @brief 发布新的指标页面（之后的抓取返回该内容）
+     */
+    void publish(std::string page) {
+        auto next = std::make_shared<const std::string>(std::move(page));
+        std::lock_guard<std::mutex> lock(page_mutex_);
+        page_.swap(next);
+    }
+
+    uint64_t get_scrape_count() const {
+        return scrapes_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void serve_loop() {
+        while (running_.load()) {
+            struct pollfd pfd;
+            pfd.fd = listen_fd_;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (::poll(&pfd, 1, POLL_INTERVAL_MS) <= 0) {
+                continue;
+            }
+
+            int client_fd = ::accept(listen_fd_, nullptr, nullptr);
+            if (client_fd < 0) {
+                continue;
+            }
+            handle_client(client_fd);
+            ::close(client_fd);
+        }
+    }
+
+    /**
+     * @brief 读取请求行并写回响应
+     *
+     * @note 连接是逐个处理的，读和写各有一个总时限：按字节计的套接字超时
+     *       会让每隔不到一秒发一个字节的客户端占住线程，阻塞所有抓取
+     */
+    void handle_client(int fd) {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point read_deadline = Clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+            if (!wait_ready(fd, POLLIN, read_deadline)) {
+                break;
+            }
+            ssize_t n = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n <= 0) {
+                break;
+            }
+            request.append(buffer, static_cast<size_t>(n));
+        }
+
+        size_t line_end = request.find("\r\n");
+        std::string line = request.substr(0, line_end);
+        bool is_get = line.compare(0, 4, "GET ") == 0;
+        std::string path = is_get ? line.substr(4, line.find(' ', 4) - 4) : "";
+
+        if (path == "/metrics" || path.compare(0, 9, "/metrics?") == 0) {
+            std::shared_ptr<const std::string> page;
+            {
+                std::lock_guard<std::mutex> lock(page_mutex_);
+                page = page_;
+            }
+            scrapes_.fetch_add(1, std::memory_order_relaxed);
+            write_response(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", *page);
+        } else if (is_get) {
+            write_response(fd, "404 Not Found", "text/plain", "try /metrics\n");
+        } else {
+            write_response(fd, "405 Method Not Allowed", "text/plain", "only GET is supported\n");
+        }
+    }
+
+    static void write_response(int fd, const char* status, const char* content_type,
+                               const std::string& body) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RESPONSE_TIMEOUT_MS);
+        char header[256];
+        int header_len = std::snprintf(header, sizeof(header),
+                                       "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+                                       "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                                       status, content_type, body.size());
+        if (send_all(fd, header, static_cast<size_t>(header_len), deadline)) {
+            send_all(fd, body.data(), body.size(), deadline);
+        }
+    }
+
+    static bool send_all(int fd, const char* data, size_t size,
+                         std::chrono::steady_clock::time_point deadline) {
+        while (size > 0) {
+            if (!wait_ready(fd, POLLOUT, deadline)) {
+                return false;
+            }
+            ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 等待套接字可读/可写，直到deadline
+     *
+     * @return false 如果已超时或连接出错
+     */
+    static bool wait_ready(int fd, short events, std::chrono::steady_clock::time_point deadline) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            return false;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        return ::poll(&pfd, 1, static_cast<int>(remaining)) > 0;
+    }
+
+    void close_listen_socket() {
+        if (listen_fd_ >= 0) {
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+        }
+    }
+
+private:
+    std::string bind_addr_;
+    uint16_t port_;
+    int listen_fd_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> scrapes_;
+    std::thread thread_;
+
+    std::mutex page_mutex_;                         // 只保护page_指针的交换，不在持锁时渲染或发送
+    std::shared_ptr<const std::string> page_;       // 最近发布的指标页面（不可变）
+};
+
+#endif // METRICS_EXPORTER_H
@@ -0,0 +1,211 @@
+/*
+ * ShardedCounter.h - 按线程分片的计数器和顺序锁快照
+ *
+ * 组成：
+ * - ShardedCounters<N>：一组N个计数器，按线程分成多个缓存行对齐的分片。
+ *   写入只对当前线程所在分片做一次relaxed原子加，读取时把所有分片相加
+ * - SeqLock<T>：单写者、多读者的快照发布。写者不等待读者，读者在写入期间重试，
+ *   读到的总是某一次完整发布的值
+ *
+ * 为什么需要：
+ * 每条消息都要更新几个统计计数。用一把互斥锁保护时，所有收发线程在这把锁上排队，
+ * 统计本身成为最热的锁；用单个原子变量时，缓存行在核心之间来回传递。
+ * 分片后每个线程基本只写自己的缓存行，代价转移到很少发生的读取上。
+ *
+ * 使用示例：
+ * @code
+ *   enum { SENT, BYTES, COUNTER_COUNT };
+ *   ShardedCounters<COUNTER_COUNT> counters;
+ *
+ *   counters.add(SENT);                          // 热路径
+ *   counters.add(BYTES, msg.total_size());
+ *
+ *   uint64_t sent = counters.sum(SENT);          // 统计线程
+ *
+ *   SeqLock<ServerStatistics> published;
+ *   published.store(stats);                      // 统计线程每周期发布一次
+ *   ServerStatistics view = published.load();    // 任意线程读取，不加锁
+ * @endcode
+ *
+ * @note 分片按线程首次写入的顺序轮流分配，线程数超过分片数时多个线程共享分片（仍然正确）
+ * @note 各计数器分别求和，读到的一组值不是同一时刻的原子快照；需要一致视图时用SeqLock发布
+ */
+
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+static constexpr size_t COUNTER_CACHE_LINE = 64;    // 分片对齐的缓存行大小
+static constexpr size_t COUNTER_SHARDS = 16;        // 分片数
+
+/**
+ * @brief 当前线程使用的分片编号
+ *
+ * @note 所有ShardedCounters共用同一个编号，线程第一次调用时分配
+ */
+inline size_t counter_shard_index() {
+    static std::atomic<size_t> next_shard(0);
+    thread_local const size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % COUNTER_SHARDS;
+    return shard;
+}
+
+// ============================================================================
+// ======================== 分片计数器 ========================================
+// ============================================================================
+
+/**
+ * @class ShardedCounters
+ * @brief N个按线程分片的单调计数器
+ *
+ * @tparam N 计数器个数（通常用调用方定义的枚举值作为下标）
+ */
+template<size_t N>
+class ShardedCounters {
+public:
+    ShardedCounters() {
+        for (auto& shard : shards_) {
+            for (auto& value : shard.values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    ShardedCounters(const ShardedCounters&) = delete;
+    ShardedCounters& operator=(const ShardedCounters&) = delete;
+
+    /**
+     * @brief 计数器index加n
+     */
+    void add(size_t index, uint64_t n = 1) {
+        shards_[counter_shard_index()].values[index].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 计数器index在所有分片上的总和
+     */
+    uint64_t sum(size_t index) const {
+        uint64_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard.values[index].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /**
+     * @brief 所有计数器的总和（一次遍历分片）
+     */
+    std::array<uint64_t, N> sum_all() const {
+        std::array<uint64_t, N> totals;
+        totals.fill(0);
+        for (const auto& shard : shards_) {
+            for (size_t i = 0; i < N; ++i) {
+                totals[i] += shard.values[i].load(std::memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+
+private:
+    struct alignas(COUNTER_CACHE_LINE) Shard {
+        std::array<std::atomic<uint64_t>, N> values;
+    };
+
+    std::array<Shard, COUNTER_SHARDS> shards_;
+};
+
+// ============================================================================
+// ======================== 顺序锁 ============================================
+// ============================================================================
+
+/**
+ * @class SeqLock
+ * @brief 单写者发布、多读者无锁读取的快照
+ *
+ * 写者先把序号加为奇数，写入数据，再加为偶数；读者读到相同的偶数序号前后
+ * 两次才接受数据，否则重试。数据按8字节字存放在原子变量中，读写之间没有数据竞争。
+ *
+ * @tparam T 可平凡复制的类型
+ *
+ * @note 同一时刻只能有一个写者（通常是统计线程）
+ */
+template<typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+public:
+    SeqLock()
+        : seq_(0) {
+        for (auto& word : words_) {
+            word.store(0, std::memory_order_relaxed);
+        }
+        store(T());
+    }
+
+    explicit SeqLock(const T& initial)
+        : seq_(0) {
+        store(initial);
+    }
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    /**
+     * @brief 发布新值（只能由一个线程调用）
+     */
+    void store(const T& value) {
+        std::array<uint64_t, WORDS> buffer = {};
+        std::memcpy(buffer.data(), &value, sizeof(T));
+
+        uint64_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) {
+            words_[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief 读取最近一次完整发布的值
+     */
+    T load() const {
+        std::array<uint64_t, WORDS> buffer;
+        uint64_t before;
+        uint64_t after;
+        do {
+            before = seq_.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; ++i) {
+                buffer[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq_.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+
+        // T可平凡复制（见static_assert），按字节覆盖是合法的；
+        // 经void*转换避免对有构造函数的统计结构报-Wclass-memaccess
+        T value;
+        std::memcpy(static_cast<void*>(&value), buffer.data(), sizeof(T));
+        return value;
+    }
+
+    /**
+     * @brief 已发布的次数
+     */
+    uint64_t version() const {
+        return seq_.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> seq_;                         // 偶数：稳定；奇数：正在写入
+    std::array<std::atomic<uint64_t>, WORDS> words_;    // 按字存放的数据
+};
+
+#endif // SHARDED_COUNTER_H
@@ -0,0 +1,709 @@
+/*
+ * AsyncLogger.h - 异步结构化日志
+ *
+ * 工作方式：
+ * - 每个线程第一次写日志时分配一个单生产者/单消费者的无锁环形缓冲
+ * - 写日志只把级别、模块、格式串指针和二进制编码的参数拷进环形缓冲，不格式化、不加锁、不做I/O
+ * - 后台写线程依次清空所有环形缓冲，格式化后批量写到stdout（WARN及以上写到stderr）；
+ *   全部为空时在条件变量上休眠，只有缓冲从空变为非空（写线程在休眠）时写日志的线程才唤醒它
+ * - 环形缓冲满时丢弃新日志并计数，由写线程报告丢弃条数，写日志的线程从不阻塞
+ * - 每个日志调用点独立限速（默认每秒50条），被抑制的条数附在下一条输出后
+ * - 低于AVSERVER_LOG_MIN_LEVEL的调用在编译期消除；运行时还可以用set_level()提高门槛
+ *
+ * 为什么需要：
+ * std::cout << ... << std::endl 要拿iostream锁并刷新终端，连接风暴时accept和
+ * 连接清理线程会被终端I/O拖慢。异步日志把这部分代价移到后台线程。
+ *
+ * 使用示例：
+ * @code
+ *   AV_LOG_INFO("TcpServer", "Connection #{} from {} closed", id, addr);
+ *   AV_LOG_WARN("Connection", "Receive buffer overflow on connection #{}", id);
+ *
+ *   AsyncLogger::instance().flush();     // 退出前等待日志写完
+ * @endcode
+ *
+ * @note 格式串和模块名必须是字符串字面量（只保存指针）；占位符是{}
+ * @note 支持的参数类型：整数、枚举、bool、浮点、const char*、std::string
+ * @note 过长的字符串参数会被截断；同一线程内的日志保持顺序，线程之间按写线程的轮询顺序输出
+ */
+
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <type_traits>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+
+#include "AVServer_29_TimeService.h"
+
+// ============================================================================
+// ======================== 日志级别 ==========================================
+// ============================================================================
+
+/**
+ * @enum LogLevel
+ * @brief 日志级别
+ */
+enum class LogLevel : uint8_t {
+    TRACE = 0,
+    DEBUG = 1,
+    INFO = 2,
+    WARN = 3,
+    ERROR = 4,
+    OFF = 5,
+};
+
+// 编译期最低级别：低于它的AV_LOG_*调用不生成任何代码（默认保留DEBUG及以上）
+#ifndef AVSERVER_LOG_MIN_LEVEL
+    #define AVSERVER_LOG_MIN_LEVEL 1
+#endif
+
+inline const char* log_level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::TRACE: return "TRACE";
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO: return "INFO ";
+        case LogLevel::WARN: return "WARN ";
+        case LogLevel::ERROR: return "ERROR";
+        default: return "?    ";
+    }
+}
+
+/**
+ * @brief 解析级别名（trace/debug/info/warn/error/off）
+ *
+ * @return false 如果名称无法识别
+ */
+inline bool parse_log_level(const std::string& name, LogLevel& level) {
+    static const char* const names[] = {"trace", "debug", "info", "warn", "error", "off"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (name == names[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// ======================== 日志记录 ==========================================
+// ============================================================================
+
+/**
+ * @struct LogRecord
+ * @brief 环形缓冲中的一条日志（固定大小，参数按类型标记 + 值依次编码）
+ */
+struct LogRecord {
+    static constexpr size_t DATA_SIZE = 200;        // 参数编码区大小
+    static constexpr size_t MAX_STRING = 120;       // 单个字符串参数的最大长度
+
+    enum ArgType : uint8_t {
+        ARG_INT = 0,
+        ARG_UINT,
+        ARG_DOUBLE,
+        ARG_BOOL,
+        ARG_STRING,
+    };
+
+    int64_t wall_ms;            // 写日志时的墙钟时间
+    const char* module;         // 模块名（字面量）
+    const char* format;         // 格式串（字面量）
+    uint32_t suppressed;        // 该调用点在此之前被限速抑制的条数
+    uint16_t thread;            // 写日志线程的编号
+    uint16_t used;              // data中已使用的字节数
+    LogLevel level;
+    uint8_t truncated;          // 参数是否因空间不足被丢弃
+    uint8_t data[DATA_SIZE];
+
+    void put_bytes(ArgType type, const void* bytes, size_t size) {
+        if (used + 1 + size > DATA_SIZE) {
+            truncated = 1;
+            return;
+        }
+        data[used++] = type;
+        std::memcpy(data + used, bytes, size);
+        used += static_cast<uint16_t>(size);
+    }
+
+    void put_string(const char* str, size_t length) {
+        length = length < MAX_STRING ? length : MAX_STRING;
+        if (used + 2 + length > DATA_SIZE) {
+            truncated = 1;
+            return;
+        }
+        data[used++] = ARG_STRING;
+        data[used++] = static_cast<uint8_t>(length);
+        std::memcpy(data + used, str, length);
+        used += static_cast<uint16_t>(length);
+    }
+};
+
+/**
+ * @brief 按类型编码一个参数
+ */
+template<typename T>
+inline void encode_log_arg(LogRecord& record, const T& value) {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same<U, bool>::value) {
+        uint8_t b = value ? 1 : 0;
+        record.put_bytes(LogRecord::ARG_BOOL, &b, sizeof(b));
+    } else if constexpr (std::is_enum<U>::value) {
+        int64_t v = static_cast<int64_t>(value);
+        record.put_bytes(LogRecord::ARG_INT, &v, sizeof(v));
+    } else if constexpr (std::is_integral<U>::value && std::is_signed<U>::value) {
+        int64_t v = value;
+        record.put_bytes(LogRecord::ARG_INT, &v, sizeof(v));
+    } else if constexpr (std::is_integral<U>::value) {
+        uint64_t v = value;
+        record.put_bytes(LogRecord::ARG_UINT, &v, sizeof(v));
+    } else if constexpr (std::is_floating_point<U>::value) {
+        double v = value;
+        record.put_bytes(LogRecord::ARG_DOUBLE, &v, sizeof(v));
+    } else if constexpr (std::is_same<U, std::string>::value) {
+        record.put_string(value.data(), value.size());
+    } else if constexpr (std::is_same<U, const char*>::value || std::is_same<U, char*>::value) {
+        const char* str = value ? value : "(null)";
+        record.put_string(str, std::strlen(str));
+    } else {
+        static_assert(std::is_same<U, const char*>::value, "unsupported log argument type");
+    }
+}
+
+/**
+ * @brief 把日志记录格式化为一行文本（在写线程上调用）
+ */
+inline void format_log_record(const LogRecord& record, std::string& out) {
+    // 时间戳
+    time_t seconds = static_cast<time_t>(record.wall_ms / 1000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char prefix[96];
+    std::snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.%03d %s T%02u [%s] ",
+                  local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+                  local.tm_hour, local.tm_min, local.tm_sec,
+                  static_cast<int>(record.wall_ms % 1000), log_level_name(record.level),
+                  static_cast<unsigned>(record.thread), record.module);
+    out += prefix;
+
+    // 按{}依次替换参数
+    size_t offset = 0;
+    char number[32];
+    for (const char* p = record.format; *p; ++p) {
+        if (p[0] != '{' || p[1] != '}') {
+            out += *p;
+            continue;
+        }
+        ++p;
+        if (offset >= record.used) {
+            out += "{}";
+            continue;
+        }
+
+        uint8_t type = record.data[offset++];
+        switch (type) {
+            case LogRecord::ARG_INT: {
+                int64_t v;
+                std::memcpy(&v, record.data + offset, sizeof(v));
+                offset += sizeof(v);
+                std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(v));
+                out += number;
+                break;
+            }
+            case LogRecord::ARG_UINT: {
+                uint64_t v;
+                std::memcpy(&v, record.data + offset, sizeof(v));
+                offset += sizeof(v);
+                std::snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(v));
+                out += number;
+                break;
+            }
+            case LogRecord::ARG_DOUBLE: {
+                double v;
+                std::memcpy(&v, record.data + offset, sizeof(v));
+                offset += sizeof(v);
+                std::snprintf(number, sizeof(number), "%g", v);
+                out += number;
+                break;
+            }
+            case LogRecord::ARG_BOOL:
+                out += record.data[offset++] ? "true" : "false";
+                break;
+            case LogRecord::ARG_STRING: {
+                size_t length = record.data[offset++];
+                out.append(reinterpret_cast<const char*>(record.data + offset), length);
+                offset += length;
+                break;
+            }
+            default:
+                offset = record.used;
+                break;
+        }
+    }
+
+    if (record.truncated) {
+        out += " [args truncated]";
+    }
+    if (record.suppressed > 0) {
+        std::snprintf(number, sizeof(number), " (+%u suppressed)", record.suppressed);
+        out += number;
+    }
+    out += '\n';
+}
+
+// ============================================================================
+// ======================== 线程环形缓冲 ======================================
+// ============================================================================
+
+/**
+ * @class LogRing
+ * @brief 一个线程专用的单生产者/单消费者日志缓冲
+ */
+class LogRing {
+public:
+    static constexpr size_t CAPACITY = 512;         // 必须是2的幂
+
+    explicit LogRing(uint16_t thread_index)
+        : thread_index_(thread_index),
+          head_(0),
+          tail_(0),
+          dropped_(0),
+          orphaned_(false) {
+    }
+
+    /**
+     * @brief 预留一个写入槽（生产者）
+     *
+     * @return 缓冲已满时返回nullptr
+     */
+    LogRecord* reserve() {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &slots_[head & (CAPACITY - 1)];
+    }
+
+    /**
+     * @brief 提交reserve()得到的槽（生产者）
+     */
+    void commit() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief 队首记录（消费者），为空时返回nullptr
+     */
+    const LogRecord* front() const {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots_[tail & (CAPACITY - 1)];
+    }
+
+    void pop() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    uint64_t take_dropped() {
+        return dropped_.exchange(0, std::memory_order_relaxed);
+    }
+
+    uint16_t thread_index() const {
+        return thread_index_;
+    }
+
+    void set_orphaned() {
+        orphaned_.store(true, std::memory_order_release);
+    }
+
+    bool orphaned() const {
+        return orphaned_.load(std::memory_order_acquire);
+    }
+
+private:
+    uint16_t thread_index_;
+    alignas(64) std::atomic<uint64_t> head_;        // 下一个写入位置（生产者独占写）
+    alignas(64) std::atomic<uint64_t> tail_;        // 下一个读取位置（消费者独占写）
+    std::atomic<uint64_t> dropped_;                 // 缓冲满时丢弃的条数
+    std::atomic<bool> orphaned_;                    // 所属线程已退出
+    std::array<LogRecord, CAPACITY> slots_;
+};
+
+// ============================================================================
+// ======================== 调用点限速 ========================================
+// ============================================================================
+
+/**
+ * @class LogRateLimiter
+ * @brief 每个日志调用点一个：每秒最多放行MAX_PER_SECOND条
+ *
+ * @note 窗口切换时的竞争只会让个别日志多放行或多抑制，不影响正确性
+ */
+class LogRateLimiter {
+public:
+    static constexpr uint32_t MAX_PER_SECOND = 50;
+
+    LogRateLimiter()
+        : window_start_ms_(0),
+          count_(0),
+          suppressed_(0) {
+    }
+
+    /**
+     * @brief 判断这一次是否放行
+     *
+     * @param[out] suppressed 放行时返回此前被抑制的条数
+     */
+    bool allow(uint32_t& suppressed) {
+        int64_t now = TimeService::instance().coarse_now_ms();
+        int64_t start = window_start_ms_.load(std::memory_order_relaxed);
+        if (now - start >= 1000 &&
+            window_start_ms_.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+            count_.store(0, std::memory_order_relaxed);
+        }
+
+        if (count_.fetch_add(1, std::memory_order_relaxed) < MAX_PER_SECOND) {
+            suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    std::atomic<int64_t> window_start_ms_;
+    std::atomic<uint32_t> count_;
+    std::atomic<uint32_t> suppressed_;
+};
+
+// ============================================================================
+// ======================== 日志器 ============================================
+// ============================================================================
+
+/**
+ * @class AsyncLogger
+ * @brief 进程级的异步日志器（单例）
+ *
+ * @note 单例不析构：进程退出时由atexit回调写完剩余日志，之后的日志同步写出
+ */
+class AsyncLogger {
+public:
+    static AsyncLogger& instance() {
+        static AsyncLogger* logger = create();
+        return *logger;
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    /**
+     * @brief 设置运行时的最低级别（不能低于编译期的AVSERVER_LOG_MIN_LEVEL）
+     */
+    void set_level(LogLevel level) {
+        level_.store(level, std::memory_order_relaxed);
+    }
+
+    bool enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 写一条日志（通常通过AV_LOG_*宏调用）
+     */
+    template<typename... Args>
+    void log(LogLevel level, const char* module, uint32_t suppressed,
+             const char* format, const Args&... args) {
+        if (!running_.load(std::memory_order_acquire)) {
+            LogRecord record;
+            fill(record, level, module, suppressed, format, 0, args...);
+            write_sync(record);
+            return;
+        }
+
+        LogRing* ring = thread_ring();
+        LogRecord* record = ring->reserve();
+        if (!record) {
+            return;
+        }
+        fill(*record, level, module, suppressed, format, ring->thread_index(), args...);
+        ring->commit();
+        wake_writer();
+    }
+
+    /**
+     * @brief 等待当前已写入的日志全部输出
+     *
+     * @note 写线程清空所有缓冲、准备休眠时唤醒等待者
+     */
+    void flush() {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        flushed_cv_.wait(lock, [this] {
+            return !running_.load(std::memory_order_acquire) || !has_pending();
+        });
+    }
+
+    /**
+     * @brief 停止写线程并输出剩余日志（之后的日志同步写出）
+     */
+    void shutdown() {
+        bool expected = true;
+        if (!running_.compare_exchange_strong(expected, false)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            writer_sleeping_.store(false);
+        }
+        wake_cv_.notify_all();
+        flushed_cv_.notify_all();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+        drain_all();
+    }
+
+    /**
+     * @brief 因环形缓冲满被丢弃的总条数
+     */
+    uint64_t get_dropped_count() const {
+        return total_dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    AsyncLogger()
+        : level_(LogLevel::INFO),
+          running_(true),
+          next_thread_(0),
+          total_dropped_(0),
+          writer_sleeping_(false) {
+        writer_ = std::thread(&AsyncLogger::writer_loop, this);
+    }
+
+    static AsyncLogger* create() {
+        // 先构造TimeService，保证它在退出回调之后才析构
+        TimeService::instance();
+        AsyncLogger* logger = new AsyncLogger();
+        std::atexit([] { AsyncLogger::instance().shutdown(); });
+        return logger;
+    }
+
+    /**
+     * @brief 线程退出时把自己的环形缓冲标记为孤立，由写线程输出剩余日志后回收
+     */
+    struct ThreadRingHandle {
+        std::shared_ptr<LogRing> ring;
+        ~ThreadRingHandle() {
+            if (ring) {
+                ring->set_orphaned();
+            }
+        }
+    };
+
+    LogRing* thread_ring() {
+        thread_local ThreadRingHandle handle;
+        if (!handle.ring) {
+            uint16_t index = static_cast<uint16_t>(next_thread_.fetch_add(1, std::memory_order_relaxed));
+            handle.ring = std::make_shared<LogRing>(index);
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings_.push_back(handle.ring);
+        }
+        return handle.ring.get();
+    }
+
+    template<typename... Args>
+    static void fill(LogRecord& record, LogLevel level, const char* module, uint32_t suppressed,
+                     const char* format, uint16_t thread, const Args&... args) {
+        record.wall_ms = TimeService::instance().wall_now_ms();
+        record.module = module;
+        record.format = format;
+        record.suppressed = suppressed;
+        record.thread = thread;
+        record.used = 0;
+        record.level = level;
+        record.truncated = 0;
+        (encode_log_arg(record, args), ...);
+    }
+
+    static void write_sync(const LogRecord& record) {
+        std::string line;
+        format_log_record(record, line);
+        FILE* stream = record.level >= LogLevel::WARN ? stderr : stdout;
+        std::fwrite(line.data(), 1, line.size(), stream);
+        std::fflush(stream);
+    }
+
+    bool has_pending() {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (const auto& ring : rings_) {
+            if (!ring->empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief 写线程主循环：有日志就输出，所有缓冲都为空时休眠到被唤醒
+     *
+     * @note 先标记休眠再复查缓冲，与wake_writer()的"先提交再检查标记"配对，
+     *       两边都有seq_cst栅栏，不会出现日志已提交而写线程仍在休眠的情况
+     */
+    void writer_loop() {
+        while (running_.load(std::memory_order_acquire)) {
+            if (drain_all()) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            writer_sleeping_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (has_pending() || !running_.load(std::memory_order_acquire)) {
+                writer_sleeping_.store(false, std::memory_order_relaxed);
+                continue;
+            }
+
+            flushed_cv_.notify_all();
+            wake_cv_.wait(lock, [this] {
+                return !writer_sleeping_.load(std::memory_order_relaxed) ||
+                       !running_.load(std::memory_order_acquire);
+            });
+            writer_sleeping_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 提交日志后唤醒休眠的写线程
+     *
+     * @note 写线程只在所有缓冲都为空时休眠，所以只有缓冲从空变为非空时才会加锁唤醒；
+     *       写线程醒着时这里只是一次栅栏和一次原子读
+     */
+    void wake_writer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!writer_sleeping_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            writer_sleeping_.store(false, std::memory_order_relaxed);
+        }
+        wake_cv_.notify_one();
+    }
+
+    /**
+     * @brief 输出所有环形缓冲中的日志，回收已退出线程的缓冲
+     *
+     * @return true 如果输出了至少一条
+     */
+    bool drain_all() {
+        std::vector<std::shared_ptr<LogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings = rings_;
+        }
+
+        bool wrote = false;
+        for (const auto& ring : rings) {
+            while (const LogRecord* record = ring->front()) {
+                format_log_record(*record, record->level >= LogLevel::WARN ? err_buffer_ : out_buffer_);
+                ring->pop();
+                wrote = true;
+            }
+
+            uint64_t dropped = ring->take_dropped();
+            if (dropped > 0) {
+                total_dropped_.fetch_add(dropped, std::memory_order_relaxed);
+                char line[96];
+                std::snprintf(line, sizeof(line), "[AsyncLogger] T%02u dropped %llu records (ring full)\n",
+                              static_cast<unsigned>(ring->thread_index()),
+                              static_cast<unsigned long long>(dropped));
+                err_buffer_ += line;
+                wrote = true;
+            }
+        }
+
+        if (!out_buffer_.empty()) {
+            std::fwrite(out_buffer_.data(), 1, out_buffer_.size(), stdout);
+            std::fflush(stdout);
+            out_buffer_.clear();
+        }
+        if (!err_buffer_.empty()) {
+            std::fwrite(err_buffer_.data(), 1, err_buffer_.size(), stderr);
+            std::fflush(stderr);
+            err_buffer_.clear();
+        }
+
+        // 回收已退出且已输出完的线程缓冲
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (auto it = rings_.begin(); it != rings_.end();) {
+            if ((*it)->orphaned() && (*it)->empty()) {
+                it = rings_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return wrote;
+    }
+
+private:
+    std::atomic<LogLevel> level_;
+    std::atomic<bool> running_;
+    std::atomic<uint32_t> next_thread_;
+    std::atomic<uint64_t> total_dropped_;
+
+    std::mutex rings_mutex_;                        // 保护rings_（只在线程注册和写线程遍历时获取）
+    std::vector<std::shared_ptr<LogRing>> rings_;
+
+    std::mutex wake_mutex_;                         // 配合wake_cv_和flushed_cv_使用
+    std::condition_variable wake_cv_;               // 休眠的写线程等待新日志
+    std::condition_variable flushed_cv_;            // flush()等待所有缓冲清空
+    std::atomic<bool> writer_sleeping_;             // 写线程是否在wake_cv_上休眠
+
+    std::thread writer_;
+    std::string out_buffer_;                        // 写线程的批量输出缓冲
+    std::string err_buffer_;
+};
+
+// ============================================================================
+// ======================== 日志宏 ============================================
+// ============================================================================
+
+/**
+ * @brief 写一条日志：编译期按级别消除，运行时按级别过滤并按调用点限速
+ */
+#define AV_LOG(level, module, ...)                                                      \
+    do {                                                                                \
+        if constexpr (static_cast<int>(level) >= AVSERVER_LOG_MIN_LEVEL) {              \
+            static LogRateLimiter av_log_limiter_;                                      \
+            uint32_t av_log_suppressed_ = 0;                                            \
+            if (AsyncLogger::instance().enabled(level) &&                               \
+                av_log_limiter_.allow(av_log_suppressed_)) {                            \
+                AsyncLogger::instance().log(level, module, av_log_suppressed_, __VA_ARGS__); \
+            }                                                                           \
+        }                                                                               \
+    } while (0)
+
+#define AV_LOG_TRACE(module, ...) AV_LOG(LogLevel::TRACE, module, __VA_ARGS__)
+#define AV_LOG_DEBUG(module, ...) AV_LOG(LogLevel::DEBUG, module, __VA_ARGS__)
+#define AV_LOG_INFO(module, ...)  AV_LOG(LogLevel::INFO, module, __VA_ARGS__)
+#define AV_LOG_WARN(module, ...)  AV_LOG(LogLevel::WARN, module, __VA_ARGS__)
+#define AV_LOG_ERROR(module, ...) AV_LOG(LogLevel::ERROR, module, __VA_ARGS__)
+
+#endif // ASYNC_LOGGER_H
@@ -0,0 +1,304 @@
+/*
+ * LockProfiler.h - 互斥锁竞争分析
+ *
+ * 组成：
+ * - InstrumentedMutex：可替代std::mutex的互斥锁，按锁位置（名称）记录
+ *   获取次数、发生竞争的次数、等待时间直方图和持有时间直方图
+ * - LockProfiler：所有锁位置的注册表，输出"竞争最严重的锁"报告
+ * - ProfiledMutex等别名：定义AVSERVER_LOCK_PROFILING=1编译时是InstrumentedMutex，
+ *   否则是std::mutex，业务代码不需要条件编译
+ *
+ * 为什么需要：
+ * connections_mutex_、clients_mutex_、统计锁、帧缓冲池和SafeQueue的锁都可能是
+ * 瓶颈，但没有数据无法判断先改哪一个。打开这个编译选项后，fullstats、locks命令和
+ * /metrics会给出每个锁位置的竞争比例和等待时间。
+ *
+ * 使用示例：
+ * @code
+ *   // g++ -DAVSERVER_LOCK_PROFILING=1 ...
+ *   mutable ProfiledMutex mutex_{"FrameBufferPool"};
+ *
+ *   std::lock_guard<ProfiledMutex> lock(mutex_);
+ *
+ *   ProfiledUniqueLock lock(mutex_);              // 需要配合条件变量时
+ *   condition_.wait(lock, ...);                   // condition_是ProfiledConditionVariable
+ *
+ *   std::cout << LockProfiler::instance().get_statistics(LockProfiler::REPORT_SITES).to_string();
+ * @endcode
+ *
+ * @note 同名的锁（如所有SafeQueue实例）汇总到同一个位置
+ * @note 先try_lock，失败才计为竞争并计时；未竞争的获取只多一次原子加
+ * @note 打开后同一位置的所有锁共享直方图，统计本身会增加一些缓存行争用，只用于分析
+ */
+
+#ifndef LOCK_PROFILER_H
+#define LOCK_PROFILER_H
+
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+#include "AVServer_29_TimeService.h"
+#include "AVServer_30_LatencyTrace.h"
+
+// 编译选项：1 = 用InstrumentedMutex替换内部互斥锁
+#ifndef AVSERVER_LOCK_PROFILING
+    #define AVSERVER_LOCK_PROFILING 0
+#endif
+
+// ============================================================================
+// ======================== 锁位置 ============================================
+// ============================================================================
+
+/**
+ * @struct LockSiteSnapshot
+ * @brief 一个锁位置某一时刻的统计
+ */
+struct LockSiteSnapshot {
+    std::string name;
+    uint64_t acquisitions;          // 获取次数
+    uint64_t contended;             // 需要等待的获取次数
+    StageHistogramSnapshot wait;    // 发生竞争时的等待时间
+    StageHistogramSnapshot hold;    // 每次的持有时间
+
+    LockSiteSnapshot()
+        : acquisitions(0),
+          contended(0) {
+    }
+
+    double contention_ratio() const {
+        return acquisitions > 0 ? static_cast<double>(contended) / acquisitions : 0.0;
+    }
+};
+
+/**
+ * @class LockSite
+ * @brief 一个命名锁位置的计数和直方图
+ */
+class LockSite {
+public:
+    explicit LockSite(const std::string& name)
+        : name_(name),
+          acquisitions_(0),
+          contended_(0) {
+    }
+
+    void record_acquire(bool contended, uint64_t wait_ns) {
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+        if (contended) {
+            contended_.fetch_add(1, std::memory_order_relaxed);
+            wait_.record(wait_ns);
+        }
+    }
+
+    void record_hold(uint64_t hold_ns) {
+        hold_.record(hold_ns);
+    }
+
+    LockSiteSnapshot snapshot() const {
+        LockSiteSnapshot snap;
+        snap.name = name_;
+        snap.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+        snap.contended = contended_.load(std::memory_order_relaxed);
+        snap.wait = wait_.snapshot();
+        snap.hold = hold_.snapshot();
+        return snap;
+    }
+
+private:
+    std::string name_;
+    std::atomic<uint64_t> acquisitions_;
+    std::atomic<uint64_t> contended_;
+    StageHistogram wait_;
+    StageHistogram hold_;
+};
+
+/**
+ * @struct LockContentionStatistics
+ * @brief 按总等待时间排序的锁位置
+ */
+struct LockContentionStatistics {
+    std::vector<LockSiteSnapshot> sites;
+
+    std::string to_string() const {
+        if (!AVSERVER_LOCK_PROFILING) {
+            return "Lock Contention: disabled (build with -DAVSERVER_LOCK_PROFILING=1)";
+        }
+        if (sites.empty()) {
+            return "Lock Contention: no lock acquisitions recorded";
+        }
+
+        std::string result = "Lock Contention (by total wait time):\n";
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer), "  %-26s %12s %10s %8s | %10s %10s %10s | %10s %10s\n",
+                      "site", "acquired", "contended", "ratio", "wait(ms)", "wait p99", "wait max",
+                      "hold p50", "hold p99");
+        result += buffer;
+        for (const auto& site : sites) {
+            std::snprintf(buffer, sizeof(buffer),
+                          "  %-26s %12llu %10llu %7.2f%% | %10.2f %8.1fus %8.1fus | %8.2fus %8.2fus\n",
+                          site.name.c_str(),
+                          static_cast<unsigned long long>(site.acquisitions),
+                          static_cast<unsigned long long>(site.contended),
+                          site.contention_ratio() * 100.0,
+                          site.wait.sum_ns / 1e6,
+                          site.wait.percentile_us(99), site.wait.max_ns / 1000.0,
+                          site.hold.percentile_us(50), site.hold.percentile_us(99));
+            result += buffer;
+        }
+        return result;
+    }
+};
+
+// ============================================================================
+// ======================== 注册表 ============================================
+// ============================================================================
+
+/**
+ * @class LockProfiler
+ * @brief 进程级的锁位置注册表（单例）
+ *
+ * @note 位置只增不删，InstrumentedMutex保存的LockSite指针在进程内一直有效
+ */
+class LockProfiler {
+public:
+    static constexpr size_t REPORT_SITES = 10;      // 控制台报告默认列出的位置数
+
+    static LockProfiler& instance() {
+        static LockProfiler* profiler = new LockProfiler();
+        return *profiler;
+    }
+
+    LockProfiler(const LockProfiler&) = delete;
+    LockProfiler& operator=(const LockProfiler&) = delete;
+
+    /**
+     * @brief 查找或创建锁位置
+     */
+    LockSite* site(const char* name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = sites_[name];
+        if (!entry) {
+            entry.reset(new LockSite(name));
+        }
+        return entry.get();
+    }
+
+    /**
+     * @brief 竞争最严重的锁位置
+     *
+     * @param limit 最多返回的位置数（0表示全部）
+     * @return 按总等待时间降序，相同时按竞争次数降序；没有获取记录的位置不返回
+     */
+    LockContentionStatistics get_statistics(size_t limit = 0) const {
+        LockContentionStatistics stats;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& entry : sites_) {
+                LockSiteSnapshot snap = entry.second->snapshot();
+                if (snap.acquisitions > 0) {
+                    stats.sites.push_back(std::move(snap));
+                }
+            }
+        }
+
+        std::sort(stats.sites.begin(), stats.sites.end(),
+                  [](const LockSiteSnapshot& a, const LockSiteSnapshot& b) {
+                      if (a.wait.sum_ns != b.wait.sum_ns) {
+                          return a.wait.sum_ns > b.wait.sum_ns;
+                      }
+                      return a.contended > b.contended;
+                  });
+        if (limit > 0 && stats.sites.size() > limit) {
+            stats.sites.resize(limit);
+        }
+        return stats;
+    }
+
+private:
+    LockProfiler() = default;
+
+    mutable std::mutex mutex_;                  // 保护sites_（只在锁构造和生成报告时获取）
+    std::map<std::string, std::unique_ptr<LockSite>> sites_;
+};
+
+// ============================================================================
+// ======================== 带统计的互斥锁 ====================================
+// ============================================================================
+
+/**
+ * @class InstrumentedMutex
+ * @brief 记录竞争和持有时间的互斥锁（满足Lockable要求）
+ */
+class InstrumentedMutex {
+public:
+    explicit InstrumentedMutex(const char* name = "unnamed")
+        : site_(LockProfiler::instance().site(name)),
+          hold_start_(0) {
+    }
+
+    InstrumentedMutex(const InstrumentedMutex&) = delete;
+    InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+
+    void lock() {
+        if (mutex_.try_lock()) {
+            site_->record_acquire(false, 0);
+        } else {
+            TimeService& time = TimeService::instance();
+            uint64_t start = time.fine_ticks();
+            mutex_.lock();
+            site_->record_acquire(true, time.fine_elapsed_ns(start));
+        }
+        hold_start_ = TimeService::instance().fine_ticks();
+    }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) {
+            return false;
+        }
+        site_->record_acquire(false, 0);
+        hold_start_ = TimeService::instance().fine_ticks();
+        return true;
+    }
+
+    void unlock() {
+        // hold_start_只由持有者读写，必须在释放前读取
+        uint64_t held_ns = TimeService::instance().fine_elapsed_ns(hold_start_);
+        mutex_.unlock();
+        site_->record_hold(held_ns);
+    }
+
+private:
+    std::mutex mutex_;
+    LockSite* site_;
+    uint64_t hold_start_;           // 本次获取的时刻（fine_ticks）
+};
+
+/**
+ * @class NamedMutex
+ * @brief 不做统计时使用的std::mutex，接受并忽略锁位置名称
+ */
+class NamedMutex : public std::mutex {
+public:
+    explicit constexpr NamedMutex(const char* = nullptr) noexcept {
+    }
+};
+
+#if AVSERVER_LOCK_PROFILING
+using ProfiledMutex = InstrumentedMutex;
+using ProfiledUniqueLock = std::unique_lock<InstrumentedMutex>;
+using ProfiledConditionVariable = std::condition_variable_any;
+#else
+using ProfiledMutex = NamedMutex;
+using ProfiledUniqueLock = std::unique_lock<std::mutex>;
+using ProfiledConditionVariable = std::condition_variable;
+#endif
+
+#endif // LOCK_PROFILER_H
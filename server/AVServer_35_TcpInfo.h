@@ -0,0 +1,200 @@
+/*
+ * TcpInfo.h - 连接的传输层状态采样（TCP_INFO）
+ *
+ * 功能：
+ * - 用getsockopt(TCP_INFO)读取内核为每个TCP连接维护的状态：
+ *   平滑RTT、RTT方差、拥塞窗口、交付速率、重传、未确认段数和未发送字节数
+ * - TcpServer在每个事件循环上按低频定时器（默认1秒）批量采样该循环上的所有会话，
+ *   一批结果通过一次回调交给上层（StreamingService存入客户端会话）
+ *
+ * 为什么需要：
+ * 观众卡顿时，应用层只能看到发送队列变长，分不清是对端接收慢、链路丢包
+ * 还是拥塞窗口受限。内核已经维护了这些数据，只需要低频读出来。
+ * 这些数据也是之后做带宽估计的基础。
+ *
+ * 使用示例：
+ * @code
+ *   TcpTransportInfo info;
+ *   if (read_tcp_transport_info(fd, info)) {
+ *       std::cout << info.to_string() << std::endl;
+ *   }
+ * @endcode
+ *
+ * @note glibc的struct tcp_info缺少较新的字段（notsent_bytes、delivery_rate），
+ *       这里按内核的布局定义前缀；旧内核返回的长度更短，缺少的字段保持为0
+ * @note 只在Linux上可用，其他平台read_tcp_transport_info()返回false
+ */
+
+#ifndef TCP_TRANSPORT_INFO_H
+#define TCP_TRANSPORT_INFO_H
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+#endif
+
+#include "AVServer_29_TimeService.h"
+
+/**
+ * @struct TcpTransportInfo
+ * @brief 一次TCP_INFO采样的结果
+ */
+struct TcpTransportInfo {
+    uint32_t srtt_us;               // 平滑RTT（微秒）
+    uint32_t rttvar_us;             // RTT方差（微秒）
+    uint32_t min_rtt_us;            // 观测到的最小RTT（微秒）
+    uint32_t cwnd_segments;         // 拥塞窗口（段）
+    uint32_t mss;                   // 发送MSS（字节）
+    uint32_t unacked_segments;      // 已发送未确认的段数
+    uint32_t notsent_bytes;         // 在发送缓冲区中尚未发出的字节数
+    uint32_t retransmits;           // 当前未恢复的连续重传次数
+    uint32_t total_retransmits;     // 连接建立以来的重传段数
+    uint32_t lost_segments;         // 内核估计丢失的段数
+    uint64_t delivery_rate_bps;     // 最近的交付速率（bps）
+    int64_t sampled_at_ms;          // 采样时的单调时间（毫秒，0表示从未采样）
+
+    TcpTransportInfo()
+        : srtt_us(0),
+          rttvar_us(0),
+          min_rtt_us(0),
+          cwnd_segments(0),
+          mss(0),
+          unacked_segments(0),
+          notsent_bytes(0),
+          retransmits(0),
+          total_retransmits(0),
+          lost_segments(0),
+          delivery_rate_bps(0),
+          sampled_at_ms(0) {
+    }
+
+    bool valid() const {
+        return sampled_at_ms != 0;
+    }
+
+    std::string to_string() const {
+        if (!valid()) {
+            return "TCP: not sampled";
+        }
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer),
+                      "TCP: srtt=%.1fms rttvar=%.1fms cwnd=%u mss=%u rate=%.2fMbps "
+                      "unacked=%u notsent=%uB retrans=%u/%u lost=%u",
+                      srtt_us / 1000.0, rttvar_us / 1000.0, cwnd_segments, mss,
+                      delivery_rate_bps / 1000000.0, unacked_segments, notsent_bytes,
+                      retransmits, total_retransmits, lost_segments);
+        return std::string(buffer);
+    }
+};
+
+#if defined(__linux__)
+/**
+ * @struct KernelTcpInfo
+ * @brief 内核struct tcp_info（linux/tcp.h）到tcpi_delivery_rate为止的前缀
+ *
+ * @note 不能直接包含linux/tcp.h：它与netinet/tcp.h的定义冲突
+ */
+struct KernelTcpInfo {
+    uint8_t state;
+    uint8_t ca_state;
+    uint8_t retransmits;
+    uint8_t probes;
+    uint8_t backoff;
+    uint8_t options;
+    uint8_t wscale;
+    uint8_t delivery_rate_app_limited;
+
+    uint32_t rto;
+    uint32_t ato;
+    uint32_t snd_mss;
+    uint32_t rcv_mss;
+
+    uint32_t unacked;
+    uint32_t sacked;
+    uint32_t lost;
+    uint32_t retrans;
+    uint32_t fackets;
+
+    uint32_t last_data_sent;
+    uint32_t last_ack_sent;
+    uint32_t last_data_recv;
+    uint32_t last_ack_recv;
+
+    uint32_t pmtu;
+    uint32_t rcv_ssthresh;
+    uint32_t rtt;
+    uint32_t rttvar;
+    uint32_t snd_ssthresh;
+    uint32_t snd_cwnd;
+    uint32_t advmss;
+    uint32_t reordering;
+
+    uint32_t rcv_rtt;
+    uint32_t rcv_space;
+
+    uint32_t total_retrans;
+
+    uint64_t pacing_rate;
+    uint64_t max_pacing_rate;
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+    uint32_t segs_out;
+    uint32_t segs_in;
+
+    uint32_t notsent_bytes;
+    uint32_t min_rtt;
+    uint32_t data_segs_in;
+    uint32_t data_segs_out;
+
+    uint64_t delivery_rate;         // 字节/秒
+};
+
+static_assert(offsetof(KernelTcpInfo, delivery_rate) == 160, "KernelTcpInfo must match the kernel layout");
+#endif
+
+/**
+ * @brief 读取一个TCP套接字的传输层状态
+ *
+ * @param fd 已连接的TCP套接字
+ * @param[out] info 采样结果（sampled_at_ms设为当前的粗粒度时间）
+ * @return false 如果getsockopt失败或平台不支持
+ *
+ * @note 一次系统调用，约1微秒；应在拥有该套接字的线程上调用
+ */
+inline bool read_tcp_transport_info(int fd, TcpTransportInfo& info) {
+#if defined(__linux__)
+    KernelTcpInfo raw;
+    std::memset(&raw, 0, sizeof(raw));
+    socklen_t length = sizeof(raw);
+    if (::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &raw, &length) != 0) {
+        return false;
+    }
+
+    info.srtt_us = raw.rtt;
+    info.rttvar_us = raw.rttvar;
+    info.min_rtt_us = raw.min_rtt;
+    info.cwnd_segments = raw.snd_cwnd;
+    info.mss = raw.snd_mss;
+    info.unacked_segments = raw.unacked;
+    info.notsent_bytes = raw.notsent_bytes;
+    info.retransmits = raw.retransmits;
+    info.total_retransmits = raw.total_retrans;
+    info.lost_segments = raw.lost;
+    info.delivery_rate_bps = raw.delivery_rate * 8;
+    info.sampled_at_ms = TimeService::instance().coarse_now_ms();
+    return true;
+#else
+    (void)fd;
+    (void)info;
+    return false;
+#endif
+}
+
+#endif // TCP_TRANSPORT_INFO_H
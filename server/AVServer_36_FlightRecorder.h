@@ -0,0 +1,491 @@
+/*
+ * FlightRecorder.h - 最近流水线事件的内存飞行记录仪
+ *
+ * 功能：
+ * - 每个线程一个固定大小的二进制事件环，记录帧采集、编码、入队、发送、丢弃，
+ *   以及连接建立/关闭和帧缓冲池事件，时间戳为TimeService的纳秒时钟
+ * - 环写满后覆盖最旧的事件，内存占用固定（每线程events_per_thread × 24字节）
+ * - 按需导出最近N秒的事件为Chrome trace / Perfetto可读的JSON
+ *   （控制台trace命令，或向进程发送SIGUSR1，由统计线程在下一个周期写出）
+ *
+ * 为什么需要：
+ * 线上卡顿时stdout日志看不出每个线程当时在做什么。飞行记录仪一直开着，
+ * 出问题后导出最近几秒，在chrome://tracing或ui.perfetto.dev中按线程查看。
+ *
+ * 使用示例：
+ * @code
+ *   flight_record(FlightEvent::FRAME_CAPTURED, stream_id, frame->size);   // 热路径
+ *
+ *   FlightRecorder::instance().dump_chrome_trace("trace.json", 10000);    // 导出最近10秒
+ *
+ *   std::signal(SIGUSR1, [](int) { FlightRecorder::instance().request_dump(); });
+ *   FlightRecorder::instance().service_dump_request();                    // 统计线程每周期调用
+ * @endcode
+ *
+ * @note 记录一次事件：一次relaxed load判断开关、一次TSC读取、三次relaxed store和一次release store，
+ *       不加锁；时间戳在导出时才换算为纳秒。线程第一次记录时分配事件环（加一次注册表锁）
+ * @note 导出时事件环仍在写入：被覆盖中的事件会被识别并丢弃，不会读到半条事件
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+#if defined(__linux__)
+    #include <unistd.h>
+    #include <sys/syscall.h>
+#endif
+
+#include "AVServer_29_TimeService.h"
+#include "AVServer_30_LatencyTrace.h"
+
+// ============================================================================
+// ======================== 事件类型 ==========================================
+// ============================================================================
+
+/**
+ * @enum FlightEvent
+ * @brief 记录的事件类型（参数a、b的含义见注释）
+ */
+enum class FlightEvent : uint8_t {
+    FRAME_CAPTURED = 0,     // a=流, b=字节数
+    FRAME_ENCODED,          // a=流, b=字节数
+    FRAME_ENQUEUED,         // a=流, b=字节数（进入分发队列）
+    FRAME_SENT,             // a=连接ID, b=字节数（一条消息写完）
+    FRAME_DROPPED,          // a=FlightDropReason, b=流
+    CONNECTION_OPENED,      // a=连接ID
+    CONNECTION_CLOSED,      // a=连接ID
+    POOL_EXHAUSTED,         // a=0, b=帧容量（池为空，新分配了一帧）
+    POOL_DISCARDED,         // a=0, b=池大小（归还时池已满，帧被释放）
+};
+
+static constexpr int FLIGHT_EVENT_COUNT = 9;
+
+/**
+ * @enum FlightDropReason
+ * @brief FRAME_DROPPED的原因
+ */
+enum class FlightDropReason : uint8_t {
+    CAPTURE_QUEUE_FULL = 0,     // 采集队列满，丢弃最旧的帧
+    OUTPUT_SHED,                // 处理器输出队列过载卸载
+    SEND_EXPIRED,               // 发送队列中超过截止时间
+    SEND_GOP_BROKEN,            // 参考帧已丢，依赖帧不再发送
+    SEND_OVERFLOW,              // 发送队列满
+};
+
+inline const char* flight_event_name(FlightEvent event) {
+    switch (event) {
+        case FlightEvent::FRAME_CAPTURED: return "frame_captured";
+        case FlightEvent::FRAME_ENCODED: return "frame_encoded";
+        case FlightEvent::FRAME_ENQUEUED: return "frame_enqueued";
+        case FlightEvent::FRAME_SENT: return "frame_sent";
+        case FlightEvent::FRAME_DROPPED: return "frame_dropped";
+        case FlightEvent::CONNECTION_OPENED: return "connection_opened";
+        case FlightEvent::CONNECTION_CLOSED: return "connection_closed";
+        case FlightEvent::POOL_EXHAUSTED: return "pool_exhausted";
+        case FlightEvent::POOL_DISCARDED: return "pool_discarded";
+        default: return "unknown";
+    }
+}
+
+inline const char* flight_drop_reason_name(uint64_t reason) {
+    switch (static_cast<FlightDropReason>(reason)) {
+        case FlightDropReason::CAPTURE_QUEUE_FULL: return "capture_queue_full";
+        case FlightDropReason::OUTPUT_SHED: return "output_shed";
+        case FlightDropReason::SEND_EXPIRED: return "send_expired";
+        case FlightDropReason::SEND_GOP_BROKEN: return "send_gop_broken";
+        case FlightDropReason::SEND_OVERFLOW: return "send_overflow";
+        default: return "unknown";
+    }
+}
+
+// ============================================================================
+// ======================== 线程事件环 ========================================
+// ============================================================================
+
+/**
+ * @class FlightRing
+ * @brief 一个线程专用的覆盖式事件环（单写者，导出线程并发读取）
+ *
+ * 每个事件三个字：时间戳（TSC计数）、参数a、(参数b << 8 | 类型)。字都是relaxed原子变量，
+ * 写者写完后用release发布head_；读者读取前后各取一次head_，
+ * 序号不大于(读后head_ - 容量)的槽可能已被覆盖，丢弃。
+ */
+class FlightRing {
+public:
+    struct Event {
+        uint64_t ns;
+        uint64_t a;
+        uint32_t b;
+        FlightEvent type;
+    };
+
+    FlightRing(size_t capacity, uint64_t tid)
+        : mask_(capacity - 1),
+          tid_(tid),
+          head_(0),
+          slots_(new Slot[capacity]) {
+    }
+
+    void record(FlightEvent type, uint64_t a, uint32_t b) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        // 与collect()中的acquire栅栏配对：读到本次写入的槽时，必然看到之前发布的head_
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot& slot = slots_[head & mask_];
+        slot.ticks.store(TimeService::instance().fine_ticks(), std::memory_order_relaxed);
+        slot.a.store(a, std::memory_order_relaxed);
+        slot.packed.store((static_cast<uint64_t>(b) << 8) | static_cast<uint8_t>(type),
+                          std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief 复制时间戳不早于since_ns的事件（按写入顺序）
+     */
+    void collect(uint64_t since_ns, std::vector<Event>& out) const {
+        const TimeService& time = TimeService::instance();
+        uint64_t capacity = mask_ + 1;
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t begin = head > capacity ? head - capacity : 0;
+
+        size_t first = out.size();
+        std::vector<uint64_t> seqs;
+        for (uint64_t seq = begin; seq < head; ++seq) {
+            const Slot& slot = slots_[seq & mask_];
+            Event event;
+            event.ns = time.ticks_to_ns(slot.ticks.load(std::memory_order_relaxed));
+            event.a = slot.a.load(std::memory_order_relaxed);
+            uint64_t packed = slot.packed.load(std::memory_order_relaxed);
+            event.b = static_cast<uint32_t>(packed >> 8);
+            event.type = static_cast<FlightEvent>(packed & 0xFF);
+            if (event.ns >= since_ns) {
+                out.push_back(event);
+                seqs.push_back(seq);
+            }
+        }
+
+        // 读取期间被写者追上的槽可能混有新旧两条事件
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = head_.load(std::memory_order_relaxed);
+        uint64_t safe_from = after >= capacity ? after - capacity + 1 : 0;
+        size_t kept = first;
+        for (size_t i = 0; i < seqs.size(); ++i) {
+            if (seqs[i] >= safe_from) {
+                out[kept++] = out[first + i];
+            }
+        }
+        out.resize(kept);
+    }
+
+    uint64_t tid() const {
+        return tid_;
+    }
+
+    uint64_t recorded() const {
+        return head_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> ticks{0};        // fine_ticks()，导出时才换算为纳秒
+        std::atomic<uint64_t> a{0};
+        std::atomic<uint64_t> packed{0};
+    };
+
+    uint64_t mask_;
+    uint64_t tid_;                              // 写入线程的系统线程ID（用作trace中的tid）
+    alignas(64) std::atomic<uint64_t> head_;    // 下一个写入序号
+    std::unique_ptr<Slot[]> slots_;
+};
+
+// ============================================================================
+// ======================== 记录仪 ============================================
+// ============================================================================
+
+/**
+ * @class FlightRecorder
+ * @brief 进程级的飞行记录仪（单例）
+ *
+ * @note 单例不析构；已退出线程的事件环保留到超过MAX_RETIRED_RINGS个为止
+ */
+class FlightRecorder {
+public:
+    static constexpr size_t DEFAULT_EVENTS_PER_THREAD = 16384;
+    static constexpr size_t MAX_RETIRED_RINGS = 32;
+
+    static FlightRecorder& instance() {
+        static FlightRecorder* recorder = new FlightRecorder();
+        return *recorder;
+    }
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    /**
+     * @brief 打开或关闭记录（关闭后记录调用只有一次load）
+     */
+    void set_enabled(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 设置之后新建的事件环的容量（向上取整为2的幂）
+     *
+     * @note 应在服务器启动前调用，已经存在的事件环不变
+     */
+    void set_events_per_thread(size_t events) {
+        size_t capacity = 64;
+        while (capacity < events) {
+            capacity <<= 1;
+        }
+        events_per_thread_.store(capacity, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 设置SIGUSR1触发导出时的文件和时间窗口
+     */
+    void set_dump_target(const std::string& path, int window_ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dump_path_ = path;
+        dump_window_ms_ = window_ms;
+    }
+
+    void record(FlightEvent type, uint64_t a, uint32_t b) {
+        if (!enabled_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        thread_ring()->record(type, a, b);
+    }
+
+    /**
+     * @brief 请求导出（异步信号安全，只设置一个标志）
+     */
+    void request_dump() {
+        dump_requested_.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 如果有导出请求，写出到set_dump_target()指定的文件
+     *
+     * @return 写出的事件数；没有请求或写出失败时返回-1
+     */
+    long service_dump_request() {
+        if (!dump_requested_.exchange(false, std::memory_order_relaxed)) {
+            return -1;
+        }
+        std::string path;
+        int window_ms;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            path = dump_path_;
+            window_ms = dump_window_ms_;
+        }
+        long written = dump_chrome_trace(path, window_ms);
+        if (written >= 0) {
+            std::cout << "[FlightRecorder] Wrote " << written << " events to " << path << std::endl;
+        } else {
+            std::cerr << "[FlightRecorder] Failed to write " << path << std::endl;
+        }
+        return written;
+    }
+
+    /**
+     * @brief 导出最近window_ms毫秒的事件为Chrome trace JSON
+     *
+     * @param path 输出文件
+     * @param window_ms 时间窗口（毫秒，0表示事件环中的全部事件）
+     * @return 写出的事件数；打开文件失败时返回-1
+     *
+     * @note 在chrome://tracing或ui.perfetto.dev中打开；每个写入线程一行
+     */
+    long dump_chrome_trace(const std::string& path, int window_ms) const {
+        uint64_t now = TimeService::instance().fine_now_ns();
+        uint64_t window_ns = static_cast<uint64_t>(window_ms) * 1000000ull;
+        uint64_t since = window_ms > 0 && now > window_ns ? now - window_ns : 0;
+
+        std::vector<std::shared_ptr<FlightRing>> rings;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rings = rings_;
+        }
+
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            return -1;
+        }
+
+        long pid = 1;
+#if defined(__linux__)
+        pid = static_cast<long>(::getpid());
+#endif
+        std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"avserver\"}}",
+                     pid);
+
+        long written = 0;
+        std::vector<FlightRing::Event> events;
+        for (const auto& ring : rings) {
+            events.clear();
+            ring->collect(since, events);
+            for (const auto& event : events) {
+                std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+                             "\"ts\":%.3f,\"pid\":%ld,\"tid\":%llu,\"args\":{",
+                             flight_event_name(event.type), event_category(event.type),
+                             event.ns / 1000.0, pid, static_cast<unsigned long long>(ring->tid()));
+                write_args(file, event);
+                std::fprintf(file, "}}");
+                ++written;
+            }
+        }
+
+        std::fprintf(file, "\n]}\n");
+        if (std::fclose(file) != 0) {
+            return -1;
+        }
+        return written;
+    }
+
+    /**
+     * @brief 所有事件环累计记录的事件数（含已被覆盖的）
+     */
+    uint64_t get_recorded_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t total = retired_recorded_;
+        for (const auto& ring : rings_) {
+            total += ring->recorded();
+        }
+        return total;
+    }
+
+private:
+    FlightRecorder()
+        : enabled_(true),
+          dump_requested_(false),
+          events_per_thread_(DEFAULT_EVENTS_PER_THREAD),
+          dump_path_("avserver-trace.json"),
+          dump_window_ms_(10000),
+          retired_recorded_(0) {
+    }
+
+    /**
+     * @brief 线程退出时登记其事件环为已退出，超过上限时释放最早退出的
+     */
+    struct ThreadRingHandle {
+        std::shared_ptr<FlightRing> ring;
+        ~ThreadRingHandle() {
+            if (ring) {
+                FlightRecorder::instance().retire(ring);
+            }
+        }
+    };
+
+    FlightRing* thread_ring() {
+        thread_local ThreadRingHandle handle;
+        if (!handle.ring) {
+            uint64_t tid = 0;
+#if defined(__linux__)
+            tid = static_cast<uint64_t>(::syscall(SYS_gettid));
+#endif
+            handle.ring = std::make_shared<FlightRing>(
+                events_per_thread_.load(std::memory_order_relaxed), tid);
+            std::lock_guard<std::mutex> lock(mutex_);
+            rings_.push_back(handle.ring);
+        }
+        return handle.ring.get();
+    }
+
+    void retire(const std::shared_ptr<FlightRing>& ring) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_.push_back(ring);
+        if (retired_.size() > MAX_RETIRED_RINGS) {
+            std::shared_ptr<FlightRing> oldest = retired_.front();
+            retired_.erase(retired_.begin());
+            for (auto it = rings_.begin(); it != rings_.end(); ++it) {
+                if (*it == oldest) {
+                    retired_recorded_ += oldest->recorded();
+                    rings_.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+
+    static const char* event_category(FlightEvent type) {
+        switch (type) {
+            case FlightEvent::CONNECTION_OPENED:
+            case FlightEvent::CONNECTION_CLOSED:
+                return "connection";
+            case FlightEvent::POOL_EXHAUSTED:
+            case FlightEvent::POOL_DISCARDED:
+                return "pool";
+            default:
+                return "frame";
+        }
+    }
+
+    static std::string stream_label(uint64_t stream) {
+        if (stream == FrameTimestamps::NO_STREAM) {
+            return "untraced";
+        }
+        return latency_stream_name(static_cast<uint32_t>(stream));
+    }
+
+    static void write_args(FILE* file, const FlightRing::Event& event) {
+        switch (event.type) {
+            case FlightEvent::FRAME_CAPTURED:
+            case FlightEvent::FRAME_ENCODED:
+            case FlightEvent::FRAME_ENQUEUED:
+                std::fprintf(file, "\"stream\":\"%s\",\"bytes\":%u",
+                             stream_label(event.a).c_str(), event.b);
+                break;
+            case FlightEvent::FRAME_SENT:
+                std::fprintf(file, "\"connection\":%llu,\"bytes\":%u",
+                             static_cast<unsigned long long>(event.a), event.b);
+                break;
+            case FlightEvent::FRAME_DROPPED:
+                std::fprintf(file, "\"reason\":\"%s\",\"stream\":\"%s\"",
+                             flight_drop_reason_name(event.a), stream_label(event.b).c_str());
+                break;
+            case FlightEvent::CONNECTION_OPENED:
+            case FlightEvent::CONNECTION_CLOSED:
+                std::fprintf(file, "\"connection\":%llu", static_cast<unsigned long long>(event.a));
+                break;
+            default:
+                std::fprintf(file, "\"value\":%u", event.b);
+                break;
+        }
+    }
+
+private:
+    std::atomic<bool> enabled_;
+    std::atomic<bool> dump_requested_;
+    std::atomic<size_t> events_per_thread_;
+
+    mutable std::mutex mutex_;                          // 保护以下成员（不在记录路径上）
+    std::vector<std::shared_ptr<FlightRing>> rings_;    // 所有事件环（含已退出线程的）
+    std::vector<std::shared_ptr<FlightRing>> retired_;  // 已退出线程的事件环（按退出顺序）
+    std::string dump_path_;
+    int dump_window_ms_;
+    uint64_t retired_recorded_;
+};
+
+/**
+ * @brief 记录一个事件（热路径入口）
+ */
+inline void flight_record(FlightEvent type, uint64_t a = 0, uint32_t b = 0) {
+    FlightRecorder::instance().record(type, a, b);
+}
+
+#endif // FLIGHT_RECORDER_H
@@ -0,0 +1,897 @@
+/*
+ * IngestCapture.h - 入站字节流的录制与确定性回放
+ *
+ * 组成：
+ * - IngestRecorder：Connection每次从套接字读到数据时，把（连接、到达时刻、原始字节）
+ *   追加到录制文件；连接建立和关闭也各记一条
+ * - IngestCaptureReader：读取录制文件及其索引
+ * - IngestReplayer：通过回环连接把录制的字节流发回服务器，
+ *   可按原始节奏、N倍速或尽快发送，结束时给出本次回放的吞吐
+ * - IngestMessageDigest：把字节流按线协议切分为消息并计算摘要，
+ *   用于验证回放后服务器收到的消息序列与录制时相同
+ *
+ * 为什么需要：
+ * 性能改动需要可重复的输入。负载生成器产生的流量和真实发布者不同，
+ * 录制一次真实的入站流量后反复回放，每次回放的吞吐就是回归基线。
+ *
+ * 文件格式（小端）：
+ * @code
+ *   文件头  [magic "AVINGEST":8][version:4][reserved:4]
+ *   记录    [kind:1][reserved:3][connection:4][offset_ns:8][length:4][data:length]
+ *   索引    [connection_count:4]
+ *           每个连接：[connection:4][record_count:4][bytes:8][记录在文件中的偏移:8 × record_count]
+ *   文件尾  [index_offset:8][magic "AVINGIDX":8]
+ * @endcode
+ * offset_ns是相对录制开始的单调时间；记录按时间顺序写入。
+ * 每条记录的额外开销20字节，一次recv最多4KB，开销不到1%。
+ *
+ * 使用示例：
+ * @code
+ *   IngestRecorder::instance().start("ingest.avcap");   // 服务器：--capture-ingest
+ *   ...
+ *   IngestRecorder::instance().stop();                  // 写入索引
+ *
+ *   IngestCaptureReader capture;
+ *   capture.load("ingest.avcap");
+ *   ReplayOptions options;
+ *   options.port = 8888;
+ *   options.speed = 0;                                  // 尽快发送
+ *   ReplayStatistics stats;
+ *   IngestReplayer(capture, options).run(stats);
+ *   std::cout << stats.to_string() << std::endl;
+ * @endcode
+ *
+ * @note 未录制时，Connection每次读取只多一次relaxed load
+ * @note 回放的每个连接发送与录制时完全相同的字节，服务器按线协议切分出的消息序列相同；
+ *       TCP分段可能不同，这不影响切分结果
+ * @note 回放只连接回环地址；回放器同时读取并丢弃服务器的响应，避免双方互相阻塞
+ */
+
+#ifndef INGEST_CAPTURE_H
+#define INGEST_CAPTURE_H
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#if defined(__linux__)
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <arpa/inet.h>
+    #include <poll.h>
+    #include <unistd.h>
+#endif
+
+#include "AVServer_06_MessageProtocol.h"
+#include "AVServer_29_TimeService.h"
+
+/**
+ * @enum IngestRecordKind
+ * @brief 录制记录的类型
+ */
+enum class IngestRecordKind : uint8_t {
+    OPEN = 1,           // 连接建立（length为0）
+    DATA = 2,           // 一次读取到的入站字节
+    CLOSE = 3,          // 连接关闭（length为0）
+};
+
+/**
+ * @struct IngestRecord
+ * @brief 录制文件中的一条记录（data指向IngestCaptureReader持有的内存）
+ */
+struct IngestRecord {
+    IngestRecordKind kind;
+    uint32_t connection;
+    uint64_t offset_ns;             // 相对录制开始的时间
+    const uint8_t* data;
+    uint32_t length;
+};
+
+/**
+ * @struct IngestConnectionIndex
+ * @brief 索引中一个连接的条目
+ */
+struct IngestConnectionIndex {
+    uint32_t connection;
+    uint32_t record_count;
+    uint64_t bytes;                         // DATA记录的字节总数
+    std::vector<uint64_t> record_offsets;   // 该连接的记录在文件中的偏移（按时间顺序）
+
+    IngestConnectionIndex()
+        : connection(0),
+          record_count(0),
+          bytes(0) {
+    }
+};
+
+/**
+ * @brief 录制文件格式的常量和编码函数
+ */
+struct IngestCaptureFormat {
+    static constexpr char FILE_MAGIC[9] = "AVINGEST";
+    static constexpr char INDEX_MAGIC[9] = "AVINGIDX";
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t FILE_HEADER_SIZE = 16;
+    static constexpr size_t RECORD_HEADER_SIZE = 20;
+    static constexpr size_t FOOTER_SIZE = 16;
+
+    static void put_le32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    static void put_le64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    static uint32_t get_le32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        return v;
+    }
+
+    static uint64_t get_le64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        return v;
+    }
+};
+
+// ============================================================================
+// ======================== 录制 ==============================================
+// ============================================================================
+
+/**
+ * @class IngestRecorder
+ * @brief 进程级的入站流量录制（单例）
+ *
+ * @note 所有连接写同一个文件，写入时加锁；只在录制期间有这部分开销
+ */
+class IngestRecorder {
+public:
+    static IngestRecorder& instance() {
+        static IngestRecorder* recorder = new IngestRecorder();
+        return *recorder;
+    }
+
+    IngestRecorder(const IngestRecorder&) = delete;
+    IngestRecorder& operator=(const IngestRecorder&) = delete;
+
+    /**
+     * @brief 开始录制到文件（覆盖已有文件）
+     *
+     * @return false 如果已在录制或无法创建文件
+     *
+     * @note 开始前已经建立的连接没有OPEN记录，回放时在其第一条数据前建立连接
+     */
+    bool start(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (file_) {
+            return false;
+        }
+
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) {
+            std::cerr << "[IngestCapture] Cannot create " << path << std::endl;
+            return false;
+        }
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+        uint8_t header[IngestCaptureFormat::FILE_HEADER_SIZE] = {};
+        std::memcpy(header, IngestCaptureFormat::FILE_MAGIC, 8);
+        IngestCaptureFormat::put_le32(header + 8, IngestCaptureFormat::VERSION);
+        std::fwrite(header, 1, sizeof(header), file_);
+
+        path_ = path;
+        offset_ = sizeof(header);
+        records_ = 0;
+        bytes_ = 0;
+        index_.clear();
+        start_ns_ = TimeService::instance().fine_now_ns();
+        active_.store(true, std::memory_order_release);
+
+        std::cout << "[IngestCapture] Recording inbound traffic to " << path << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief 停止录制，写入索引和文件尾
+     *
+     * @return false 如果没有在录制或写入失败
+     */
+    bool stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_) {
+            return false;
+        }
+        active_.store(false, std::memory_order_relaxed);
+
+        uint64_t index_offset = offset_;
+        uint8_t buffer[16];
+        IngestCaptureFormat::put_le32(buffer, static_cast<uint32_t>(index_.size()));
+        std::fwrite(buffer, 1, 4, file_);
+        for (const auto& [connection, entry] : index_) {
+            IngestCaptureFormat::put_le32(buffer, connection);
+            IngestCaptureFormat::put_le32(buffer + 4, entry.record_count);
+            IngestCaptureFormat::put_le64(buffer + 8, entry.bytes);
+            std::fwrite(buffer, 1, 16, file_);
+            for (uint64_t record_offset : entry.record_offsets) {
+                IngestCaptureFormat::put_le64(buffer, record_offset);
+                std::fwrite(buffer, 1, 8, file_);
+            }
+        }
+        IngestCaptureFormat::put_le64(buffer, index_offset);
+        std::memcpy(buffer + 8, IngestCaptureFormat::INDEX_MAGIC, 8);
+        std::fwrite(buffer, 1, IngestCaptureFormat::FOOTER_SIZE, file_);
+
+        bool ok = !std::ferror(file_);
+        ok = std::fclose(file_) == 0 && ok;
+        file_ = nullptr;
+
+        if (ok) {
+            std::cout << "[IngestCapture] Wrote " << records_ << " records (" << bytes_ << " bytes) for "
+                      << index_.size() << " connections to " << path_ << std::endl;
+        } else {
+            std::cerr << "[IngestCapture] Failed to write " << path_ << std::endl;
+        }
+        return ok;
+    }
+
+    bool active() const {
+        return active_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 记录一个事件（未录制时立即返回）
+     */
+    void record(IngestRecordKind kind, uint32_t connection, const uint8_t* data = nullptr, size_t length = 0) {
+        if (!active_.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_) {
+            return;
+        }
+
+        // 在锁内取时间，保证文件中的记录按时间排序
+        uint64_t now = TimeService::instance().fine_now_ns();
+        uint8_t header[IngestCaptureFormat::RECORD_HEADER_SIZE] = {};
+        header[0] = static_cast<uint8_t>(kind);
+        IngestCaptureFormat::put_le32(header + 4, connection);
+        IngestCaptureFormat::put_le64(header + 8, now > start_ns_ ? now - start_ns_ : 0);
+        IngestCaptureFormat::put_le32(header + 16, static_cast<uint32_t>(length));
+        std::fwrite(header, 1, sizeof(header), file_);
+        if (length > 0) {
+            std::fwrite(data, 1, length, file_);
+        }
+
+        IngestConnectionIndex& entry = index_[connection];
+        entry.connection = connection;
+        entry.record_count++;
+        entry.record_offsets.push_back(offset_);
+        if (kind == IngestRecordKind::DATA) {
+            entry.bytes += length;
+            bytes_ += length;
+        }
+        offset_ += sizeof(header) + length;
+        records_++;
+    }
+
+private:
+    IngestRecorder()
+        : active_(false),
+          file_(nullptr),
+          offset_(0),
+          records_(0),
+          bytes_(0),
+          start_ns_(0) {
+    }
+
+    std::atomic<bool> active_;                          // 记录路径上唯一的检查
+
+    std::mutex mutex_;                                  // 保护以下成员
+    FILE* file_;
+    std::string path_;
+    uint64_t offset_;                                   // 下一条记录的文件偏移
+    uint64_t records_;
+    uint64_t bytes_;
+    uint64_t start_ns_;                                 // 录制开始时刻（fine_now_ns）
+    std::map<uint32_t, IngestConnectionIndex> index_;
+};
+
+// ============================================================================
+// ======================== 读取 ==============================================
+// ============================================================================
+
+/**
+ * @class IngestCaptureReader
+ * @brief 读取录制文件（整个文件读入内存，回放时不再读磁盘）
+ */
+class IngestCaptureReader {
+public:
+    IngestCaptureReader()
+        : duration_ns_(0),
+          total_bytes_(0) {
+    }
+
+    /**
+     * @brief 读取并校验录制文件
+     *
+     * @return false 如果文件无法读取、格式不对或没有正常结束（缺少索引）
+     */
+    bool load(const std::string& path) {
+        records_.clear();
+        index_.clear();
+        duration_ns_ = 0;
+        total_bytes_ = 0;
+
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            std::cerr << "[IngestCapture] Cannot open " << path << std::endl;
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        data_.resize(size > 0 ? static_cast<size_t>(size) : 0);
+        size_t read = data_.empty() ? 0 : std::fread(data_.data(), 1, data_.size(), file);
+        std::fclose(file);
+
+        if (read != data_.size() ||
+            data_.size() < IngestCaptureFormat::FILE_HEADER_SIZE + IngestCaptureFormat::FOOTER_SIZE ||
+            std::memcmp(data_.data(), IngestCaptureFormat::FILE_MAGIC, 8) != 0 ||
+            IngestCaptureFormat::get_le32(data_.data() + 8) != IngestCaptureFormat::VERSION) {
+            std::cerr << "[IngestCapture] Not an ingest capture: " << path << std::endl;
+            return false;
+        }
+
+        const uint8_t* footer = data_.data() + data_.size() - IngestCaptureFormat::FOOTER_SIZE;
+        uint64_t index_offset = IngestCaptureFormat::get_le64(footer);
+        if (std::memcmp(footer + 8, IngestCaptureFormat::INDEX_MAGIC, 8) != 0 ||
+            index_offset < IngestCaptureFormat::FILE_HEADER_SIZE ||
+            index_offset > data_.size() - IngestCaptureFormat::FOOTER_SIZE) {
+            std::cerr << "[IngestCapture] Capture has no index (recording not stopped?): " << path << std::endl;
+            return false;
+        }
+
+        if (!parse_records(index_offset) || !parse_index(index_offset)) {
+            std::cerr << "[IngestCapture] Corrupt capture: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    const std::vector<IngestRecord>& records() const {
+        return records_;
+    }
+
+    const std::vector<IngestConnectionIndex>& connections() const {
+        return index_;
+    }
+
+    /**
+     * @brief 一个连接的记录（通过索引定位，不扫描整个文件）
+     */
+    std::vector<IngestRecord> connection_records(uint32_t connection) const {
+        std::vector<IngestRecord> result;
+        for (const auto& entry : index_) {
+            if (entry.connection != connection) {
+                continue;
+            }
+            for (uint64_t offset : entry.record_offsets) {
+                result.push_back(decode_record(data_.data() + offset));
+            }
+        }
+        return result;
+    }
+
+    uint64_t duration_ns() const {
+        return duration_ns_;
+    }
+
+    uint64_t total_bytes() const {
+        return total_bytes_;
+    }
+
+    std::string to_string() const {
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer),
+                      "Ingest capture: %zu connections, %zu records, %llu bytes over %.3f s",
+                      index_.size(), records_.size(), static_cast<unsigned long long>(total_bytes_),
+                      duration_ns_ / 1e9);
+        return std::string(buffer);
+    }
+
+private:
+    static IngestRecord decode_record(const uint8_t* p) {
+        IngestRecord record;
+        record.kind = static_cast<IngestRecordKind>(p[0]);
+        record.connection = IngestCaptureFormat::get_le32(p + 4);
+        record.offset_ns = IngestCaptureFormat::get_le64(p + 8);
+        record.length = IngestCaptureFormat::get_le32(p + 16);
+        record.data = p + IngestCaptureFormat::RECORD_HEADER_SIZE;
+        return record;
+    }
+
+    bool parse_records(uint64_t end) {
+        uint64_t offset = IngestCaptureFormat::FILE_HEADER_SIZE;
+        while (offset < end) {
+            if (end - offset < IngestCaptureFormat::RECORD_HEADER_SIZE) {
+                return false;
+            }
+            IngestRecord record = decode_record(data_.data() + offset);
+            offset += IngestCaptureFormat::RECORD_HEADER_SIZE;
+            if (record.length > end - offset ||
+                record.kind < IngestRecordKind::OPEN || record.kind > IngestRecordKind::CLOSE) {
+                return false;
+            }
+            offset += record.length;
+            records_.push_back(record);
+            duration_ns_ = std::max(duration_ns_, record.offset_ns);
+            total_bytes_ += record.length;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 索引中的偏移必须落在parse_records()找到的某条记录的开头，且属于该连接
+     *
+     * @note 只检查范围不够：偏移落在记录中间时length是任意数据，decode出的data会越过data_
+     */
+    bool is_record_of(uint64_t record_offset, uint32_t connection) const {
+        if (record_offset > data_.size() - IngestCaptureFormat::RECORD_HEADER_SIZE) {
+            return false;
+        }
+        const uint8_t* data = data_.data() + record_offset + IngestCaptureFormat::RECORD_HEADER_SIZE;
+        auto it = std::lower_bound(records_.begin(), records_.end(), data,
+                                   [](const IngestRecord& record, const uint8_t* target) {
+                                       return record.data < target;
+                                   });
+        return it != records_.end() && it->data == data && it->connection == connection;
+    }
+
+    bool parse_index(uint64_t offset) {
+        uint64_t end = data_.size() - IngestCaptureFormat::FOOTER_SIZE;
+        if (end - offset < 4) {
+            return false;
+        }
+        uint32_t count = IngestCaptureFormat::get_le32(data_.data() + offset);
+        offset += 4;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (end - offset < 16) {
+                return false;
+            }
+            IngestConnectionIndex entry;
+            entry.connection = IngestCaptureFormat::get_le32(data_.data() + offset);
+            entry.record_count = IngestCaptureFormat::get_le32(data_.data() + offset + 4);
+            entry.bytes = IngestCaptureFormat::get_le64(data_.data() + offset + 8);
+            offset += 16;
+            if ((end - offset) / 8 < entry.record_count) {
+                return false;
+            }
+            for (uint32_t r = 0; r < entry.record_count; ++r) {
+                uint64_t record_offset = IngestCaptureFormat::get_le64(data_.data() + offset);
+                offset += 8;
+                if (!is_record_of(record_offset, entry.connection)) {
+                    return false;
+                }
+                entry.record_offsets.push_back(record_offset);
+            }
+            index_.push_back(std::move(entry));
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> data_;                     // 整个文件
+    std::vector<IngestRecord> records_;             // 所有记录（文件顺序即时间顺序）
+    std::vector<IngestConnectionIndex> index_;
+    uint64_t duration_ns_;
+    uint64_t total_bytes_;
+};
+
+// ============================================================================
+// ======================== 消息摘要 ==========================================
+// ============================================================================
+
+/**
+ * @class IngestMessageDigest
+ * @brief 一个连接的消息序列摘要（FNV-1a，覆盖类型、时间戳和消息体）
+ *
+ * 录制一侧用feed()按线协议切分字节流，服务器一侧对收到的每条消息调用add()，
+ * 两边的count()和value()相同即消息序列相同。
+ */
+class IngestMessageDigest {
+public:
+    IngestMessageDigest()
+        : hash_(FNV_OFFSET),
+          count_(0),
+          valid_(true) {
+    }
+
+    /**
+     * @brief 追加一段入站字节，对其中完整的消息计算摘要
+     *
+     * @note 遇到无效消息头后停止（服务器此时会清空接收缓冲区，序列无法对齐）
+     */
+    void feed(const uint8_t* data, size_t length) {
+        if (!valid_) {
+            return;
+        }
+        pending_.insert(pending_.end(), data, data + length);
+
+        size_t offset = 0;
+        while (pending_.size() - offset >= MessageHeader::HEADER_SIZE) {
+            MessageHeader header;
+            header.deserialize(pending_.data() + offset);
+            if (!header.is_valid()) {
+                valid_ = false;
+                break;
+            }
+            size_t total = MessageHeader::HEADER_SIZE + header.payload_size;
+            if (pending_.size() - offset < total) {
+                break;
+            }
+            update(header.type, header.timestamp,
+                   pending_.data() + offset + MessageHeader::HEADER_SIZE, header.payload_size);
+            offset += total;
+        }
+        pending_.erase(pending_.begin(), pending_.begin() + offset);
+    }
+
+    /**
+     * @brief 追加一条已切分的消息
+     */
+    void add(const Message& message) {
+        update(static_cast<uint16_t>(message.get_type()), message.get_header().timestamp,
+               message.get_payload(), message.get_payload_size());
+    }
+
+    uint64_t value() const {
+        return hash_;
+    }
+
+    uint64_t count() const {
+        return count_;
+    }
+
+    /**
+     * @brief 字节流是否都能按线协议切分
+     */
+    bool valid() const {
+        return valid_;
+    }
+
+private:
+    static constexpr uint64_t FNV_OFFSET = 1469598103934665603ull;
+    static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    void update(uint16_t type, uint64_t timestamp, const uint8_t* payload, size_t size) {
+        uint8_t fields[14];
+        IngestCaptureFormat::put_le32(fields, type);
+        IngestCaptureFormat::put_le64(fields + 2, timestamp);
+        IngestCaptureFormat::put_le32(fields + 10, static_cast<uint32_t>(size));
+        mix(fields, sizeof(fields));
+        if (payload && size > 0) {
+            mix(payload, size);
+        }
+        count_++;
+    }
+
+    void mix(const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash_ = (hash_ ^ data[i]) * FNV_PRIME;
+        }
+    }
+
+    uint64_t hash_;
+    uint64_t count_;
+    bool valid_;
+    std::vector<uint8_t> pending_;                  // 尚未凑成完整消息的字节
+};
+
+/**
+ * @brief 录制文件中每个连接的期望消息摘要（按连接ID）
+ */
+inline std::map<uint32_t, IngestMessageDigest> ingest_expected_digests(const IngestCaptureReader& capture) {
+    std::map<uint32_t, IngestMessageDigest> digests;
+    for (const auto& record : capture.records()) {
+        if (record.kind == IngestRecordKind::DATA) {
+            digests[record.connection].feed(record.data, record.length);
+        }
+    }
+    return digests;
+}
+
+// ============================================================================
+// ======================== 回放 ==============================================
+// ============================================================================
+
+/**
+ * @struct ReplayOptions
+ * @brief 回放参数
+ */
+struct ReplayOptions {
+    std::string host;               // 服务器地址（只允许回环地址）
+    uint16_t port;
+    double speed;                   // 1 = 原始节奏，N = N倍速，0 = 尽快发送
+    int drain_timeout_ms;           // 发送完后等待服务器关闭连接的最长时间
+
+    ReplayOptions()
+        : host("127.0.0.1"),
+          port(8888),
+          speed(1.0),
+          drain_timeout_ms(2000) {
+    }
+};
+
+/**
+ * @struct ReplayStatistics
+ * @brief 一次回放的结果
+ */
+struct ReplayStatistics {
+    uint64_t connections;           // 建立的连接数
+    uint64_t failed_connections;    // 连接失败（其数据被跳过）
+    uint64_t failed_sends;          // 服务器提前关闭连接（该连接之后的数据被跳过）
+    uint64_t records;               // 回放的DATA记录数
+    uint64_t bytes_sent;
+    uint64_t bytes_received;        // 服务器的响应（读取后丢弃）
+    double elapsed_ms;              // 第一条记录到最后一个字节写入的时间
+
+    ReplayStatistics()
+        : connections(0),
+          failed_connections(0),
+          failed_sends(0),
+          records(0),
+          bytes_sent(0),
+          bytes_received(0),
+          elapsed_ms(0.0) {
+    }
+
+    double throughput_mbps() const {
+        return elapsed_ms > 0 ? bytes_sent * 8.0 / (elapsed_ms * 1000.0) : 0.0;
+    }
+
+    std::string to_string() const {
+        char buffer[320];
+        std::snprintf(buffer, sizeof(buffer),
+                      "Replay: %llu connections (%llu failed, %llu closed early), %llu records, %llu bytes in %.1f ms "
+                      "= %.2f Mbps, %.0f records/s, %llu response bytes",
+                      static_cast<unsigned long long>(connections),
+                      static_cast<unsigned long long>(failed_connections),
+                      static_cast<unsigned long long>(failed_sends),
+                      static_cast<unsigned long long>(records),
+                      static_cast<unsigned long long>(bytes_sent), elapsed_ms, throughput_mbps(),
+                      elapsed_ms > 0 ? records * 1000.0 / elapsed_ms : 0.0,
+                      static_cast<unsigned long long>(bytes_received));
+        return std::string(buffer);
+    }
+};
+
+#if defined(__linux__)
+/**
+ * @class IngestReplayer
+ * @brief 把录制的入站字节流经回环连接发回服务器（单线程，按记录的时间顺序）
+ *
+ * @note 每个录制连接对应一个回放连接；CLOSE记录只关闭写方向，
+ *       继续读取直到服务器关闭，避免未读数据触发RST使服务器丢掉尚未处理的数据
+ */
+class IngestReplayer {
+public:
+    IngestReplayer(const IngestCaptureReader& capture, const ReplayOptions& options)
+        : capture_(capture),
+          options_(options) {
+    }
+
+    ~IngestReplayer() {
+        for (auto& [connection, fd] : sockets_) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    IngestReplayer(const IngestReplayer&) = delete;
+    IngestReplayer& operator=(const IngestReplayer&) = delete;
+
+    /**
+     * @brief 执行回放
+     *
+     * @param[out] stats 回放结果
+     * @return false 如果地址不是回环地址或无效
+     */
+    bool run(ReplayStatistics& stats) {
+        stats = ReplayStatistics();
+        std::memset(&server_addr_, 0, sizeof(server_addr_));
+        server_addr_.sin_family = AF_INET;
+        server_addr_.sin_port = htons(options_.port);
+        if (::inet_pton(AF_INET, options_.host.c_str(), &server_addr_.sin_addr) != 1 ||
+            (ntohl(server_addr_.sin_addr.s_addr) >> 24) != 127) {
+            std::cerr << "[Replay] Replay target must be a loopback address: " << options_.host << std::endl;
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& record : capture_.records()) {
+            if (options_.speed > 0) {
+                auto due = start + std::chrono::nanoseconds(
+                    static_cast<int64_t>(record.offset_ns / options_.speed));
+                while (std::chrono::steady_clock::now() < due) {
+                    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        due - std::chrono::steady_clock::now()).count();
+                    pump(-1, static_cast<int>(std::max<int64_t>(remaining, 0)), stats);
+                }
+            }
+
+            switch (record.kind) {
+                case IngestRecordKind::OPEN:
+                    open_connection(record.connection, stats);
+                    break;
+                case IngestRecordKind::DATA: {
+                    int fd = open_connection(record.connection, stats);
+                    if (fd >= 0 && send_all(fd, record.data, record.length, stats)) {
+                        stats.records++;
+                        stats.bytes_sent += record.length;
+                    }
+                    break;
+                }
+                case IngestRecordKind::CLOSE: {
+                    auto it = sockets_.find(record.connection);
+                    if (it != sockets_.end() && it->second >= 0) {
+                        ::shutdown(it->second, SHUT_WR);
+                    }
+                    break;
+                }
+            }
+        }
+        stats.elapsed_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+
+        // 关闭写方向，读完服务器剩余的响应
+        for (auto& [connection, fd] : sockets_) {
+            if (fd >= 0) {
+                ::shutdown(fd, SHUT_WR);
+            }
+        }
+        auto drain_deadline = std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(options_.drain_timeout_ms);
+        while (open_sockets() > 0 && std::chrono::steady_clock::now() < drain_deadline) {
+            pump(-1, 10, stats);
+        }
+        return true;
+    }
+
+private:
+    /**
+     * @brief 返回录制连接对应的回放套接字，第一次使用时建立连接
+     *
+     * @return 套接字；连接失败时返回-1（之后该连接的数据都跳过）
+     */
+    int open_connection(uint32_t connection, ReplayStatistics& stats) {
+        auto it = sockets_.find(connection);
+        if (it != sockets_.end()) {
+            return it->second;
+        }
+
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&server_addr_), sizeof(server_addr_)) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        if (fd < 0) {
+            stats.failed_connections++;
+            std::cerr << "[Replay] Failed to connect for recorded connection #" << connection << std::endl;
+        } else {
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            stats.connections++;
+        }
+        sockets_[connection] = fd;
+        return fd;
+    }
+
+    /**
+     * @brief 写完一段数据；等待可写时继续读取所有连接的响应
+     */
+    bool send_all(int fd, const uint8_t* data, size_t length, ReplayStatistics& stats) {
+        size_t offset = 0;
+        while (offset < length) {
+            ssize_t sent = ::send(fd, data + offset, length - offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent > 0) {
+                offset += static_cast<size_t>(sent);
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                pump(fd, 100, stats);
+                continue;
+            }
+            // 服务器已关闭连接：该连接之后的数据都跳过
+            stats.failed_sends++;
+            close_socket(fd);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 读取并丢弃所有连接上已到达的响应
+     *
+     * @param writer 正在等待可写的套接字（-1表示没有）
+     * @param timeout_ms poll超时
+     */
+    void pump(int writer, int timeout_ms, ReplayStatistics& stats) {
+        poll_fds_.clear();
+        for (const auto& [connection, fd] : sockets_) {
+            if (fd >= 0) {
+                short events = POLLIN;
+                if (fd == writer) {
+                    events |= POLLOUT;
+                }
+                poll_fds_.push_back(pollfd{fd, events, 0});
+            }
+        }
+        if (poll_fds_.empty()) {
+            if (timeout_ms > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+            }
+            return;
+        }
+
+        if (::poll(poll_fds_.data(), poll_fds_.size(), timeout_ms) <= 0) {
+            return;
+        }
+
+        uint8_t buffer[65536];
+        for (const auto& p : poll_fds_) {
+            if ((p.revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+                continue;
+            }
+            ssize_t n = ::recv(p.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n > 0) {
+                stats.bytes_received += static_cast<uint64_t>(n);
+            } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                close_socket(p.fd);
+            }
+        }
+    }
+
+    void close_socket(int fd) {
+        for (auto& [connection, socket] : sockets_) {
+            if (socket == fd) {
+                ::close(fd);
+                socket = -1;
+                return;
+            }
+        }
+    }
+
+    size_t open_sockets() const {
+        size_t count = 0;
+        for (const auto& [connection, fd] : sockets_) {
+            if (fd >= 0) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    const IngestCaptureReader& capture_;
+    ReplayOptions options_;
+    struct sockaddr_in server_addr_;
+    std::unordered_map<uint32_t, int> sockets_;     // 录制连接ID -> 回放套接字（-1表示已关闭或失败）
+    std::vector<pollfd> poll_fds_;
+};
+#endif
+
+#endif // INGEST_CAPTURE_H
@@ -0,0 +1,915 @@
+/*
+ * avserver_loadgen.cpp - 端到端负载生成器（模拟发布者和订阅者）
+ *
+ * 用MessageProtocol.h的线协议连接AVServer：
+ * - 发布者：按配置帧率发送带simulcast帧头的VIDEO_FRAME和AUDIO_FRAME
+ * - 订阅者：发送START_STREAM订阅某个发布者的流，定时发送HEARTBEAT，
+ *   可选发送SET_BITRATE；统计收到的视频帧
+ * 所有连接分布在少量epoll事件循环线程上（EventLoop.h），单机可以模拟上千个订阅者。
+ *
+ * 发布者在每帧的simulcast帧头之后写入负载标记：
+ *   [magic "LGEN":4][流内序号:8][发送时刻（steady_clock纳秒）:8]
+ * 订阅者据此计算端到端延迟（同一台机器上steady_clock在进程间一致）、
+ * 序号空洞（gap，一次跳跃记一次）和丢失帧数（跳过的序号总数）。
+ *
+ * 输出：
+ * - 每秒一行进度（连接数、收发帧数）
+ * - 结束时的汇总：每个订阅者的帧率/码率分布、空洞与丢帧、端到端延迟分位数
+ * - --csv FILE：每个订阅者一行的明细
+ *
+ * 编译方式：
+ *   g++ -std=c++17 -O2 -pthread -I.. -o avserver_loadgen avserver_loadgen.cpp
+ *   （或在bench目录下执行 make avserver_loadgen，make bench 构建全部）
+ *
+ * 运行方式（先启动服务器：./avserver 8888）：
+ *   ./avserver_loadgen --subscribers 2000 --publishers 4 --fps 30 --duration 30
+ *   ./avserver_loadgen --subscribers 500 --bitrate 2000000 --csv clients.csv
+ *
+ * @note 连接数较多时需要提高文件描述符上限（启动时自动提高到硬上限）
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "AVServer_06_MessageProtocol.h"
+#include "AVServer_17_SimulcastForwarder.h"
+#include "AVServer_24_EventLoop.h"
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint32_t LOADGEN_MAGIC = 0x4C47454E;      // "LGEN"
+static constexpr size_t LOADGEN_MARK_SIZE = 20;             // magic + 序号 + 发送时刻
+static constexpr size_t MAX_SEND_BACKLOG = 4 * 1024 * 1024; // 发布者未发出的数据超过此值时丢帧
+
+// ============================================================================
+// ======================== 配置 ==============================================
+// ============================================================================
+
+struct LoadConfig {
+    std::string host;
+    uint16_t port;
+    int subscribers;                // 订阅者连接数
+    int publishers;                 // 发布者连接数（每个发布一路流）
+    int fps;                        // 每路视频帧率
+    int frame_bytes;                // 每个视频帧的消息体大小
+    int gop;                        // 关键帧间隔（帧）
+    int audio_fps;                  // 每路音频帧率（0表示不发音频）
+    int audio_bytes;                // 每个音频帧的消息体大小
+    int heartbeat_ms;               // 订阅者心跳间隔
+    uint32_t bitrate;               // 订阅者SET_BITRATE的值（0表示不发送）
+    int duration_s;                 // 运行时长（秒，从开始建立连接算起）
+    int threads;                    // 事件循环线程数
+    int connect_rate;               // 每秒新建连接数（0表示不限制）
+    uint32_t stream_base;           // 第一路流的stream_id
+    std::string csv_path;           // 每个订阅者的明细输出（空表示不输出）
+
+    LoadConfig()
+        : host("127.0.0.1"),
+          port(8888),
+          subscribers(100),
+          publishers(1),
+          fps(30),
+          frame_bytes(12000),
+          gop(30),
+          audio_fps(50),
+          audio_bytes(160),
+          heartbeat_ms(5000),
+          bitrate(0),
+          duration_s(10),
+          threads(2),
+          connect_rate(1000),
+          stream_base(1000),
+          csv_path() {
+    }
+};
+
+// ============================================================================
+// ======================== 延迟直方图 ========================================
+// ============================================================================
+
+/**
+ * @class LatencyHistogram
+ * @brief 对数分桶的延迟直方图（微秒），相对误差约6%，内存固定
+ *
+ * 每个2的幂区间分16个子桶；订阅者很多时不保存原始样本
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKETS = 16;
+    static constexpr int MAX_EXPONENT = 32;
+
+    LatencyHistogram()
+        : counts_(SUB_BUCKETS * MAX_EXPONENT, 0),
+          total_(0),
+          max_us_(0) {
+    }
+
+    void record(uint64_t us) {
+        counts_[index_of(us)]++;
+        total_++;
+        max_us_ = std::max(max_us_, us);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        max_us_ = std::max(max_us_, other.max_us_);
+    }
+
+    uint64_t count() const {
+        return total_;
+    }
+
+    uint64_t max_us() const {
+        return max_us_;
+    }
+
+    /**
+     * @brief 分位数（返回所在桶的上界）
+     */
+    uint64_t percentile_us(double p) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank && counts_[i] > 0) {
+                return std::min(upper_bound_of(i), max_us_);
+            }
+        }
+        return max_us_;
+    }
+
+private:
+    static size_t index_of(uint64_t us) {
+        if (us < SUB_BUCKETS) {
+            return static_cast<size_t>(us);
+        }
+        int exponent = 63 - __builtin_clzll(us);                 // us >= 16 时 >= 4
+        int shift = exponent - 4;
+        size_t sub = static_cast<size_t>((us >> shift) - SUB_BUCKETS);
+        size_t index = static_cast<size_t>(shift + 1) * SUB_BUCKETS + sub;
+        return std::min(index, static_cast<size_t>(SUB_BUCKETS * MAX_EXPONENT - 1));
+    }
+
+    static uint64_t upper_bound_of(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+        uint64_t sub = index % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t max_us_;
+};
+
+// ============================================================================
+// ======================== 客户端 ============================================
+// ============================================================================
+
+enum class ClientRole {
+    PUBLISHER,
+    SUBSCRIBER,
+};
+
+/**
+ * @struct LoadClient
+ * @brief 一个模拟连接（只在所属事件循环线程中访问，结束后由主线程汇总）
+ */
+struct LoadClient {
+    int index;
+    ClientRole role;
+    uint32_t stream_id;
+    EventLoop* loop;
+    int fd;
+    bool connected;
+    bool closed;
+
+    std::vector<uint8_t> in;                // 未解析的接收数据
+    std::vector<uint8_t> out;               // 未发出的数据
+    size_t out_offset;
+    bool write_pending;                     // 正在等待可写
+
+    // 发布者
+    uint64_t next_seq;
+    Clock::time_point next_video;
+    Clock::time_point next_audio;
+    uint64_t video_sent;
+    uint64_t audio_sent;
+    uint64_t send_drops;                    // 发送积压过多而丢弃的帧
+
+    // 订阅者
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t acks;
+    uint64_t heartbeat_acks;
+    uint64_t gaps;
+    uint64_t lost;
+    uint64_t reordered;
+    bool has_seq;
+    uint64_t last_seq;
+    Clock::time_point first_frame;
+    Clock::time_point last_frame;
+    LatencyHistogram latency;
+
+    LoadClient(int idx, ClientRole r, uint32_t stream, EventLoop* l)
+        : index(idx), role(r), stream_id(stream), loop(l), fd(-1),
+          connected(false), closed(false), out_offset(0), write_pending(false),
+          next_seq(0), video_sent(0), audio_sent(0), send_drops(0),
+          frames(0), bytes(0), acks(0), heartbeat_acks(0),
+          gaps(0), lost(0), reordered(0), has_seq(false), last_seq(0) {
+    }
+
+    size_t backlog() const {
+        return out.size() - out_offset;
+    }
+};
+
+/**
+ * @class LoadGenerator
+ * @brief 建立连接、驱动发布和订阅，并汇总统计
+ */
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const LoadConfig& config)
+        : config_(config),
+          connected_(0),
+          failed_(0),
+          closed_(0),
+          video_sent_(0),
+          frames_received_(0),
+          bytes_received_(0) {
+    }
+
+    bool run() {
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(config_.port);
+        if (::inet_pton(AF_INET, config_.host.c_str(), &addr.sin_addr) != 1) {
+            std::cerr << "[LoadGen] Invalid host: " << config_.host << std::endl;
+            return false;
+        }
+        server_addr_ = addr;
+
+        for (int i = 0; i < std::max(1, config_.threads); ++i) {
+            loops_.push_back(std::make_unique<EventLoop>());
+            loops_.back()->start();
+        }
+
+        // 发布者先连接，订阅者订阅时流已经存在
+        for (int i = 0; i < config_.publishers; ++i) {
+            add_client(ClientRole::PUBLISHER, config_.stream_base + i);
+        }
+        for (int i = 0; i < config_.subscribers; ++i) {
+            uint32_t stream = config_.stream_base + (config_.publishers > 0 ? i % config_.publishers : 0);
+            add_client(ClientRole::SUBSCRIBER, stream);
+        }
+
+        auto start = Clock::now();
+        auto end = start + std::chrono::seconds(config_.duration_s);
+        size_t started = 0;
+        auto next_report = start + std::chrono::seconds(1);
+
+        while (Clock::now() < end) {
+            // 按连接速率分批发起连接
+            size_t target = clients_.size();
+            if (config_.connect_rate > 0) {
+                double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+                target = std::min(clients_.size(),
+                                  static_cast<size_t>(config_.connect_rate * elapsed) + 1);
+            }
+            for (; started < target; ++started) {
+                LoadClient* client = clients_[started].get();
+                client->loop->post([this, client] { begin_connect(client); });
+            }
+
+            if (Clock::now() >= next_report) {
+                report_progress(std::chrono::duration<double>(Clock::now() - start).count());
+                next_report += std::chrono::seconds(1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        for (auto& loop : loops_) {
+            loop->stop();
+        }
+        for (auto& client : clients_) {
+            if (client->fd >= 0) {
+                ::close(client->fd);
+                client->fd = -1;
+            }
+        }
+
+        print_summary(std::chrono::duration<double>(Clock::now() - start).count());
+        if (!config_.csv_path.empty()) {
+            write_csv(config_.csv_path);
+        }
+        return true;
+    }
+
+private:
+    void add_client(ClientRole role, uint32_t stream) {
+        EventLoop* loop = loops_[clients_.size() % loops_.size()].get();
+        clients_.push_back(std::make_unique<LoadClient>(
+            static_cast<int>(clients_.size()), role, stream, loop));
+    }
+
+    // ===== 连接 =====
+
+    void begin_connect(LoadClient* client) {
+        client->fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (client->fd < 0) {
+            fail(client);
+            return;
+        }
+        int one = 1;
+        ::setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        int rc = ::connect(client->fd, reinterpret_cast<const struct sockaddr*>(&server_addr_),
+                           sizeof(server_addr_));
+        if (rc == 0) {
+            on_connected(client);
+            return;
+        }
+        if (errno != EINPROGRESS) {
+            fail(client);
+            return;
+        }
+
+        client->loop->await_io(client->fd, IoEvent::WRITABLE, 5000, [this, client](IoResult result) {
+            if (result != IoResult::READY) {
+                if (result != IoResult::CLOSED) {
+                    fail(client);
+                }
+                return;
+            }
+            int error = 0;
+            socklen_t len = sizeof(error);
+            ::getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0) {
+                fail(client);
+                return;
+            }
+            on_connected(client);
+        });
+    }
+
+    void on_connected(LoadClient* client) {
+        client->connected = true;
+        connected_++;
+        arm_read(client);
+
+        auto now = Clock::now();
+        if (client->role == ClientRole::PUBLISHER) {
+            client->next_video = now;
+            client->next_audio = now;
+            schedule_video(client);
+            if (config_.audio_fps > 0) {
+                schedule_audio(client);
+            }
+            return;
+        }
+
+        // 订阅：START_STREAM携带stream_id（小端序）
+        uint8_t stream[4];
+        write_le32(stream, client->stream_id);
+        send_message(client, MessageType::START_STREAM, stream, sizeof(stream));
+
+        if (config_.bitrate > 0) {
+            uint8_t bitrate[4];
+            write_le32(bitrate, config_.bitrate);
+            send_message(client, MessageType::SET_BITRATE, bitrate, sizeof(bitrate));
+        }
+        schedule_heartbeat(client);
+    }
+
+    void fail(LoadClient* client) {
+        failed_++;
+        close_client(client, false);
+    }
+
+    void close_client(LoadClient* client, bool by_peer) {
+        if (client->closed) {
+            return;
+        }
+        client->closed = true;
+        if (by_peer) {
+            closed_++;
+        }
+        if (client->fd >= 0) {
+            client->loop->remove_fd(client->fd);
+            ::close(client->fd);
+            client->fd = -1;
+        }
+    }
+
+    // ===== 定时发送 =====
+
+    static int delay_ms_until(Clock::time_point when) {
+        auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(when - Clock::now()).count();
+        return delay > 0 ? static_cast<int>(delay) : 0;
+    }
+
+    void schedule_video(LoadClient* client) {
+        client->loop->run_after(delay_ms_until(client->next_video), [this, client] {
+            if (client->closed) {
+                return;
+            }
+            // 定时器晚到时补发错过的帧，保持平均帧率
+            auto interval = std::chrono::microseconds(1000000 / std::max(1, config_.fps));
+            while (client->next_video <= Clock::now()) {
+                send_video_frame(client);
+                client->next_video += interval;
+            }
+            schedule_video(client);
+        });
+    }
+
+    void schedule_audio(LoadClient* client) {
+        client->loop->run_after(delay_ms_until(client->next_audio), [this, client] {
+            if (client->closed) {
+                return;
+            }
+            auto interval = std::chrono::microseconds(1000000 / config_.audio_fps);
+            std::vector<uint8_t> payload(static_cast<size_t>(std::max(1, config_.audio_bytes)), 0x11);
+            while (client->next_audio <= Clock::now()) {
+                if (client->backlog() < MAX_SEND_BACKLOG) {
+                    send_message(client, MessageType::AUDIO_FRAME, payload.data(),
+                                 static_cast<uint32_t>(payload.size()));
+                    client->audio_sent++;
+                }
+                client->next_audio += interval;
+            }
+            schedule_audio(client);
+        });
+    }
+
+    void schedule_heartbeat(LoadClient* client) {
+        client->loop->run_after(config_.heartbeat_ms, [this, client] {
+            if (client->closed) {
+                return;
+            }
+            send_message(client, MessageType::HEARTBEAT, nullptr, 0);
+            schedule_heartbeat(client);
+        });
+    }
+
+    void send_video_frame(LoadClient* client) {
+        uint64_t seq = client->next_seq++;
+        if (client->backlog() >= MAX_SEND_BACKLOG) {
+            client->send_drops++;
+            return;
+        }
+
+        size_t size = std::max(SimulcastFrameHeader::HEADER_SIZE + LOADGEN_MARK_SIZE,
+                               static_cast<size_t>(config_.frame_bytes));
+        std::vector<uint8_t> payload(size, 0x22);
+
+        SimulcastFrameHeader header;
+        header.stream_id = client->stream_id;
+        header.layer_id = 0;
+        header.frame_type = static_cast<uint8_t>(
+            seq % static_cast<uint64_t>(std::max(1, config_.gop)) == 0
+                ? FrameType::VIDEO_I_FRAME : FrameType::VIDEO_P_FRAME);
+        header.layer_bitrate = static_cast<uint32_t>(
+            std::min<uint64_t>(UINT32_MAX, static_cast<uint64_t>(size) * 8 * config_.fps));
+        header.serialize(payload.data());
+
+        uint8_t* mark = payload.data() + SimulcastFrameHeader::HEADER_SIZE;
+        write_le32(mark, LOADGEN_MAGIC);
+        write_le64(mark + 4, seq);
+        write_le64(mark + 12, now_ns());
+
+        send_message(client, MessageType::VIDEO_FRAME, payload.data(), static_cast<uint32_t>(size));
+        client->video_sent++;
+        video_sent_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // ===== 发送 =====
+
+    void send_message(LoadClient* client, MessageType type, const uint8_t* payload, uint32_t size) {
+        if (client->closed) {
+            return;
+        }
+
+        MessageHeader header(type, size, ProtocolHelper::get_timestamp_ms());
+        size_t offset = client->out.size();
+        client->out.resize(offset + MessageHeader::HEADER_SIZE + size);
+        header.serialize(client->out.data() + offset);
+        if (size > 0) {
+            std::memcpy(client->out.data() + offset + MessageHeader::HEADER_SIZE, payload, size);
+        }
+        flush(client);
+    }
+
+    void flush(LoadClient* client) {
+        while (!client->closed && client->out_offset < client->out.size()) {
+            ssize_t sent = ::send(client->fd, client->out.data() + client->out_offset,
+                                  client->out.size() - client->out_offset, MSG_NOSIGNAL);
+            if (sent > 0) {
+                client->out_offset += static_cast<size_t>(sent);
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!client->write_pending) {
+                    client->write_pending = true;
+                    client->loop->await_io(client->fd, IoEvent::WRITABLE, -1, [this, client](IoResult result) {
+                        client->write_pending = false;
+                        if (result == IoResult::READY) {
+                            flush(client);
+                        }
+                    });
+                }
+                return;
+            }
+            close_client(client, true);
+            return;
+        }
+
+        if (client->out_offset >= client->out.size()) {
+            client->out.clear();
+            client->out_offset = 0;
+        } else if (client->out_offset > (1 << 20)) {
+            client->out.erase(client->out.begin(), client->out.begin() + client->out_offset);
+            client->out_offset = 0;
+        }
+    }
+
+    // ===== 接收 =====
+
+    void arm_read(LoadClient* client) {
+        client->loop->await_io(client->fd, IoEvent::READABLE, -1, [this, client](IoResult result) {
+            if (result != IoResult::READY || client->closed) {
+                return;
+            }
+
+            uint8_t buffer[64 * 1024];
+            while (true) {
+                ssize_t n = ::recv(client->fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    client->in.insert(client->in.end(), buffer, buffer + n);
+                    bytes_received_.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break;
+                }
+                close_client(client, true);
+                return;
+            }
+
+            if (!parse_messages(client)) {
+                std::cerr << "[LoadGen] Client #" << client->index << " received an invalid header" << std::endl;
+                close_client(client, true);
+                return;
+            }
+            arm_read(client);
+        });
+    }
+
+    /**
+     * @return false 如果遇到无效的消息头
+     */
+    bool parse_messages(LoadClient* client) {
+        size_t offset = 0;
+        while (client->in.size() - offset >= MessageHeader::HEADER_SIZE) {
+            MessageHeader header;
+            header.deserialize(client->in.data() + offset);
+            if (!header.is_valid()) {
+                return false;
+            }
+            size_t total = MessageHeader::HEADER_SIZE + header.payload_size;
+            if (client->in.size() - offset < total) {
+                break;
+            }
+
+            const uint8_t* payload = client->in.data() + offset + MessageHeader::HEADER_SIZE;
+            on_message(client, static_cast<MessageType>(header.type), payload,
+                       header.payload_size, total);
+            offset += total;
+        }
+        client->in.erase(client->in.begin(), client->in.begin() + offset);
+        return true;
+    }
+
+    void on_message(LoadClient* client, MessageType type, const uint8_t* payload,
+                    uint32_t size, size_t total) {
+        switch (type) {
+            case MessageType::ACK:
+                client->acks++;
+                break;
+            case MessageType::HEARTBEAT_ACK:
+                client->heartbeat_acks++;
+                break;
+            case MessageType::VIDEO_FRAME:
+                on_video_frame(client, payload, size, total);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void on_video_frame(LoadClient* client, const uint8_t* payload, uint32_t size, size_t total) {
+        auto now = Clock::now();
+        if (client->frames == 0) {
+            client->first_frame = now;
+        }
+        client->last_frame = now;
+        client->frames++;
+        client->bytes += total;
+        frames_received_.fetch_add(1, std::memory_order_relaxed);
+
+        if (size < SimulcastFrameHeader::HEADER_SIZE + LOADGEN_MARK_SIZE) {
+            return;
+        }
+        const uint8_t* mark = payload + SimulcastFrameHeader::HEADER_SIZE;
+        if (read_le32(mark) != LOADGEN_MAGIC) {
+            return;
+        }
+
+        uint64_t seq = read_le64(mark + 4);
+        uint64_t sent_ns = read_le64(mark + 12);
+        uint64_t recv_ns = now_ns();
+        client->latency.record(recv_ns > sent_ns ? (recv_ns - sent_ns) / 1000 : 0);
+
+        if (client->has_seq) {
+            if (seq > client->last_seq + 1) {
+                client->gaps++;
+                client->lost += seq - client->last_seq - 1;
+            } else if (seq <= client->last_seq) {
+                client->reordered++;
+                return;
+            }
+        }
+        client->has_seq = true;
+        client->last_seq = seq;
+    }
+
+    // ===== 报告 =====
+
+    void report_progress(double elapsed) {
+        std::printf("[LoadGen] t=%5.1fs connected=%llu failed=%llu closed=%llu sent=%llu recv=%llu (%.1f MB)\n",
+                    elapsed,
+                    static_cast<unsigned long long>(connected_.load()),
+                    static_cast<unsigned long long>(failed_.load()),
+                    static_cast<unsigned long long>(closed_.load()),
+                    static_cast<unsigned long long>(video_sent_.load()),
+                    static_cast<unsigned long long>(frames_received_.load()),
+                    bytes_received_.load() / 1e6);
+        std::fflush(stdout);
+    }
+
+    static double client_seconds(const LoadClient& c) {
+        return c.frames > 1 ? std::chrono::duration<double>(c.last_frame - c.first_frame).count() : 0.0;
+    }
+
+    static double client_fps(const LoadClient& c) {
+        double seconds = client_seconds(c);
+        return seconds > 0 ? (c.frames - 1) / seconds : 0.0;
+    }
+
+    static double client_mbps(const LoadClient& c) {
+        double seconds = client_seconds(c);
+        return seconds > 0 ? c.bytes * 8.0 / seconds / 1e6 : 0.0;
+    }
+
+    static double percentile(std::vector<double> values, double p) {
+        if (values.empty()) {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+        return values[index];
+    }
+
+    void print_summary(double elapsed) {
+        uint64_t pub_video = 0, pub_audio = 0, pub_drops = 0;
+        uint64_t frames = 0, gaps = 0, lost = 0, reordered = 0, starved = 0;
+        std::vector<double> fps;
+        std::vector<double> mbps;
+        LatencyHistogram latency;
+
+        for (const auto& c : clients_) {
+            if (c->role == ClientRole::PUBLISHER) {
+                pub_video += c->video_sent;
+                pub_audio += c->audio_sent;
+                pub_drops += c->send_drops;
+                continue;
+            }
+            if (!c->connected) {
+                continue;
+            }
+            frames += c->frames;
+            gaps += c->gaps;
+            lost += c->lost;
+            reordered += c->reordered;
+            if (c->frames == 0) {
+                starved++;
+            }
+            fps.push_back(client_fps(*c));
+            mbps.push_back(client_mbps(*c));
+            latency.merge(c->latency);
+        }
+
+        std::printf("\n=== Load summary (%.1fs, %d publishers, %d subscribers, %d threads) ===\n",
+                    elapsed, config_.publishers, config_.subscribers, config_.threads);
+        std::printf("connections: connected=%llu failed=%llu closed_by_server=%llu\n",
+                    static_cast<unsigned long long>(connected_.load()),
+                    static_cast<unsigned long long>(failed_.load()),
+                    static_cast<unsigned long long>(closed_.load()));
+        std::printf("publishers:  video=%llu audio=%llu send_drops=%llu (target %d fps x %d bytes)\n",
+                    static_cast<unsigned long long>(pub_video),
+                    static_cast<unsigned long long>(pub_audio),
+                    static_cast<unsigned long long>(pub_drops),
+                    config_.fps, config_.frame_bytes);
+        std::printf("subscribers: frames=%llu starved=%llu gaps=%llu lost=%llu reordered=%llu\n",
+                    static_cast<unsigned long long>(frames),
+                    static_cast<unsigned long long>(starved),
+                    static_cast<unsigned long long>(gaps),
+                    static_cast<unsigned long long>(lost),
+                    static_cast<unsigned long long>(reordered));
+        std::printf("per-client fps:  min=%.1f p10=%.1f p50=%.1f max=%.1f\n",
+                    percentile(fps, 0.0), percentile(fps, 0.10),
+                    percentile(fps, 0.50), percentile(fps, 1.0));
+        std::printf("per-client Mbps: min=%.2f p10=%.2f p50=%.2f max=%.2f\n",
+                    percentile(mbps, 0.0), percentile(mbps, 0.10),
+                    percentile(mbps, 0.50), percentile(mbps, 1.0));
+        std::printf("e2e latency (us): p50=%llu p90=%llu p99=%llu p999=%llu max=%llu (%llu samples)\n",
+                    static_cast<unsigned long long>(latency.percentile_us(0.50)),
+                    static_cast<unsigned long long>(latency.percentile_us(0.90)),
+                    static_cast<unsigned long long>(latency.percentile_us(0.99)),
+                    static_cast<unsigned long long>(latency.percentile_us(0.999)),
+                    static_cast<unsigned long long>(latency.max_us()),
+                    static_cast<unsigned long long>(latency.count()));
+    }
+
+    void write_csv(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "[LoadGen] Cannot write " << path << std::endl;
+            return;
+        }
+        file << "client,stream,connected,frames,fps,mbps,gaps,lost,reordered,acks,heartbeat_acks,"
+                "p50_us,p90_us,p99_us,max_us\n";
+        for (const auto& c : clients_) {
+            if (c->role != ClientRole::SUBSCRIBER) {
+                continue;
+            }
+            char line[320];
+            std::snprintf(line, sizeof(line),
+                          "%d,%u,%d,%llu,%.2f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                          c->index, c->stream_id, c->connected ? 1 : 0,
+                          static_cast<unsigned long long>(c->frames), client_fps(*c), client_mbps(*c),
+                          static_cast<unsigned long long>(c->gaps),
+                          static_cast<unsigned long long>(c->lost),
+                          static_cast<unsigned long long>(c->reordered),
+                          static_cast<unsigned long long>(c->acks),
+                          static_cast<unsigned long long>(c->heartbeat_acks),
+                          static_cast<unsigned long long>(c->latency.percentile_us(0.50)),
+                          static_cast<unsigned long long>(c->latency.percentile_us(0.90)),
+                          static_cast<unsigned long long>(c->latency.percentile_us(0.99)),
+                          static_cast<unsigned long long>(c->latency.max_us()));
+            file << line;
+        }
+        std::cout << "[LoadGen] Per-client results written to " << path << std::endl;
+    }
+
+    // ===== 工具函数 =====
+
+    static uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count());
+    }
+
+    static void write_le32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    static void write_le64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    static uint32_t read_le32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        return v;
+    }
+
+    static uint64_t read_le64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        return v;
+    }
+
+private:
+    LoadConfig config_;
+    struct sockaddr_in server_addr_;
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::vector<std::unique_ptr<LoadClient>> clients_;
+
+    std::atomic<uint64_t> connected_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> closed_;
+    std::atomic<uint64_t> video_sent_;
+    std::atomic<uint64_t> frames_received_;
+    std::atomic<uint64_t> bytes_received_;
+};
+
+// ============================================================================
+// ======================== 入口 ==============================================
+// ============================================================================
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --host ADDR          server address (default 127.0.0.1)\n"
+              << "  --port N             server port (default 8888)\n"
+              << "  --subscribers N      subscriber connections (default 100)\n"
+              << "  --publishers N       publisher connections, one stream each (default 1)\n"
+              << "  --fps N              video frames per second per publisher (default 30)\n"
+              << "  --frame-bytes N      video frame payload size (default 12000)\n"
+              << "  --gop N              keyframe interval in frames (default 30)\n"
+              << "  --audio-fps N        audio frames per second per publisher, 0 = off (default 50)\n"
+              << "  --audio-bytes N      audio frame payload size (default 160)\n"
+              << "  --heartbeat-ms N     subscriber heartbeat interval (default 5000)\n"
+              << "  --bitrate BPS        send SET_BITRATE after subscribing (default off)\n"
+              << "  --duration S         run time in seconds (default 10)\n"
+              << "  --threads N          epoll threads (default 2)\n"
+              << "  --connect-rate N     new connections per second, 0 = unlimited (default 1000)\n"
+              << "  --stream-base ID     stream_id of the first publisher (default 1000)\n"
+              << "  --csv FILE           write per-subscriber results\n";
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        auto next_int = [&]() { return std::atoi(argv[++i]); };
+
+        if (arg == "--host" && has_value) config.host = argv[++i];
+        else if (arg == "--port" && has_value) config.port = static_cast<uint16_t>(next_int());
+        else if (arg == "--subscribers" && has_value) config.subscribers = std::max(0, next_int());
+        else if (arg == "--publishers" && has_value) config.publishers = std::max(0, next_int());
+        else if (arg == "--fps" && has_value) config.fps = std::max(1, next_int());
+        else if (arg == "--frame-bytes" && has_value) config.frame_bytes = std::max(1, next_int());
+        else if (arg == "--gop" && has_value) config.gop = std::max(1, next_int());
+        else if (arg == "--audio-fps" && has_value) config.audio_fps = std::max(0, next_int());
+        else if (arg == "--audio-bytes" && has_value) config.audio_bytes = std::max(1, next_int());
+        else if (arg == "--heartbeat-ms" && has_value) config.heartbeat_ms = std::max(100, next_int());
+        else if (arg == "--bitrate" && has_value) config.bitrate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--duration" && has_value) config.duration_s = std::max(1, next_int());
+        else if (arg == "--threads" && has_value) config.threads = std::max(1, next_int());
+        else if (arg == "--connect-rate" && has_value) config.connect_rate = std::max(0, next_int());
+        else if (arg == "--stream-base" && has_value) config.stream_base = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--csv" && has_value) config.csv_path = argv[++i];
+        else {
+            print_usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // 每个连接一个fd，提高到硬上限
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::cout << "[LoadGen] " << config.publishers << " publishers, " << config.subscribers
+              << " subscribers -> " << config.host << ":" << config.port << std::endl;
+
+    LoadGenerator generator(config);
+    return generator.run() ? 0 : 1;
+}
@@ -0,0 +1,344 @@
+/*
+ * avserver_replay.cpp - 回放录制的入站流量（IngestCapture.h），作为吞吐回归基线
+ *
+ * 先用 ./avserver --capture-ingest ingest.avcap 录制一段真实流量（退出服务器时写入索引），
+ * 之后每次改动都回放同一个文件：
+ * - 默认回放到已运行的服务器（只允许回环地址）
+ * - --self：在进程内启动TcpServer接收回放，并逐连接比较收到的消息序列摘要
+ *   与录制文件中的是否一致（验证回放是确定的）
+ *
+ * 输出：
+ * - 每次回放一行：连接数、字节数、耗时、吞吐（--self时另有服务器收完全部消息的耗时）
+ * - --baseline FILE：每次回放追加一行CSV，并与同一录制文件、速度和模式的上一次结果比较
+ *
+ * 编译方式：
+ *   g++ -std=c++20 -O2 -pthread -I.. -o avserver_replay avserver_replay.cpp
+ *   （或在bench目录下执行 make avserver_replay，make bench 构建全部）
+ *
+ * 运行方式：
+ *   ./avserver_replay --file ingest.avcap --info
+ *   ./avserver_replay --file ingest.avcap --port 8888              # 原始节奏
+ *   ./avserver_replay --file ingest.avcap --port 8888 --speed 4    # 4倍速
+ *   ./avserver_replay --file ingest.avcap --self --fast --runs 5 --baseline replay.csv
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "AVServer_07_TcpServer.h"
+#include "AVServer_08_Connection.h"
+#include "AVServer_37_IngestCapture.h"
+
+using Clock = std::chrono::steady_clock;
+
+// ============================================================================
+// ======================== 配置 ==============================================
+// ============================================================================
+
+struct ReplayConfig {
+    std::string file;               // 录制文件
+    ReplayOptions replay;           // 地址、端口、速度
+    bool self;                      // 在进程内启动TcpServer并校验消息序列
+    bool info;                      // 只输出录制文件的索引
+    int runs;                       // 回放次数
+    std::string baseline_path;      // 回归基线CSV（空表示不写）
+
+    ReplayConfig()
+        : self(false),
+          info(false),
+          runs(1) {
+    }
+};
+
+/**
+ * @struct RunResult
+ * @brief 一次回放的结果（写入基线CSV的字段）
+ */
+struct RunResult {
+    ReplayStatistics replay;
+    double server_ms;               // --self：从开始回放到服务器收到最后一条消息（否则为0）
+    bool verified;                  // --self：消息序列与录制一致
+
+    RunResult()
+        : server_ms(0.0),
+          verified(false) {
+    }
+
+    double mbps() const {
+        double ms = server_ms > 0 ? server_ms : replay.elapsed_ms;
+        return ms > 0 ? replay.bytes_sent * 8.0 / (ms * 1000.0) : 0.0;
+    }
+};
+
+// ============================================================================
+// ======================== 进程内接收端 ======================================
+// ============================================================================
+
+/**
+ * @class DigestServer
+ * @brief 进程内的TcpServer，对每个连接收到的消息计算摘要
+ */
+class DigestServer {
+public:
+    explicit DigestServer(uint16_t port)
+        : server_(make_config(port)),
+          messages_(0),
+          last_message_ns_(0) {
+        server_.set_on_message_received([this](const std::shared_ptr<Connection>& conn, const Message& message) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                digests_[conn->get_id()].add(message);
+            }
+            last_message_ns_.store(TimeService::instance().fine_now_ns(), std::memory_order_relaxed);
+            messages_.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    bool start() {
+        return server_.start();
+    }
+
+    void stop() {
+        server_.stop();
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        digests_.clear();
+        messages_.store(0);
+        last_message_ns_.store(0);
+    }
+
+    uint64_t messages() const {
+        return messages_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t last_message_ns() const {
+        return last_message_ns_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 各连接的（消息数，摘要），排序后与录制一侧比较（服务器的连接ID与录制时不同）
+     */
+    std::vector<std::pair<uint64_t, uint64_t>> sequences() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::pair<uint64_t, uint64_t>> result;
+        for (const auto& [id, digest] : digests_) {
+            result.emplace_back(digest.count(), digest.value());
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+private:
+    static ServerConfig make_config(uint16_t port) {
+        ServerConfig config;
+        config.port = port;
+        config.listen_addr = "127.0.0.1";
+        config.flight_recorder = false;
+        return config;
+    }
+
+    TcpServer server_;
+    mutable std::mutex mutex_;
+    std::map<uint32_t, IngestMessageDigest> digests_;
+    std::atomic<uint64_t> messages_;
+    std::atomic<uint64_t> last_message_ns_;
+};
+
+/**
+ * @brief 录制文件中各连接的（消息数，摘要），排序后返回；没有消息的连接不计入
+ */
+static std::vector<std::pair<uint64_t, uint64_t>> expected_sequences(const IngestCaptureReader& capture,
+                                                                     uint64_t& total_messages) {
+    std::vector<std::pair<uint64_t, uint64_t>> result;
+    total_messages = 0;
+    for (const auto& [connection, digest] : ingest_expected_digests(capture)) {
+        if (!digest.valid()) {
+            std::cerr << "[Replay] Recorded connection #" << connection
+                      << " contains an invalid message header; sequence check covers the valid prefix" << std::endl;
+        }
+        if (digest.count() > 0) {
+            result.emplace_back(digest.count(), digest.value());
+            total_messages += digest.count();
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// ============================================================================
+// ======================== 回归基线 ==========================================
+// ============================================================================
+
+/**
+ * @brief 追加一行结果，并与同一文件、速度和模式的上一行比较
+ */
+static void update_baseline(const ReplayConfig& config, const RunResult& result) {
+    double previous = 0.0;
+    {
+        std::ifstream in(config.baseline_path);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::stringstream row(line);
+            std::vector<std::string> fields;
+            std::string field;
+            while (std::getline(row, field, ',')) {
+                fields.push_back(field);
+            }
+            if (fields.size() >= 9 && fields[1] == config.file &&
+                std::atof(fields[2].c_str()) == config.replay.speed &&
+                fields[3] == (config.self ? "self" : "server")) {
+                previous = std::atof(fields[8].c_str());
+            }
+        }
+    }
+
+    bool exists = std::ifstream(config.baseline_path).good();
+    std::ofstream out(config.baseline_path, std::ios::app);
+    if (!out) {
+        std::cerr << "[Replay] Cannot write baseline " << config.baseline_path << std::endl;
+        return;
+    }
+    if (!exists) {
+        out << "time,file,speed,mode,connections,bytes,replay_ms,server_ms,mbps,verified\n";
+    }
+    char line[512];
+    std::snprintf(line, sizeof(line), "%lld,%s,%g,%s,%llu,%llu,%.1f,%.1f,%.2f,%d\n",
+                  static_cast<long long>(std::time(nullptr)), config.file.c_str(), config.replay.speed,
+                  config.self ? "self" : "server",
+                  static_cast<unsigned long long>(result.replay.connections),
+                  static_cast<unsigned long long>(result.replay.bytes_sent),
+                  result.replay.elapsed_ms, result.server_ms, result.mbps(), result.verified ? 1 : 0);
+    out << line;
+
+    if (previous > 0) {
+        std::printf("[Replay] Baseline: %.2f Mbps -> %.2f Mbps (%+.1f%%)\n",
+                    previous, result.mbps(), (result.mbps() / previous - 1.0) * 100.0);
+    }
+}
+
+// ============================================================================
+// ======================== 入口 ==============================================
+// ============================================================================
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " --file CAPTURE [options]\n"
+              << "  --file FILE          capture written by avserver --capture-ingest\n"
+              << "  --info               print the capture index and exit\n"
+              << "  --host ADDR          loopback address of the server (default 127.0.0.1)\n"
+              << "  --port N             server port (default 8888)\n"
+              << "  --speed X            1 = original pacing, N = N times faster (default 1)\n"
+              << "  --fast               send as fast as possible (same as --speed 0)\n"
+              << "  --self               replay into an in-process TcpServer and verify message sequences\n"
+              << "  --runs N             number of replays (default 1)\n"
+              << "  --baseline FILE      append results to a CSV and compare with the previous run\n";
+}
+
+int main(int argc, char* argv[]) {
+    ReplayConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--file" && has_value) config.file = argv[++i];
+        else if (arg == "--info") config.info = true;
+        else if (arg == "--host" && has_value) config.replay.host = argv[++i];
+        else if (arg == "--port" && has_value) config.replay.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--speed" && has_value) config.replay.speed = std::max(0.0, std::atof(argv[++i]));
+        else if (arg == "--fast") config.replay.speed = 0;
+        else if (arg == "--self") config.self = true;
+        else if (arg == "--runs" && has_value) config.runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--baseline" && has_value) config.baseline_path = argv[++i];
+        else {
+            print_usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (config.file.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    IngestCaptureReader capture;
+    if (!capture.load(config.file)) {
+        return 1;
+    }
+    std::cout << "[Replay] " << capture.to_string() << std::endl;
+
+    if (config.info) {
+        for (const auto& entry : capture.connections()) {
+            std::printf("  connection #%u: %u records, %llu bytes\n", entry.connection, entry.record_count,
+                        static_cast<unsigned long long>(entry.bytes));
+        }
+        return 0;
+    }
+
+    uint64_t expected_messages = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> expected;
+    std::unique_ptr<DigestServer> server;
+    if (config.self) {
+        expected = expected_sequences(capture, expected_messages);
+        server = std::make_unique<DigestServer>(config.replay.port);
+        if (!server->start()) {
+            std::cerr << "[Replay] Cannot start in-process server on port " << config.replay.port << std::endl;
+            return 1;
+        }
+    }
+
+    bool all_verified = true;
+    for (int run = 1; run <= config.runs; ++run) {
+        if (server) {
+            server->reset();
+        }
+
+        RunResult result;
+        uint64_t start_ns = TimeService::instance().fine_now_ns();
+        if (!IngestReplayer(capture, config.replay).run(result.replay)) {
+            return 1;
+        }
+
+        if (server) {
+            // 服务器可能还在处理最后的数据
+            auto deadline = Clock::now() + std::chrono::seconds(10);
+            while (server->messages() < expected_messages && Clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            uint64_t last = server->last_message_ns();
+            result.server_ms = last > start_ns ? (last - start_ns) / 1e6 : 0.0;
+            result.verified = server->sequences() == expected;
+            all_verified = all_verified && result.verified;
+        }
+
+        std::printf("[Replay] Run %d/%d: %s\n", run, config.runs, result.replay.to_string().c_str());
+        if (server) {
+            std::printf("[Replay] Run %d/%d: server received %llu/%llu messages in %.1f ms = %.2f Mbps, "
+                        "sequences %s\n",
+                        run, config.runs, static_cast<unsigned long long>(server->messages()),
+                        static_cast<unsigned long long>(expected_messages), result.server_ms, result.mbps(),
+                        result.verified ? "identical" : "DIFFER");
+        }
+        if (!config.baseline_path.empty()) {
+            update_baseline(config, result);
+        }
+    }
+
+    if (server) {
+        server->stop();
+    }
+    return all_verified ? 0 : 2;
+}
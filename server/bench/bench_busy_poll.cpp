@@ -0,0 +1,118 @@
+/*
+ * bench_busy_poll.cpp - 阶段输入通道自旋等待的代价与收益
+ *
+ * 生产者按固定间隔向BoundedChannel推送元素，消费者线程用pop_for取出，
+ * 对比不同自旋预算下：
+ * - 取数延迟（从入队到消费者拿到元素）的平均值和p99
+ * - 消费者线程消耗的CPU时间（getrusage按线程统计）
+ *
+ * 间隔小于自旋预算时大部分元素在自旋期间到达，省掉条件变量唤醒；
+ * 间隔远大于预算时自旋几乎总是落空，只多消耗CPU。
+ *
+ * 编译方式：
+ *   g++ -std=c++17 -O2 -pthread -I.. -o bench_busy_poll bench_busy_poll.cpp
+ *   （或在bench目录下执行 make bench_busy_poll，make bench 构建全部）
+ *
+ * 运行方式：
+ *   ./bench_busy_poll [元素数] [间隔us] [自旋预算us ...]
+ *   ./bench_busy_poll 20000 20 0 10 50 200
+ *
+ * @note 至少需要2个CPU，单CPU上自旋的消费者会和生产者争抢CPU
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+#include "AVServer_21_StageGraph.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchResult {
+    double avg_us;
+    double p99_us;
+    double consumer_cpu_ms;
+    SpinStatistics spin;
+};
+
+/**
+ * @brief 当前线程消耗的CPU时间（毫秒）
+ */
+static double thread_cpu_ms() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+static BenchResult run(int items, int interval_us, int spin_us) {
+    BoundedChannel<int> channel(1024);
+    channel.set_spin_us(spin_us);
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(items);
+    double cpu_ms = 0.0;
+
+    std::thread consumer([&] {
+        double cpu_start = thread_cpu_ms();
+        int value = 0;
+        uint64_t wait_ns = 0;
+        while (static_cast<int>(latencies.size()) < items) {
+            if (channel.pop_for(value, 100, wait_ns)) {
+                latencies.push_back(wait_ns);
+            }
+        }
+        cpu_ms = thread_cpu_ms() - cpu_start;
+    });
+
+    auto start = Clock::now();
+    for (int i = 0; i < items; ++i) {
+        std::this_thread::sleep_until(start + std::chrono::microseconds(interval_us) * (i + 1));
+        channel.try_push(i);
+    }
+    consumer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t total = 0;
+    for (uint64_t ns : latencies) {
+        total += ns;
+    }
+
+    BenchResult result;
+    result.avg_us = total / 1000.0 / latencies.size();
+    result.p99_us = latencies[latencies.size() * 99 / 100] / 1000.0;
+    result.consumer_cpu_ms = cpu_ms;
+    result.spin = channel.get_spin_statistics();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int items = argc >= 2 ? std::max(100, std::atoi(argv[1])) : 20000;
+    int interval_us = argc >= 3 ? std::max(1, std::atoi(argv[2])) : 20;
+
+    std::vector<int> budgets;
+    for (int i = 3; i < argc; ++i) {
+        budgets.push_back(std::max(0, std::atoi(argv[i])));
+    }
+    if (budgets.empty()) {
+        budgets = {0, 10, 50, 200};
+    }
+
+    std::printf("=== Channel pickup latency (%d items, interval %dus, %u cpus) ===\n",
+                items, interval_us, std::thread::hardware_concurrency());
+    for (int spin_us : budgets) {
+        BenchResult r = run(items, interval_us, spin_us);
+        std::printf("spin=%-5dus avg=%8.1fus p99=%8.1fus consumer_cpu=%8.1fms\n",
+                    spin_us, r.avg_us, r.p99_us, r.consumer_cpu_ms);
+        if (spin_us > 0) {
+            std::printf("             %s\n", r.spin.to_string().c_str());
+        }
+    }
+    return 0;
+}
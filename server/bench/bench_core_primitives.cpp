@@ -0,0 +1,476 @@
+/*
+ * bench_core_primitives.cpp - 基础组件的微基准测试套件
+ *
+ * 测量项：
+ * - safe_queue：SafeQueue在P个生产者、C个消费者下的push/pop吞吐
+ * - circular_buffer：CircularBuffer按不同块大小write/peek/read（容量不是块大小的整数倍，持续跨越回绕点）
+ * - frame_pool：FrameBufferPool在多线程争用下的get/return_frame
+ * - message_codec：Message::to_bytes/from_bytes在不同消息体大小下的吞吐
+ * - header_crc：MessageHeader::calculate_crc
+ * - thread_pool_roundtrip：ThreadPool::add_task提交空任务到future返回的往返延迟
+ * - stats_counter：多线程更新统计计数，ShardedCounters（sharded=1）对比互斥锁保护的结构体（sharded=0）
+ *
+ * 输出为JSON（标准输出），用于在版本之间比较回归；--format text输出便于阅读的表格。
+ * 不依赖第三方库：每个用例先小批量试跑，再按--min-time估算迭代次数。
+ *
+ * 编译方式：
+ *   g++ -std=c++17 -O2 -pthread -I.. -o bench_core_primitives bench_core_primitives.cpp
+ *   （或在bench目录下执行 make bench_core_primitives，make bench 构建全部）
+ *
+ * 运行方式：
+ *   ./bench_core_primitives [--filter 名称子串] [--min-time 毫秒] [--max-threads N] [--format json|text]
+ *   ./bench_core_primitives > baseline.json
+ *   ./bench_core_primitives --filter safe_queue --format text
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "AVServer_01_SafeQueue.h"
+#include "AVServer_02_CircularBuffer.h"
+#include "AVServer_03_FrameBuffer.h"
+#include "AVServer_04_ThreadPool.h"
+#include "AVServer_06_MessageProtocol.h"
+#include "AVServer_32_ShardedCounter.h"
+
+using Clock = std::chrono::steady_clock;
+
+// ============================================================================
+// ======================== 测量框架 ==========================================
+// ============================================================================
+
+struct BenchOptions {
+    std::string filter;             // 只运行名称包含该子串的用例
+    int min_time_ms;                // 每个用例至少运行的时间
+    size_t max_threads;             // 多线程用例的最大线程数
+    bool json;                      // 输出JSON（否则为文本表格）
+
+    BenchOptions()
+        : min_time_ms(200),
+          max_threads(std::max(2u, std::thread::hardware_concurrency())),
+          json(true) {
+    }
+};
+
+struct BenchResult {
+    std::string name;                                       // 用例名称
+    std::vector<std::pair<std::string, long long>> params;  // 参数（线程数、大小等）
+    uint64_t iterations;                                    // 总操作数
+    double seconds;                                         // 总耗时
+    uint64_t bytes;                                         // 处理的总字节数（0表示不适用）
+    std::vector<uint64_t> latencies_ns;                     // 单次操作延迟样本（可为空）
+
+    BenchResult()
+        : iterations(0),
+          seconds(0.0),
+          bytes(0) {
+    }
+
+    double ns_per_op() const {
+        return iterations > 0 ? seconds * 1e9 / iterations : 0.0;
+    }
+
+    double ops_per_sec() const {
+        return seconds > 0 ? iterations / seconds : 0.0;
+    }
+
+    uint64_t percentile_ns(double p) const {
+        if (latencies_ns.empty()) {
+            return 0;
+        }
+        std::vector<uint64_t> sorted(latencies_ns);
+        std::sort(sorted.begin(), sorted.end());
+        size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+        return sorted[index];
+    }
+
+    std::string full_name() const {
+        std::string text = name;
+        for (const auto& param : params) {
+            text += "/" + param.first + ":" + std::to_string(param.second);
+        }
+        return text;
+    }
+};
+
+/**
+ * @brief 按目标时长运行一个批量函数
+ *
+ * @param batch 执行n次操作并返回实际耗时（秒）
+ * @return 总操作数和总耗时
+ *
+ * 从1次开始试跑，每轮把次数放大到预计达到min_time为止
+ */
+static BenchResult run_timed(const BenchOptions& options,
+                             const std::function<double(uint64_t)>& batch) {
+    BenchResult result;
+    double target = options.min_time_ms / 1000.0;
+    uint64_t n = 1;
+
+    while (true) {
+        double seconds = batch(n);
+        if (seconds >= target || n >= (1ull << 40)) {
+            result.iterations = n;
+            result.seconds = seconds;
+            return result;
+        }
+        double scale = seconds > 0 ? target / seconds * 1.2 : 100.0;
+        n = static_cast<uint64_t>(n * std::min(100.0, std::max(2.0, scale)));
+    }
+}
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief 1, 2, 4, ... 直到max（包含max）
+ */
+static std::vector<size_t> thread_counts(size_t max) {
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(max);
+    return counts;
+}
+
+// ============================================================================
+// ======================== 用例 ==============================================
+// ============================================================================
+
+static BenchResult bench_safe_queue(const BenchOptions& options, size_t producers, size_t consumers) {
+    BenchResult result = run_timed(options, [&](uint64_t n) {
+        SafeQueue<uint64_t> queue;
+        std::atomic<uint64_t> consumed(0);
+        uint64_t per_producer = std::max<uint64_t>(1, n / producers);
+        uint64_t total = per_producer * producers;
+
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < consumers; ++c) {
+            threads.emplace_back([&] {
+                uint64_t value;
+                while (consumed.load(std::memory_order_relaxed) < total) {
+                    if (queue.pop_for(value, 1)) {
+                        consumed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+        for (size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p] {
+                for (uint64_t i = 0; i < per_producer; ++i) {
+                    queue.push(p * per_producer + i);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        return seconds_since(start);
+    });
+
+    result.name = "safe_queue";
+    result.params = {{"producers", static_cast<long long>(producers)},
+                     {"consumers", static_cast<long long>(consumers)}};
+    return result;
+}
+
+static BenchResult bench_circular_buffer(const BenchOptions& options, size_t chunk) {
+    // 容量不是块大小的整数倍，读写位置持续跨越回绕点
+    CircularBuffer buffer(64 * 1024 + 7);
+    std::vector<uint8_t> in(chunk, 0x5A);
+    std::vector<uint8_t> out(chunk);
+
+    BenchResult result = run_timed(options, [&](uint64_t n) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < n; ++i) {
+            buffer.write(in.data(), chunk);
+            buffer.peek(out.data(), chunk);
+            buffer.read(out.data(), chunk);
+        }
+        return seconds_since(start);
+    });
+
+    result.name = "circular_buffer";
+    result.params = {{"chunk", static_cast<long long>(chunk)}};
+    result.bytes = result.iterations * chunk;
+    return result;
+}
+
+static BenchResult bench_frame_pool(const BenchOptions& options, size_t threads) {
+    FrameBufferPool pool(64, 64 * 1024);
+
+    BenchResult result = run_timed(options, [&](uint64_t n) {
+        uint64_t per_thread = std::max<uint64_t>(1, n / threads);
+        auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (uint64_t i = 0; i < per_thread; ++i) {
+                    auto frame = pool.get();
+                    pool.return_frame(frame);
+                }
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        return seconds_since(start);
+    });
+
+    result.name = "frame_pool";
+    result.params = {{"threads", static_cast<long long>(threads)}};
+    return result;
+}
+
+static BenchResult bench_stats_counter(const BenchOptions& options, size_t threads, bool sharded) {
+    ShardedCounters<2> counters;
+    std::mutex mutex;
+    uint64_t locked_counts[2] = {0, 0};
+
+    BenchResult result = run_timed(options, [&](uint64_t n) {
+        uint64_t per_thread = std::max<uint64_t>(1, n / threads);
+        auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (uint64_t i = 0; i < per_thread; ++i) {
+                    if (sharded) {
+                        counters.add(0);
+                        counters.add(1, 1500);
+                    } else {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        locked_counts[0]++;
+                        locked_counts[1] += 1500;
+                    }
+                }
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        return seconds_since(start);
+    });
+
+    result.name = "stats_counter";
+    result.params = {{"threads", static_cast<long long>(threads)},
+                     {"sharded", sharded ? 1 : 0}};
+    return result;
+}
+
+static BenchResult bench_message_codec(const BenchOptions& options, uint32_t payload_size) {
+    std::vector<uint8_t> payload(payload_size, 0xA5);
+    Message msg(MessageType::VIDEO_FRAME, payload_size, 123456789);
+    if (payload_size > 0) {
+        msg.set_payload(payload.data(), payload_size);
+    }
+
+    bool ok = true;
+    BenchResult result = run_timed(options, [&](uint64_t n) {
+        Message decoded;
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < n; ++i) {
+            std::vector<uint8_t> bytes = msg.to_bytes();
+            ok &= decoded.from_bytes(bytes);
+        }
+        return seconds_since(start);
+    });
+    if (!ok) {
+        std::cerr << "[Bench] message round trip failed for payload " << payload_size << std::endl;
+    }
+
+    result.name = "message_codec";
+    result.params = {{"payload", static_cast<long long>(payload_size)}};
+    result.bytes = result.iterations * (MessageHeader::HEADER_SIZE + payload_size);
+    return result;
+}
+
+static BenchResult bench_header_crc(const BenchOptions& options) {
+    MessageHeader header(MessageType::VIDEO_FRAME, 1500, 123456789);
+    volatile uint16_t sink = 0;
+
+    BenchResult result = run_timed(options, [&](uint64_t n) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < n; ++i) {
+            header.timestamp = i;
+            sink = sink ^ header.calculate_crc();
+        }
+        return seconds_since(start);
+    });
+
+    result.name = "header_crc";
+    result.bytes = result.iterations * 18;
+    return result;
+}
+
+static BenchResult bench_thread_pool_roundtrip(const BenchOptions& options, size_t threads) {
+    ThreadPool pool(threads);
+    std::vector<uint64_t> samples;
+
+    BenchResult result = run_timed(options, [&](uint64_t n) {
+        samples.clear();
+        samples.reserve(n);
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < n; ++i) {
+            auto t0 = Clock::now();
+            pool.add_task([] { return 0; }).get();
+            samples.push_back(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count()));
+        }
+        return seconds_since(start);
+    });
+    pool.shutdown();
+
+    result.name = "thread_pool_roundtrip";
+    result.params = {{"threads", static_cast<long long>(threads)}};
+    result.latencies_ns = std::move(samples);
+    return result;
+}
+
+// ============================================================================
+// ======================== 输出 ==============================================
+// ============================================================================
+
+static std::string to_json(const std::vector<BenchResult>& results, const BenchOptions& options) {
+    std::ostringstream out;
+    out << "{\n"
+        << "  \"suite\": \"core_primitives\",\n"
+        << "  \"timestamp_ms\": " << ProtocolHelper::get_timestamp_ms() << ",\n"
+        << "  \"context\": {\"cpus\": " << std::thread::hardware_concurrency()
+        << ", \"min_time_ms\": " << options.min_time_ms
+        << ", \"compiler\": \"" << __VERSION__ << "\"},\n"
+        << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        char numbers[256];
+        std::snprintf(numbers, sizeof(numbers),
+                      "\"iterations\": %llu, \"seconds\": %.6f, \"ns_per_op\": %.2f, \"ops_per_sec\": %.1f",
+                      static_cast<unsigned long long>(r.iterations), r.seconds,
+                      r.ns_per_op(), r.ops_per_sec());
+
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": \"" << r.full_name() << "\", \"benchmark\": \"" << r.name << "\", \"params\": {";
+        for (size_t p = 0; p < r.params.size(); ++p) {
+            out << (p == 0 ? "" : ", ") << "\"" << r.params[p].first << "\": " << r.params[p].second;
+        }
+        out << "}, " << numbers;
+        if (r.bytes > 0) {
+            char rate[64];
+            std::snprintf(rate, sizeof(rate), "%.1f", r.seconds > 0 ? r.bytes / r.seconds : 0.0);
+            out << ", \"bytes_per_sec\": " << rate;
+        }
+        if (!r.latencies_ns.empty()) {
+            out << ", \"p50_ns\": " << r.percentile_ns(0.50)
+                << ", \"p99_ns\": " << r.percentile_ns(0.99)
+                << ", \"max_ns\": " << r.percentile_ns(1.0);
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+static void print_text(const BenchResult& r) {
+    std::printf("%-48s %12llu ops %10.1f ns/op", r.full_name().c_str(),
+                static_cast<unsigned long long>(r.iterations), r.ns_per_op());
+    if (r.bytes > 0) {
+        std::printf(" %9.1f MB/s", r.bytes / r.seconds / 1e6);
+    }
+    if (!r.latencies_ns.empty()) {
+        std::printf(" p50=%lluns p99=%lluns",
+                    static_cast<unsigned long long>(r.percentile_ns(0.50)),
+                    static_cast<unsigned long long>(r.percentile_ns(0.99)));
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.min_time_ms = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--max-threads" && i + 1 < argc) {
+            options.max_threads = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--format" && i + 1 < argc) {
+            options.json = std::string(argv[++i]) != "text";
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--filter NAME] [--min-time MS] [--max-threads N] [--format json|text]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<std::string, std::function<BenchResult()>>> cases;
+    for (size_t producers : thread_counts(options.max_threads)) {
+        for (size_t consumers : thread_counts(options.max_threads)) {
+            cases.emplace_back("safe_queue", [&options, producers, consumers] {
+                return bench_safe_queue(options, producers, consumers);
+            });
+        }
+    }
+    for (size_t chunk : {64, 1500, 16384}) {
+        cases.emplace_back("circular_buffer", [&options, chunk] {
+            return bench_circular_buffer(options, chunk);
+        });
+    }
+    for (size_t threads : thread_counts(options.max_threads)) {
+        cases.emplace_back("frame_pool", [&options, threads] {
+            return bench_frame_pool(options, threads);
+        });
+    }
+    for (uint32_t size : {0u, 64u, 1024u, 64u * 1024u, 1024u * 1024u}) {
+        cases.emplace_back("message_codec", [&options, size] {
+            return bench_message_codec(options, size);
+        });
+    }
+    cases.emplace_back("header_crc", [&options] {
+        return bench_header_crc(options);
+    });
+    for (size_t threads : {static_cast<size_t>(1), options.max_threads}) {
+        cases.emplace_back("thread_pool_roundtrip", [&options, threads] {
+            return bench_thread_pool_roundtrip(options, threads);
+        });
+    }
+
+    for (size_t threads : thread_counts(options.max_threads)) {
+        for (bool sharded : {false, true}) {
+            cases.emplace_back("stats_counter", [&options, threads, sharded] {
+                return bench_stats_counter(options, threads, sharded);
+            });
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (auto& bench_case : cases) {
+        if (!options.filter.empty() && bench_case.first.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(bench_case.second());
+        if (!options.json) {
+            print_text(results.back());
+        }
+    }
+
+    if (options.json) {
+        std::cout << to_json(results, options);
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * bench_deadline_pool.cpp - 过载时截止时间调度的效果
+ *
+ * 模拟编码线程池过载：生产者按固定帧间隔提交"编码"任务，每个任务耗时固定，
+ * 总负载超过线程池能力。对比两种提交方式：
+ * - fifo：不带截止时间，所有任务按顺序执行，排队延迟不断增长
+ * - deadline：每帧带帧时长的预算，过期的任务在执行前丢弃
+ *
+ * 统计每种方式下按时完成（从提交到完成不超过预算）、迟到和丢弃的帧数。
+ *
+ * 编译方式：
+ *   g++ -std=c++17 -O2 -pthread -I.. -o bench_deadline_pool bench_deadline_pool.cpp
+ *   （或在bench目录下执行 make bench_deadline_pool，make bench 构建全部）
+ *
+ * 运行方式：
+ *   ./bench_deadline_pool [线程数] [帧数] [任务耗时us] [帧间隔us] [预算ms]
+ *   ./bench_deadline_pool 2 600 5000 2000 33
+ */
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "AVServer_04_ThreadPool.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchConfig {
+    size_t threads;
+    int frames;
+    int work_us;
+    int interval_us;
+    int budget_ms;
+
+    BenchConfig()
+        : threads(2),
+          frames(600),
+          work_us(5000),
+          interval_us(2000),
+          budget_ms(33) {
+    }
+};
+
+struct BenchResult {
+    uint64_t on_time;
+    uint64_t late;
+    uint64_t expired;
+    double seconds;
+};
+
+/**
+ * @brief 忙等模拟编码耗时（sleep的精度不够）
+ */
+static void spin_for_us(int us) {
+    auto until = Clock::now() + std::chrono::microseconds(us);
+    while (Clock::now() < until) {
+    }
+}
+
+static BenchResult run(const BenchConfig& config, bool with_deadline) {
+    ThreadPool pool(config.threads);
+    std::atomic<uint64_t> on_time(0);
+    std::atomic<uint64_t> late(0);
+    auto budget = std::chrono::milliseconds(config.budget_ms);
+
+    auto start = Clock::now();
+    for (int i = 0; i < config.frames; ++i) {
+        auto submitted = Clock::now();
+        auto work = [&, submitted]() {
+            spin_for_us(config.work_us);
+            if (Clock::now() - submitted <= budget) {
+                on_time++;
+            } else {
+                late++;
+            }
+        };
+
+        if (with_deadline) {
+            // 开始得太晚就不可能按时完成，截止时间扣掉任务本身的耗时
+            TaskOptions options;
+            options.deadline = submitted + budget - std::chrono::microseconds(config.work_us);
+            pool.schedule(work, options);
+        } else {
+            pool.add_work(work);
+        }
+
+        std::this_thread::sleep_until(start + std::chrono::microseconds(config.interval_us) * (i + 1));
+    }
+
+    // 等待队列排空
+    while (pool.queue_size() > 0 || pool.active_tasks() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    BenchResult result;
+    result.on_time = on_time.load();
+    result.late = late.load();
+    result.expired = pool.get_statistics().tasks_expired;
+    result.seconds = elapsed;
+
+    std::cout << (with_deadline ? "deadline " : "fifo     ")
+              << pool.get_statistics().to_string() << std::endl;
+    pool.shutdown();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    if (argc >= 2) config.threads = static_cast<size_t>(std::max(1, std::atoi(argv[1])));
+    if (argc >= 3) config.frames = std::max(1, std::atoi(argv[2]));
+    if (argc >= 4) config.work_us = std::max(1, std::atoi(argv[3]));
+    if (argc >= 5) config.interval_us = std::max(1, std::atoi(argv[4]));
+    if (argc >= 6) config.budget_ms = std::max(1, std::atoi(argv[5]));
+
+    double load = static_cast<double>(config.work_us) / config.interval_us / config.threads;
+
+    BenchResult fifo = run(config, false);
+    BenchResult deadline = run(config, true);
+
+    std::printf("\n=== Deadline scheduling (%zu threads, %d frames, load x%.2f, budget %dms) ===\n",
+                config.threads, config.frames, load, config.budget_ms);
+    std::printf("%-10s on_time=%-6llu late=%-6llu expired=%-6llu drain=%.2fs\n", "fifo",
+                static_cast<unsigned long long>(fifo.on_time),
+                static_cast<unsigned long long>(fifo.late),
+                static_cast<unsigned long long>(fifo.expired), fifo.seconds);
+    std::printf("%-10s on_time=%-6llu late=%-6llu expired=%-6llu drain=%.2fs\n", "deadline",
+                static_cast<unsigned long long>(deadline.on_time),
+                static_cast<unsigned long long>(deadline.late),
+                static_cast<unsigned long long>(deadline.expired), deadline.seconds);
+    return 0;
+}
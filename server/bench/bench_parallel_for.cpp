@@ -0,0 +1,93 @@
+/*
+ * bench_parallel_for.cpp - ThreadPool::parallel_for的开销与加速比
+ *
+ * 测试项：
+ * - fork/join开销：块函数为空，测量每次parallel_for调用的平均耗时
+ * - 1080p亮度转换：串行 vs STATIC分块 vs DYNAMIC分块
+ *
+ * 编译方式：
+ *   g++ -std=c++17 -O2 -pthread -I.. -o bench_parallel_for bench_parallel_for.cpp
+ *   （或在bench目录下执行 make bench_parallel_for，make bench 构建全部）
+ *
+ * 运行方式：
+ *   ./bench_parallel_for [线程数]
+ */
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "AVServer_04_ThreadPool.h"
+#include "AVServer_20_PipelineKernels.h"
+
+template <typename Fn>
+static double measure_us(int iterations, const Fn& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    size_t threads = std::thread::hardware_concurrency();
+    if (argc >= 2) {
+        threads = static_cast<size_t>(std::max(1, std::atoi(argv[1])));
+    }
+    size_t helpers = threads > 1 ? threads - 1 : 1;
+
+    ThreadPool pool(helpers);
+
+    std::cout << "=== parallel_for (" << helpers << " workers + caller) ===" << std::endl;
+
+    // ===== fork/join开销 =====
+    const int FORK_ITERATIONS = 20000;
+    volatile size_t sink = 0;
+
+    double static_us = measure_us(FORK_ITERATIONS, [&] {
+        pool.parallel_for(0, 1080, 1, [&](size_t b, size_t e) { sink = sink + (e - b); },
+                          ChunkPolicy::STATIC);
+    });
+    double dynamic_us = measure_us(FORK_ITERATIONS, [&] {
+        pool.parallel_for(0, 1080, 135, [&](size_t b, size_t e) { sink = sink + (e - b); },
+                          ChunkPolicy::DYNAMIC);
+    });
+
+    std::printf("fork_join_static   %.2f us/call\n", static_us);
+    std::printf("fork_join_dynamic  %.2f us/call (8 chunks)\n", dynamic_us);
+
+    // ===== 1080p亮度转换 =====
+    const uint32_t width = 1920;
+    const uint32_t height = 1080;
+    const int CONVERT_ITERATIONS = 200;
+    std::vector<uint8_t> frame(width * height * 3 / 2, 128);
+    uint8_t* data = frame.data();
+
+    double serial_us = measure_us(CONVERT_ITERATIONS, [&] {
+        ConvertKernel::convert_luma(data, 0, width * height);
+    });
+
+    double parallel_static_us = measure_us(CONVERT_ITERATIONS, [&] {
+        pool.parallel_for(0, height, ConvertKernel::ROWS_PER_CHUNK, [&](size_t y0, size_t y1) {
+            ConvertKernel::convert_luma(data, y0 * width, y1 * width);
+        }, ChunkPolicy::STATIC);
+    });
+
+    double parallel_dynamic_us = measure_us(CONVERT_ITERATIONS, [&] {
+        pool.parallel_for(0, height, ConvertKernel::ROWS_PER_CHUNK, [&](size_t y0, size_t y1) {
+            ConvertKernel::convert_luma(data, y0 * width, y1 * width);
+        }, ChunkPolicy::DYNAMIC);
+    });
+
+    std::printf("convert_serial     %.1f us/frame\n", serial_us);
+    std::printf("convert_static     %.1f us/frame (x%.2f)\n",
+                parallel_static_us, serial_us / parallel_static_us);
+    std::printf("convert_dynamic    %.1f us/frame (x%.2f)\n",
+                parallel_dynamic_us, serial_us / parallel_dynamic_us);
+
+    pool.shutdown();
+    return 0;
+}
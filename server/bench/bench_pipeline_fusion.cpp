@@ -0,0 +1,197 @@
+/*
+ * bench_pipeline_fusion.cpp - 融合管道与阶段图的吞吐量对比
+ *
+ * 对比MediaProcessor的视频路径（测试源 -> 转换 -> 编码 -> 打包 -> 分发）
+ * 在三种组织方式下的吞吐量：
+ * - unfused：StageGraph，每个内核一个阶段，阶段之间有通道
+ * - graph_fused：StageGraph，用融合阶段（encode_packetize）减少一个通道
+ * - fused：FusedPipeline，单线程循环，编译期组合，没有中间通道
+ *
+ * 测试源不限速（fps=0），结果为每秒走完整条链路的帧数。
+ *
+ * 编译方式：
+ *   g++ -std=c++17 -O2 -pthread -I.. -o bench_pipeline_fusion bench_pipeline_fusion.cpp
+ *   （或在bench目录下执行 make bench_pipeline_fusion，make bench 构建全部）
+ *
+ * 运行方式：
+ *   ./bench_pipeline_fusion [秒数] [宽] [高]
+ *   ./bench_pipeline_fusion 3 1280 720
+ */
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+#include "AVServer_06_MessageProtocol.h"
+#include "AVServer_20_PipelineKernels.h"
+#include "AVServer_21_StageGraph.h"
+#include "AVServer_22_FusedPipeline.h"
+
+// ============================================================================
+// ======================== 测试参数 ==========================================
+// ============================================================================
+
+struct BenchConfig {
+    int seconds;
+    uint32_t width;
+    uint32_t height;
+
+    BenchConfig()
+        : seconds(3),
+          width(1280),
+          height(720) {
+    }
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t frames;
+    double seconds;
+
+    double fps() const {
+        return seconds > 0 ? frames / seconds : 0.0;
+    }
+};
+
+/**
+ * @brief 测试源和编码阶段共用的原始帧缓冲池
+ *
+ * 编码后把原始帧归还给测试源，三种方式的内存分配行为一致
+ */
+static std::shared_ptr<FrameBufferPool> g_raw_pool;
+
+// ============================================================================
+// ======================== 阶段图 ============================================
+// ============================================================================
+
+/**
+ * @brief 注册使用共享原始帧缓冲池的测试阶段
+ */
+static void register_bench_stage_kinds() {
+    StageRegistry& registry = StageRegistry::instance();
+
+    registry.register_kind("bench_source", [](const StageSpec& s, const PipelineResources&) {
+        return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                 TestSourceKernel(g_raw_pool,
+                                                  s.get_int("width", 1280),
+                                                  s.get_int("height", 720), 0));
+    });
+
+    registry.register_kind("bench_encode", [](const StageSpec& s, const PipelineResources& r) {
+        EncodeKernel kernel(r.engine, r.frame_pool);
+        kernel.release_input = [](MediaFramePtr frame) { g_raw_pool->return_frame(frame); };
+        return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity, std::move(kernel));
+    });
+
+    registry.register_kind("bench_encode_packetize", [](const StageSpec& s, const PipelineResources& r) {
+        EncodeKernel kernel(r.engine, r.frame_pool);
+        kernel.release_input = [](MediaFramePtr frame) { g_raw_pool->return_frame(frame); };
+        return make_kernel_stage(s.name, s.kind, s.executor, s.queue_capacity,
+                                 fuse_kernels(std::move(kernel), PacketizeKernel(r.frame_pool)));
+    });
+}
+
+static BenchResult run_graph(const std::string& name, const std::string& spec,
+                             CompressionEngine& engine, const BenchConfig& config) {
+    std::atomic<uint64_t> delivered(0);
+
+    PipelineResources resources;
+    resources.engine = &engine;
+    resources.fanout = [&delivered](const MediaMessagePtr&) { delivered++; };
+
+    StageGraph graph(resources);
+    if (!graph.build(spec)) {
+        return BenchResult{name, 0, 0.0};
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    graph.start();
+    std::this_thread::sleep_for(std::chrono::seconds(config.seconds));
+    graph.stop();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    graph.print_metrics();
+    return BenchResult{name, delivered.load(), elapsed};
+}
+
+// ============================================================================
+// ======================== 融合管道 ==========================================
+// ============================================================================
+
+static BenchResult run_fused(CompressionEngine& engine, const BenchConfig& config) {
+    std::atomic<uint64_t> delivered(0);
+    auto frame_pool = std::make_shared<FrameBufferPool>(30);
+
+    EncodeKernel encode(&engine, frame_pool);
+    encode.release_input = [](MediaFramePtr frame) { g_raw_pool->return_frame(frame); };
+
+    auto pipeline = make_fused_pipeline(
+        TestSourceKernel(g_raw_pool, config.width, config.height, 0),
+        ConvertKernel(),
+        std::move(encode),
+        PacketizeKernel(frame_pool),
+        FanoutKernel([&delivered](const MediaMessagePtr&) { delivered++; }));
+
+    pipeline.start();
+    std::this_thread::sleep_for(std::chrono::seconds(config.seconds));
+    pipeline.stop();
+
+    auto stats = pipeline.get_statistics();
+    std::cout << "Fused " << stats.to_string() << std::endl;
+    return BenchResult{"fused", delivered.load(), stats.elapsed_seconds};
+}
+
+// ============================================================================
+// ======================== 主程序 ============================================
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    if (argc >= 2) config.seconds = std::max(1, std::atoi(argv[1]));
+    if (argc >= 3) config.width = static_cast<uint32_t>(std::atoi(argv[2]));
+    if (argc >= 4) config.height = static_cast<uint32_t>(std::atoi(argv[3]));
+
+    g_raw_pool = std::make_shared<FrameBufferPool>(16);
+    register_bench_stage_kinds();
+
+    CompressionEngine engine;
+    engine.start();
+
+    std::string size = " width=" + std::to_string(config.width) +
+                       " height=" + std::to_string(config.height);
+
+    std::string unfused =
+        "pool 1\n"
+        "stage source    bench_source thread" + size + "\n"
+        "stage convert   convert      thread queue=8\n"
+        "stage encode    bench_encode thread queue=8\n"
+        "stage packetize packetize    thread queue=8\n"
+        "stage fanout    fanout       thread queue=64\n"
+        "link source convert encode packetize fanout\n";
+
+    std::string graph_fused =
+        "pool 1\n"
+        "stage source    bench_source           thread" + size + "\n"
+        "stage convert   convert                thread queue=8\n"
+        "stage encode    bench_encode_packetize thread queue=8\n"
+        "stage fanout    fanout                 inline\n"
+        "link source convert encode fanout\n";
+
+    std::vector<BenchResult> results;
+    results.push_back(run_graph("unfused", unfused, engine, config));
+    results.push_back(run_graph("graph_fused", graph_fused, engine, config));
+    results.push_back(run_fused(engine, config));
+
+    engine.stop();
+
+    std::cout << "\n=== Pipeline fusion (" << config.width << "x" << config.height
+              << ", " << config.seconds << "s) ===" << std::endl;
+    for (const auto& r : results) {
+        std::printf("%-12s frames=%-8llu fps=%.1f\n", r.name.c_str(),
+                    static_cast<unsigned long long>(r.frames), r.fps());
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * check_shedding_queue.cpp - 输出队列按帧类型丢帧的回归检查
+ *
+ * 逐个场景构造帧序列推入SheddingMessageQueue，检查每一帧是否被接纳：
+ * - keyframe_after_shed：队列满时到达的I帧触发丢弃旧GOP的P帧链，
+ *   新GOP的P帧不能被当成"依赖已丢弃参考帧"的帧一并拒绝
+ * - rejected_keyframe：I帧因硬上限被拒绝后，依赖它的P帧也应拒绝
+ *
+ * 编译方式：
+ *   g++ -std=c++17 -O2 -pthread -I.. -o check_shedding_queue check_shedding_queue.cpp
+ *   （或在bench目录下执行 make check_shedding_queue，make bench 构建全部）
+ *
+ * 运行方式：
+ *   ./check_shedding_queue      # 全部通过时返回0，否则打印失败的场景并返回1
+ */
+
+#include <iostream>
+#include <cstdio>
+
+#include "AVServer_19_SheddingMessageQueue.h"
+
+static int failures = 0;
+
+static Message make_video(FrameType type) {
+    Message msg(MessageType::VIDEO_FRAME);
+    msg.set_frame_type(type);
+    return msg;
+}
+
+static void expect(const char* scenario, const char* step, bool actual, bool expected) {
+    if (actual != expected) {
+        std::printf("FAIL %-22s %s: pushed=%d, expected %d\n", scenario, step, actual, expected);
+        failures++;
+    }
+}
+
+/**
+ * @brief 满队列时到达的I帧丢弃旧GOP的P帧链后，新GOP的P帧照常接纳
+ */
+static void keyframe_after_shed() {
+    OutputQueueConfig config;
+    config.max_messages = 4;
+    config.hard_limit = 8;
+    SheddingMessageQueue queue(config);
+
+    const char* name = "keyframe_after_shed";
+    expect(name, "I1", queue.push(make_video(FrameType::VIDEO_I_FRAME)), true);
+    for (int i = 0; i < 3; ++i) {
+        expect(name, "P (GOP 1)", queue.push(make_video(FrameType::VIDEO_P_FRAME)), true);
+    }
+    expect(name, "I2", queue.push(make_video(FrameType::VIDEO_I_FRAME)), true);
+    for (int i = 0; i < 2; ++i) {
+        expect(name, "P (GOP 2)", queue.push(make_video(FrameType::VIDEO_P_FRAME)), true);
+    }
+
+    OutputQueueStatistics stats = queue.get_statistics();
+    expect(name, "GOP 1 chain shed", stats.shed_p_frames == 1 && stats.shed_dependents == 2, true);
+}
+
+/**
+ * @brief I帧达到硬上限被拒绝后，之后的P帧无法解码，也被拒绝
+ */
+static void rejected_keyframe() {
+    OutputQueueConfig config;
+    config.max_messages = 2;
+    config.hard_limit = 3;
+    SheddingMessageQueue queue(config);
+
+    const char* name = "rejected_keyframe";
+    for (int i = 0; i < 3; ++i) {
+        Message audio(MessageType::AUDIO_FRAME);
+        audio.set_frame_type(FrameType::AUDIO_FRAME);
+        expect(name, "audio", queue.push(audio), true);
+    }
+    expect(name, "I (hard limit)", queue.push(make_video(FrameType::VIDEO_I_FRAME)), false);
+
+    Message out;
+    queue.try_pop(out);
+    queue.try_pop(out);  // 队列有空位，P帧只会因为依赖被拒绝
+    expect(name, "P after rejected I", queue.push(make_video(FrameType::VIDEO_P_FRAME)), false);
+    expect(name, "next I", queue.push(make_video(FrameType::VIDEO_I_FRAME)), true);
+}
+
+int main() {
+    keyframe_after_shed();
+    rejected_keyframe();
+
+    if (failures > 0) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All shedding queue checks passed\n");
+    return 0;
+}